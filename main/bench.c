@@ -0,0 +1,286 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "json_tok.h"
+#include "rfid.h"
+#include "tag_store.h"
+#include "mqtt_batch.h"
+#include "tag_rules.h"
+
+static const char *TAG = "BENCH";
+
+#define BENCH_CASE_US  200000   // Measured time per case
+#define BENCH_SLICE_US 10000    // Busy time between yields, so the idle task keeps the watchdog fed
+#define BENCH_UNROLL   8        // Calls between clock reads
+#define TAGS_JSON_BUF  2048     // As GET /tags
+
+static const int s_table_sizes[] = { 32, 1000, 5000 };
+
+// Commands as they arrive, with the README example payloads for each topic
+#define BENCH_CMD_TOKENS 128
+typedef enum { CMD_START, CMD_POWER, CMD_BATCH, CMD_SEEN, CMD_RULES } bench_cmd_kind_t;
+static const struct {
+    bench_cmd_kind_t kind;
+    const char *payload;
+} s_commands[] = {
+    { CMD_START, "{\"action\": \"start\"}" },   // cmd/rfid
+    { CMD_POWER, "{\"action\": \"set\", \"reader\": 0, \"ant1\": 30, \"ant2\": 30, \"ant3\": 30, \"ant4\": 30}" },   // cmd/power
+    { CMD_BATCH, "{\"action\": \"set\", \"max_tags\": 200, \"max_bytes\": 8192, \"max_latency_ms\": 1000}" },   // cmd/batch
+    { CMD_SEEN, "{\"action\": \"seen\", \"mode\": \"suppress\", \"hours\": 12, \"capacity\": 100000, \"fp_rate\": 0.001}" },   // cmd/rfid
+    { CMD_RULES, "{\"action\": \"rules\", \"rules\": {\"rssi_floor\": [[-70, -70, -65, -70]], \"antennas\": [[1, 2, 3, 4], [1, 2]], "
+                 "\"min_reads\": 2, \"epc\": [{\"epc\": \"3074257B\", \"action\": \"drop\"}, {\"epc\": \"E280\", \"mask\": \"FFF0\", "
+                 "\"reader\": 0, \"ants\": [1], \"rssi_min\": -60, \"action\": \"keep\"}]}}" },   // cmd/rfid
+};
+
+// Start inventory, the frame sent most often
+static const uint8_t s_frame[] = { 0x5A, 0x00, 0x01, 0x02, 0x10, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0x01, 0xF4, 0x87 };
+
+// Heap allocations made by the bench task while a case runs. None of these
+// paths should allocate; the count catches one that starts to.
+static _Atomic uint32_t s_allocs;
+static _Atomic uint32_t s_alloc_bytes;
+
+static inline void count_alloc(size_t size)
+{
+    atomic_fetch_add_explicit(&s_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_alloc_bytes, (uint32_t)size, memory_order_relaxed);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host build: main/CMakeLists.txt links with --wrap for the three allocators.
+// Flagged per thread, so the other host tasks are not counted.
+#define BENCH_COUNTS_ALLOCS 1
+static __thread bool s_counting;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    if (s_counting) count_alloc(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    if (s_counting) count_alloc(n * size);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (s_counting) count_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+static void count_allocs(bool on)
+{
+    s_counting = on;
+}
+#elif CONFIG_HEAP_USE_HOOKS
+// Device: the heap calls this for every allocation from any task or ISR;
+// only those of the task running the bench are counted
+#define BENCH_COUNTS_ALLOCS 1
+static TaskHandle_t s_counting_task;
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (s_counting_task && xTaskGetCurrentTaskHandle() == s_counting_task) count_alloc(size);
+}
+
+static void count_allocs(bool on)
+{
+    s_counting_task = on ? xTaskGetCurrentTaskHandle() : NULL;
+}
+#else
+#define BENCH_COUNTS_ALLOCS 0   // allocs_op / alloc_bytes_op reported as null
+static void count_allocs(bool on) { (void)on; }
+#endif
+
+typedef struct {
+    tag_table_t *table;     // Private table of the current size
+    char *buf;
+    int buf_len;
+    int max_tags;
+    unsigned next;
+    json_tok_t *toks;       // BENCH_CMD_TOKENS
+    tag_rules_t *rules;     // Compiled, never applied
+} bench_ctx_t;
+
+typedef void (*bench_fn)(bench_ctx_t *ctx);
+
+static void case_tags_json(bench_ctx_t *ctx)
+{
+    tag_store_table_get_json(ctx->table, ctx->buf, TAGS_JSON_BUF, RFID_ALL_READERS);
+}
+
+static void case_batch_json(bench_ctx_t *ctx)
+{
+    tag_batch_info_t info;
+    tag_store_bench_rewind(ctx->table);
+    tag_store_table_get_batch_json(ctx->table, ctx->buf, ctx->buf_len, ctx->max_tags, &info);
+}
+
+// mqtt_process_command up to the handler's side effects: tokenize in place,
+// look up the routing fields, then the handler's own field extraction (for
+// rules, the compile step). Applying, saving and responding are left out.
+static void case_command_parse(bench_ctx_t *ctx)
+{
+    unsigned i = ctx->next++ % (sizeof(s_commands) / sizeof(s_commands[0]));
+    const char *cmd = s_commands[i].payload;
+    json_doc_t doc;
+    if (json_parse(&doc, cmd, strlen(cmd), ctx->toks, BENCH_CMD_TOKENS) < 0) return;
+    int reader = RFID_ALL_READERS;
+    char action[32];
+    json_get_int(&doc, json_obj_get(&doc, 0, "reader"), &reader);
+    json_get_str(&doc, json_obj_get(&doc, 0, "action"), action, sizeof(action));
+
+    switch (s_commands[i].kind) {
+    case CMD_START:
+        break;
+    case CMD_POWER: {
+        int p[4] = { 30, 30, 30, 30 };
+        const json_field_t fields[] = {
+            { "ant1", JSON_FIELD_INT, &p[0], 0 },
+            { "ant2", JSON_FIELD_INT, &p[1], 0 },
+            { "ant3", JSON_FIELD_INT, &p[2], 0 },
+            { "ant4", JSON_FIELD_INT, &p[3], 0 },
+        };
+        json_extract(&doc, 0, fields, 4);
+        break;
+    }
+    case CMD_BATCH: {
+        int v[3] = { 0 };
+        const json_field_t fields[] = {
+            { "max_tags", JSON_FIELD_INT, &v[0], 0 },
+            { "max_bytes", JSON_FIELD_INT, &v[1], 0 },
+            { "max_latency_ms", JSON_FIELD_INT, &v[2], 0 },
+        };
+        json_extract(&doc, 0, fields, 3);
+        break;
+    }
+    case CMD_SEEN: {
+        char mode[16];
+        double hours = 0, cap = 0, fp = 0;
+        const json_field_t fields[] = {
+            { "mode", JSON_FIELD_STR, mode, sizeof(mode) },
+            { "hours", JSON_FIELD_DOUBLE, &hours, 0 },
+            { "capacity", JSON_FIELD_DOUBLE, &cap, 0 },
+            { "fp_rate", JSON_FIELD_DOUBLE, &fp, 0 },
+        };
+        json_extract(&doc, 0, fields, 4);
+        break;
+    }
+    case CMD_RULES: {
+        char err[64];
+        tag_rules_parse_json(&doc, json_obj_get(&doc, 0, "rules"), ctx->rules, err, sizeof(err));
+        break;
+    }
+    }
+}
+
+static void case_frame_format(bench_ctx_t *ctx)
+{
+    rfid_format_frame(s_frame, sizeof(s_frame), ctx->buf, 128);
+}
+
+// Runs fn for about BENCH_CASE_US after one warm-up call; appends the result to out
+static int run_case(char *out, int out_len, const char *name, int size, bench_fn fn, bench_ctx_t *ctx)
+{
+    fn(ctx);
+    atomic_store(&s_allocs, 0);
+    atomic_store(&s_alloc_bytes, 0);
+    count_allocs(true);
+
+    uint32_t iters = 0;
+    int64_t busy_us = 0;
+    while (busy_us < BENCH_CASE_US) {
+        int64_t t0 = esp_timer_get_time(), t1;
+        do {
+            for (int i = 0; i < BENCH_UNROLL; i++) fn(ctx);
+            iters += BENCH_UNROLL;
+            t1 = esp_timer_get_time();
+        } while (t1 - t0 < BENCH_SLICE_US);
+        busy_us += t1 - t0;
+        vTaskDelay(1);
+    }
+    count_allocs(false);
+
+    uint32_t allocs = atomic_load(&s_allocs), bytes = atomic_load(&s_alloc_bytes);
+    ESP_LOGI(TAG, "%s/%d: %lu ns/op over %lu iterations", name, size,
+             (unsigned long)(busy_us * 1000 / iters), (unsigned long)iters);
+    int n = snprintf(out, out_len, "{\"name\":\"%s\",\"size\":%d,\"iters\":%lu,\"ns_op\":%llu,",
+                     name, size, (unsigned long)iters, (unsigned long long)(busy_us * 1000 / iters));
+    if (n >= out_len) return n;
+    if (BENCH_COUNTS_ALLOCS) {
+        n += snprintf(out + n, out_len - n, "\"allocs_op\":%.2f,\"alloc_bytes_op\":%lu}",
+                      (double)allocs / iters, (unsigned long)(bytes / iters));
+    } else {
+        n += snprintf(out + n, out_len - n, "\"allocs_op\":null,\"alloc_bytes_op\":null}");
+    }
+    return n;
+}
+
+int bench_run_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    mqtt_batch_config_t bcfg;
+    mqtt_batch_get_config(&bcfg);
+    bench_ctx_t ctx = { .buf_len = (int)bcfg.max_bytes, .max_tags = (int)bcfg.max_tags };
+    if (ctx.buf_len < TAGS_JSON_BUF) ctx.buf_len = TAGS_JSON_BUF;
+    ctx.buf = heap_caps_malloc(ctx.buf_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ctx.buf) ctx.buf = malloc(ctx.buf_len);
+    ctx.toks = malloc(BENCH_CMD_TOKENS * sizeof(json_tok_t));
+    ctx.rules = malloc(sizeof(tag_rules_t));
+    if (!ctx.buf || !ctx.toks || !ctx.rules) {
+        free(ctx.buf);
+        free(ctx.toks);
+        free(ctx.rules);
+        snprintf(out, out_len, "{\"error\":\"no memory\"}");
+        return -1;
+    }
+
+    int n = snprintf(out, out_len, "{\"target\":\"%s\",\"cases\":[", CONFIG_IDF_TARGET);
+    bool first = true;
+    for (size_t s = 0; s < sizeof(s_table_sizes) / sizeof(s_table_sizes[0]) && n < out_len; s++) {
+        int size = s_table_sizes[s];
+        ctx.table = tag_store_bench_create(size);
+        if (!ctx.table) {
+            ESP_LOGW(TAG, "No memory for a %d-tag table, skipped", size);
+            n += snprintf(out + n, out_len - n,
+                          "%s{\"name\":\"tags_json\",\"size\":%d,\"skipped\":\"no memory\"},"
+                          "{\"name\":\"batch_json\",\"size\":%d,\"skipped\":\"no memory\"}",
+                          first ? "" : ",", size, size);
+            first = false;
+            continue;
+        }
+        n += snprintf(out + n, out_len - n, "%s", first ? "" : ",");
+        if (n < out_len) n += run_case(out + n, out_len - n, "tags_json", size, case_tags_json, &ctx);
+        if (n < out_len) n += snprintf(out + n, out_len - n, ",");
+        if (n < out_len) n += run_case(out + n, out_len - n, "batch_json", size, case_batch_json, &ctx);
+        tag_store_bench_destroy(ctx.table);
+        ctx.table = NULL;
+        first = false;
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, ",");
+    if (n < out_len) n += run_case(out + n, out_len - n, "command_parse", 0, case_command_parse, &ctx);
+    if (n < out_len) n += snprintf(out + n, out_len - n, ",");
+    if (n < out_len) n += run_case(out + n, out_len - n, "frame_format", 0, case_frame_format, &ctx);
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]}");
+
+    free(ctx.buf);
+    free(ctx.toks);
+    free(ctx.rules);
+    return (n < out_len) ? n : out_len - 1;
+}
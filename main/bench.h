@@ -0,0 +1,17 @@
+/* bench.h - microbenchmarks for the serialization and command paths
+ *
+ * GET /debug/bench runs every case on the device (or the linux host build)
+ * and reports ns/op and heap allocations per op; tools/bench.py compares
+ * the result with the baseline in tools/bench_baseline.json. The tag table
+ * cases run on private tables of 32, 1000 and 5000 synthetic tags; the live
+ * table, inventory and the MQTT batch carry on untouched. */
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_JSON_MAX 2048
+
+// {"target","cases":[{"name","size","iters","ns_op","allocs_op","alloc_bytes_op"}]};
+// -1 with {"error":...} in out when the bench buffers cannot be allocated
+int bench_run_json(char *out, int out_len);
+
+#endif // BENCH_H
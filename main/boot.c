@@ -0,0 +1,167 @@
+#include "boot.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "BOOT";
+
+#define BOOT_STAGE_PRIORITY 5
+
+typedef struct {
+    const boot_stage_t *stage;
+    int index;
+    uint32_t start_ms;
+    uint32_t end_ms;
+} boot_record_t;
+
+static boot_record_t s_records[BOOT_MAX_STAGES];
+static int s_stage_count = 0;
+static uint32_t s_boot_start_ms = 0;   // boot_run entry (app_main)
+static uint32_t s_boot_done_ms = 0;    // All stages finished
+
+static EventGroupHandle_t s_stage_group = NULL;   // One bit per finished stage
+static EventGroupHandle_t s_mark_group = NULL;    // One bit per reached milestone
+static volatile uint32_t s_mark_ms[BOOT_MARK_COUNT];
+static portMUX_TYPE s_mark_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *s_mark_names[BOOT_MARK_COUNT] = {
+    "reader_ready", "link_up", "mqtt_connected", "first_read", "first_publish"
+};
+
+// esp_timer starts early in startup, so this is close to time since power-on
+uint32_t boot_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000ULL);
+}
+
+static void boot_stage_task(void *arg)
+{
+    boot_record_t *rec = (boot_record_t *)arg;
+
+    rec->start_ms = boot_now_ms();
+    rec->stage->run();
+    rec->end_ms = boot_now_ms();
+
+    ESP_LOGI(TAG, "Stage %-10s %5lu -> %5lu ms (%lu ms)", rec->stage->name,
+             (unsigned long)rec->start_ms, (unsigned long)rec->end_ms,
+             (unsigned long)(rec->end_ms - rec->start_ms));
+    xEventGroupSetBits(s_stage_group, BOOT_DEP(rec->index));
+    vTaskDelete(NULL);
+}
+
+void boot_run(const boot_stage_t *stages, int count)
+{
+    if (!stages || count <= 0) return;
+    if (count > BOOT_MAX_STAGES) {
+        ESP_LOGE(TAG, "Too many boot stages (%d, max %d)", count, BOOT_MAX_STAGES);
+        count = BOOT_MAX_STAGES;
+    }
+
+    s_boot_start_ms = boot_now_ms();
+    if (!s_stage_group) s_stage_group = xEventGroupCreate();
+    if (!s_mark_group) s_mark_group = xEventGroupCreate();
+
+    s_stage_count = count;
+    for (int i = 0; i < count; i++) {
+        s_records[i] = (boot_record_t){ .stage = &stages[i], .index = i };
+    }
+
+    const uint32_t all = BOOT_DEP(count) - 1;
+    uint32_t started = 0, done = 0;
+
+    while (done != all) {
+        // Start every stage whose dependencies have finished
+        for (int i = 0; i < count; i++) {
+            uint32_t bit = BOOT_DEP(i);
+            if ((started & bit) || (stages[i].deps & done) != stages[i].deps) continue;
+
+            started |= bit;
+            if (!s_stage_group ||
+                xTaskCreate(boot_stage_task, stages[i].name, stages[i].stack_size,
+                            &s_records[i], BOOT_STAGE_PRIORITY, NULL) != pdPASS) {
+                // No task: run it here instead of stalling the boot
+                ESP_LOGW(TAG, "Running stage %s inline", stages[i].name);
+                s_records[i].start_ms = boot_now_ms();
+                stages[i].run();
+                s_records[i].end_ms = boot_now_ms();
+                done |= bit;
+                i = -1;   // Rescan: this may have unblocked earlier stages
+            }
+        }
+        if (done == all) break;
+
+        if (started == done) {
+            ESP_LOGE(TAG, "Unsatisfiable stage dependencies (pending 0x%04lx)",
+                     (unsigned long)(all & ~done));
+            break;
+        }
+        done |= xEventGroupWaitBits(s_stage_group, all & ~done, pdFALSE, pdFALSE, portMAX_DELAY) & all;
+    }
+
+    s_boot_done_ms = boot_now_ms();
+    ESP_LOGI(TAG, "Init stages finished at %lu ms (%lu ms after app_main)",
+             (unsigned long)s_boot_done_ms, (unsigned long)(s_boot_done_ms - s_boot_start_ms));
+}
+
+void boot_mark(boot_mark_t mark)
+{
+    if (mark >= BOOT_MARK_COUNT || s_mark_ms[mark] != 0) return;
+
+    uint32_t now = boot_now_ms();
+    bool first = false;
+    portENTER_CRITICAL(&s_mark_lock);
+    if (s_mark_ms[mark] == 0) {
+        s_mark_ms[mark] = now ? now : 1;
+        first = true;
+    }
+    portEXIT_CRITICAL(&s_mark_lock);
+    if (!first) return;
+
+    if (s_mark_group) xEventGroupSetBits(s_mark_group, BOOT_DEP(mark));
+    ESP_LOGI(TAG, "Boot milestone %s at %lu ms", s_mark_names[mark], (unsigned long)now);
+}
+
+bool boot_mark_reached(boot_mark_t mark)
+{
+    return mark < BOOT_MARK_COUNT && s_mark_ms[mark] != 0;
+}
+
+bool boot_wait_mark(boot_mark_t mark, uint32_t timeout_ms)
+{
+    if (mark >= BOOT_MARK_COUNT) return false;
+    if (s_mark_ms[mark] != 0) return true;
+    if (!s_mark_group) return false;
+
+    xEventGroupWaitBits(s_mark_group, BOOT_DEP(mark), pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return s_mark_ms[mark] != 0;
+}
+
+int boot_get_report_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    int n = snprintf(out, out_len, "{\"app_main_ms\":%lu,\"init_done_ms\":%lu,\"stages\":[",
+                     (unsigned long)s_boot_start_ms, (unsigned long)s_boot_done_ms);
+    for (int i = 0; i < s_stage_count && n < out_len; i++) {
+        const boot_record_t *rec = &s_records[i];
+        n += snprintf(out + n, out_len - n, "%s{\"name\":\"%s\",\"start_ms\":%lu,\"end_ms\":%lu,\"ms\":%lu}",
+                      i ? "," : "", rec->stage->name, (unsigned long)rec->start_ms,
+                      (unsigned long)rec->end_ms,
+                      (unsigned long)(rec->end_ms >= rec->start_ms ? rec->end_ms - rec->start_ms : 0));
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "],\"milestones\":{");
+    for (int m = 0; m < BOOT_MARK_COUNT && n < out_len; m++) {
+        if (s_mark_ms[m]) {
+            n += snprintf(out + n, out_len - n, "%s\"%s\":%lu", m ? "," : "", s_mark_names[m],
+                          (unsigned long)s_mark_ms[m]);
+        } else {
+            n += snprintf(out + n, out_len - n, "%s\"%s\":null", m ? "," : "", s_mark_names[m]);
+        }
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "}}");
+    return (n < out_len) ? n : out_len - 1;
+}
@@ -0,0 +1,44 @@
+/* boot.h - dependency-ordered, parallel startup stages with boot timing
+ *
+ * app_main declares its init stages with the stages they depend on; every stage
+ * whose dependencies have finished runs in its own task. Stage times and
+ * milestones (first tag read, first tag batch acknowledged) are kept as ms since
+ * power-on for the boot report. */
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BOOT_MAX_STAGES 16
+#define BOOT_DEP(stage) (1u << (stage))   // Dependency bit for a stage index
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    uint32_t deps;          // BOOT_DEP() mask of stages that must finish first
+    uint32_t stack_size;    // Task stack for the stage
+} boot_stage_t;
+
+// Milestones after the stages themselves; each is recorded once
+typedef enum {
+    BOOT_MARK_READER_READY = 0,  // First frame received from the RFID module
+    BOOT_MARK_LINK_UP,           // Ethernet/WiFi has an IP address
+    BOOT_MARK_MQTT_CONNECTED,
+    BOOT_MARK_FIRST_READ,        // First tag stored
+    BOOT_MARK_FIRST_PUBLISH,     // First tag batch acknowledged by the broker
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+// Run the stages and return once all of them have finished
+void boot_run(const boot_stage_t *stages, int count);
+
+void boot_mark(boot_mark_t mark);
+bool boot_wait_mark(boot_mark_t mark, uint32_t timeout_ms);
+bool boot_mark_reached(boot_mark_t mark);
+uint32_t boot_now_ms(void);   // ms since power-on
+
+// Stage timings and milestones as JSON
+int boot_get_report_json(char *out, int out_len);
+
+#endif // BOOT_H
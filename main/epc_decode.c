@@ -0,0 +1,346 @@
+#include "epc_decode.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "EPC";
+static const char *NVS_NAMESPACE = "epc";
+
+#define EPC96_BYTES 12
+
+// EPC header byte of each 96-bit scheme (TDS 1.x)
+#define HDR_SGTIN96 0x30
+#define HDR_SSCC96  0x31
+#define HDR_GRAI96  0x33
+
+// Partition value -> company prefix and reference field widths
+typedef struct {
+    uint8_t company_bits;
+    uint8_t company_digits;
+    uint8_t ref_bits;
+    uint8_t ref_digits;
+} epc_partition_t;
+
+// Item reference includes the GTIN indicator digit
+static const epc_partition_t s_sgtin_parts[7] = {
+    { 40, 12,  4, 1 }, { 37, 11,  7, 2 }, { 34, 10, 10, 3 }, { 30, 9, 14, 4 },
+    { 27,  8, 17, 5 }, { 24,  7, 20, 6 }, { 20,  6, 24, 7 },
+};
+
+// Serial reference includes the SSCC extension digit
+static const epc_partition_t s_sscc_parts[7] = {
+    { 40, 12, 18,  5 }, { 37, 11, 21,  6 }, { 34, 10, 24,  7 }, { 30, 9, 28, 8 },
+    { 27,  8, 31,  9 }, { 24,  7, 34, 10 }, { 20,  6, 38, 11 },
+};
+
+// Asset type
+static const epc_partition_t s_grai_parts[7] = {
+    { 40, 12,  4, 0 }, { 37, 11,  7, 1 }, { 34, 10, 10, 2 }, { 30, 9, 14, 3 },
+    { 27,  8, 17, 4 }, { 24,  7, 20, 5 }, { 20,  6, 24, 6 },
+};
+
+static const uint64_t s_pow10[13] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+};
+
+static epc_rules_t s_rules = { .mode = EPC_RULE_OFF };
+static uint32_t s_checked = 0;
+static uint32_t s_rejected = 0;
+static uint32_t s_unknown = 0;
+static SemaphoreHandle_t s_lock = NULL;
+
+// n <= 40 bits starting at bit `start` (0 = MSB of byte 0)
+static uint64_t get_bits(const uint8_t *b, int start, int n)
+{
+    int first = start >> 3, last = (start + n - 1) >> 3;
+    uint64_t v = 0;
+    for (int i = first; i <= last; i++) v = (v << 8) | b[i];
+    v >>= (last + 1) * 8 - (start + n);
+    return v & ((1ULL << n) - 1);
+}
+
+// GS1 mod-10 check digit over n digits
+static char check_digit(const char *digits, int n)
+{
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        int d = digits[n - 1 - i] - '0';
+        sum += (i % 2 == 0) ? d * 3 : d;
+    }
+    return (char)('0' + (10 - sum % 10) % 10);
+}
+
+static void put_digits(char *out, uint64_t v, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    out[digits] = '\0';
+}
+
+bool epc_decode(const uint8_t *epc, size_t len, epc_info_t *out)
+{
+    if (!epc || !out || len < EPC96_BYTES) return false;
+    memset(out, 0, sizeof(*out));
+
+    const epc_partition_t *table;
+    epc_scheme_t scheme;
+    switch (epc[0]) {
+    case HDR_SGTIN96: table = s_sgtin_parts; scheme = EPC_SCHEME_SGTIN96; break;
+    case HDR_SSCC96:  table = s_sscc_parts;  scheme = EPC_SCHEME_SSCC96;  break;
+    case HDR_GRAI96:  table = s_grai_parts;  scheme = EPC_SCHEME_GRAI96;  break;
+    default: return false;
+    }
+
+    // Header(8) filter(3) partition(3) company reference [serial]
+    uint8_t filter = (uint8_t)get_bits(epc, 8, 3);
+    uint8_t partition = (uint8_t)get_bits(epc, 11, 3);
+    if (partition > 6) return false;
+    const epc_partition_t *p = &table[partition];
+
+    uint64_t company = get_bits(epc, 14, p->company_bits);
+    uint64_t ref = get_bits(epc, 14 + p->company_bits, p->ref_bits);
+    if (company >= s_pow10[p->company_digits] || ref >= s_pow10[p->ref_digits]) return false;
+
+    char cp[EPC_PREFIX_LEN], rf[14];
+    put_digits(cp, company, p->company_digits);
+    put_digits(rf, ref, p->ref_digits);
+
+    switch (scheme) {
+    case EPC_SCHEME_SGTIN96:
+        // Indicator digit, company prefix, rest of the item reference
+        out->id[0] = rf[0];
+        memcpy(out->id + 1, cp, p->company_digits);
+        memcpy(out->id + 1 + p->company_digits, rf + 1, p->ref_digits - 1);
+        out->id[13] = check_digit(out->id, 13);
+        out->id[14] = '\0';
+        out->serial = get_bits(epc, 58, 38);
+        break;
+    case EPC_SCHEME_SSCC96:
+        // Extension digit, company prefix, rest of the serial reference
+        out->id[0] = rf[0];
+        memcpy(out->id + 1, cp, p->company_digits);
+        memcpy(out->id + 1 + p->company_digits, rf + 1, p->ref_digits - 1);
+        out->id[17] = check_digit(out->id, 17);
+        out->id[18] = '\0';
+        break;
+    default:
+        // Leading zero, company prefix, asset type
+        out->id[0] = '0';
+        memcpy(out->id + 1, cp, p->company_digits);
+        memcpy(out->id + 1 + p->company_digits, rf, p->ref_digits);
+        out->id[13] = check_digit(out->id, 13);
+        out->id[14] = '\0';
+        out->serial = get_bits(epc, 58, 38);
+        break;
+    }
+
+    out->scheme = scheme;
+    out->filter = filter;
+    out->partition = partition;
+    memcpy(out->company, cp, sizeof(cp));
+    return true;
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool epc_decode_hex(const char *hex, epc_info_t *out)
+{
+    if (!hex) return false;
+    uint8_t bytes[EPC96_BYTES];
+    for (int i = 0; i < EPC96_BYTES; i++) {
+        int hi = hex_nibble(hex[2 * i]);
+        int lo = (hi < 0) ? -1 : hex_nibble(hex[2 * i + 1]);
+        if (lo < 0) return false;
+        bytes[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return epc_decode(bytes, sizeof(bytes), out);
+}
+
+int epc_decode_json(const epc_info_t *info, char *out, int out_len)
+{
+    if (!info || !out || out_len <= 0) return 0;
+    int n;
+    switch (info->scheme) {
+    case EPC_SCHEME_SGTIN96:
+        n = snprintf(out, out_len, "{\"scheme\":\"sgtin-96\",\"filter\":%u,\"company\":\"%s\",\"gtin\":\"%s\",\"serial\":%llu}",
+                     (unsigned)info->filter, info->company, info->id, (unsigned long long)info->serial);
+        break;
+    case EPC_SCHEME_SSCC96:
+        n = snprintf(out, out_len, "{\"scheme\":\"sscc-96\",\"filter\":%u,\"company\":\"%s\",\"sscc\":\"%s\"}",
+                     (unsigned)info->filter, info->company, info->id);
+        break;
+    case EPC_SCHEME_GRAI96:
+        n = snprintf(out, out_len, "{\"scheme\":\"grai-96\",\"filter\":%u,\"company\":\"%s\",\"grai\":\"%s\",\"serial\":%llu}",
+                     (unsigned)info->filter, info->company, info->id, (unsigned long long)info->serial);
+        break;
+    default:
+        n = snprintf(out, out_len, "null");
+        break;
+    }
+    return (n < out_len) ? n : out_len - 1;
+}
+
+static bool prefix_listed(const char *company)
+{
+    for (int i = 0; i < s_rules.count; i++) {
+        const char *p = s_rules.prefixes[i];
+        if (strncmp(company, p, strlen(p)) == 0) return true;
+    }
+    return false;
+}
+
+bool epc_decode_accept(const uint8_t *epc, size_t len)
+{
+    // Plain read: the common case is no rules at all
+    if (s_rules.mode == EPC_RULE_OFF || !s_lock) return true;
+
+    epc_info_t info;
+    bool decoded = epc_decode(epc, len, &info);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool accept;
+    s_checked++;
+    if (!decoded) {
+        s_unknown++;
+        accept = !(s_rules.mode == EPC_RULE_ALLOW && s_rules.drop_unknown);
+    } else if (s_rules.mode == EPC_RULE_ALLOW) {
+        accept = prefix_listed(info.company);
+    } else if (s_rules.mode == EPC_RULE_DENY) {
+        accept = !prefix_listed(info.company);
+    } else {
+        accept = true;
+    }
+    if (!accept) s_rejected++;
+    xSemaphoreGive(s_lock);
+    return accept;
+}
+
+bool epc_decode_payload_enabled(void)
+{
+    return s_rules.payload;
+}
+
+static bool valid_prefix(const char *p)
+{
+    size_t n = strnlen(p, EPC_PREFIX_LEN);
+    if (n == 0 || n >= EPC_PREFIX_LEN) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') return false;
+    }
+    return true;
+}
+
+void epc_decode_init(void)
+{
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    epc_rules_t r = { .mode = EPC_RULE_OFF };
+    uint8_t v;
+    if (nvs_get_u8(h, "rule", &v) == ESP_OK && v <= EPC_RULE_DENY) r.mode = v;
+    if (nvs_get_u8(h, "payload", &v) == ESP_OK) r.payload = v != 0;
+    if (nvs_get_u8(h, "drop_unk", &v) == ESP_OK) r.drop_unknown = v != 0;
+    size_t len = sizeof(r.prefixes);
+    if (nvs_get_blob(h, "prefixes", r.prefixes, &len) == ESP_OK) r.count = (int)(len / EPC_PREFIX_LEN);
+    nvs_close(h);
+
+    for (int i = 0; i < r.count; i++) {
+        if (!valid_prefix(r.prefixes[i])) {
+            ESP_LOGW(TAG, "Ignoring stored prefix list (entry %d invalid)", i);
+            r.count = 0;
+            break;
+        }
+    }
+    s_rules = r;
+    ESP_LOGI(TAG, "Rules: mode=%d prefixes=%d payload=%d", r.mode, r.count, (int)r.payload);
+}
+
+void epc_decode_get_rules(epc_rules_t *rules)
+{
+    if (!rules || !s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *rules = s_rules;
+    xSemaphoreGive(s_lock);
+}
+
+int epc_decode_set_rules(const epc_rules_t *rules)
+{
+    if (!rules || !s_lock) return -1;
+    if (rules->mode < EPC_RULE_OFF || rules->mode > EPC_RULE_DENY) return -1;
+    if (rules->count < 0 || rules->count > EPC_PREFIX_MAX) return -1;
+    for (int i = 0; i < rules->count; i++) {
+        if (!valid_prefix(rules->prefixes[i])) return -1;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_rules = *rules;
+    xSemaphoreGive(s_lock);
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return 0;
+    nvs_set_u8(h, "rule", (uint8_t)rules->mode);
+    nvs_set_u8(h, "payload", rules->payload ? 1 : 0);
+    nvs_set_u8(h, "drop_unk", rules->drop_unknown ? 1 : 0);
+    if (rules->count > 0) {
+        nvs_set_blob(h, "prefixes", rules->prefixes, (size_t)rules->count * EPC_PREFIX_LEN);
+    } else {
+        nvs_erase_key(h, "prefixes");
+    }
+    nvs_commit(h);
+    nvs_close(h);
+    ESP_LOGI(TAG, "Rules updated: mode=%d prefixes=%d", rules->mode, rules->count);
+    return 0;
+}
+
+static const char *mode_name(int mode)
+{
+    switch (mode) {
+    case EPC_RULE_ALLOW: return "allow";
+    case EPC_RULE_DENY:  return "deny";
+    default:             return "off";
+    }
+}
+
+int epc_decode_parse_mode(const char *name)
+{
+    if (!name) return -1;
+    if (strcmp(name, "off") == 0) return EPC_RULE_OFF;
+    if (strcmp(name, "allow") == 0) return EPC_RULE_ALLOW;
+    if (strcmp(name, "deny") == 0) return EPC_RULE_DENY;
+    return -1;
+}
+
+int epc_decode_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0 || !s_lock) return 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    epc_rules_t r = s_rules;
+    uint32_t checked = s_checked, rejected = s_rejected, unknown = s_unknown;
+    xSemaphoreGive(s_lock);
+
+    int n = snprintf(out, out_len,
+                     "{\"mode\":\"%s\",\"payload\":%s,\"drop_unknown\":%s,"
+                     "\"checked\":%lu,\"rejected\":%lu,\"unknown\":%lu,\"prefixes\":[",
+                     mode_name(r.mode), r.payload ? "true" : "false", r.drop_unknown ? "true" : "false",
+                     (unsigned long)checked, (unsigned long)rejected, (unsigned long)unknown);
+    for (int i = 0; i < r.count && n < out_len; i++) {
+        n += snprintf(out + n, out_len - n, "%s\"%s\"", i ? "," : "", r.prefixes[i]);
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]}");
+    return (n < out_len) ? n : out_len - 1;
+}
@@ -0,0 +1,62 @@
+/* epc_decode.h - GS1 EPC decoding (SGTIN-96, SSCC-96, GRAI-96) and company-prefix rules */
+#ifndef EPC_DECODE_H
+#define EPC_DECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define EPC_PREFIX_MAX      32    // Company prefixes in the allow/deny list
+#define EPC_PREFIX_LEN      13    // Up to 12 digits + NUL
+#define EPC_DECODE_JSON_MAX 128   // Longest "gs1" object from epc_decode_json
+
+typedef enum {
+    EPC_SCHEME_UNKNOWN = 0,
+    EPC_SCHEME_SGTIN96,
+    EPC_SCHEME_SSCC96,
+    EPC_SCHEME_GRAI96,
+} epc_scheme_t;
+
+typedef struct {
+    epc_scheme_t scheme;
+    uint8_t filter;
+    uint8_t partition;
+    char company[EPC_PREFIX_LEN];   // Company prefix, 6..12 digits
+    char id[19];                    // GTIN-14, SSCC-18 or GRAI-14 (without serial), check digit included
+    uint64_t serial;                // SGTIN / GRAI serial; 0 for SSCC
+} epc_info_t;
+
+typedef enum {
+    EPC_RULE_OFF = 0,
+    EPC_RULE_ALLOW,     // Only tags whose company prefix is listed are kept
+    EPC_RULE_DENY,      // Tags whose company prefix is listed are dropped
+} epc_rule_mode_t;
+
+typedef struct {
+    int mode;                 // epc_rule_mode_t
+    bool payload;             // Add the decoded "gs1" object to /tags and MQTT batches
+    bool drop_unknown;        // Allow mode: also drop EPCs that are not SGTIN/SSCC/GRAI-96
+    int count;
+    char prefixes[EPC_PREFIX_MAX][EPC_PREFIX_LEN];   // Digits; a listed prefix matches any company prefix that starts with it
+} epc_rules_t;
+
+void epc_decode_init(void);   // Loads the rules from NVS
+
+// Decode raw EPC bytes (at least 12) or the hex string the tag store keeps
+bool epc_decode(const uint8_t *epc, size_t len, epc_info_t *out);
+bool epc_decode_hex(const char *hex, epc_info_t *out);
+
+// {"scheme":"sgtin-96",...} for a decoded EPC. Returns bytes written.
+int epc_decode_json(const epc_info_t *info, char *out, int out_len);
+
+// Company-prefix rules, applied by the reader before a read is stored
+bool epc_decode_accept(const uint8_t *epc, size_t len);
+bool epc_decode_payload_enabled(void);
+void epc_decode_get_rules(epc_rules_t *rules);
+int epc_decode_set_rules(const epc_rules_t *rules);   // Applies and saves to NVS; -1 if a prefix is not 1..12 digits
+int epc_decode_parse_mode(const char *name);          // "off" / "allow" / "deny"; -1 if unknown
+
+// Rules and counters as JSON
+int epc_decode_get_json(char *out, int out_len);
+
+#endif // EPC_DECODE_H
@@ -0,0 +1,298 @@
+#include "epcdb.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "EPCDB";
+
+#define SECTOR_SIZE 4096
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;   // Held by lookups and while the mapping changes
+
+// Mapped image; NULL while no valid table is loaded
+static esp_partition_mmap_handle_t s_map;
+static const epcdb_header_t *s_hdr = NULL;
+static const epcdb_record_t *s_records = NULL;
+static const char *s_names = NULL;
+
+static uint32_t s_lookups = 0;
+static uint32_t s_hits = 0;
+
+// Streamed update (one at a time, HTTP task)
+static struct {
+    bool active;
+    size_t total;
+    size_t written;
+    size_t erased;
+    uint32_t crc;
+    uint8_t header[sizeof(epcdb_header_t)];
+} s_upd;
+
+static bool header_sane(const epcdb_header_t *h, size_t limit)
+{
+    if (h->magic != EPCDB_MAGIC || h->version != EPCDB_VERSION) return false;
+    if (h->record_size != sizeof(epcdb_record_t)) return false;
+    uint64_t size = sizeof(*h) + (uint64_t)h->count * sizeof(epcdb_record_t) + h->names_len;
+    return size <= limit;
+}
+
+static size_t image_size(const epcdb_header_t *h)
+{
+    return sizeof(*h) + (size_t)h->count * sizeof(epcdb_record_t) + h->names_len;
+}
+
+// Caller holds s_lock
+static void unmap_locked(void)
+{
+    if (!s_hdr) return;
+    s_hdr = NULL;
+    s_records = NULL;
+    s_names = NULL;
+    esp_partition_munmap(s_map);
+}
+
+// Caller holds s_lock
+static bool map_locked(void)
+{
+    epcdb_header_t h;
+    if (esp_partition_read(s_part, 0, &h, sizeof(h)) != ESP_OK) return false;
+    if (!header_sane(&h, s_part->size)) return false;
+
+    const void *ptr;
+    if (esp_partition_mmap(s_part, 0, image_size(&h), ESP_PARTITION_MMAP_DATA, &ptr, &s_map) != ESP_OK) {
+        ESP_LOGE(TAG, "mmap of %u bytes failed", (unsigned)image_size(&h));
+        return false;
+    }
+    const uint8_t *base = (const uint8_t *)ptr;
+    uint32_t crc = esp_rom_crc32_le(0, base + sizeof(h), image_size(&h) - sizeof(h));
+    if (crc != h.crc32) {
+        ESP_LOGW(TAG, "Image CRC mismatch (%08lx != %08lx)", (unsigned long)crc, (unsigned long)h.crc32);
+        esp_partition_munmap(s_map);
+        return false;
+    }
+    s_hdr = (const epcdb_header_t *)base;
+    s_records = (const epcdb_record_t *)(base + sizeof(h));
+    s_names = (const char *)(base + sizeof(h) + (size_t)h.count * sizeof(epcdb_record_t));
+    return true;
+}
+
+void epcdb_init(void)
+{
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, EPCDB_PARTITION_LABEL);
+    if (!s_part) {
+        ESP_LOGW(TAG, "No '%s' partition; asset lookup disabled", EPCDB_PARTITION_LABEL);
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = map_locked();
+    xSemaphoreGive(s_lock);
+    if (ok) {
+        ESP_LOGI(TAG, "Loaded %lu EPC records (%lu bytes of names)",
+                 (unsigned long)s_hdr->count, (unsigned long)s_hdr->names_len);
+    } else {
+        ESP_LOGI(TAG, "Partition holds no valid table (%lu bytes available)", (unsigned long)s_part->size);
+    }
+}
+
+bool epcdb_loaded(void)
+{
+    return s_hdr != NULL;
+}
+
+// Caller holds s_lock and a table is mapped
+static const epcdb_record_t *find_locked(const uint8_t *epc)
+{
+    uint32_t lo = 0, hi = s_hdr->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = memcmp(epc, s_records[mid].epc, EPCDB_EPC_BYTES);
+        if (c == 0) return &s_records[mid];
+        if (c < 0) hi = mid; else lo = mid + 1;
+    }
+    return NULL;
+}
+
+bool epcdb_lookup(const uint8_t *epc, size_t len, epcdb_record_t *out)
+{
+    if (!epc || len != EPCDB_EPC_BYTES || !s_hdr) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const epcdb_record_t *rec = s_hdr ? find_locked(epc) : NULL;
+    s_lookups++;
+    if (rec) {
+        s_hits++;
+        if (out) *out = *rec;
+    }
+    xSemaphoreGive(s_lock);
+    return rec != NULL;
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool epcdb_lookup_hex(const char *hex, epcdb_record_t *out)
+{
+    if (!hex || !s_hdr || strlen(hex) != 2 * EPCDB_EPC_BYTES) return false;
+    uint8_t epc[EPCDB_EPC_BYTES];
+    for (int i = 0; i < EPCDB_EPC_BYTES; i++) {
+        int hi = hex_nibble(hex[2 * i]), lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        epc[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return epcdb_lookup(epc, sizeof(epc), out);
+}
+
+bool epcdb_accept(const uint8_t *epc, size_t len)
+{
+    if (!s_hdr) return true;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool keep = true;
+    if (s_hdr) {
+        const epcdb_record_t *rec = (epc && len == EPCDB_EPC_BYTES) ? find_locked(epc) : NULL;
+        s_lookups++;
+        if (rec) {
+            s_hits++;
+            keep = !(rec->flags & EPCDB_FLAG_SUPPRESS);
+        } else {
+            keep = !(s_hdr->flags & EPCDB_HDR_ALLOW_ONLY);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return keep;
+}
+
+int epcdb_record_json(const epcdb_record_t *rec, char *out, int out_len)
+{
+    if (!rec || !out || out_len <= 0) return 0;
+
+    // Names are copied out of the mapping and made JSON-safe
+    char name[EPCDB_NAME_MAX + 1] = "";
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_hdr && rec->name_off != UINT32_MAX && (uint64_t)rec->name_off + rec->name_len <= s_hdr->names_len) {
+        size_t n = rec->name_len < EPCDB_NAME_MAX ? rec->name_len : EPCDB_NAME_MAX;
+        for (size_t i = 0; i < n; i++) {
+            char c = s_names[rec->name_off + i];
+            name[i] = (c < 0x20 || c == '"' || c == '\\') ? '_' : c;
+        }
+        name[n] = '\0';
+    }
+    xSemaphoreGive(s_lock);
+
+    int n = snprintf(out, out_len, "{\"id\":%lu,\"name\":\"%s\"}", (unsigned long)rec->asset_id, name);
+    return (n < out_len) ? n : out_len - 1;
+}
+
+int epcdb_update_begin(size_t total_len)
+{
+    if (!s_part || !s_lock) return -1;
+    if (total_len < sizeof(epcdb_header_t) || total_len > s_part->size) return -1;
+
+    // The old table goes away first: its flash is about to be erased
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    unmap_locked();
+    xSemaphoreGive(s_lock);
+
+    memset(&s_upd, 0, sizeof(s_upd));
+    s_upd.active = true;
+    s_upd.total = total_len;
+    // Sector 0 holds the header, which is written last so a partial upload never validates
+    if (esp_partition_erase_range(s_part, 0, SECTOR_SIZE) != ESP_OK) {
+        s_upd.active = false;
+        return -1;
+    }
+    s_upd.erased = SECTOR_SIZE;
+    ESP_LOGI(TAG, "Update started (%u bytes)", (unsigned)total_len);
+    return 0;
+}
+
+int epcdb_update_write(const void *data, size_t len)
+{
+    if (!s_upd.active || s_upd.written + len > s_upd.total) return -1;
+    const uint8_t *p = (const uint8_t *)data;
+
+    // Header bytes are held back until the image has been checked
+    while (len > 0 && s_upd.written < sizeof(epcdb_header_t)) {
+        s_upd.header[s_upd.written++] = *p++;
+        len--;
+    }
+    if (len == 0) return 0;
+
+    // Erase sector by sector just ahead of the data, so no single call stalls
+    size_t end = s_upd.written + len;
+    while (s_upd.erased < end) {
+        if (esp_partition_erase_range(s_part, s_upd.erased, SECTOR_SIZE) != ESP_OK) return -1;
+        s_upd.erased += SECTOR_SIZE;
+    }
+    if (esp_partition_write(s_part, s_upd.written, p, len) != ESP_OK) return -1;
+    s_upd.crc = esp_rom_crc32_le(s_upd.crc, p, len);
+    s_upd.written = end;
+    return 0;
+}
+
+int epcdb_update_finish(void)
+{
+    if (!s_upd.active) return -1;
+    s_upd.active = false;
+
+    epcdb_header_t h;
+    memcpy(&h, s_upd.header, sizeof(h));
+    if (s_upd.written != s_upd.total || !header_sane(&h, s_part->size) || image_size(&h) != s_upd.total) {
+        ESP_LOGW(TAG, "Update rejected: bad header or size");
+        return -1;
+    }
+    if (s_upd.crc != h.crc32) {
+        ESP_LOGW(TAG, "Update rejected: CRC %08lx != %08lx", (unsigned long)s_upd.crc, (unsigned long)h.crc32);
+        return -1;
+    }
+    if (esp_partition_write(s_part, 0, &h, sizeof(h)) != ESP_OK) return -1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = map_locked();
+    xSemaphoreGive(s_lock);
+    if (!ok) return -1;
+    ESP_LOGI(TAG, "Update complete: %lu EPC records", (unsigned long)h.count);
+    return 0;
+}
+
+void epcdb_update_abort(void)
+{
+    if (!s_upd.active) return;
+    s_upd.active = false;
+    ESP_LOGW(TAG, "Update aborted after %u of %u bytes", (unsigned)s_upd.written, (unsigned)s_upd.total);
+}
+
+int epcdb_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+    uint32_t count = 0, names = 0, flags = 0, size = 0;
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_hdr) {
+            count = s_hdr->count;
+            names = s_hdr->names_len;
+            flags = s_hdr->flags;
+            size = (uint32_t)image_size(s_hdr);
+        }
+        xSemaphoreGive(s_lock);
+    }
+    int n = snprintf(out, out_len,
+                     "{\"partition\":%s,\"partition_bytes\":%lu,\"loaded\":%s,\"records\":%lu,\"names_bytes\":%lu,"
+                     "\"image_bytes\":%lu,\"allow_only\":%s,\"updating\":%s,\"lookups\":%lu,\"hits\":%lu}",
+                     s_part ? "true" : "false", (unsigned long)(s_part ? s_part->size : 0),
+                     size ? "true" : "false", (unsigned long)count, (unsigned long)names, (unsigned long)size,
+                     (flags & EPCDB_HDR_ALLOW_ONLY) ? "true" : "false", s_upd.active ? "true" : "false",
+                     (unsigned long)s_lookups, (unsigned long)s_hits);
+    return (n < out_len) ? n : out_len - 1;
+}
@@ -0,0 +1,67 @@
+/* epcdb.h - EPC -> asset lookup table in a memory-mapped flash partition */
+#ifndef EPCDB_H
+#define EPCDB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Image layout (little endian), built by tools/epcdb_build.py:
+//   header (32 bytes) | records sorted by EPC (count * 24 bytes) | name pool
+// The CRC covers records and names. Only 96-bit EPCs are stored.
+#define EPCDB_PARTITION_LABEL "epcdb"
+#define EPCDB_MAGIC           0x42445045   // "EPDB"
+#define EPCDB_VERSION         1
+#define EPCDB_EPC_BYTES       12
+#define EPCDB_NAME_MAX        32           // Longest asset name rendered into payloads
+#define EPCDB_JSON_MAX        (EPCDB_NAME_MAX + 48)
+
+// Header flags
+#define EPCDB_HDR_ALLOW_ONLY  0x0001       // Drop EPCs that are not in the table
+
+// Record flags
+#define EPCDB_FLAG_SUPPRESS   0x0001       // Known fixture: drop every read
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t names_len;
+    uint32_t crc32;
+    uint16_t flags;
+    uint8_t reserved[10];
+} epcdb_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t epc[EPCDB_EPC_BYTES];
+    uint32_t asset_id;
+    uint32_t name_off;     // Into the name pool; UINT32_MAX = no name
+    uint16_t flags;
+    uint16_t name_len;
+} epcdb_record_t;
+
+void epcdb_init(void);   // Validates and maps the partition if it holds an image
+bool epcdb_loaded(void);
+
+// Copy of the record for an EPC; false if absent or no table is loaded
+bool epcdb_lookup(const uint8_t *epc, size_t len, epcdb_record_t *out);
+bool epcdb_lookup_hex(const char *hex, epcdb_record_t *out);
+
+// Ingest check: false if the table suppresses this EPC
+bool epcdb_accept(const uint8_t *epc, size_t len);
+
+// {"id":..,"name":".."} for a record. Returns bytes written.
+int epcdb_record_json(const epcdb_record_t *rec, char *out, int out_len);
+
+// Streamed replacement: begin with the full image size, write chunks in
+// order, then finish (validates and maps) or abort. Lookups pass while an
+// update is in progress.
+int epcdb_update_begin(size_t total_len);
+int epcdb_update_write(const void *data, size_t len);
+int epcdb_update_finish(void);
+void epcdb_update_abort(void);
+
+int epcdb_get_json(char *out, int out_len);
+
+#endif // EPCDB_H
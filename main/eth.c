@@ -1,6 +1,8 @@
 #include "sdkconfig.h"
 #include "eth.h"
 #include "network_config.h"
+#include "net_events.h"
+#include "boot.h"
 #include <stdio.h>
 #include <string.h>
 #include "esp_netif.h"
@@ -45,6 +47,7 @@ static void eth_event_handler(void *arg, esp_event_base_t event_base,
     case ETHERNET_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "Ethernet Link Down");
         s_eth_connected = false;
+        net_events_post(NET_EVT_LINK_DOWN);
         break;
     case ETHERNET_EVENT_START:
         ESP_LOGI(TAG, "Ethernet Started");
@@ -73,6 +76,8 @@ static void got_ip_event_handler(void *arg, esp_event_base_t event_base,
 
     // Mark Ethernet as connected
     s_eth_connected = true;
+    net_events_post(NET_EVT_LINK_UP);
+    boot_mark(BOOT_MARK_LINK_UP);
 
     // Spawn a connectivity test task to verify Internet access (non-blocking)
     // xTaskCreate(connectivity_test_task, "eth_connect_test", 4096, NULL, 5, NULL);
@@ -0,0 +1,41 @@
+#include "eth.h"
+#include "net_events.h"
+#include "boot.h"
+#include <stdio.h>
+#include <string.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_event.h"
+#include "esp_log.h"
+
+static const char *TAG = "ETH";
+
+static bool s_eth_connected = false;
+
+// The host network stack is already up: log its addresses and report the link
+void eth_init(void)
+{
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    struct ifaddrs *ifs;
+    if (getifaddrs(&ifs) == 0) {
+        for (struct ifaddrs *i = ifs; i; i = i->ifa_next) {
+            if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET || (i->ifa_flags & IFF_LOOPBACK)) continue;
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &((struct sockaddr_in *)i->ifa_addr)->sin_addr, ip, sizeof(ip));
+            ESP_LOGI(TAG, "Host interface %s: %s", i->ifa_name, ip);
+        }
+        freeifaddrs(ifs);
+    }
+
+    s_eth_connected = true;
+    net_events_post(NET_EVT_LINK_UP);
+    boot_mark(BOOT_MARK_LINK_UP);
+}
+
+bool eth_is_connected(void)
+{
+    return s_eth_connected;
+}
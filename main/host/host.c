@@ -0,0 +1,49 @@
+#include "host.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_private/partition_linux.h"
+
+static const char *TAG = "HOST";
+
+void host_init(void)
+{
+    const char *path = getenv(HOST_FLASH_ENV);
+    if (!path || !path[0]) path = HOST_FLASH_DEFAULT;
+
+    esp_partition_file_mmap_ctrl_t *in = esp_partition_get_file_mmap_ctrl_input();
+    bool exists = access(path, R_OK | W_OK) == 0;
+    if (exists) {
+        strncpy(in->flash_file_name, path, sizeof(in->flash_file_name) - 1);
+    }
+    in->remove_dump = false;
+
+    // The first partition lookup maps the image (a fresh one has the partition table written in)
+    if (!esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL)) {
+        ESP_LOGE(TAG, "No NVS partition in the flash image");
+        return;
+    }
+    if (!exists) {
+        const char *tmp = esp_partition_get_file_mmap_ctrl_act()->flash_file_name;
+        if (rename(tmp, path) != 0) {
+            ESP_LOGW(TAG, "Flash image stays at %s", tmp);
+            return;
+        }
+    }
+    ESP_LOGI(TAG, "Flash image %s (%s)", path, exists ? "reused" : "new");
+}
+
+void host_read_mac(uint8_t mac[6])
+{
+    static const uint8_t fallback[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    const char *env = getenv(HOST_MAC_ENV);
+    unsigned v[6];
+    if (env && sscanf(env, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6) {
+        for (int i = 0; i < 6; i++) mac[i] = (uint8_t)v[i];
+        return;
+    }
+    memcpy(mac, fallback, sizeof(fallback));
+}
@@ -0,0 +1,24 @@
+/* host.h - Linux host build (idf.py --preview set-target linux)
+ *
+ * The hardware modules have host stand-ins in this directory: uart_host.c
+ * (pty, serial device or TCP socket per UART), eth_host.c (the host network
+ * stack) and wifi_host.c (no WiFi). NVS and the epcdb partition live in a
+ * flash image file that survives restarts. */
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+#define HOST_FLASH_ENV     "READER_FLASH"       // Flash image path
+#define HOST_FLASH_DEFAULT "reader_flash.bin"
+#define HOST_UART_ENV      "READER_UART"        // READER_UART1=/dev/ttyUSB0 or tcp:host:port; default a new pty
+#define HOST_MAC_ENV       "READER_MAC"         // aa:bb:cc:dd:ee:ff reported as the reader MAC
+
+// Before nvs_flash_init: reuse the flash image, or create it on first run
+void host_init(void);
+
+// Stand-in for esp_read_mac(ESP_MAC_ETH): HOST_MAC_ENV, else a fixed locally
+// administered address
+void host_read_mac(uint8_t mac[6]);
+
+#endif // HOST_H
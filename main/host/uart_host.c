@@ -0,0 +1,226 @@
+#define _GNU_SOURCE   // posix_openpt, ptsname
+#include "uart.h"
+#include "host.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "metrics.h"
+#include "latency.h"
+
+static const char *TAG = "UART";
+
+#define BUF_SIZE        (4096)
+#define UART_HOST_PORTS 3        // Same numbering as the ESP32-S3 UARTs
+#define RX_IDLE_MS      2        // Poll interval: a blocking read would stall the FreeRTOS scheduler
+
+typedef struct {
+    bool initialized;
+    int port;
+    int fd;
+    uart_rx_fn on_rx;
+    void *ctx;
+    char *rx_buffer;     // Hex dump of recent traffic for GET /data
+    int rx_buffer_len;
+} uart_ctx_t;
+
+static uart_ctx_t s_uarts[UART_HOST_PORTS];
+
+static uart_ctx_t *uart_ctx(int port)
+{
+    if (port < 0 || port >= UART_HOST_PORTS || !s_uarts[port].initialized) return NULL;
+    return &s_uarts[port];
+}
+
+static int open_tcp(const char *spec)
+{
+    char host[128];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || (size_t)(colon - spec) >= sizeof(host)) return -1;
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// A serial device or an existing pty, raw at 115200
+static int open_tty(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// A new pty: a reader simulator (or socat to real hardware) attaches to the printed path
+static int open_pty(int port)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    ESP_LOGI(TAG, "UART%d is pty %s", port, ptsname(fd));
+    return fd;
+}
+
+int uart_open(int port, int txd, int rxd, uart_rx_fn on_rx, void *ctx)
+{
+    if (port < 0 || port >= UART_HOST_PORTS) return -1;
+    uart_ctx_t *u = &s_uarts[port];
+    if (u->initialized) return 0;
+
+    char env[32];
+    snprintf(env, sizeof(env), HOST_UART_ENV "%d", port);
+    const char *spec = getenv(env);
+    int fd;
+    if (spec && strncmp(spec, "tcp:", 4) == 0) fd = open_tcp(spec + 4);
+    else if (spec && spec[0]) fd = open_tty(spec);
+    else fd = open_pty(port);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "UART%d: cannot open %s (errno %d)", port, spec ? spec : "a pty", errno);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    u->rx_buffer = (char*) malloc(BUF_SIZE);
+    if (!u->rx_buffer) {
+        close(fd);
+        return -1;
+    }
+    u->port = port;
+    u->fd = fd;
+    u->on_rx = on_rx;
+    u->ctx = ctx;
+    u->rx_buffer_len = 0;
+    u->initialized = true;
+    if (spec && spec[0]) ESP_LOGI(TAG, "UART%d on %s", port, spec);
+    return 0;
+}
+
+int uart_send_bytes(int port, const char *data, size_t len)
+{
+    if (data == NULL || len == 0) return -1;
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) {
+        ESP_LOGE(TAG, "UART%d not initialized, cannot send data", port);
+        return -1;
+    }
+
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = write(u->fd, data + sent, len - sent);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        } else {
+            ESP_LOGE(TAG, "UART%d write failed (errno %d)", port, errno);
+            return -1;
+        }
+    }
+    return (int)sent;
+}
+
+int uart_get_rx_data(int port, char *dest, int max_len)
+{
+    if (dest == NULL || max_len <= 0) return 0;
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) {
+        dest[0] = '\0';
+        return 0;
+    }
+    int to_copy = u->rx_buffer_len;
+    if (to_copy > max_len - 1) to_copy = max_len - 1;
+    if (to_copy > 0) memcpy(dest, u->rx_buffer, to_copy);
+    dest[to_copy > 0 ? to_copy : 0] = '\0';
+    u->rx_buffer_len = 0;
+    return to_copy;
+}
+
+static void hex_dump_append(uart_ctx_t *u, const uint8_t *buf, int len)
+{
+    if (u->rx_buffer_len + len * 3 + 10 >= BUF_SIZE - 100) {
+        u->rx_buffer_len = 0;
+        return;
+    }
+    char *write_pos = u->rx_buffer + u->rx_buffer_len;
+    for (int i = 0; i < len && i < 32; i++) write_pos += sprintf(write_pos, "%02X ", buf[i]);
+    if (len > 32) write_pos += sprintf(write_pos, "... ");
+    write_pos += sprintf(write_pos, "\n");
+    u->rx_buffer_len = write_pos - u->rx_buffer;
+}
+
+static void uart_rx_task(void *arg)
+{
+    uart_ctx_t *u = (uart_ctx_t *)arg;
+    uint8_t *dtmp = (uint8_t*) malloc(BUF_SIZE);
+    if (!dtmp) {
+        ESP_LOGE(TAG, "UART%d RX task: no memory for read buffer", u->port);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "UART%d RX task started and waiting for data...", u->port);
+
+    while (1) {
+        ssize_t len = read(u->fd, dtmp, BUF_SIZE);
+        if (len <= 0) {
+            // A pty reads EIO until the other side opens it; a closed socket reads 0
+            if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EIO)) {
+                metrics_inc(METRIC_UART_EVT_OTHER);
+                vTaskDelay(pdMS_TO_TICKS(100));
+            } else {
+                vTaskDelay(pdMS_TO_TICKS(RX_IDLE_MS));
+            }
+            continue;
+        }
+
+        uint32_t rx_us = latency_now_us();
+        metrics_inc(METRIC_UART_EVT_DATA);
+        metrics_add(METRIC_UART_RX_BYTES, (uint32_t)len);
+        metrics_observe(METRIC_HIST_UART_READ_BYTES, (uint32_t)len);
+        if (u->on_rx) u->on_rx(u->ctx, dtmp, (size_t)len, rx_us);
+        hex_dump_append(u, dtmp, (int)len);
+    }
+}
+
+int uart_start_rx_task(int port)
+{
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) return -1;
+
+    char name[16];
+    snprintf(name, sizeof(name), "uart_rx_%d", port);
+    if (xTaskCreate(uart_rx_task, name, 8192, u, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create %s", name);
+        return -1;
+    }
+    return 0;
+}
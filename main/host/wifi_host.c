@@ -0,0 +1,45 @@
+#include "wifi.h"
+#include "esp_log.h"
+
+static const char *TAG = "WIFI";
+
+// No WiFi on the host; the network comes from eth_host.c
+void wifi_init(void)
+{
+    ESP_LOGW(TAG, "WiFi is not available in the host build");
+}
+
+void wifi_connect_with_credentials(const char* ssid, const char* password)
+{
+    ESP_LOGW(TAG, "WiFi is not available in the host build");
+}
+
+void wifi_disconnect(void)
+{
+}
+
+bool wifi_is_connected(void)
+{
+    return false;
+}
+
+const char* wifi_get_status(void)
+{
+    return "not_initialized";
+}
+
+const char* wifi_get_connected_ssid(void)
+{
+    return "";
+}
+
+const char* wifi_get_ip_address(void)
+{
+    return "";
+}
+
+bool wifi_test_connection(const char* ssid, const char* password)
+{
+    ESP_LOGW(TAG, "WiFi test skipped: not available in the host build");
+    return false;
+}
@@ -0,0 +1,354 @@
+#include "json_tok.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Parser states between tokens
+typedef enum {
+    EXPECT_VALUE,   // Top level, after ':' or after '[' / ',' in an array
+    EXPECT_KEY,     // After '{' or ',' in an object
+    EXPECT_COLON,
+    EXPECT_NEXT,    // After a value inside a container: ',' or the closing bracket
+} parse_state_t;
+
+static int new_tok(json_doc_t *d, int max_toks, json_type_t type, size_t start)
+{
+    if (d->count >= max_toks) return JSON_ERR_NOMEM;
+    json_tok_t *t = &d->toks[d->count];
+    t->type = (uint8_t)type;
+    t->start = (uint16_t)start;
+    t->end = (uint16_t)start;
+    t->size = 0;
+    t->next = (uint16_t)(d->count + 1);
+    return d->count++;
+}
+
+// Closing quote of the string opening at js[pos]; JSON_ERR_PART if unterminated,
+// JSON_ERR_INVAL if malformed
+static long scan_string(const char *js, size_t len, size_t pos)
+{
+    for (size_t i = pos + 1; i < len; i++) {
+        unsigned char c = (unsigned char)js[i];
+        if (c == '"') return (long)i;
+        if (c < 0x20) return JSON_ERR_INVAL;
+        if (c != '\\') continue;
+        if (++i >= len) return JSON_ERR_PART;
+        switch (js[i]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            break;
+        case 'u':
+            if (i + 4 >= len) return JSON_ERR_PART;
+            for (int k = 1; k <= 4; k++) {
+                char h = js[i + k];
+                if (!((h >= '0' && h <= '9') || (h >= 'a' && h <= 'f') || (h >= 'A' && h <= 'F'))) return JSON_ERR_INVAL;
+            }
+            i += 4;
+            break;
+        default:
+            return JSON_ERR_INVAL;
+        }
+    }
+    return JSON_ERR_PART;
+}
+
+// Number, true, false or null starting at js[pos]; returns its end, -1 if malformed
+static long scan_primitive(const char *js, size_t len, size_t pos, json_type_t *type)
+{
+    size_t end = pos;
+    while (end < len && strchr(" \t\r\n,]}", js[end]) == NULL) end++;
+    size_t n = end - pos;
+
+    if (n == 4 && memcmp(js + pos, "true", 4) == 0) *type = JSON_BOOL;
+    else if (n == 5 && memcmp(js + pos, "false", 5) == 0) *type = JSON_BOOL;
+    else if (n == 4 && memcmp(js + pos, "null", 4) == 0) *type = JSON_NULL;
+    else {
+        // -?int(.digits)?([eE][+-]?digits)?
+        size_t i = pos;
+        if (i < end && js[i] == '-') i++;
+        if (i >= end || js[i] < '0' || js[i] > '9') return -1;
+        if (js[i] == '0') i++; else while (i < end && js[i] >= '0' && js[i] <= '9') i++;
+        if (i < end && js[i] == '.') {
+            if (++i >= end || js[i] < '0' || js[i] > '9') return -1;
+            while (i < end && js[i] >= '0' && js[i] <= '9') i++;
+        }
+        if (i < end && (js[i] == 'e' || js[i] == 'E')) {
+            if (++i < end && (js[i] == '+' || js[i] == '-')) i++;
+            if (i >= end || js[i] < '0' || js[i] > '9') return -1;
+            while (i < end && js[i] >= '0' && js[i] <= '9') i++;
+        }
+        if (i != end) return -1;
+        *type = JSON_NUMBER;
+    }
+    return (long)end;
+}
+
+int json_parse(json_doc_t *doc, const char *js, size_t len, json_tok_t *toks, int max_toks)
+{
+    doc->js = js;
+    doc->len = len;
+    doc->toks = toks;
+    doc->count = 0;
+    if (!js || !toks || len > JSON_MAX_LEN || max_toks > UINT16_MAX) return JSON_ERR_INVAL;
+
+    int stack[JSON_MAX_DEPTH];   // Open containers
+    int depth = 0;
+    parse_state_t state = EXPECT_VALUE;
+    bool empty_ok = false;       // Just after '{' or '[': the container may close at once
+    bool done = false;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        char c = js[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        if (done) return JSON_ERR_INVAL;   // Something after the top-level value
+
+        int parent = depth ? stack[depth - 1] : -1;
+        bool closes = (c == '}' || c == ']') &&
+                      (state == EXPECT_NEXT || (empty_ok && (state == EXPECT_KEY || state == EXPECT_VALUE)));
+        if (closes) {
+            if (parent < 0 || toks[parent].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY)) return JSON_ERR_INVAL;
+            toks[parent].end = (uint16_t)(pos + 1);
+            toks[parent].next = (uint16_t)doc->count;
+            depth--;
+            empty_ok = false;
+            state = EXPECT_NEXT;
+            if (depth == 0) done = true;
+            continue;
+        }
+
+        switch (state) {
+        case EXPECT_KEY: {
+            if (c != '"') return JSON_ERR_INVAL;
+            long q = scan_string(js, len, pos);
+            if (q < 0) return (int)q;
+            int t = new_tok(doc, max_toks, JSON_STRING, pos + 1);
+            if (t < 0) return t;
+            toks[t].end = (uint16_t)q;
+            toks[parent].size++;
+            pos = (size_t)q;
+            state = EXPECT_COLON;
+            break;
+        }
+        case EXPECT_COLON:
+            if (c != ':') return JSON_ERR_INVAL;
+            state = EXPECT_VALUE;
+            break;
+        case EXPECT_NEXT:
+            if (c != ',') return JSON_ERR_INVAL;
+            state = toks[parent].type == JSON_OBJECT ? EXPECT_KEY : EXPECT_VALUE;
+            break;
+        case EXPECT_VALUE: {
+            int t;
+            if (c == '{' || c == '[') {
+                if (depth >= JSON_MAX_DEPTH) return JSON_ERR_INVAL;
+                t = new_tok(doc, max_toks, c == '{' ? JSON_OBJECT : JSON_ARRAY, pos);
+                if (t < 0) return t;
+                if (parent >= 0 && toks[parent].type == JSON_ARRAY) toks[parent].size++;
+                stack[depth++] = t;
+                state = (c == '{') ? EXPECT_KEY : EXPECT_VALUE;
+                empty_ok = true;
+                continue;
+            }
+            if (c == '"') {
+                long q = scan_string(js, len, pos);
+                if (q < 0) return (int)q;
+                t = new_tok(doc, max_toks, JSON_STRING, pos + 1);
+                if (t < 0) return t;
+                toks[t].end = (uint16_t)q;
+                pos = (size_t)q;
+            } else {
+                json_type_t type;
+                long end = scan_primitive(js, len, pos, &type);
+                if (end < 0) return JSON_ERR_INVAL;
+                t = new_tok(doc, max_toks, type, pos);
+                if (t < 0) return t;
+                toks[t].end = (uint16_t)end;
+                pos = (size_t)end - 1;
+            }
+            if (parent >= 0 && toks[parent].type == JSON_ARRAY) toks[parent].size++;
+            if (depth == 0) done = true;
+            state = EXPECT_NEXT;
+            break;
+        }
+        }
+        empty_ok = false;
+    }
+    return done ? doc->count : JSON_ERR_PART;
+}
+
+static inline bool valid(const json_doc_t *doc, int i)
+{
+    return doc && i >= 0 && i < doc->count;
+}
+
+json_type_t json_type(const json_doc_t *doc, int i)
+{
+    return valid(doc, i) ? (json_type_t)doc->toks[i].type : JSON_NONE;
+}
+
+int json_size(const json_doc_t *doc, int i)
+{
+    return valid(doc, i) ? doc->toks[i].size : 0;
+}
+
+int json_obj_get(const json_doc_t *doc, int obj, const char *key)
+{
+    if (json_type(doc, obj) != JSON_OBJECT || !key) return -1;
+    int k = obj + 1;
+    for (int m = 0; m < doc->toks[obj].size; m++) {
+        if (json_str_eq(doc, k, key)) return k + 1;
+        k = doc->toks[k + 1].next;
+    }
+    return -1;
+}
+
+int json_array_get(const json_doc_t *doc, int arr, int n)
+{
+    if (json_type(doc, arr) != JSON_ARRAY || n < 0 || n >= doc->toks[arr].size) return -1;
+    int it = arr + 1;
+    while (n-- > 0) it = doc->toks[it].next;
+    return it;
+}
+
+static int hex4(const char *p)
+{
+    int v = 0;
+    for (int k = 0; k < 4; k++) {
+        char h = p[k];
+        v = (v << 4) | (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+    }
+    return v;
+}
+
+// Decodes the next character of a string token at js[*pos] (below end) into
+// UTF-8 bytes; returns the byte count
+static int next_char(const char *js, size_t *pos, size_t end, char out[4])
+{
+    size_t p = *pos;
+    if (js[p] != '\\') {
+        out[0] = js[p];
+        *pos = p + 1;
+        return 1;
+    }
+    char e = js[p + 1];
+    *pos = p + 2;
+    switch (e) {
+    case 'b': out[0] = '\b'; return 1;
+    case 'f': out[0] = '\f'; return 1;
+    case 'n': out[0] = '\n'; return 1;
+    case 'r': out[0] = '\r'; return 1;
+    case 't': out[0] = '\t'; return 1;
+    case 'u': break;
+    default:  out[0] = e; return 1;   // " \ /
+    }
+
+    uint32_t cp = (uint32_t)hex4(js + p + 2);
+    *pos = p + 6;
+    if (cp >= 0xD800 && cp < 0xDC00 && *pos + 6 <= end && js[*pos] == '\\' && js[*pos + 1] == 'u') {
+        uint32_t lo = (uint32_t)hex4(js + *pos + 2);
+        if (lo >= 0xDC00 && lo < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            *pos += 6;
+        }
+    }
+    if (cp >= 0xD800 && cp < 0xE000) cp = '?';   // Unpaired surrogate
+    if (cp < 0x80) { out[0] = (char)cp; return 1; }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+bool json_str_eq(const json_doc_t *doc, int i, const char *s)
+{
+    if (json_type(doc, i) != JSON_STRING || !s) return false;
+    const json_tok_t *t = &doc->toks[i];
+    size_t slen = strlen(s);
+    // Fast path: no escapes, so the raw bytes are the string
+    if (!memchr(doc->js + t->start, '\\', t->end - t->start)) {
+        return (size_t)(t->end - t->start) == slen && memcmp(doc->js + t->start, s, slen) == 0;
+    }
+    size_t pos = t->start, k = 0;
+    char ch[4];
+    while (pos < t->end) {
+        int n = next_char(doc->js, &pos, t->end, ch);
+        if (k + n > slen || memcmp(s + k, ch, n) != 0) return false;
+        k += n;
+    }
+    return k == slen;
+}
+
+int json_get_str(const json_doc_t *doc, int i, char *out, size_t out_len)
+{
+    if (json_type(doc, i) != JSON_STRING) return -1;
+    const json_tok_t *t = &doc->toks[i];
+    size_t pos = t->start, total = 0;
+    char ch[4];
+    while (pos < t->end) {
+        int n = next_char(doc->js, &pos, t->end, ch);
+        if (out && total + n < out_len) memcpy(out + total, ch, n);
+        else if (out && total < out_len) out_len = total + 1;   // Never split a character
+        total += n;
+    }
+    if (out && out_len) out[total < out_len ? total : out_len - 1] = '\0';
+    return (int)total;
+}
+
+bool json_get_double(const json_doc_t *doc, int i, double *out)
+{
+    if (json_type(doc, i) != JSON_NUMBER || !out) return false;
+    const json_tok_t *t = &doc->toks[i];
+    char num[40];
+    size_t n = t->end - t->start;
+    if (n >= sizeof(num)) return false;
+    memcpy(num, doc->js + t->start, n);
+    num[n] = '\0';
+    *out = strtod(num, NULL);
+    return true;
+}
+
+bool json_get_int(const json_doc_t *doc, int i, int *out)
+{
+    double d;
+    if (!out || !json_get_double(doc, i, &d)) return false;
+    if (d >= INT_MAX) *out = INT_MAX;
+    else if (d <= (double)INT_MIN) *out = INT_MIN;
+    else *out = (int)d;
+    return true;
+}
+
+bool json_get_bool(const json_doc_t *doc, int i, bool *out)
+{
+    if (json_type(doc, i) != JSON_BOOL || !out) return false;
+    *out = doc->js[doc->toks[i].start] == 't';
+    return true;
+}
+
+uint32_t json_extract(const json_doc_t *doc, int obj, const json_field_t *fields, int count)
+{
+    uint32_t found = 0;
+    for (int f = 0; f < count && f < 32; f++) {
+        int v = json_obj_get(doc, obj, fields[f].key);
+        bool ok = false;
+        switch (fields[f].type) {
+        case JSON_FIELD_INT:    ok = json_get_int(doc, v, (int *)fields[f].out); break;
+        case JSON_FIELD_DOUBLE: ok = json_get_double(doc, v, (double *)fields[f].out); break;
+        case JSON_FIELD_BOOL:   ok = json_get_bool(doc, v, (bool *)fields[f].out); break;
+        case JSON_FIELD_STR:    ok = json_get_str(doc, v, (char *)fields[f].out, fields[f].out_len) >= 0; break;
+        }
+        if (ok) found |= 1u << f;
+    }
+    return found;
+}
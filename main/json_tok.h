@@ -0,0 +1,90 @@
+/* json_tok.h - allocation-free JSON tokenizer for command payloads
+ *
+ * One pass over the payload fills a caller-supplied token array, jsmn style:
+ * tokens hold byte offsets into the payload, which need not be NUL terminated
+ * and is never copied or modified. Containers record their member count and
+ * the index after their subtree, so lookups skip whole values. Strings are
+ * unescaped only when copied out. No heap, no recursion. */
+#ifndef JSON_TOK_H
+#define JSON_TOK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_MAX_DEPTH 16
+#define JSON_MAX_LEN   UINT16_MAX   // Payload bytes a token offset can address
+
+// json_parse errors
+#define JSON_ERR_NOMEM (-1)   // More tokens than the array holds
+#define JSON_ERR_INVAL (-2)   // Not valid JSON (or nested deeper than JSON_MAX_DEPTH)
+#define JSON_ERR_PART  (-3)   // Ends before the top-level value is complete
+
+typedef enum {
+    JSON_NONE = 0,   // Missing (index < 0)
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL,
+} json_type_t;
+
+typedef struct {
+    uint8_t type;     // json_type_t
+    uint16_t start;   // Payload offsets; strings exclude the quotes
+    uint16_t end;
+    uint16_t size;    // Object: members, array: elements
+    uint16_t next;    // Index of the token after this value's subtree
+} json_tok_t;
+
+typedef struct {
+    const char *js;
+    size_t len;
+    json_tok_t *toks;
+    int count;
+} json_doc_t;
+
+// Tokenize js[0..len); returns the token count (the root is token 0) or a JSON_ERR_*
+int json_parse(json_doc_t *doc, const char *js, size_t len, json_tok_t *toks, int max_toks);
+
+// Every accessor accepts index -1 (missing) and then reports JSON_NONE / false / -1
+json_type_t json_type(const json_doc_t *doc, int i);
+int json_size(const json_doc_t *doc, int i);                    // Members or elements, 0 for scalars
+int json_obj_get(const json_doc_t *doc, int obj, const char *key);
+int json_array_get(const json_doc_t *doc, int arr, int n);
+static inline int json_next(const json_doc_t *doc, int i) { return doc->toks[i].next; }
+
+// Elements of an array, in order: JSON_ARRAY_FOR_EACH(doc, arr, it) { ... token it ... }
+#define JSON_ARRAY_FOR_EACH(doc, arr, it) \
+    for (int it##_left = json_type(doc, arr) == JSON_ARRAY ? json_size(doc, arr) : 0, it = (arr) + 1; \
+         it##_left > 0; it##_left--, it = json_next(doc, it))
+
+bool json_str_eq(const json_doc_t *doc, int i, const char *s);   // String token equal to s (after unescaping)
+// Unescaped string into out (truncated, always terminated); returns the full
+// length like snprintf, or -1 if the token is not a string
+int json_get_str(const json_doc_t *doc, int i, char *out, size_t out_len);
+bool json_get_double(const json_doc_t *doc, int i, double *out);
+bool json_get_int(const json_doc_t *doc, int i, int *out);       // Saturated like cJSON's valueint
+bool json_get_bool(const json_doc_t *doc, int i, bool *out);
+
+// Schema-driven extraction of an object's members: each field whose key is
+// present with the right type is stored through `out`.
+typedef enum {
+    JSON_FIELD_INT = 0,   // int *
+    JSON_FIELD_DOUBLE,    // double *
+    JSON_FIELD_BOOL,      // bool *
+    JSON_FIELD_STR,       // char[out_len], truncated
+} json_field_type_t;
+
+typedef struct {
+    const char *key;
+    json_field_type_t type;
+    void *out;
+    size_t out_len;
+} json_field_t;
+
+// Returns a bit per field found (bit k = fields[k]); up to 32 fields
+uint32_t json_extract(const json_doc_t *doc, int obj, const json_field_t *fields, int count);
+
+#endif // JSON_TOK_H
@@ -0,0 +1,175 @@
+#include "latency.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+
+static const char *TAG = "LATENCY";
+
+// Values below 8 us get one bucket each; above that every power of two is
+// split into 4. Anything over 2^27 us (~134 s) lands in the last bucket.
+#define LATENCY_LINEAR   8
+#define LATENCY_SUB_BITS 2
+#define LATENCY_MAX_EXP  26
+#define LATENCY_BUCKETS  (LATENCY_LINEAR + (LATENCY_MAX_EXP - 2) * (1 << LATENCY_SUB_BITS))
+
+// JSON key and Prometheus stage label
+static const char *s_stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_UART_TO_PARSE]  = "uart_to_parse",
+    [LATENCY_PARSE_TO_STORE] = "parse_to_store",
+    [LATENCY_STORE_TO_BATCH] = "store_to_batch",
+    [LATENCY_QUEUE_TO_SEND]  = "queue_to_send",
+    [LATENCY_SEND_TO_ACK]    = "send_to_ack",
+    [LATENCY_READ_TO_ACK]    = "read_to_ack",
+    [LATENCY_READ_TO_STREAM] = "read_to_stream",
+    [LATENCY_READ_TO_LLRP]   = "read_to_llrp",
+};
+
+static _Atomic uint32_t s_counts[LATENCY_STAGE_COUNT][LATENCY_BUCKETS];
+static _Atomic uint64_t s_sum_us[LATENCY_STAGE_COUNT];
+static _Atomic uint32_t s_max_us[LATENCY_STAGE_COUNT];
+static volatile bool s_trace = false;
+
+static const struct {
+    uint32_t permille;
+    const char *label;
+} s_quantiles[] = { { 500, "0.5" }, { 950, "0.95" }, { 990, "0.99" } };
+
+static int bucket_of(uint32_t us)
+{
+    if (us < LATENCY_LINEAR) return (int)us;
+    int exp = 31 - __builtin_clz(us);
+    if (exp > LATENCY_MAX_EXP) return LATENCY_BUCKETS - 1;
+    int sub = (us >> (exp - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+    return LATENCY_LINEAR + (exp - 3) * (1 << LATENCY_SUB_BITS) + sub;
+}
+
+static uint32_t bucket_upper(int b)
+{
+    if (b < LATENCY_LINEAR) return (uint32_t)b;
+    int exp = 3 + (b - LATENCY_LINEAR) / (1 << LATENCY_SUB_BITS);
+    int sub = (b - LATENCY_LINEAR) % (1 << LATENCY_SUB_BITS);
+    return ((uint32_t)((1 << LATENCY_SUB_BITS) + sub + 1) << (exp - LATENCY_SUB_BITS)) - 1;
+}
+
+void latency_record(latency_stage_t stage, uint32_t from_us, uint32_t to_us)
+{
+    if (stage >= LATENCY_STAGE_COUNT || from_us == 0) return;
+
+    uint32_t us = to_us - from_us;
+    if (us > 0x80000000u) return;   // to_us taken before from_us (racing update)
+
+    atomic_fetch_add_explicit(&s_counts[stage][bucket_of(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_sum_us[stage], us, memory_order_relaxed);
+    uint32_t max = atomic_load_explicit(&s_max_us[stage], memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&s_max_us[stage], &max, us,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Copy a stage's buckets; returns the sample count
+static uint32_t snapshot(latency_stage_t stage, uint32_t *counts)
+{
+    uint32_t total = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        counts[b] = atomic_load_explicit(&s_counts[stage][b], memory_order_relaxed);
+        total += counts[b];
+    }
+    return total;
+}
+
+static uint32_t percentile_of(const uint32_t *counts, uint32_t total, uint32_t permille)
+{
+    if (total == 0) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)total * permille + 999) / 1000);
+    if (target == 0) target = 1;
+
+    uint32_t cumulative = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        cumulative += counts[b];
+        if (cumulative >= target) return bucket_upper(b);
+    }
+    return bucket_upper(LATENCY_BUCKETS - 1);
+}
+
+uint32_t latency_percentile_us(latency_stage_t stage, uint32_t permille)
+{
+    if (stage >= LATENCY_STAGE_COUNT) return 0;
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t total = snapshot(stage, counts);
+    return percentile_of(counts, total, permille);
+}
+
+void latency_reset(void)
+{
+    for (int s = 0; s < LATENCY_STAGE_COUNT; s++) {
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            atomic_store_explicit(&s_counts[s][b], 0, memory_order_relaxed);
+        }
+        atomic_store_explicit(&s_sum_us[s], 0, memory_order_relaxed);
+        atomic_store_explicit(&s_max_us[s], 0, memory_order_relaxed);
+    }
+    ESP_LOGI(TAG, "Latency histograms reset");
+}
+
+void latency_set_trace(bool enabled)
+{
+    if (s_trace != enabled) ESP_LOGI(TAG, "Payload tracing %s", enabled ? "enabled" : "disabled");
+    s_trace = enabled;
+}
+
+bool latency_trace_enabled(void)
+{
+    return s_trace;
+}
+
+int latency_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    uint32_t counts[LATENCY_BUCKETS];
+    int n = snprintf(out, out_len, "{\"trace\":%s,\"stages\":{", s_trace ? "true" : "false");
+    for (int s = 0; s < LATENCY_STAGE_COUNT && n < out_len; s++) {
+        uint32_t total = snapshot(s, counts);
+        uint64_t sum = atomic_load_explicit(&s_sum_us[s], memory_order_relaxed);
+        n += snprintf(out + n, out_len - n,
+                      "%s\"%s\":{\"count\":%lu,\"avg_us\":%lu,\"p50_us\":%lu,\"p95_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu}",
+                      s ? "," : "", s_stage_names[s], (unsigned long)total,
+                      (unsigned long)(total ? sum / total : 0),
+                      (unsigned long)percentile_of(counts, total, 500),
+                      (unsigned long)percentile_of(counts, total, 950),
+                      (unsigned long)percentile_of(counts, total, 990),
+                      (unsigned long)atomic_load_explicit(&s_max_us[s], memory_order_relaxed));
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "}}");
+    return (n < out_len) ? n : out_len - 1;
+}
+
+int latency_render_prometheus(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    static const char *name = "reader_latency_seconds";
+    uint32_t counts[LATENCY_BUCKETS];
+    int n = snprintf(out, out_len,
+                     "# HELP %s Tag read latency per pipeline stage (quantiles are bucket upper bounds)\n"
+                     "# TYPE %s summary\n", name, name);
+    for (int s = 0; s < LATENCY_STAGE_COUNT && n < out_len; s++) {
+        uint32_t total = snapshot(s, counts);
+        for (size_t q = 0; q < sizeof(s_quantiles) / sizeof(s_quantiles[0]) && n < out_len; q++) {
+            uint32_t us = percentile_of(counts, total, s_quantiles[q].permille);
+            n += snprintf(out + n, out_len - n, "%s{stage=\"%s\",quantile=\"%s\"} %lu.%06lu\n",
+                          name, s_stage_names[s], s_quantiles[q].label,
+                          (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+        }
+        uint64_t sum = atomic_load_explicit(&s_sum_us[s], memory_order_relaxed);
+        if (n < out_len) {
+            n += snprintf(out + n, out_len - n,
+                          "%s_sum{stage=\"%s\"} %llu.%06llu\n%s_count{stage=\"%s\"} %lu\n",
+                          name, s_stage_names[s], (unsigned long long)(sum / 1000000),
+                          (unsigned long long)(sum % 1000000), name, s_stage_names[s], (unsigned long)total);
+        }
+    }
+    return (n < out_len) ? n : out_len - 1;
+}
@@ -0,0 +1,49 @@
+/* latency.h - per-stage latency of a tag read from UART arrival to PUBACK
+ *
+ * A read is stamped when its UART_DATA event is handled and the stamp travels
+ * with the tag through parse, tag-store update, batch build, the offline queue
+ * and the esp-mqtt publish. Each hop is recorded into a log-linear histogram
+ * (4 sub-buckets per power of two, so within 25%) and p50/p95/p99 are read
+ * without storing samples. Timestamps are esp_timer microseconds truncated to
+ * 32 bits; differences stay correct across the 71 minute wrap. */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_timer.h"
+
+typedef enum {
+    LATENCY_UART_TO_PARSE = 0,   // UART_DATA event -> tag decoded
+    LATENCY_PARSE_TO_STORE,      // Tag decoded -> tag table updated
+    LATENCY_STORE_TO_BATCH,      // Oldest unbatched read of a tag -> written to a batch
+    LATENCY_QUEUE_TO_SEND,       // Batch queued -> handed to esp-mqtt (first send only)
+    LATENCY_SEND_TO_ACK,         // Handed to esp-mqtt -> MQTT_EVENT_PUBLISHED (PUBACK)
+    LATENCY_READ_TO_ACK,         // Oldest read in the message -> PUBACK (end to end)
+    LATENCY_READ_TO_STREAM,      // UART_DATA event -> frame written to a LAN stream socket
+    LATENCY_READ_TO_LLRP,        // UART_DATA event -> RO_ACCESS_REPORT written to the LLRP client
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+static inline uint32_t latency_now_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+// Record to_us - from_us for a stage; from_us == 0 means "not traced" and is ignored
+void latency_record(latency_stage_t stage, uint32_t from_us, uint32_t to_us);
+
+// Upper bound of the bucket holding the given percentile (permille, e.g. 990 = p99)
+uint32_t latency_percentile_us(latency_stage_t stage, uint32_t permille);
+void latency_reset(void);
+
+// Debug mode: batches carry a "trace" object with the stamps of their oldest read
+void latency_set_trace(bool enabled);
+bool latency_trace_enabled(void);
+
+#define LATENCY_JSON_MAX 1408
+int latency_get_json(char *out, int out_len);
+// Prometheus summaries (quantile label), appended to GET /metrics
+int latency_render_prometheus(char *out, int out_len);
+
+#endif // LATENCY_H
@@ -0,0 +1,1315 @@
+#include "llrp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "host/host.h"
+#else
+#include "esp_mac.h"
+#endif
+#include "lwip/sockets.h"
+#include "nvs.h"
+#include "rfid.h"
+#include "latency.h"
+
+static const char *TAG = "LLRP";
+static const char *NVS_NAMESPACE = "llrp";
+
+#define LLRP_VERSION       1
+#define LLRP_MAX_ANTENNAS  (RFID_MAX_READERS * 4)
+#define LLRP_EPC_MAX       32
+#define LLRP_QUEUE_LEN     128
+#define LLRP_REPORT_MAX    64      // Pending TagReportData entries; a full table is reported
+#define LLRP_RX_MAX        4096    // Largest message accepted from the client
+#define LLRP_TX_MAX        6144    // Fits a report of LLRP_REPORT_MAX entries
+#define LLRP_ROSPEC_RAW    512     // ADD_ROSPEC body kept for GET_ROSPECS
+#define LLRP_POLL_MS       20      // Socket polling while no read arrives
+#define LLRP_KEEPALIVE_MISSES 3    // Unacked keepalives before the client is dropped
+#define LLRP_POWER_MAX_DBM 33      // Power table: index dBm + 1
+
+// Message types
+#define MSG_GET_READER_CAPABILITIES 1
+#define MSG_GET_READER_CONFIG       2
+#define MSG_SET_READER_CONFIG       3
+#define MSG_CLOSE_CONNECTION_RESP   4
+#define MSG_GET_READER_CAPS_RESP    11
+#define MSG_GET_READER_CONFIG_RESP  12
+#define MSG_SET_READER_CONFIG_RESP  13
+#define MSG_CLOSE_CONNECTION        14
+#define MSG_ADD_ROSPEC              20
+#define MSG_DELETE_ROSPEC           21
+#define MSG_START_ROSPEC            22
+#define MSG_STOP_ROSPEC             23
+#define MSG_ENABLE_ROSPEC           24
+#define MSG_DISABLE_ROSPEC          25
+#define MSG_GET_ROSPECS             26
+#define MSG_ADD_ACCESSSPEC          40
+#define MSG_DELETE_ACCESSSPEC       41
+#define MSG_ENABLE_ACCESSSPEC       42
+#define MSG_DISABLE_ACCESSSPEC      43
+#define MSG_GET_ACCESSSPECS         44
+#define MSG_GET_REPORT              60
+#define MSG_RO_ACCESS_REPORT        61
+#define MSG_KEEPALIVE               62
+#define MSG_READER_EVENT            63
+#define MSG_ENABLE_EVENTS_REPORTS   64
+#define MSG_KEEPALIVE_ACK           72
+#define MSG_ERROR_MESSAGE           100
+#define MSG_RESPONSE_OFFSET         10   // Request type + 10 (CLOSE_CONNECTION excepted)
+
+// Parameter types
+#define P_UPTIME                    129
+#define P_GENERAL_DEVICE_CAPS       137
+#define P_RECEIVE_SENSITIVITY       139
+#define P_PER_ANTENNA_PROTOCOL      140
+#define P_GPIO_CAPS                 141
+#define P_LLRP_CAPS                 142
+#define P_REGULATORY_CAPS           143
+#define P_UHF_BAND_CAPS             144
+#define P_TX_POWER_ENTRY            145
+#define P_FREQUENCY_INFO            146
+#define P_FREQUENCY_HOP_TABLE       147
+#define P_ROSPEC                    177
+#define P_RO_BOUNDARY_SPEC          178
+#define P_ROSPEC_START_TRIGGER      179
+#define P_ROSPEC_STOP_TRIGGER       182
+#define P_AISPEC                    183
+#define P_AISPEC_STOP_TRIGGER       184
+#define P_INVENTORY_PARAM_SPEC      186
+#define P_LLRP_CONFIG_STATE         217
+#define P_IDENTIFICATION            218
+#define P_KEEPALIVE_SPEC            220
+#define P_ANTENNA_PROPERTIES        221
+#define P_ANTENNA_CONFIGURATION     222
+#define P_RF_TRANSMITTER            224
+#define P_EVENTS_AND_REPORTS        226
+#define P_RO_REPORT_SPEC            237
+#define P_TAG_REPORT_CONTENT        238
+#define P_ACCESS_REPORT_SPEC        239
+#define P_TAG_REPORT_DATA           240
+#define P_EPC_DATA                  241
+#define P_READER_EVENT_DATA         246
+#define P_CONNECTION_ATTEMPT        256
+#define P_LLRP_STATUS               287
+#define P_C1G2_LLRP_CAPS            327
+#define P_C1G2_RF_MODE_TABLE        328
+#define P_C1G2_RF_MODE_ENTRY        329
+
+// TV parameters in TagReportData
+#define TV_ANTENNA_ID               1
+#define TV_FIRST_SEEN_UPTIME        3
+#define TV_LAST_SEEN_UPTIME         5
+#define TV_PEAK_RSSI                6
+#define TV_CHANNEL_INDEX            7
+#define TV_TAG_SEEN_COUNT           8
+#define TV_ROSPEC_ID                9
+#define TV_INV_PARAM_SPEC_ID        10
+#define TV_EPC96                    13
+#define TV_SPEC_INDEX               14
+#define TV_ACCESSSPEC_ID            16
+
+// LLRPStatus codes
+#define ST_SUCCESS                  0
+#define ST_M_FIELD_ERROR            101
+#define ST_M_MISSING_PARAMETER      103
+#define ST_M_UNSUPPORTED_MESSAGE    109
+#define ST_M_UNSUPPORTED_VERSION    110
+#define ST_P_FIELD_ERROR            201
+#define ST_P_UNSUPPORTED_PARAMETER  209
+#define ST_A_INVALID                300
+#define ST_A_OUT_OF_RANGE           301
+
+// ConnectionAttemptEvent status
+#define CONN_SUCCESS                0
+#define CONN_CLIENT_EXISTS          2
+
+// TagReportContentSelector flags
+#define SEL_ROSPEC_ID               0x8000
+#define SEL_SPEC_INDEX              0x4000
+#define SEL_INV_PARAM_SPEC_ID       0x2000
+#define SEL_ANTENNA_ID              0x1000
+#define SEL_CHANNEL_INDEX           0x0800
+#define SEL_PEAK_RSSI               0x0400
+#define SEL_FIRST_SEEN              0x0200
+#define SEL_LAST_SEEN               0x0100
+#define SEL_TAG_SEEN_COUNT          0x0080
+#define SEL_ACCESSSPEC_ID           0x0040
+
+typedef enum { ROSPEC_DISABLED = 0, ROSPEC_INACTIVE = 1, ROSPEC_ACTIVE = 2 } rospec_state_t;
+
+// ROReportTrigger: 0 = only on GET_REPORT, 1 / 2 = every N tags and at the end
+typedef struct {
+    uint8_t trigger;
+    uint16_t n;
+    uint16_t content;
+} report_spec_t;
+
+typedef struct {
+    bool present;
+    uint32_t id;
+    uint8_t priority;
+    rospec_state_t state;
+    bool start_immediate;       // Start as soon as it is enabled
+    uint32_t duration_ms;       // 0 = until STOP_ROSPEC
+    uint32_t ant_mask;          // Bit (id - 1) per LLRP antenna
+    uint16_t inv_param_id;
+    int8_t power[LLRP_MAX_ANTENNAS];   // dBm from InventoryParameterSpec; -1 = leave as is
+    report_spec_t report;
+    uint64_t started_us;
+    uint16_t raw_len;
+    uint8_t raw[LLRP_ROSPEC_RAW];
+} rospec_t;
+
+typedef struct {
+    uint8_t antenna;            // LLRP antenna ID
+    uint8_t len;
+    int8_t rssi;
+    uint32_t rx_us;
+    uint64_t seen_us;
+    uint8_t epc[LLRP_EPC_MAX];
+} llrp_read_t;
+
+typedef struct {
+    uint8_t antenna;
+    uint8_t len;
+    int8_t peak_rssi;
+    uint16_t count;
+    uint32_t first_rx_us;
+    uint64_t first_us, last_us;
+    uint8_t epc[LLRP_EPC_MAX];
+} report_entry_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap, len;
+    bool overflow;
+} llrp_buf_t;
+
+typedef struct {
+    uint16_t type;
+    const uint8_t *body;
+    size_t len;
+} llrp_param_t;
+
+static const report_spec_t s_factory_report = {
+    .trigger = 2, .n = 1,
+    .content = SEL_ROSPEC_ID | SEL_ANTENNA_ID | SEL_PEAK_RSSI | SEL_FIRST_SEEN | SEL_LAST_SEEN | SEL_TAG_SEEN_COUNT,
+};
+
+static uint16_t s_port = LLRP_DEFAULT_PORT;
+static volatile uint32_t s_port_gen = 0;
+static TaskHandle_t s_task = NULL;
+static QueueHandle_t s_queue = NULL;
+
+// Owned by the LLRP task; llrp_get_json only reads scalars
+static int s_client = -1;
+static char s_peer[24];
+static rospec_t s_rospec;
+static report_spec_t s_default_report;
+static uint32_t s_keepalive_ms = 0;
+static uint32_t s_keepalive_missed = 0;
+static uint64_t s_keepalive_at_us = 0;
+static uint32_t s_msg_id = 0;
+static report_entry_t s_pending[LLRP_REPORT_MAX];
+static int s_pending_count = 0;
+static uint8_t *s_rx = NULL;
+static size_t s_rx_len = 0;
+static uint8_t *s_tx = NULL;
+
+// Read by the RX tasks
+static volatile bool s_reporting = false;
+static volatile uint32_t s_report_mask = 0;
+static _Atomic uint32_t s_queue_drops = 0;
+static uint32_t s_reports = 0;
+static uint32_t s_tags_reported = 0;
+
+static inline uint64_t now_us(void)
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+static uint16_t get_be16(const uint8_t *p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t get_be32(const uint8_t *p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+// ---- Encoding ----
+
+static void put_bytes(llrp_buf_t *b, const void *data, size_t n)
+{
+    if (n == 0) return;
+    if (b->len + n > b->cap) {
+        b->overflow = true;
+        return;
+    }
+    memcpy(b->buf + b->len, data, n);
+    b->len += n;
+}
+
+static void put_u8(llrp_buf_t *b, uint8_t v) { put_bytes(b, &v, 1); }
+static void put_u16(llrp_buf_t *b, uint16_t v) { uint8_t p[2] = { v >> 8, (uint8_t)v }; put_bytes(b, p, 2); }
+static void put_u32(llrp_buf_t *b, uint32_t v) { uint8_t p[4] = { v >> 24, v >> 16, v >> 8, (uint8_t)v }; put_bytes(b, p, 4); }
+static void put_u64(llrp_buf_t *b, uint64_t v) { put_u32(b, (uint32_t)(v >> 32)); put_u32(b, (uint32_t)v); }
+
+static void patch_u16(llrp_buf_t *b, size_t off, uint16_t v) { b->buf[off] = v >> 8; b->buf[off + 1] = (uint8_t)v; }
+static void patch_u32(llrp_buf_t *b, size_t off, uint32_t v)
+{
+    b->buf[off] = v >> 24; b->buf[off + 1] = v >> 16; b->buf[off + 2] = v >> 8; b->buf[off + 3] = (uint8_t)v;
+}
+
+// TLV parameter: returns its offset for tlv_end() to fill in the length
+static size_t tlv_begin(llrp_buf_t *b, uint16_t type)
+{
+    size_t off = b->len;
+    put_u16(b, type & 0x3FF);
+    put_u16(b, 0);
+    return off;
+}
+
+static void tlv_end(llrp_buf_t *b, size_t off)
+{
+    if (!b->overflow) patch_u16(b, off + 2, (uint16_t)(b->len - off));
+}
+
+static void put_tv(llrp_buf_t *b, uint8_t type) { put_u8(b, 0x80 | type); }
+
+static void msg_begin(llrp_buf_t *b, uint16_t type, uint32_t id)
+{
+    b->len = 0;
+    b->overflow = false;
+    put_u16(b, (LLRP_VERSION << 10) | (type & 0x3FF));
+    put_u32(b, 0);
+    put_u32(b, id);
+}
+
+static void msg_end(llrp_buf_t *b)
+{
+    if (!b->overflow) patch_u32(b, 2, (uint32_t)b->len);
+}
+
+static void put_status(llrp_buf_t *b, uint16_t code, const char *desc)
+{
+    size_t off = tlv_begin(b, P_LLRP_STATUS);
+    size_t n = desc ? strlen(desc) : 0;
+    put_u16(b, code);
+    put_u16(b, (uint16_t)n);
+    put_bytes(b, desc, n);
+    tlv_end(b, off);
+}
+
+static bool client_send(const llrp_buf_t *b)
+{
+    if (s_client < 0 || b->overflow) return false;
+    size_t sent = 0;
+    while (sent < b->len) {
+        int ret = send(s_client, b->buf + sent, b->len - sent, 0);
+        if (ret <= 0) return false;
+        sent += (size_t)ret;
+    }
+    return true;
+}
+
+// ---- Decoding ----
+
+static size_t tv_length(uint8_t type)
+{
+    switch (type) {
+    case 1: case 7: case 8: case 10: case 11: case 12: case 14: case 15: case 17: return 2;
+    case 2: case 3: case 4: case 5: return 8;
+    case 6: return 1;
+    case 9: case 16: case 18: return 4;
+    case 13: return 12;
+    default: return 0;
+    }
+}
+
+// Next parameter in [*p, end): 1 = found, 0 = end, -1 = malformed
+static int next_param(const uint8_t **p, const uint8_t *end, llrp_param_t *out)
+{
+    if (*p >= end) return 0;
+    const uint8_t *q = *p;
+    if (q[0] & 0x80) {
+        size_t n = tv_length(q[0] & 0x7F);
+        if (n == 0 || (size_t)(end - q) < 1 + n) return -1;
+        out->type = q[0] & 0x7F;
+        out->body = q + 1;
+        out->len = n;
+        *p = q + 1 + n;
+        return 1;
+    }
+    if (end - q < 4) return -1;
+    uint16_t len = get_be16(q + 2);
+    if (len < 4 || len > end - q) return -1;
+    out->type = get_be16(q) & 0x3FF;
+    out->body = q + 4;
+    out->len = len - 4;
+    *p = q + len;
+    return 1;
+}
+
+// ---- Antennas and power ----
+
+static int antenna_count(void)
+{
+    return rfid_reader_count() * 4;
+}
+
+static int antenna_power(int id)
+{
+    int p[4];
+    if (!rfid_get_power((id - 1) / 4, &p[0], &p[1], &p[2], &p[3])) return 0;
+    return p[(id - 1) % 4];
+}
+
+// Antenna 0 = every antenna
+static void set_antenna_power(int id, int dbm)
+{
+    for (int reader = 0; reader < rfid_reader_count(); reader++) {
+        int p[4];
+        bool changed = false;
+        if (!rfid_get_power(reader, &p[0], &p[1], &p[2], &p[3])) continue;
+        for (int a = 0; a < 4; a++) {
+            if ((id == 0 || id == reader * 4 + a + 1) && p[a] != dbm) {
+                p[a] = dbm;
+                changed = true;
+            }
+        }
+        if (changed) rfid_set_power(reader, p[0], p[1], p[2], p[3]);
+    }
+}
+
+// AntennaConfiguration: only RFTransmitter's power index is applied.
+// Returns the status code; *id and *dbm receive the request.
+static uint16_t parse_antenna_config(const llrp_param_t *ac, int *id, int *dbm)
+{
+    *dbm = -1;
+    if (ac->len < 2) return ST_P_FIELD_ERROR;
+    *id = get_be16(ac->body);
+    if (*id > antenna_count()) return ST_A_OUT_OF_RANGE;
+
+    const uint8_t *p = ac->body + 2, *end = ac->body + ac->len;
+    llrp_param_t sub;
+    int r;
+    while ((r = next_param(&p, end, &sub)) == 1) {
+        if (sub.type != P_RF_TRANSMITTER) continue;   // Receiver, C1G2 inventory settings
+        if (sub.len < 6) return ST_P_FIELD_ERROR;
+        int index = get_be16(sub.body + 4);
+        if (index < 1 || index > LLRP_POWER_MAX_DBM + 1) return ST_A_OUT_OF_RANGE;
+        *dbm = index - 1;
+    }
+    return r < 0 ? ST_P_FIELD_ERROR : ST_SUCCESS;
+}
+
+// ---- ROSpec ----
+
+static uint16_t parse_report_spec(const llrp_param_t *rs, report_spec_t *out)
+{
+    if (rs->len < 3) return ST_P_FIELD_ERROR;
+    out->trigger = rs->body[0];
+    out->n = get_be16(rs->body + 1);
+    out->content = s_factory_report.content;
+    if (out->trigger > 2) return ST_P_UNSUPPORTED_PARAMETER;
+
+    const uint8_t *p = rs->body + 3, *end = rs->body + rs->len;
+    llrp_param_t sub;
+    int r;
+    while ((r = next_param(&p, end, &sub)) == 1) {
+        if (sub.type == P_TAG_REPORT_CONTENT && sub.len >= 2) out->content = get_be16(sub.body);
+    }
+    return r < 0 ? ST_P_FIELD_ERROR : ST_SUCCESS;
+}
+
+static uint16_t parse_boundary(const llrp_param_t *bs, rospec_t *rs, const char **why)
+{
+    const uint8_t *p = bs->body, *end = bs->body + bs->len;
+    llrp_param_t sub;
+    int r;
+    while ((r = next_param(&p, end, &sub)) == 1) {
+        if (sub.type == P_ROSPEC_START_TRIGGER && sub.len >= 1) {
+            if (sub.body[0] > 1) {
+                *why = "Periodic and GPI start triggers are not supported";
+                return ST_P_UNSUPPORTED_PARAMETER;
+            }
+            rs->start_immediate = sub.body[0] == 1;
+        } else if (sub.type == P_ROSPEC_STOP_TRIGGER && sub.len >= 5) {
+            if (sub.body[0] > 1) {
+                *why = "GPI stop triggers are not supported";
+                return ST_P_UNSUPPORTED_PARAMETER;
+            }
+            rs->duration_ms = sub.body[0] == 1 ? get_be32(sub.body + 1) : 0;
+        }
+    }
+    return r < 0 ? ST_P_FIELD_ERROR : ST_SUCCESS;
+}
+
+// One AISpec: antennas, stop trigger and InventoryParameterSpec power
+static uint16_t parse_aispec(const llrp_param_t *ai, rospec_t *rs, uint32_t *duration_ms, const char **why)
+{
+    if (ai->len < 2) return ST_P_FIELD_ERROR;
+    uint16_t count = get_be16(ai->body);
+    if (ai->len < 2u + 2u * count) return ST_P_FIELD_ERROR;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t id = get_be16(ai->body + 2 + 2 * i);
+        if (id == 0) {
+            rs->ant_mask = (1u << LLRP_MAX_ANTENNAS) - 1;
+        } else if (id <= antenna_count()) {
+            rs->ant_mask |= 1u << (id - 1);
+        } else {
+            *why = "Unknown antenna";
+            return ST_A_OUT_OF_RANGE;
+        }
+    }
+
+    const uint8_t *p = ai->body + 2 + 2 * count, *end = ai->body + ai->len;
+    llrp_param_t sub;
+    int r;
+    *duration_ms = 0;
+    while ((r = next_param(&p, end, &sub)) == 1) {
+        if (sub.type == P_AISPEC_STOP_TRIGGER && sub.len >= 5) {
+            if (sub.body[0] > 1) {
+                *why = "Only null and duration AISpec stop triggers are supported";
+                return ST_P_UNSUPPORTED_PARAMETER;
+            }
+            *duration_ms = sub.body[0] == 1 ? get_be32(sub.body + 1) : 0;
+        } else if (sub.type == P_INVENTORY_PARAM_SPEC && sub.len >= 3) {
+            if (rs->inv_param_id == 0) rs->inv_param_id = get_be16(sub.body);
+            const uint8_t *q = sub.body + 3, *qend = sub.body + sub.len;
+            llrp_param_t ac;
+            int r2;
+            while ((r2 = next_param(&q, qend, &ac)) == 1) {
+                if (ac.type != P_ANTENNA_CONFIGURATION) continue;
+                int id, dbm;
+                uint16_t st = parse_antenna_config(&ac, &id, &dbm);
+                if (st != ST_SUCCESS) return st;
+                if (dbm < 0) continue;
+                for (int a = 0; a < LLRP_MAX_ANTENNAS; a++) {
+                    if (id == 0 || id == a + 1) rs->power[a] = (int8_t)dbm;
+                }
+            }
+            if (r2 < 0) return ST_P_FIELD_ERROR;
+        }
+    }
+    return r < 0 ? ST_P_FIELD_ERROR : ST_SUCCESS;
+}
+
+static uint16_t parse_rospec(const uint8_t *body, size_t len, rospec_t *rs, const char **why)
+{
+    const uint8_t *p = body, *end = body + len;
+    llrp_param_t spec;
+    if (next_param(&p, end, &spec) != 1 || spec.type != P_ROSPEC || spec.len < 6) {
+        *why = "ROSpec expected";
+        return ST_M_MISSING_PARAMETER;
+    }
+    if (spec.len + 4 > sizeof(rs->raw)) {
+        *why = "ROSpec too large";
+        return ST_A_OUT_OF_RANGE;
+    }
+
+    memset(rs, 0, sizeof(*rs));
+    memset(rs->power, -1, sizeof(rs->power));
+    rs->id = get_be32(spec.body);
+    rs->priority = spec.body[4];
+    rs->report = s_default_report;
+    if (rs->id == 0) {
+        *why = "ROSpecID 0 is reserved";
+        return ST_A_INVALID;
+    }
+    if (spec.body[5] != ROSPEC_DISABLED) {
+        *why = "A new ROSpec must be Disabled";
+        return ST_A_INVALID;
+    }
+
+    const uint8_t *q = spec.body + 6, *qend = spec.body + spec.len;
+    llrp_param_t sub;
+    int r, aispecs = 0;
+    bool all_timed = true;
+    uint32_t ai_total_ms = 0;
+    while ((r = next_param(&q, qend, &sub)) == 1) {
+        uint16_t st = ST_SUCCESS;
+        if (sub.type == P_RO_BOUNDARY_SPEC) {
+            st = parse_boundary(&sub, rs, why);
+        } else if (sub.type == P_AISPEC) {
+            uint32_t ms;
+            st = parse_aispec(&sub, rs, &ms, why);
+            aispecs++;
+            if (ms == 0) all_timed = false;
+            ai_total_ms += ms;
+        } else if (sub.type == P_RO_REPORT_SPEC) {
+            st = parse_report_spec(&sub, &rs->report);
+        } else {
+            *why = "Only AISpecs are supported";
+            st = ST_P_UNSUPPORTED_PARAMETER;
+        }
+        if (st != ST_SUCCESS) return st;
+    }
+    if (r < 0) return ST_P_FIELD_ERROR;
+    if (aispecs == 0) {
+        *why = "AISpec missing";
+        return ST_M_MISSING_PARAMETER;
+    }
+    // AISpecs run back to back: the ROSpec ends with the last timed one
+    if (rs->duration_ms == 0 && all_timed) rs->duration_ms = ai_total_ms;
+    if (rs->inv_param_id == 0) rs->inv_param_id = 1;
+
+    rs->present = true;
+    rs->state = ROSPEC_DISABLED;
+    rs->raw_len = (uint16_t)(spec.len + 4);
+    memcpy(rs->raw, body, rs->raw_len);
+    return ST_SUCCESS;
+}
+
+// Readers behind the ROSpec's antennas
+static uint32_t rospec_readers(const rospec_t *rs)
+{
+    uint32_t readers = 0;
+    for (int reader = 0; reader < rfid_reader_count(); reader++) {
+        if (rs->ant_mask & (0xFu << (reader * 4))) readers |= 1u << reader;
+    }
+    return readers;
+}
+
+// ---- Reports ----
+
+static void put_report_entry(llrp_buf_t *b, const report_entry_t *e, const rospec_t *rs)
+{
+    uint16_t sel = rs->report.content;
+    size_t off = tlv_begin(b, P_TAG_REPORT_DATA);
+    if (e->len == 12) {
+        put_tv(b, TV_EPC96);
+        put_bytes(b, e->epc, 12);
+    } else {
+        size_t epc = tlv_begin(b, P_EPC_DATA);
+        put_u16(b, (uint16_t)(e->len * 8));
+        put_bytes(b, e->epc, e->len);
+        tlv_end(b, epc);
+    }
+    if (sel & SEL_ROSPEC_ID) { put_tv(b, TV_ROSPEC_ID); put_u32(b, rs->id); }
+    if (sel & SEL_SPEC_INDEX) { put_tv(b, TV_SPEC_INDEX); put_u16(b, 1); }
+    if (sel & SEL_INV_PARAM_SPEC_ID) { put_tv(b, TV_INV_PARAM_SPEC_ID); put_u16(b, rs->inv_param_id); }
+    if (sel & SEL_ANTENNA_ID) { put_tv(b, TV_ANTENNA_ID); put_u16(b, e->antenna); }
+    if (sel & SEL_PEAK_RSSI) { put_tv(b, TV_PEAK_RSSI); put_u8(b, (uint8_t)e->peak_rssi); }
+    if (sel & SEL_CHANNEL_INDEX) { put_tv(b, TV_CHANNEL_INDEX); put_u16(b, 1); }   // Not reported by the module
+    if (sel & SEL_FIRST_SEEN) { put_tv(b, TV_FIRST_SEEN_UPTIME); put_u64(b, e->first_us); }
+    if (sel & SEL_LAST_SEEN) { put_tv(b, TV_LAST_SEEN_UPTIME); put_u64(b, e->last_us); }
+    if (sel & SEL_TAG_SEEN_COUNT) { put_tv(b, TV_TAG_SEEN_COUNT); put_u16(b, e->count); }
+    if (sel & SEL_ACCESSSPEC_ID) { put_tv(b, TV_ACCESSSPEC_ID); put_u32(b, 0); }
+    tlv_end(b, off);
+}
+
+// Send up to n pending entries (0 = all) as one RO_ACCESS_REPORT
+static bool send_report(int n)
+{
+    if (s_pending_count == 0) return true;
+    if (n <= 0 || n > s_pending_count) n = s_pending_count;
+
+    llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+    msg_begin(&b, MSG_RO_ACCESS_REPORT, ++s_msg_id);
+    for (int i = 0; i < n; i++) put_report_entry(&b, &s_pending[i], &s_rospec);
+    msg_end(&b);
+    bool ok = client_send(&b);
+
+    uint32_t sent_us = latency_now_us();
+    for (int i = 0; ok && i < n; i++) latency_record(LATENCY_READ_TO_LLRP, s_pending[i].first_rx_us, sent_us);
+    s_reports++;
+    s_tags_reported += (uint32_t)n;
+    s_pending_count -= n;
+    memmove(s_pending, s_pending + n, (size_t)s_pending_count * sizeof(s_pending[0]));
+    return ok;
+}
+
+// Reports due under the ROSpec's trigger
+static bool report_due(void)
+{
+    const report_spec_t *spec = &s_rospec.report;
+    bool ok = true;
+    if (spec->trigger != 0 && spec->n > 0) {
+        while (ok && s_pending_count >= spec->n) ok = send_report(spec->n);
+    }
+    // A full table goes out whatever the trigger says
+    if (ok && s_pending_count >= LLRP_REPORT_MAX) ok = send_report(0);
+    return ok;
+}
+
+static void aggregate(const llrp_read_t *rd)
+{
+    for (int i = 0; i < s_pending_count; i++) {
+        report_entry_t *e = &s_pending[i];
+        if (e->antenna == rd->antenna && e->len == rd->len && memcmp(e->epc, rd->epc, rd->len) == 0) {
+            if (rd->rssi > e->peak_rssi) e->peak_rssi = rd->rssi;
+            if (e->count < UINT16_MAX) e->count++;
+            e->last_us = rd->seen_us;
+            return;
+        }
+    }
+    if (s_pending_count >= LLRP_REPORT_MAX) send_report(0);
+    report_entry_t *e = &s_pending[s_pending_count++];
+    e->antenna = rd->antenna;
+    e->len = rd->len;
+    e->peak_rssi = rd->rssi;
+    e->count = 1;
+    e->first_rx_us = rd->rx_us;
+    e->first_us = e->last_us = rd->seen_us;
+    memcpy(e->epc, rd->epc, rd->len);
+}
+
+void llrp_read(int reader, int ant, int rssi, const uint8_t *epc, size_t len, uint32_t rx_us)
+{
+    if (!s_reporting || !epc || len == 0) return;
+    int id = reader * 4 + ant;
+    if (id < 1 || id > LLRP_MAX_ANTENNAS || !(s_report_mask & (1u << (id - 1)))) return;
+
+    llrp_read_t rd = {
+        .antenna = (uint8_t)id,
+        .len = (uint8_t)(len < LLRP_EPC_MAX ? len : LLRP_EPC_MAX),
+        .rssi = (int8_t)rssi,
+        .rx_us = rx_us,
+        .seen_us = now_us(),
+    };
+    memcpy(rd.epc, epc, rd.len);
+    if (xQueueSend(s_queue, &rd, 0) != pdTRUE) {
+        atomic_fetch_add_explicit(&s_queue_drops, 1, memory_order_relaxed);
+    }
+}
+
+// ---- ROSpec state changes ----
+
+static void rospec_start(void)
+{
+    rospec_t *rs = &s_rospec;
+    for (int a = 0; a < LLRP_MAX_ANTENNAS; a++) {
+        if (rs->power[a] >= 0 && a < antenna_count()) set_antenna_power(a + 1, rs->power[a]);
+    }
+    s_pending_count = 0;
+    xQueueReset(s_queue);
+    s_report_mask = rs->ant_mask;
+    s_reporting = true;
+    rs->state = ROSPEC_ACTIVE;
+    rs->started_us = now_us();
+
+    uint32_t readers = rospec_readers(rs);
+    for (int reader = 0; reader < RFID_MAX_READERS; reader++) {
+        if (readers & (1u << reader)) rfid_start_inventory_local(reader);
+    }
+    ESP_LOGI(TAG, "ROSpec %lu started (antennas 0x%02lx, %lu ms)", (unsigned long)rs->id,
+             (unsigned long)rs->ant_mask, (unsigned long)rs->duration_ms);
+}
+
+// Active -> Inactive; the reads still queued and pending are reported
+static void rospec_stop(void)
+{
+    rospec_t *rs = &s_rospec;
+    if (rs->state != ROSPEC_ACTIVE) return;
+
+    uint32_t readers = rospec_readers(rs);
+    for (int reader = 0; reader < RFID_MAX_READERS; reader++) {
+        if (readers & (1u << reader)) rfid_stop_inventory_local(reader);
+    }
+    s_reporting = false;
+    llrp_read_t rd;
+    while (xQueueReceive(s_queue, &rd, 0) == pdTRUE) aggregate(&rd);
+    if (rs->report.trigger != 0) send_report(0);
+    rs->state = ROSPEC_INACTIVE;
+    ESP_LOGI(TAG, "ROSpec %lu stopped", (unsigned long)rs->id);
+}
+
+// ---- Messages ----
+
+static void send_reader_event(uint16_t connection_status)
+{
+    llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+    msg_begin(&b, MSG_READER_EVENT, ++s_msg_id);
+    size_t data = tlv_begin(&b, P_READER_EVENT_DATA);
+    size_t ts = tlv_begin(&b, P_UPTIME);
+    put_u64(&b, now_us());
+    tlv_end(&b, ts);
+    size_t ev = tlv_begin(&b, P_CONNECTION_ATTEMPT);
+    put_u16(&b, connection_status);
+    tlv_end(&b, ev);
+    tlv_end(&b, data);
+    msg_end(&b);
+    client_send(&b);
+}
+
+static void reply_status(uint16_t type, uint32_t id, uint16_t code, const char *desc)
+{
+    llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+    msg_begin(&b, type, id);
+    put_status(&b, code, desc);
+    msg_end(&b);
+    client_send(&b);
+}
+
+static void put_capabilities(llrp_buf_t *b, uint8_t requested)
+{
+    int antennas = antenna_count();
+    if (requested == 0 || requested == 1) {
+        static const char *fw = "esp32_rfid_reader";
+        size_t off = tlv_begin(b, P_GENERAL_DEVICE_CAPS);
+        put_u16(b, (uint16_t)antennas);
+        put_u16(b, 0);   // No antenna properties, no UTC clock
+        put_u32(b, 0);   // Manufacturer (IANA PEN) and model unknown
+        put_u32(b, 0);
+        put_u16(b, (uint16_t)strlen(fw));
+        put_bytes(b, fw, strlen(fw));
+        size_t rs = tlv_begin(b, P_RECEIVE_SENSITIVITY);
+        put_u16(b, 1);
+        put_u16(b, 0);
+        tlv_end(b, rs);
+        for (int a = 1; a <= antennas; a++) {
+            size_t pa = tlv_begin(b, P_PER_ANTENNA_PROTOCOL);
+            put_u16(b, (uint16_t)a);
+            put_u16(b, 1);
+            put_u8(b, 1);   // EPCglobal Class 1 Gen 2
+            tlv_end(b, pa);
+        }
+        size_t gpio = tlv_begin(b, P_GPIO_CAPS);
+        put_u16(b, 0);
+        put_u16(b, 0);
+        tlv_end(b, gpio);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 2) {
+        size_t off = tlv_begin(b, P_LLRP_CAPS);
+        put_u8(b, 0);
+        put_u8(b, 7);    // MaxPriorityLevelSupported
+        put_u16(b, 0);
+        put_u32(b, 1);   // ROSpecs
+        put_u32(b, 8);   // Specs per ROSpec
+        put_u32(b, 1);   // InventoryParameterSpecs per AISpec
+        put_u32(b, 0);   // AccessSpecs
+        put_u32(b, 0);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 3) {
+        size_t off = tlv_begin(b, P_REGULATORY_CAPS);
+        put_u16(b, 0);   // Country and standard unspecified
+        put_u16(b, 0);
+        size_t band = tlv_begin(b, P_UHF_BAND_CAPS);
+        for (int dbm = 0; dbm <= LLRP_POWER_MAX_DBM; dbm++) {
+            size_t e = tlv_begin(b, P_TX_POWER_ENTRY);
+            put_u16(b, (uint16_t)(dbm + 1));
+            put_u16(b, (uint16_t)(dbm * 100));
+            tlv_end(b, e);
+        }
+        // The module hops on its own; one table so HopTableID 1 is valid
+        size_t freq = tlv_begin(b, P_FREQUENCY_INFO);
+        put_u8(b, 0x80);
+        size_t hop = tlv_begin(b, P_FREQUENCY_HOP_TABLE);
+        put_u8(b, 1);
+        put_u8(b, 0);
+        put_u16(b, 1);
+        put_u32(b, 915250);
+        tlv_end(b, hop);
+        tlv_end(b, freq);
+        size_t modes = tlv_begin(b, P_C1G2_RF_MODE_TABLE);
+        size_t mode = tlv_begin(b, P_C1G2_RF_MODE_ENTRY);
+        put_u32(b, 0);        // ModeIdentifier
+        put_u8(b, 0);         // DR 8, not EPC HAG conformant
+        put_u8(b, 2);         // Miller 4
+        put_u8(b, 2);         // PR-ASK
+        put_u8(b, 0);
+        put_u32(b, 250000);   // BDR bps
+        put_u32(b, 2000);     // PIE x1000
+        put_u32(b, 12500);    // Tari ns
+        put_u32(b, 25000);
+        put_u32(b, 0);
+        tlv_end(b, mode);
+        tlv_end(b, modes);
+        tlv_end(b, band);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 4) {
+        size_t off = tlv_begin(b, P_C1G2_LLRP_CAPS);
+        put_u8(b, 0);
+        put_u16(b, 0);
+        tlv_end(b, off);
+    }
+}
+
+static void put_report_spec(llrp_buf_t *b, const report_spec_t *spec)
+{
+    size_t off = tlv_begin(b, P_RO_REPORT_SPEC);
+    put_u8(b, spec->trigger);
+    put_u16(b, spec->n);
+    size_t sel = tlv_begin(b, P_TAG_REPORT_CONTENT);
+    put_u16(b, spec->content);
+    tlv_end(b, sel);
+    tlv_end(b, off);
+}
+
+static void put_reader_config(llrp_buf_t *b, uint16_t antenna, uint16_t requested)
+{
+    int antennas = antenna_count();
+    if (requested == 0 || requested == 1) {
+        uint8_t mac[6] = { 0 };
+#if CONFIG_IDF_TARGET_LINUX
+        host_read_mac(mac);
+#else
+        esp_read_mac(mac, ESP_MAC_ETH);
+#endif
+        size_t off = tlv_begin(b, P_IDENTIFICATION);
+        put_u8(b, 0);   // MAC address
+        put_u16(b, sizeof(mac));
+        put_bytes(b, mac, sizeof(mac));
+        tlv_end(b, off);
+    }
+    for (int a = 1; a <= antennas; a++) {
+        if (antenna != 0 && antenna != a) continue;
+        if (requested == 0 || requested == 2) {
+            size_t off = tlv_begin(b, P_ANTENNA_PROPERTIES);
+            put_u8(b, 0x80);   // Connected (not detected by the module)
+            put_u16(b, (uint16_t)a);
+            put_u16(b, 0);
+            tlv_end(b, off);
+        }
+        if (requested == 0 || requested == 3) {
+            size_t off = tlv_begin(b, P_ANTENNA_CONFIGURATION);
+            put_u16(b, (uint16_t)a);
+            size_t tx = tlv_begin(b, P_RF_TRANSMITTER);
+            put_u16(b, 1);
+            put_u16(b, 1);
+            int dbm = antenna_power(a);
+            if (dbm < 0) dbm = 0;
+            if (dbm > LLRP_POWER_MAX_DBM) dbm = LLRP_POWER_MAX_DBM;
+            put_u16(b, (uint16_t)(dbm + 1));
+            tlv_end(b, tx);
+            tlv_end(b, off);
+        }
+    }
+    if (requested == 0 || requested == 4) put_report_spec(b, &s_default_report);
+    if (requested == 0 || requested == 6) {
+        size_t off = tlv_begin(b, P_ACCESS_REPORT_SPEC);
+        put_u8(b, 0);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 7) {
+        size_t off = tlv_begin(b, P_LLRP_CONFIG_STATE);
+        put_u32(b, 0);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 8) {
+        size_t off = tlv_begin(b, P_KEEPALIVE_SPEC);
+        put_u8(b, s_keepalive_ms ? 1 : 0);
+        put_u32(b, s_keepalive_ms);
+        tlv_end(b, off);
+    }
+    if (requested == 0 || requested == 11) {
+        size_t off = tlv_begin(b, P_EVENTS_AND_REPORTS);
+        put_u8(b, 0);
+        tlv_end(b, off);
+    }
+}
+
+static void handle_set_config(uint32_t id, const uint8_t *body, size_t len)
+{
+    if (len < 1) {
+        reply_status(MSG_SET_READER_CONFIG_RESP, id, ST_M_FIELD_ERROR, "Message too short");
+        return;
+    }
+
+    // Validate everything before applying anything
+    bool reset = body[0] & 0x80;   // ResetToFactoryDefault, then apply the rest
+    const uint8_t *p = body + 1, *end = body + len;
+    llrp_param_t prm;
+    int r;
+    report_spec_t report = reset ? s_factory_report : s_default_report;
+    uint32_t keepalive_ms = reset ? 0 : s_keepalive_ms;
+    int power_id[LLRP_MAX_ANTENNAS + 1], power_dbm[LLRP_MAX_ANTENNAS + 1], powers = 0;
+    while ((r = next_param(&p, end, &prm)) == 1) {
+        uint16_t st = ST_SUCCESS;
+        if (prm.type == P_RO_REPORT_SPEC) {
+            st = parse_report_spec(&prm, &report);
+        } else if (prm.type == P_KEEPALIVE_SPEC) {
+            if (prm.len < 5) st = ST_P_FIELD_ERROR;
+            else keepalive_ms = prm.body[0] == 1 ? get_be32(prm.body + 1) : 0;
+        } else if (prm.type == P_ANTENNA_CONFIGURATION) {
+            int ant, dbm;
+            st = parse_antenna_config(&prm, &ant, &dbm);
+            if (st == ST_SUCCESS && dbm >= 0 && powers < LLRP_MAX_ANTENNAS + 1) {
+                power_id[powers] = ant;
+                power_dbm[powers++] = dbm;
+            }
+        }
+        // Event notification, antenna properties and access report settings are accepted as is
+        if (st != ST_SUCCESS) {
+            reply_status(MSG_SET_READER_CONFIG_RESP, id, st, "Invalid parameter");
+            return;
+        }
+    }
+    if (r < 0) {
+        reply_status(MSG_SET_READER_CONFIG_RESP, id, ST_P_FIELD_ERROR, "Malformed parameter");
+        return;
+    }
+
+    s_default_report = report;
+    if (keepalive_ms != s_keepalive_ms) {
+        s_keepalive_ms = keepalive_ms;
+        s_keepalive_at_us = now_us() + (uint64_t)keepalive_ms * 1000ULL;
+        s_keepalive_missed = 0;
+    }
+    for (int i = 0; i < powers; i++) set_antenna_power(power_id[i], power_dbm[i]);
+    reply_status(MSG_SET_READER_CONFIG_RESP, id, ST_SUCCESS, NULL);
+}
+
+// ROSpec commands: 0 = every ROSpec where the message allows it
+static bool rospec_matches(uint32_t want)
+{
+    return s_rospec.present && (want == 0 || want == s_rospec.id);
+}
+
+static void handle_rospec(uint16_t type, uint32_t id, const uint8_t *body, size_t len)
+{
+    uint16_t resp = type + MSG_RESPONSE_OFFSET;
+    if (type == MSG_ADD_ROSPEC) {
+        if (s_rospec.present) {
+            reply_status(resp, id, ST_A_INVALID, "Only one ROSpec is supported");
+            return;
+        }
+        rospec_t rs;
+        const char *why = "Invalid ROSpec";
+        uint16_t st = parse_rospec(body, len, &rs, &why);
+        if (st == ST_SUCCESS) s_rospec = rs;
+        reply_status(resp, id, st, st == ST_SUCCESS ? NULL : why);
+        return;
+    }
+    if (type == MSG_GET_ROSPECS) {
+        llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+        msg_begin(&b, resp, id);
+        put_status(&b, ST_SUCCESS, NULL);
+        if (s_rospec.present) {
+            s_rospec.raw[9] = (uint8_t)s_rospec.state;   // After the header, ROSpecID and priority
+            put_bytes(&b, s_rospec.raw, s_rospec.raw_len);
+        }
+        msg_end(&b);
+        client_send(&b);
+        return;
+    }
+
+    if (len < 4) {
+        reply_status(resp, id, ST_M_FIELD_ERROR, "ROSpecID missing");
+        return;
+    }
+    uint32_t want = get_be32(body);
+    bool all_allowed = type != MSG_START_ROSPEC && type != MSG_STOP_ROSPEC;
+    if ((want == 0 && !all_allowed) || !rospec_matches(want)) {
+        // Deleting / enabling / disabling "all" of none is fine
+        uint16_t st = (want == 0 && all_allowed) ? ST_SUCCESS : ST_A_INVALID;
+        reply_status(resp, id, st, st == ST_SUCCESS ? NULL : "No such ROSpec");
+        return;
+    }
+
+    rospec_t *rs = &s_rospec;
+    uint16_t st = ST_SUCCESS;
+    const char *why = NULL;
+    switch (type) {
+    case MSG_DELETE_ROSPEC:
+        rospec_stop();
+        rs->present = false;
+        break;
+    case MSG_ENABLE_ROSPEC:
+        if (rs->state == ROSPEC_DISABLED) rs->state = ROSPEC_INACTIVE;
+        break;
+    case MSG_DISABLE_ROSPEC:
+        rospec_stop();
+        rs->state = ROSPEC_DISABLED;
+        break;
+    case MSG_START_ROSPEC:
+        if (rs->state != ROSPEC_INACTIVE) {
+            st = ST_A_INVALID;
+            why = rs->state == ROSPEC_ACTIVE ? "ROSpec already active" : "ROSpec is disabled";
+        }
+        break;
+    case MSG_STOP_ROSPEC:
+        if (rs->state != ROSPEC_ACTIVE) {
+            st = ST_A_INVALID;
+            why = "ROSpec is not active";
+        }
+        break;
+    }
+    reply_status(resp, id, st, why);
+    if (st != ST_SUCCESS) return;
+
+    // Start after the response so the report cannot overtake it
+    if (type == MSG_START_ROSPEC || (type == MSG_ENABLE_ROSPEC && rs->start_immediate && rs->state == ROSPEC_INACTIVE)) {
+        rospec_start();
+    } else if (type == MSG_STOP_ROSPEC) {
+        rospec_stop();
+    }
+}
+
+// Returns false when the connection is to be closed
+static bool handle_message(uint16_t type, uint32_t id, const uint8_t *body, size_t len)
+{
+    switch (type) {
+    case MSG_GET_READER_CAPABILITIES: {
+        llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+        msg_begin(&b, MSG_GET_READER_CAPS_RESP, id);
+        put_status(&b, ST_SUCCESS, NULL);
+        put_capabilities(&b, len >= 1 ? body[0] : 0);
+        msg_end(&b);
+        client_send(&b);
+        break;
+    }
+    case MSG_GET_READER_CONFIG: {
+        uint16_t antenna = len >= 2 ? get_be16(body) : 0;
+        uint16_t requested = len >= 4 ? get_be16(body + 2) : 0;
+        llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+        msg_begin(&b, MSG_GET_READER_CONFIG_RESP, id);
+        if (antenna > antenna_count()) {
+            put_status(&b, ST_A_OUT_OF_RANGE, "Unknown antenna");
+        } else {
+            put_status(&b, ST_SUCCESS, NULL);
+            put_reader_config(&b, antenna, requested);
+        }
+        msg_end(&b);
+        client_send(&b);
+        break;
+    }
+    case MSG_SET_READER_CONFIG:
+        handle_set_config(id, body, len);
+        break;
+    case MSG_ADD_ROSPEC: case MSG_DELETE_ROSPEC: case MSG_START_ROSPEC: case MSG_STOP_ROSPEC:
+    case MSG_ENABLE_ROSPEC: case MSG_DISABLE_ROSPEC: case MSG_GET_ROSPECS:
+        handle_rospec(type, id, body, len);
+        break;
+    case MSG_DELETE_ACCESSSPEC:
+        // There are none: deleting all of them succeeds
+        reply_status(type + MSG_RESPONSE_OFFSET, id, (len >= 4 && get_be32(body) == 0) ? ST_SUCCESS : ST_A_INVALID,
+                     (len >= 4 && get_be32(body) == 0) ? NULL : "No such AccessSpec");
+        break;
+    case MSG_GET_ACCESSSPECS:
+        reply_status(type + MSG_RESPONSE_OFFSET, id, ST_SUCCESS, NULL);
+        break;
+    case MSG_ADD_ACCESSSPEC: case MSG_ENABLE_ACCESSSPEC: case MSG_DISABLE_ACCESSSPEC:
+        reply_status(type + MSG_RESPONSE_OFFSET, id, ST_M_UNSUPPORTED_MESSAGE, "AccessSpecs are not supported");
+        break;
+    case MSG_GET_REPORT:
+        send_report(0);
+        break;
+    case MSG_KEEPALIVE_ACK:
+        s_keepalive_missed = 0;
+        break;
+    case MSG_ENABLE_EVENTS_REPORTS:
+        break;   // Reports are never held
+    case MSG_CLOSE_CONNECTION:
+        reply_status(MSG_CLOSE_CONNECTION_RESP, id, ST_SUCCESS, NULL);
+        return false;
+    default:
+        reply_status(MSG_ERROR_MESSAGE, id, ST_M_UNSUPPORTED_MESSAGE, "Unsupported message");
+        break;
+    }
+    return true;
+}
+
+// ---- Connection ----
+
+static void client_close(const char *why)
+{
+    if (s_client < 0) return;
+    rospec_stop();
+    s_pending_count = 0;
+    close(s_client);
+    s_client = -1;
+    ESP_LOGI(TAG, "Client %s disconnected (%s)", s_peer, why);
+}
+
+// Parse every complete message in the receive buffer
+static bool client_receive(void)
+{
+    for (;;) {
+        int ret = recv(s_client, s_rx + s_rx_len, LLRP_RX_MAX - s_rx_len, MSG_DONTWAIT);
+        if (ret == 0) return false;
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        s_rx_len += (size_t)ret;
+
+        size_t pos = 0;
+        while (s_rx_len - pos >= 10) {
+            const uint8_t *m = s_rx + pos;
+            uint32_t mlen = get_be32(m + 2);
+            if (mlen < 10 || mlen > LLRP_RX_MAX) {
+                ESP_LOGW(TAG, "Bad message length %lu", (unsigned long)mlen);
+                return false;
+            }
+            if (s_rx_len - pos < mlen) break;
+            uint16_t ver = (get_be16(m) >> 10) & 0x7;
+            uint16_t type = get_be16(m) & 0x3FF;
+            uint32_t id = get_be32(m + 6);
+            pos += mlen;
+            if (ver != LLRP_VERSION) {
+                reply_status(MSG_ERROR_MESSAGE, id, ST_M_UNSUPPORTED_VERSION, "Only LLRP 1.0.1 is supported");
+                continue;
+            }
+            if (!handle_message(type, id, m + 10, mlen - 10)) return false;
+        }
+        memmove(s_rx, s_rx + pos, s_rx_len - pos);
+        s_rx_len -= pos;
+    }
+    return true;
+}
+
+static int open_listener(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on TCP %u (errno %d)", (unsigned)port, errno);
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    ESP_LOGI(TAG, "Listening on TCP %u", (unsigned)port);
+    return fd;
+}
+
+static void accept_client(int listen_fd)
+{
+    struct sockaddr_in peer;
+    socklen_t plen = sizeof(peer);
+    int fd = accept(listen_fd, (struct sockaddr *)&peer, &plen);
+    if (fd < 0) return;
+
+    int one = 1;
+    struct timeval tv = { .tv_sec = 2 };
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (s_client >= 0) {
+        // Tell the newcomer why, on its own socket
+        int keep = s_client;
+        s_client = fd;
+        send_reader_event(CONN_CLIENT_EXISTS);
+        s_client = keep;
+        close(fd);
+        ESP_LOGW(TAG, "Rejected a second client");
+        return;
+    }
+
+    s_client = fd;
+    s_rx_len = 0;
+    s_keepalive_missed = 0;
+    s_keepalive_at_us = now_us() + (uint64_t)s_keepalive_ms * 1000ULL;
+    inet_ntop(AF_INET, &peer.sin_addr, s_peer, sizeof(s_peer));
+    ESP_LOGI(TAG, "Client %s connected", s_peer);
+    send_reader_event(CONN_SUCCESS);
+}
+
+static void llrp_task(void *arg)
+{
+    int listen_fd = -1;
+    uint32_t gen = UINT32_MAX;
+
+    for (;;) {
+        if (gen != s_port_gen) {
+            gen = s_port_gen;
+            client_close("port changed");
+            if (listen_fd >= 0) close(listen_fd);
+            listen_fd = s_port ? open_listener(s_port) : -1;
+        }
+        if (listen_fd >= 0) accept_client(listen_fd);
+        if (s_client >= 0 && !client_receive()) client_close("closed");
+
+        // Reads wake the task at once; otherwise it polls the sockets
+        llrp_read_t rd;
+        if (xQueueReceive(s_queue, &rd, pdMS_TO_TICKS(LLRP_POLL_MS)) == pdTRUE) {
+            do {
+                if (s_reporting) aggregate(&rd);
+            } while (xQueueReceive(s_queue, &rd, 0) == pdTRUE);
+            if (s_client >= 0 && !report_due()) client_close("send failed");
+        }
+
+        if (s_rospec.state == ROSPEC_ACTIVE && s_rospec.duration_ms &&
+            now_us() - s_rospec.started_us >= (uint64_t)s_rospec.duration_ms * 1000ULL) {
+            rospec_stop();
+        }
+
+        if (s_client >= 0 && s_keepalive_ms && now_us() >= s_keepalive_at_us) {
+            s_keepalive_at_us = now_us() + (uint64_t)s_keepalive_ms * 1000ULL;
+            if (++s_keepalive_missed > LLRP_KEEPALIVE_MISSES) {
+                client_close("keepalive not acknowledged");
+                continue;
+            }
+            llrp_buf_t b = { .buf = s_tx, .cap = LLRP_TX_MAX };
+            msg_begin(&b, MSG_KEEPALIVE, ++s_msg_id);
+            msg_end(&b);
+            if (!client_send(&b)) client_close("send failed");
+        }
+    }
+}
+
+void llrp_init(void)
+{
+    s_default_report = s_factory_report;
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    nvs_get_u16(h, "port", &s_port);
+    nvs_close(h);
+}
+
+void llrp_start(void)
+{
+    if (s_task) return;
+    s_rx = heap_caps_malloc(LLRP_RX_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    s_tx = heap_caps_malloc(LLRP_TX_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_rx) s_rx = malloc(LLRP_RX_MAX);
+    if (!s_tx) s_tx = malloc(LLRP_TX_MAX);
+    s_queue = xQueueCreate(LLRP_QUEUE_LEN, sizeof(llrp_read_t));
+    if (!s_rx || !s_tx || !s_queue) {
+        ESP_LOGE(TAG, "No memory for the LLRP server");
+        return;
+    }
+    xTaskCreate(llrp_task, "llrp", 6144, NULL, 6, &s_task);
+}
+
+uint16_t llrp_get_port(void)
+{
+    return s_port;
+}
+
+int llrp_set_port(uint16_t port)
+{
+    s_port = port;
+    s_port_gen++;
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return -1;
+    nvs_set_u16(h, "port", port);
+    nvs_commit(h);
+    nvs_close(h);
+    return 0;
+}
+
+int llrp_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+    static const char *states[] = { "disabled", "inactive", "active" };
+    int n = snprintf(out, out_len, "{\"port\":%u,\"client\":", (unsigned)s_port);
+    if (s_client >= 0) n += snprintf(out + n, out_len - n, "\"%s\"", s_peer);
+    else n += snprintf(out + n, out_len - n, "null");
+    if (n < out_len && s_rospec.present) {
+        n += snprintf(out + n, out_len - n,
+                      ",\"rospec\":{\"id\":%lu,\"state\":\"%s\",\"antennas\":%lu,\"duration_ms\":%lu,\"report_trigger\":%u,\"report_n\":%u}",
+                      (unsigned long)s_rospec.id, states[s_rospec.state], (unsigned long)s_rospec.ant_mask,
+                      (unsigned long)s_rospec.duration_ms, (unsigned)s_rospec.report.trigger, (unsigned)s_rospec.report.n);
+    }
+    if (n < out_len) {
+        n += snprintf(out + n, out_len - n,
+                      ",\"keepalive_ms\":%lu,\"reports\":%lu,\"tags_reported\":%lu,\"pending\":%d,\"queue_drops\":%lu}",
+                      (unsigned long)s_keepalive_ms, (unsigned long)s_reports, (unsigned long)s_tags_reported,
+                      s_pending_count, (unsigned long)atomic_load_explicit(&s_queue_drops, memory_order_relaxed));
+    }
+    return (n < out_len) ? n : out_len - 1;
+}
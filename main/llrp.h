@@ -0,0 +1,35 @@
+/* llrp.h - minimal LLRP 1.0.1 reader endpoint (TCP 5084) for standard middleware
+ *
+ * One client at a time. Supported: GET_READER_CAPABILITIES, GET/SET_READER_CONFIG
+ * (antenna power, ROReportSpec, KeepaliveSpec), one ROSpec with ADD / ENABLE /
+ * START / STOP / DISABLE / DELETE / GET_ROSPECS, GET_REPORT, KEEPALIVE and
+ * CLOSE_CONNECTION. START_ROSPEC maps onto rfid_start_inventory_local() for the
+ * readers behind the ROSpec's antennas and the RFTransmitter power onto
+ * rfid_set_power(). Reads are aggregated per EPC and antenna and sent as
+ * RO_ACCESS_REPORT when ROReportSpec's N is reached, on GET_REPORT and when the
+ * ROSpec ends. AccessSpecs, periodic / GPI triggers and UTC time are not
+ * supported.
+ *
+ * LLRP antenna IDs are reader * 4 + antenna (1-4 on reader 0, 5-8 on reader 1). */
+#ifndef LLRP_H
+#define LLRP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LLRP_DEFAULT_PORT 5084
+#define LLRP_JSON_MAX     512
+
+void llrp_init(void);    // Loads the port from NVS
+void llrp_start(void);   // Starts the server task (needs the network stack)
+
+// Ingest path: one accepted read (called by the reader RX tasks)
+void llrp_read(int reader, int ant, int rssi, const uint8_t *epc, size_t len, uint32_t rx_us);
+
+uint16_t llrp_get_port(void);
+int llrp_set_port(uint16_t port);   // 0 = off; saved to NVS, applies at once
+
+// Port, client, ROSpec state and counters as JSON
+int llrp_get_json(char *out, int out_len);
+
+#endif // LLRP_H
@@ -1,3 +1,4 @@
+#include "sdkconfig.h"
 #include <stdio.h>
 #include "nvs_flash.h"
 #include "esp_log.h"
@@ -10,53 +11,76 @@
 #include "mqtt_config.h"
 #include "web.h"
 #include "rfid.h"
+#include "mqtt_batch.h"
+#include "tag_store.h"
+#include "net_events.h"
+#include "boot.h"
+#include "metrics.h"
+#include "tag_stream.h"
+#include "llrp.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "host/host.h"
+#endif
 
 
 static const char *TAG = "MAIN";
 
-// Forward declaration
-static void mqtt_task(void *pvParameters);
-
-// MQTT task to handle connectivity and periodic batch publishing
+// MQTT task to handle connectivity and batch publishing. It sleeps on the
+// network event group and only wakes for an event or its next deadline.
 static void mqtt_task(void *pvParameters)
 {
-    uint32_t last_batch_publish = 0;
-    uint32_t last_connection_attempt = 0;
-    const uint32_t BATCH_PUBLISH_INTERVAL_MS = 5000; // Publish batch every 5 seconds (reduced frequency)
-    const uint32_t CONNECTION_RETRY_INTERVAL_MS = 10000; // Wait 10 seconds between connection attempts
-    
     while (1) {
-        uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        // Connection state machine: backoff with jitter, gated on any network link
+        bool link_up = eth_is_connected() || wifi_is_connected();
+        uint32_t wait_ms = mqtt_reconnect_step(link_up);
         
-        // Check if Ethernet is connected and MQTT should connect (with retry delay)
-        if (eth_is_connected() && !mqtt_is_connected() && !mqtt_is_connecting()) {
-            if ((now - last_connection_attempt) >= CONNECTION_RETRY_INTERVAL_MS) {
-                ESP_LOGI(TAG, "Ethernet connected, attempting MQTT connection...");
-                mqtt_connect();
-                last_connection_attempt = now;
+        // Flush the tag batch once a size threshold is hit or its deadline expires.
+        // Batches are queued even while offline and sent after reconnecting.
+        if (rfid_get_mqtt_status_bool()) {
+            uint32_t due_ms = mqtt_batch_ms_until_due();
+            if (due_ms == 0) {
+                mqtt_batch_flush();
+                due_ms = mqtt_batch_ms_until_due();
             }
+            if (due_ms < wait_ms) wait_ms = due_ms;
         }
         
-        // Periodic batch publishing for MQTT data (only if connection is stable)
-        if (mqtt_is_connected() && (now - last_batch_publish) >= BATCH_PUBLISH_INTERVAL_MS) {
-            if (rfid_get_mqtt_status_bool()) {
-                mqtt_publish_periodic_batch();
-            }
-            // Also flush any remaining buffered data periodically
-            mqtt_flush_buffer();
-            last_batch_publish = now;
-        }
+        // Expire tags not read within the tag timeout (DEPART events)
+        uint32_t expire_ms = tag_store_expire();
+        if (expire_ms < wait_ms) wait_ms = expire_ms;
+        
+        // Apply PUBACKs and keep the QoS1 in-flight window full
+        uint32_t sweep_ms = mqtt_flush_buffer();
+        if (sweep_ms < wait_ms) wait_ms = sweep_ms;
         
         // Run connection health monitoring
-        mqtt_connection_monitor();
+        uint32_t monitor_ms = mqtt_connection_monitor();
+        if (monitor_ms < wait_ms) wait_ms = monitor_ms;
         
-        vTaskDelay(pdMS_TO_TICKS(2000)); // Check every 2 seconds (reduced frequency)
+        // Optional metrics push (off unless configured via cmd/metrics)
+        uint32_t push_ms = metrics_ms_until_push();
+        if (push_ms == 0) {
+            metrics_push();
+            push_ms = metrics_ms_until_push();
+        }
+        if (push_ms < wait_ms) wait_ms = push_ms;
+        
+        EventBits_t events = net_events_wait(wait_ms);
+        if (events & (NET_EVT_LINK_UP | NET_EVT_LINK_DOWN | NET_EVT_MQTT_CONNECTED | NET_EVT_MQTT_DISCONNECTED)) {
+            ESP_LOGI(TAG, "Uplink events: 0x%02x", (unsigned)events);
+        }
     }
 }
 
-void app_main(void)
+// ---- Boot stages ----
+
+#define READER_HANDSHAKE_TIMEOUT_MS 500
+
+static void stage_nvs(void)
 {
-    // Initialize NVS
+#if CONFIG_IDF_TARGET_LINUX
+    host_init();   // File-backed flash image for NVS and the epcdb partition
+#endif
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
@@ -64,33 +88,84 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    // Initialize modules
+    // Uplink event group must exist before Ethernet/MQTT start posting events
+    net_events_init();
+    metrics_init();
+}
+
+// UART + reader handshake: the first frame from any module replaces the old fixed settle delay.
+// Needs NVS for the reader count.
+static void stage_reader(void)
+{
     rfid_init();
-    
-    // Allow system to stabilize before starting UART task
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    uart_start_rx_task();
-    
-    // Initialize Ethernet (for both web server and MQTT communication)
+    rfid_confirm_connection(RFID_ALL_READERS);
+    if (!boot_wait_mark(BOOT_MARK_READER_READY, READER_HANDSHAKE_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "RFID module did not answer within %d ms", READER_HANDSHAKE_TIMEOUT_MS);
+    }
+}
+
+// Ethernet driver start; link-up and DHCP finish in the background (BOOT_MARK_LINK_UP)
+static void stage_network(void)
+{
     eth_init();
-    
     // Initialize WiFi (optional - can be disabled if only using Ethernet)
     // wifi_init();
-    
-    // Initialize MQTT client
+}
+
+// MQTT config, offline queue and batching settings from NVS
+static void stage_mqtt(void)
+{
     mqtt_init();
+}
 
-    // Start web server on Ethernet
-    httpd_handle_t server = start_webserver();
-    if (server == NULL) {
+static void stage_web(void)
+{
+    if (start_webserver() == NULL) {
         ESP_LOGE(TAG, "Failed to start web server");
         return;
     }
     ESP_LOGI(TAG, "Web server started on Ethernet");
-    
+}
+
+// LAN tag stream: TCP listener and optional multicast, fed by the reader RX tasks
+static void stage_stream(void)
+{
+    tag_stream_init();
+    tag_stream_start();
+}
+
+// LLRP server for middleware; drives the readers, so it waits for them too
+static void stage_llrp(void)
+{
+    llrp_init();
+    llrp_start();
+}
+
+static void stage_uplink(void)
+{
     // Start a task to handle MQTT connectivity and batch publishing (larger stack for JSON buffers)
     xTaskCreate(mqtt_task, "mqtt_task", 8192, NULL, 5, NULL);
+}
+
+enum { BOOT_NVS, BOOT_READER, BOOT_NETWORK, BOOT_MQTT, BOOT_WEB, BOOT_STREAM, BOOT_LLRP, BOOT_UPLINK };
+
+static const boot_stage_t s_boot_stages[] = {
+    [BOOT_NVS]       = { "nvs",       stage_nvs,       0,                                           4096 },
+    [BOOT_READER]    = { "reader",    stage_reader,    BOOT_DEP(BOOT_NVS),                          4096 },
+    [BOOT_NETWORK]   = { "network",   stage_network,   BOOT_DEP(BOOT_NVS),                          4096 },
+    [BOOT_MQTT]      = { "mqtt",      stage_mqtt,      BOOT_DEP(BOOT_NVS),                          6144 },
+    [BOOT_WEB]       = { "web",       stage_web,       BOOT_DEP(BOOT_NETWORK),                      4096 },
+    [BOOT_STREAM]    = { "stream",    stage_stream,    BOOT_DEP(BOOT_NETWORK),                      4096 },
+    [BOOT_LLRP]      = { "llrp",      stage_llrp,      BOOT_DEP(BOOT_NETWORK) | BOOT_DEP(BOOT_READER), 4096 },
+    // The uplink task expires and batches the tag table that stage_reader allocates
+    [BOOT_UPLINK]    = { "uplink",    stage_uplink,    BOOT_DEP(BOOT_NETWORK) | BOOT_DEP(BOOT_MQTT) | BOOT_DEP(BOOT_READER), 2048 },
+};
+
+void app_main(void)
+{
+    // Stages run in parallel as soon as their dependencies finish: the reader
+    // handshake overlaps Ethernet bring-up and the MQTT config load
+    boot_run(s_boot_stages, sizeof(s_boot_stages) / sizeof(s_boot_stages[0]));
     
     ESP_LOGI(TAG, "System initialized successfully - Ethernet mode (Web Server + MQTT)");
 }
@@ -0,0 +1,262 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "mqtt_config.h"
+#include "net_events.h"
+#include "latency.h"
+#include "tag_store.h"
+
+static const char *TAG = "METRICS";
+static const char *NVS_NAMESPACE = "metrics";
+
+_Atomic uint32_t metrics_values[METRIC_COUNT];
+_Atomic uint32_t metrics_frames_by_mid[256];
+
+typedef struct {
+    const char *name;     // Entries sharing a name form one family
+    const char *help;
+    const char *labels;   // Optional, e.g. "type=\"data\""
+    bool gauge;
+} metric_desc_t;
+
+static const metric_desc_t s_desc[METRIC_COUNT] = {
+    [METRIC_UART_RX_BYTES]            = { "reader_uart_rx_bytes_total", "Bytes read from the RFID module UART", NULL, false },
+    [METRIC_UART_EVT_DATA]            = { "reader_uart_events_total", "UART driver events by type", "type=\"data\"", false },
+    [METRIC_UART_EVT_FIFO_OVF]        = { "reader_uart_events_total", NULL, "type=\"fifo_ovf\"", false },
+    [METRIC_UART_EVT_BUFFER_FULL]     = { "reader_uart_events_total", NULL, "type=\"buffer_full\"", false },
+    [METRIC_UART_EVT_OTHER]           = { "reader_uart_events_total", NULL, "type=\"other\"", false },
+    [METRIC_RFID_CRC_ERRORS]          = { "reader_rfid_crc_errors_total", "Complete frames whose CRC did not match", NULL, false },
+    [METRIC_RFID_PACKETS_SKIPPED]     = { "reader_rfid_packets_skipped_total", "UART reads dropped while inventory is stopped", NULL, false },
+    [METRIC_RFID_TAG_READS]           = { "reader_rfid_tag_reads_total", "Tag reads stored in the tag table", NULL, false },
+    [METRIC_RFID_TAG_EVICTIONS]       = { "reader_rfid_tag_evictions_total", "Tags evicted from the full tag table", NULL, false },
+    [METRIC_RFID_TAG_DEPARTS]         = { "reader_rfid_tag_departs_total", "Tags expired after the tag timeout", NULL, false },
+    [METRIC_RFID_SEEN_RETURNS]        = { "reader_rfid_seen_returns_total", "Tags that came back within the seen-filter window", NULL, false },
+    [METRIC_RFID_EPC_REJECTED]        = { "reader_rfid_epc_rejected_total", "Reads dropped by the EPC company-prefix rules", NULL, false },
+    [METRIC_RFID_RULE_DROPS]          = { "reader_rfid_rule_drops_total", "Reads dropped by the edge rules", NULL, false },
+    [METRIC_RFID_EPCDB_SUPPRESSED]    = { "reader_rfid_epcdb_suppressed_total", "Reads dropped by the EPC asset table (fixtures, allow-only)", NULL, false },
+    [METRIC_MQTT_BATCHES_BY_TAGS]     = { "reader_mqtt_batches_total", "Tag batches queued by flush reason", "reason=\"tags\"", false },
+    [METRIC_MQTT_BATCHES_BY_BYTES]    = { "reader_mqtt_batches_total", NULL, "reason=\"bytes\"", false },
+    [METRIC_MQTT_BATCHES_BY_DEADLINE] = { "reader_mqtt_batches_total", NULL, "reason=\"deadline\"", false },
+    [METRIC_MQTT_BATCHED_TAGS]        = { "reader_mqtt_batched_tags_total", "Tags written to batches", NULL, false },
+    [METRIC_MQTT_SENT]                = { "reader_mqtt_messages_sent_total", "Queued messages handed to the MQTT client", NULL, false },
+    [METRIC_MQTT_SEND_ERRORS]         = { "reader_mqtt_send_errors_total", "Messages the MQTT outbox rejected", NULL, false },
+    [METRIC_MQTT_ACKED]               = { "reader_mqtt_messages_acked_total", "Queued messages acknowledged by the broker", NULL, false },
+    [METRIC_MQTT_RETRANSMITS]         = { "reader_mqtt_retransmits_total", "In-flight messages requeued after a timeout or disconnect", NULL, false },
+    [METRIC_MQTT_CONNECTS]            = { "reader_mqtt_connects_total", "Successful broker connections", NULL, false },
+    [METRIC_HTTP_REQUESTS]            = { "reader_http_requests_total", "HTTP requests handled", NULL, false },
+    [METRIC_HTTP_ERRORS]              = { "reader_http_errors_total", "HTTP handlers that returned an error", NULL, false },
+    [METRIC_STREAM_DROPPED_FRAMES]    = { "reader_stream_dropped_frames_total", "LAN stream frames lost to a full client ring or a failed send", NULL, false },
+    [METRIC_MQTT_CONNECTED]           = { "reader_mqtt_connected", "1 while connected to the broker", NULL, true },
+    [METRIC_MQTT_QUEUE_MSGS]          = { "reader_mqtt_queue_messages", "Messages in the offline queue", NULL, true },
+    [METRIC_MQTT_QUEUE_BYTES]         = { "reader_mqtt_queue_bytes", "Bytes in the offline queue", NULL, true },
+    [METRIC_MQTT_INFLIGHT_MSGS]       = { "reader_mqtt_inflight_messages", "Messages awaiting PUBACK", NULL, true },
+    [METRIC_MQTT_BATCH_PENDING_TAGS]  = { "reader_mqtt_batch_pending_tags", "Changed tags waiting for the next batch", NULL, true },
+    [METRIC_RFID_ACTIVE_TAGS]         = { "reader_rfid_active_tags", "Tags in the tag table", NULL, true },
+    [METRIC_STREAM_CLIENTS]           = { "reader_stream_clients", "TCP clients on the LAN tag stream", NULL, true },
+    [METRIC_HEAP_FREE_BYTES]          = { "reader_heap_free_bytes", "Free heap", NULL, true },
+};
+
+// Histograms: counts[i] covers values <= bounds[i], counts[nbounds] is overflow
+typedef struct {
+    const char *name;
+    const char *help;
+    const uint32_t *bounds;
+    size_t nbounds;
+} hist_desc_t;
+
+static const uint32_t UART_READ_BOUNDS[] = {16, 32, 64, 128, 256, 512, 1024};
+static const uint32_t BATCH_TAGS_BOUNDS[] = {1, 5, 10, 25, 50, 100, 200, 500};
+static const uint32_t BATCH_LATENCY_BOUNDS_MS[] = {10, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+static const uint32_t CONNECT_BOUNDS_MS[] = {100, 250, 500, 1000, 2000, 5000, 10000, 30000};
+#define NBOUNDS(a) (sizeof(a) / sizeof((a)[0]))
+
+static const hist_desc_t s_hist_desc[METRIC_HIST_COUNT] = {
+    [METRIC_HIST_UART_READ_BYTES]  = { "reader_uart_read_bytes", "Bytes per UART read", UART_READ_BOUNDS, NBOUNDS(UART_READ_BOUNDS) },
+    [METRIC_HIST_BATCH_TAGS]       = { "reader_mqtt_batch_tags", "Tags per MQTT batch", BATCH_TAGS_BOUNDS, NBOUNDS(BATCH_TAGS_BOUNDS) },
+    [METRIC_HIST_BATCH_LATENCY_MS] = { "reader_mqtt_batch_latency_ms", "Age of the oldest change when a batch is flushed", BATCH_LATENCY_BOUNDS_MS, NBOUNDS(BATCH_LATENCY_BOUNDS_MS) },
+    [METRIC_HIST_MQTT_CONNECT_MS]  = { "reader_mqtt_connect_ms", "Connect attempt start to CONNACK", CONNECT_BOUNDS_MS, NBOUNDS(CONNECT_BOUNDS_MS) },
+};
+
+static _Atomic uint32_t s_hist_counts[METRIC_HIST_COUNT][METRICS_HIST_MAX_BOUNDS + 1];
+static _Atomic uint32_t s_hist_sum[METRIC_HIST_COUNT];   // Wraps at 2^32
+
+static uint32_t s_push_interval_s = 0;
+static uint32_t s_last_push_ms = 0;
+static volatile bool s_push_requested = false;
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000ULL);
+}
+
+void metrics_observe(metric_hist_id_t id, uint32_t value)
+{
+    const hist_desc_t *h = &s_hist_desc[id];
+    size_t i = 0;
+    while (i < h->nbounds && value > h->bounds[i]) i++;
+    atomic_fetch_add_explicit(&s_hist_counts[id][i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_hist_sum[id], value, memory_order_relaxed);
+}
+
+size_t metrics_hist_read(metric_hist_id_t id, const uint32_t **bounds, uint32_t *counts)
+{
+    const hist_desc_t *h = &s_hist_desc[id];
+    if (bounds) *bounds = h->bounds;
+    if (counts) {
+        for (size_t i = 0; i <= h->nbounds; i++) {
+            counts[i] = atomic_load_explicit(&s_hist_counts[id][i], memory_order_relaxed);
+        }
+    }
+    return h->nbounds;
+}
+
+void metrics_init(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        uint32_t v;
+        if (nvs_get_u32(h, "push_s", &v) == ESP_OK && (v == 0 || (v >= METRICS_PUSH_MIN_S && v <= METRICS_PUSH_MAX_S))) {
+            s_push_interval_s = v;
+        }
+        nvs_close(h);
+    }
+    s_last_push_ms = now_ms();
+    if (s_push_interval_s) {
+        ESP_LOGI(TAG, "Pushing metrics over MQTT every %lus", (unsigned long)s_push_interval_s);
+    }
+}
+
+static int render_family_header(char *out, int out_len, const char *name, const char *help, const char *type)
+{
+    return snprintf(out, out_len, "# HELP %s %s\n# TYPE %s %s\n", name, help ? help : "", name, type);
+}
+
+int metrics_render_prometheus(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+    out[0] = '\0';
+
+    metrics_set(METRIC_HEAP_FREE_BYTES, esp_get_free_heap_size());
+
+    int n = 0;
+    const char *family = NULL;
+    for (int i = 0; i < METRIC_COUNT && n < out_len; i++) {
+        const metric_desc_t *d = &s_desc[i];
+        if (!family || strcmp(family, d->name) != 0) {
+            family = d->name;
+            n += render_family_header(out + n, out_len - n, d->name, d->help, d->gauge ? "gauge" : "counter");
+            if (n >= out_len) break;
+        }
+        if (d->labels) {
+            n += snprintf(out + n, out_len - n, "%s{%s} %lu\n", d->name, d->labels, (unsigned long)metrics_get(i));
+        } else {
+            n += snprintf(out + n, out_len - n, "%s %lu\n", d->name, (unsigned long)metrics_get(i));
+        }
+    }
+
+    // Frames by message ID: only the IDs seen so far
+    if (n < out_len) {
+        n += render_family_header(out + n, out_len - n, "reader_rfid_frames_total",
+                                  "Frames received from the RFID module by message ID", "counter");
+    }
+    for (int mid = 0; mid < 256 && n < out_len; mid++) {
+        uint32_t v = atomic_load_explicit(&metrics_frames_by_mid[mid], memory_order_relaxed);
+        if (v) n += snprintf(out + n, out_len - n, "reader_rfid_frames_total{mid=\"0x%02X\"} %lu\n", mid, (unsigned long)v);
+    }
+
+    for (int id = 0; id < METRIC_HIST_COUNT && n < out_len; id++) {
+        const hist_desc_t *h = &s_hist_desc[id];
+        n += render_family_header(out + n, out_len - n, h->name, h->help, "histogram");
+        uint32_t cumulative = 0;
+        for (size_t b = 0; b <= h->nbounds && n < out_len; b++) {
+            cumulative += atomic_load_explicit(&s_hist_counts[id][b], memory_order_relaxed);
+            if (b < h->nbounds) {
+                n += snprintf(out + n, out_len - n, "%s_bucket{le=\"%lu\"} %lu\n", h->name,
+                              (unsigned long)h->bounds[b], (unsigned long)cumulative);
+            } else {
+                n += snprintf(out + n, out_len - n, "%s_bucket{le=\"+Inf\"} %lu\n", h->name, (unsigned long)cumulative);
+            }
+        }
+        if (n < out_len) {
+            n += snprintf(out + n, out_len - n, "%s_sum %lu\n%s_count %lu\n", h->name,
+                          (unsigned long)atomic_load_explicit(&s_hist_sum[id], memory_order_relaxed),
+                          h->name, (unsigned long)cumulative);
+        }
+    }
+    if (n < out_len) n += latency_render_prometheus(out + n, out_len - n);
+    if (n < out_len) n += tag_store_render_prometheus(out + n, out_len - n);
+
+    if (n >= out_len) {
+        ESP_LOGW(TAG, "Metrics output truncated at %d bytes", out_len);
+        n = out_len - 1;
+    }
+    return n;
+}
+
+int metrics_set_push_interval(uint32_t seconds)
+{
+    if (seconds != 0) {
+        if (seconds < METRICS_PUSH_MIN_S) seconds = METRICS_PUSH_MIN_S;
+        if (seconds > METRICS_PUSH_MAX_S) seconds = METRICS_PUSH_MAX_S;
+    }
+    s_push_interval_s = seconds;
+    s_last_push_ms = now_ms();
+    net_events_post(NET_EVT_CONFIG);
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+        return -1;
+    }
+    nvs_set_u32(h, "push_s", seconds);
+    err = nvs_commit(h);
+    nvs_close(h);
+
+    ESP_LOGI(TAG, "Metrics push interval: %lus", (unsigned long)seconds);
+    return (err == ESP_OK) ? 0 : -1;
+}
+
+uint32_t metrics_get_push_interval(void)
+{
+    return s_push_interval_s;
+}
+
+void metrics_request_push(void)
+{
+    s_push_requested = true;
+    net_events_post(NET_EVT_CONFIG);
+}
+
+uint32_t metrics_ms_until_push(void)
+{
+    if (s_push_requested) return 0;
+    if (s_push_interval_s == 0) return UINT32_MAX;
+    uint32_t age = now_ms() - s_last_push_ms;
+    uint32_t interval_ms = s_push_interval_s * 1000;
+    return (age >= interval_ms) ? 0 : interval_ms - age;
+}
+
+void metrics_push(void)
+{
+    s_push_requested = false;
+    s_last_push_ms = now_ms();
+    if (!mqtt_is_connected()) return;
+
+    char *buf = heap_caps_malloc(METRICS_RENDER_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) buf = malloc(METRICS_RENDER_MAX);
+    if (!buf) {
+        ESP_LOGE(TAG, "No memory for metrics push");
+        return;
+    }
+    metrics_render_prometheus(buf, METRICS_RENDER_MAX);
+    mqtt_publish_metrics(buf);
+    free(buf);
+}
@@ -0,0 +1,112 @@
+/* metrics.h - counters, gauges and fixed-bucket histograms for the hot paths
+ *
+ * Metrics are fixed at build time: an enum entry plus a row in the descriptor
+ * table in metrics.c. Updates are single relaxed atomic adds on a static array,
+ * safe from any task. GET /metrics renders Prometheus text; the same text can
+ * be pushed over MQTT on an interval. */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef enum {
+    // Counters
+    METRIC_UART_RX_BYTES = 0,
+    METRIC_UART_EVT_DATA,
+    METRIC_UART_EVT_FIFO_OVF,
+    METRIC_UART_EVT_BUFFER_FULL,
+    METRIC_UART_EVT_OTHER,
+    METRIC_RFID_CRC_ERRORS,
+    METRIC_RFID_PACKETS_SKIPPED,   // Received while inventory is stopped
+    METRIC_RFID_TAG_READS,
+    METRIC_RFID_TAG_EVICTIONS,
+    METRIC_RFID_TAG_DEPARTS,
+    METRIC_RFID_SEEN_RETURNS,      // New slot for an EPC the seen filter already held
+    METRIC_RFID_EPC_REJECTED,      // Reads dropped by the company-prefix rules
+    METRIC_RFID_RULE_DROPS,        // Reads dropped by the edge rules (RSSI, antenna, EPC mask)
+    METRIC_RFID_EPCDB_SUPPRESSED,  // Reads dropped by the EPC asset table
+    METRIC_MQTT_BATCHES_BY_TAGS,
+    METRIC_MQTT_BATCHES_BY_BYTES,
+    METRIC_MQTT_BATCHES_BY_DEADLINE,
+    METRIC_MQTT_BATCHED_TAGS,
+    METRIC_MQTT_SENT,
+    METRIC_MQTT_SEND_ERRORS,
+    METRIC_MQTT_ACKED,
+    METRIC_MQTT_RETRANSMITS,
+    METRIC_MQTT_CONNECTS,
+    METRIC_HTTP_REQUESTS,
+    METRIC_HTTP_ERRORS,
+    METRIC_STREAM_DROPPED_FRAMES,   // LAN stream frames lost to a full client ring or a failed send
+    // Gauges
+    METRIC_MQTT_CONNECTED,
+    METRIC_MQTT_QUEUE_MSGS,
+    METRIC_MQTT_QUEUE_BYTES,
+    METRIC_MQTT_INFLIGHT_MSGS,
+    METRIC_MQTT_BATCH_PENDING_TAGS,
+    METRIC_RFID_ACTIVE_TAGS,
+    METRIC_STREAM_CLIENTS,
+    METRIC_HEAP_FREE_BYTES,         // Sampled when rendered
+    METRIC_COUNT
+} metric_id_t;
+
+typedef enum {
+    METRIC_HIST_UART_READ_BYTES = 0,   // Bytes per UART_DATA read
+    METRIC_HIST_BATCH_TAGS,            // Tags per MQTT batch
+    METRIC_HIST_BATCH_LATENCY_MS,      // Oldest change in a batch -> flush
+    METRIC_HIST_MQTT_CONNECT_MS,       // Attempt start -> CONNACK
+    METRIC_HIST_COUNT
+} metric_hist_id_t;
+
+#define METRICS_HIST_MAX_BOUNDS 10
+
+// Counter and gauge storage; use the inline helpers below
+extern _Atomic uint32_t metrics_values[METRIC_COUNT];
+extern _Atomic uint32_t metrics_frames_by_mid[256];   // rfid_frames_total{mid=...}
+
+static inline void metrics_inc(metric_id_t id)
+{
+    atomic_fetch_add_explicit(&metrics_values[id], 1, memory_order_relaxed);
+}
+
+static inline void metrics_add(metric_id_t id, uint32_t n)
+{
+    atomic_fetch_add_explicit(&metrics_values[id], n, memory_order_relaxed);
+}
+
+static inline void metrics_set(metric_id_t id, uint32_t v)
+{
+    atomic_store_explicit(&metrics_values[id], v, memory_order_relaxed);
+}
+
+static inline uint32_t metrics_get(metric_id_t id)
+{
+    return atomic_load_explicit(&metrics_values[id], memory_order_relaxed);
+}
+
+static inline void metrics_count_frame(uint8_t mid)
+{
+    atomic_fetch_add_explicit(&metrics_frames_by_mid[mid], 1, memory_order_relaxed);
+}
+
+void metrics_observe(metric_hist_id_t id, uint32_t value);
+// Copy bucket counts (nbounds + 1 entries, the last is overflow); returns nbounds
+size_t metrics_hist_read(metric_hist_id_t id, const uint32_t **bounds, uint32_t *counts);
+
+void metrics_init(void);
+
+// Prometheus text exposition format; returns bytes written
+int metrics_render_prometheus(char *out, int out_len);
+#define METRICS_RENDER_MAX 12288
+
+// Optional MQTT push (0 = off), saved to NVS
+#define METRICS_PUSH_MIN_S 5
+#define METRICS_PUSH_MAX_S 3600
+int metrics_set_push_interval(uint32_t seconds);
+uint32_t metrics_get_push_interval(void);
+uint32_t metrics_ms_until_push(void);   // UINT32_MAX when push is off
+void metrics_request_push(void);        // One push as soon as the uplink task runs
+void metrics_push(void);                // Uplink task only
+
+#endif // METRICS_H
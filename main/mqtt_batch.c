@@ -0,0 +1,285 @@
+#include "mqtt_batch.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_config.h"
+#include "tag_store.h"
+#include "net_events.h"
+#include "metrics.h"
+
+static const char *TAG = "MQTT_BATCH";
+static const char *NVS_NAMESPACE = "mqtt_batch";
+
+static mqtt_batch_config_t s_cfg = {
+    .max_tags = MQTT_BATCH_DEFAULT_MAX_TAGS,
+    .max_bytes = MQTT_BATCH_DEFAULT_MAX_BYTES,
+    .max_latency_ms = MQTT_BATCH_DEFAULT_MAX_LATENCY,
+};
+
+// Pending work, updated by the UART task and reset by the uplink task on flush
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_pending_tags = 0;
+static uint32_t s_pending_bytes = 0;
+static uint32_t s_pending_since_ms = 0;   // When the oldest pending change happened
+static bool s_wake_sent = false;          // Uplink task already woken for a full batch
+
+// Serialization buffer, sized to max_bytes and owned by the uplink task
+static char *s_buf = NULL;
+static uint32_t s_buf_size = 0;
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000ULL);
+}
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void clamp_config(mqtt_batch_config_t *cfg)
+{
+    cfg->max_tags = clamp_u32(cfg->max_tags, 1, MQTT_BATCH_MAX_TAGS_LIMIT);
+    cfg->max_bytes = clamp_u32(cfg->max_bytes, MQTT_BATCH_MIN_BYTES, MQTT_BATCH_MAX_BYTES_LIMIT);
+    cfg->max_latency_ms = clamp_u32(cfg->max_latency_ms, MQTT_BATCH_MIN_LATENCY_MS, MQTT_BATCH_MAX_LATENCY_MS);
+}
+
+static void load_config(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) {
+        return; // Nothing saved yet, keep defaults
+    }
+    uint32_t v;
+    if (nvs_get_u32(h, "max_tags", &v) == ESP_OK) s_cfg.max_tags = v;
+    if (nvs_get_u32(h, "max_bytes", &v) == ESP_OK) s_cfg.max_bytes = v;
+    if (nvs_get_u32(h, "max_lat", &v) == ESP_OK) s_cfg.max_latency_ms = v;
+    nvs_close(h);
+    clamp_config(&s_cfg);
+}
+
+static bool ensure_buffer(void)
+{
+    if (s_buf && s_buf_size >= s_cfg.max_bytes) return true;
+
+    free(s_buf);
+    s_buf_size = 0;
+    s_buf = heap_caps_malloc(s_cfg.max_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_buf) {
+        s_buf = malloc(s_cfg.max_bytes);
+    }
+    if (!s_buf) {
+        ESP_LOGE(TAG, "Failed to allocate %lu byte batch buffer", (unsigned long)s_cfg.max_bytes);
+        return false;
+    }
+    s_buf_size = s_cfg.max_bytes;
+    return true;
+}
+
+void mqtt_batch_init(void)
+{
+    load_config();
+    ESP_LOGI(TAG, "Batching: max_tags=%lu max_bytes=%lu max_latency=%lums",
+             (unsigned long)s_cfg.max_tags, (unsigned long)s_cfg.max_bytes,
+             (unsigned long)s_cfg.max_latency_ms);
+}
+
+void mqtt_batch_get_config(mqtt_batch_config_t *cfg)
+{
+    if (cfg) *cfg = s_cfg;
+}
+
+int mqtt_batch_set_config(const mqtt_batch_config_t *cfg)
+{
+    if (!cfg) return -1;
+
+    mqtt_batch_config_t c = *cfg;
+    clamp_config(&c);
+    s_cfg = c;   // The buffer is resized by the uplink task on its next flush
+    net_events_post(NET_EVT_CONFIG);
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+        return -1;
+    }
+    nvs_set_u32(h, "max_tags", c.max_tags);
+    nvs_set_u32(h, "max_bytes", c.max_bytes);
+    nvs_set_u32(h, "max_lat", c.max_latency_ms);
+    err = nvs_commit(h);
+    nvs_close(h);
+
+    ESP_LOGI(TAG, "Batching updated: max_tags=%lu max_bytes=%lu max_latency=%lums",
+             (unsigned long)c.max_tags, (unsigned long)c.max_bytes, (unsigned long)c.max_latency_ms);
+    return (err == ESP_OK) ? 0 : -1;
+}
+
+void mqtt_batch_note_pending(uint32_t entry_bytes)
+{
+    bool wake = false;
+
+    taskENTER_CRITICAL(&s_lock);
+    if (s_pending_tags == 0) {
+        // First change of a batch starts its deadline; the uplink task must know
+        s_pending_since_ms = now_ms();
+        wake = true;
+    }
+    s_pending_tags++;
+    s_pending_bytes += entry_bytes;
+    if (!s_wake_sent && (s_pending_tags >= s_cfg.max_tags || s_pending_bytes >= s_cfg.max_bytes)) {
+        s_wake_sent = true;
+        wake = true;
+    }
+    uint32_t pending = s_pending_tags;
+    taskEXIT_CRITICAL(&s_lock);
+    metrics_set(METRIC_MQTT_BATCH_PENDING_TAGS, pending);
+
+    // New deadline, or a size threshold was hit: flush now rather than at the deadline
+    if (wake) {
+        net_events_post(NET_EVT_BATCH_READY);
+    }
+}
+
+uint32_t mqtt_batch_ms_until_due(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    uint32_t tags = s_pending_tags, bytes = s_pending_bytes, since = s_pending_since_ms;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (tags == 0) return UINT32_MAX;
+    if (tags >= s_cfg.max_tags || bytes >= s_cfg.max_bytes) return 0;
+
+    uint32_t age = now_ms() - since;
+    return (age >= s_cfg.max_latency_ms) ? 0 : s_cfg.max_latency_ms - age;
+}
+
+void mqtt_batch_flush(void)
+{
+    if (!ensure_buffer()) return;
+
+    taskENTER_CRITICAL(&s_lock);
+    uint32_t tags = s_pending_tags, bytes = s_pending_bytes, since = s_pending_since_ms;
+    taskEXIT_CRITICAL(&s_lock);
+    if (tags == 0) return;
+
+    uint32_t now = now_ms();
+    uint32_t age = now - since;
+
+    tag_batch_info_t info;
+    int used = tag_store_get_batch_json(s_buf, (int)s_buf_size, (int)s_cfg.max_tags, &info);
+
+    // Remove what was emitted; tags marked during the scan stay counted and
+    // whatever did not fit keeps its original deadline
+    taskENTER_CRITICAL(&s_lock);
+    if (info.tags == 0) {
+        // Counts drifted (e.g. pending tags evicted from the table): resync
+        s_pending_tags = info.remaining_tags;
+        s_pending_bytes = info.remaining_bytes;
+    } else {
+        s_pending_tags = (s_pending_tags > (uint32_t)info.tags) ? s_pending_tags - info.tags : 0;
+        s_pending_bytes = (s_pending_bytes > info.bytes) ? s_pending_bytes - info.bytes : 0;
+        if (s_pending_tags < (uint32_t)info.remaining_tags) s_pending_tags = info.remaining_tags;
+    }
+    if (s_pending_tags == 0) {
+        s_pending_bytes = 0;
+        s_pending_since_ms = 0;
+    } else if (info.remaining_tags == 0) {
+        s_pending_since_ms = now;
+    }
+    s_wake_sent = false;
+    uint32_t pending = s_pending_tags;
+    taskEXIT_CRITICAL(&s_lock);
+    metrics_set(METRIC_MQTT_BATCH_PENDING_TAGS, pending);
+
+    if (info.tags == 0 || used <= 0) return;
+
+    if (tags >= s_cfg.max_tags) metrics_inc(METRIC_MQTT_BATCHES_BY_TAGS);
+    else if (bytes >= s_cfg.max_bytes) metrics_inc(METRIC_MQTT_BATCHES_BY_BYTES);
+    else metrics_inc(METRIC_MQTT_BATCHES_BY_DEADLINE);
+    metrics_add(METRIC_MQTT_BATCHED_TAGS, info.tags);
+    metrics_observe(METRIC_HIST_BATCH_TAGS, (uint32_t)info.tags);
+    metrics_observe(METRIC_HIST_BATCH_LATENCY_MS, age);
+
+    mqtt_config_t cfg;
+    mqtt_get_config(&cfg);
+    char topic[128];
+    snprintf(topic, sizeof(topic), "reader/%s/data/batch", cfg.client_id);
+    mqtt_publish_buffered(topic, s_buf, info.oldest_rx_us);
+
+    ESP_LOGD(TAG, "Queued batch: %d tags, %d bytes, waited %lums, %d still pending",
+             info.tags, used, (unsigned long)age, info.remaining_tags);
+}
+
+void mqtt_batch_publish_departs(const tag_depart_t *tags, int count)
+{
+    if (!tags || count <= 0) return;
+
+    char buf[1024];
+    int used = snprintf(buf, sizeof(buf), "{\"event\":\"depart\",\"timeout_ms\":%lu,\"tags\":[",
+                        (unsigned long)tag_store_get_timeout_ms());
+    for (int i = 0; i < count; i++) {
+        int n = snprintf(buf + used, sizeof(buf) - used,
+                         "%s{\"epc\":\"%s\",\"reader\":%d,\"ant\":%d,\"readers\":%u,\"ts\":%llu,\"count\":%lu}",
+                         i ? "," : "", tags[i].epc, tags[i].reader, tags[i].ant, (unsigned)tags[i].readers,
+                         (unsigned long long)tags[i].last_ms, (unsigned long)tags[i].count);
+        if (n <= 0 || used + n + 3 > (int)sizeof(buf)) {
+            // Should not happen with the expiry chunk size; send what fits
+            ESP_LOGW(TAG, "DEPART event truncated to %d of %d tags", i, count);
+            break;
+        }
+        used += n;
+    }
+    snprintf(buf + used, sizeof(buf) - used, "]}");
+
+    mqtt_config_t cfg;
+    mqtt_get_config(&cfg);
+    char topic[128];
+    snprintf(topic, sizeof(topic), "reader/%s/data/events", cfg.client_id);
+    mqtt_publish_buffered(topic, buf, 0);
+}
+
+static int hist_json(char *out, int out_len, const char *name, metric_hist_id_t id)
+{
+    const uint32_t *bounds;
+    uint32_t counts[METRICS_HIST_MAX_BOUNDS + 1];
+    size_t nbounds = metrics_hist_read(id, &bounds, counts);
+    int used = snprintf(out, out_len, "\"%s\":{\"le\":[", name);
+    for (size_t i = 0; i < nbounds && used < out_len; i++) {
+        used += snprintf(out + used, out_len - used, "%s%lu", i ? "," : "", (unsigned long)bounds[i]);
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "],\"counts\":[");
+    for (size_t i = 0; i <= nbounds && used < out_len; i++) {
+        used += snprintf(out + used, out_len - used, "%s%lu", i ? "," : "", (unsigned long)counts[i]);
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "]}");
+    return used;
+}
+
+int mqtt_batch_get_stats_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    uint32_t by_tags = metrics_get(METRIC_MQTT_BATCHES_BY_TAGS);
+    uint32_t by_bytes = metrics_get(METRIC_MQTT_BATCHES_BY_BYTES);
+    uint32_t by_deadline = metrics_get(METRIC_MQTT_BATCHES_BY_DEADLINE);
+    uint32_t batches = by_tags + by_bytes + by_deadline;
+    int used = snprintf(out, out_len,
+        "{\"config\":{\"max_tags\":%lu,\"max_bytes\":%lu,\"max_latency_ms\":%lu},"
+        "\"batches\":%lu,\"tags\":%lu,\"pending_tags\":%lu,"
+        "\"flush_reason\":{\"tags\":%lu,\"bytes\":%lu,\"deadline\":%lu},",
+        (unsigned long)s_cfg.max_tags, (unsigned long)s_cfg.max_bytes, (unsigned long)s_cfg.max_latency_ms,
+        (unsigned long)batches, (unsigned long)metrics_get(METRIC_MQTT_BATCHED_TAGS), (unsigned long)s_pending_tags,
+        (unsigned long)by_tags, (unsigned long)by_bytes, (unsigned long)by_deadline);
+    if (used < out_len) used += hist_json(out + used, out_len - used, "size_tags", METRIC_HIST_BATCH_TAGS);
+    if (used < out_len) used += snprintf(out + used, out_len - used, ",");
+    if (used < out_len) used += hist_json(out + used, out_len - used, "latency_ms", METRIC_HIST_BATCH_LATENCY_MS);
+    if (used < out_len) used += snprintf(out + used, out_len - used, "}");
+    return used < out_len ? used : out_len - 1;
+}
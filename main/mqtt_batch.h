@@ -0,0 +1,42 @@
+/* mqtt_batch.h - size- and deadline-triggered batching of tag updates for MQTT */
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tag_store.h"
+
+// Defaults and accepted ranges for the batching thresholds
+#define MQTT_BATCH_DEFAULT_MAX_TAGS      200
+#define MQTT_BATCH_DEFAULT_MAX_BYTES     8192
+#define MQTT_BATCH_DEFAULT_MAX_LATENCY   1000
+#define MQTT_BATCH_MAX_TAGS_LIMIT        1000
+#define MQTT_BATCH_MIN_BYTES             512
+#define MQTT_BATCH_MAX_BYTES_LIMIT       16384
+#define MQTT_BATCH_MIN_LATENCY_MS        20
+#define MQTT_BATCH_MAX_LATENCY_MS        60000
+
+typedef struct {
+    uint32_t max_tags;        // Flush when this many changed tags are pending
+    uint32_t max_bytes;       // Flush when the pending batch would reach this size
+    uint32_t max_latency_ms;  // Flush when the oldest pending change is this old
+} mqtt_batch_config_t;
+
+void mqtt_batch_init(void);
+void mqtt_batch_get_config(mqtt_batch_config_t *cfg);
+int mqtt_batch_set_config(const mqtt_batch_config_t *cfg);   // Clamps, applies and saves to NVS
+
+// Called from the ingest path when a tag becomes pending for the MQTT batch
+void mqtt_batch_note_pending(uint32_t entry_bytes);
+
+// Queue a DEPART event for tags that expired from the MQTT view (data/events)
+void mqtt_batch_publish_departs(const tag_depart_t *tags, int count);
+
+// Milliseconds until the next flush is due (0 = now, UINT32_MAX = nothing pending)
+uint32_t mqtt_batch_ms_until_due(void);
+void mqtt_batch_flush(void);   // Uplink task only
+
+// Config, counters and batch size / latency histograms as JSON
+int mqtt_batch_get_stats_json(char *out, int out_len);
+
+#endif // MQTT_BATCH_H
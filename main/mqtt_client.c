@@ -1,21 +1,39 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "sdkconfig.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_timer.h"
 #include "mqtt_client.h"   // ESP-IDF MQTT client
-#include "esp_crt_bundle.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_crt_bundle.h"   // No certificate bundle on the linux target
+#endif
+#include "esp_transport_ssl.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "wifi.h"
 #include "mqtt_config.h"   // Our local MQTT configuration
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "rfid.h"
-#include "cJSON.h"
+#include "tag_store.h"
+#include "seen_filter.h"
+#include "epc_decode.h"
+#include "tag_rules.h"
+#include "tag_stream.h"
+#include "llrp.h"
+#include "mqtt_batch.h"
+#include "net_events.h"
+#include "boot.h"
+#include "metrics.h"
+#include "task_stats.h"
+#include "latency.h"
+#include "esp_random.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "json_tok.h"
 
 
 // Global variables for throttling
@@ -25,12 +43,19 @@ static const uint64_t PUBLISH_INTERVAL_MS = 500;  // Publish every 500ms to bala
 static const char *TAG = "MQTT";
 static const char *NVS_NAMESPACE = "mqtt_cfg";
 
-// Data buffering system for offline storage
-static mqtt_buffer_entry_t s_mqtt_buffer[MQTT_BUFFER_SIZE];
-static int s_buffer_head = 0;
-static int s_buffer_count = 0;
+// Data buffering system for offline storage (variable-length arena, see mqtt_queue.c)
 static bool s_buffer_initialized = false;
 
+// The event handler runs on the esp-mqtt task with the client lock held, so it
+// only records acks/disconnects here; the uplink task applies them to the queue.
+#define MQTT_ACK_QUEUE_LEN 32
+typedef struct {
+    int msg_id;
+    uint32_t ack_us;   // PUBACK arrival, for latency tracing
+} mqtt_ack_t;
+static QueueHandle_t s_ack_queue = NULL;
+static volatile bool s_requeue_pending = false;
+
 // Connection health monitoring
 static uint32_t s_last_successful_publish = 0;
 static uint32_t s_connection_health_failures = 0;
@@ -42,14 +67,92 @@ static bool s_mqtt_connecting = false;  // Add connecting state
 static uint64_t s_connection_start_time = 0;  // Track connection start time
 static bool s_mqtt_initialized = false;
 
+// Reconnect state machine, stepped by the uplink task (mqtt_reconnect_step)
+static mqtt_conn_state_t s_conn_state = MQTT_CONN_IDLE;
+static bool s_client_started = false;
+static volatile bool s_client_rebuild = false;     // Config changed: recreate the client
+static uint32_t s_next_attempt_ms = 0;
+static uint32_t s_attempt_start_ms = 0;
+static uint32_t s_attempt_dns_ms = 0;
+static volatile uint32_t s_before_connect_ms = 0;  // MQTT_EVENT_BEFORE_CONNECT timestamp
+static volatile uint32_t s_connack_ms = 0;         // MQTT_EVENT_CONNECTED timestamp
+static bool s_rtt_pending = false;                 // Take rtt_ms from the next PUBACK
+static uint32_t s_rtt_after_us = 0;                // ... of a publish sent after this
+static mqtt_conn_metrics_t s_conn_metrics = {0};
+
+// TLS: the SSL transport is created by us so session tickets can be enabled.
+// It is owned by the client and freed by esp_mqtt_client_destroy.
+static bool s_tls_session_saved = false;   // A handshake completed on this client
+static bool s_attempt_offers_ticket = false;
+static char *s_ca_pem = NULL;              // Pinned CA, must outlive the client
+
+// Commands are tokenized in place (json_tok.h). esp-mqtt delivers a payload
+// larger than its receive buffer as several MQTT_EVENT_DATA fragments; those
+// are joined here first. Both run on the esp-mqtt task only.
+#define MQTT_CMD_MAX_LEN    4096   // Largest command, fits a full rule set
+#define MQTT_CMD_MAX_TOKENS 512
+static char s_cmd_topic[128];
+static int s_cmd_topic_len = 0;
+static char s_cmd_buf[MQTT_CMD_MAX_LEN];
+static int s_cmd_total = -1;   // Length of the command being joined; -1 = none or dropped
+static json_tok_t s_cmd_toks[MQTT_CMD_MAX_TOKENS];
+
+// Rules bench: runs on its own low priority task so the MQTT task keeps
+// serving keepalives and acks, and answers with a second response
+static volatile bool s_rules_bench_busy = false;
+
+static void rules_bench_task(void *arg)
+{
+    tag_rules_bench_t b;
+    tag_rules_bench((int)(intptr_t)arg, &b);
+    char resp[224];
+    snprintf(resp, sizeof(resp),
+             "{\"command\":\"rfid\",\"action\":\"rules\",\"status\":\"success\",\"bench\":"
+             "{\"iterations\":%lu,\"ns_per_read\":%lu,\"full_ns_per_read\":%lu,\"full_rules\":%d}}",
+             (unsigned long)b.iterations, (unsigned long)b.current_ns, (unsigned long)b.full_ns, TAG_RULES_MAX);
+    mqtt_publish_response(resp);
+    s_rules_bench_busy = false;
+    vTaskDelete(NULL);
+}
+
+static void mqtt_command_fragment(esp_mqtt_event_handle_t event)
+{
+    if (event->current_data_offset == 0) {
+        // The first fragment carries the topic
+        s_cmd_topic_len = (event->topic_len < (int)sizeof(s_cmd_topic)) ? event->topic_len : (int)sizeof(s_cmd_topic);
+        memcpy(s_cmd_topic, event->topic, s_cmd_topic_len);
+        s_cmd_total = event->total_data_len;
+        if (s_cmd_total > MQTT_CMD_MAX_LEN) {
+            ESP_LOGW(TAG, "Command of %d bytes on %.*s dropped", s_cmd_total, s_cmd_topic_len, s_cmd_topic);
+            mqtt_publish_response("{\"status\":\"error\",\"message\":\"Command too large\"}");
+            s_cmd_total = -1;
+        }
+    }
+    if (s_cmd_total < 0 || event->total_data_len != s_cmd_total ||
+        event->current_data_offset + event->data_len > s_cmd_total) {
+        return;   // Rest of a dropped command, or a fragment without its start
+    }
+    memcpy(s_cmd_buf + event->current_data_offset, event->data, event->data_len);
+    if (event->current_data_offset + event->data_len == s_cmd_total) {
+        mqtt_process_command(s_cmd_topic, s_cmd_topic_len, s_cmd_buf, s_cmd_total);
+        s_cmd_total = -1;
+    }
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
 
     switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+        // Transport connect (TCP + TLS) starts right after this event
+        s_before_connect_ms = esp_timer_get_time() / 1000ULL;
+        break;
+
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT Connected");
+        s_connack_ms = esp_timer_get_time() / 1000ULL;
         s_mqtt_connected = true;
         s_mqtt_connecting = false;  // Clear connecting state
         
@@ -65,6 +168,15 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         
         snprintf(cmd_topic, sizeof(cmd_topic), "reader/%s/cmd/inventory", s_mqtt_config.client_id);
         esp_mqtt_client_subscribe(client, cmd_topic, 1);
+        
+        snprintf(cmd_topic, sizeof(cmd_topic), "reader/%s/cmd/batch", s_mqtt_config.client_id);
+        esp_mqtt_client_subscribe(client, cmd_topic, 1);
+        
+        snprintf(cmd_topic, sizeof(cmd_topic), "reader/%s/cmd/metrics", s_mqtt_config.client_id);
+        esp_mqtt_client_subscribe(client, cmd_topic, 1);
+        
+        snprintf(cmd_topic, sizeof(cmd_topic), "reader/%s/cmd/debug", s_mqtt_config.client_id);
+        esp_mqtt_client_subscribe(client, cmd_topic, 1);
         ESP_LOGI(TAG, "Subscribed to inventory commands: %s", cmd_topic);
         
         // Subscribe to legacy command topic if configured
@@ -76,8 +188,8 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         // Publish connection status
         mqtt_publish_status("online");
         
-        // Flush any buffered data after successful connection
-        mqtt_flush_buffer();
+        // Uplink task flushes buffered data after successful connection
+        net_events_post(NET_EVT_MQTT_CONNECTED);
         break;
 
     case MQTT_EVENT_DISCONNECTED:
@@ -85,8 +197,11 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         s_mqtt_connected = false;
         s_mqtt_connecting = false;  // Clear connecting state on disconnect
         
-        // Schedule automatic reconnection after a short delay
-        // The main task will handle the reconnection
+        // Unacknowledged messages go back to pending and are resent after reconnect
+        s_requeue_pending = true;
+        
+        // The uplink task handles the reconnection
+        net_events_post(NET_EVT_MQTT_DISCONNECTED);
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -98,16 +213,26 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
 
     case MQTT_EVENT_PUBLISHED:
-        ESP_LOGI(TAG, "MQTT Published, msg_id=%d", event->msg_id);
+        ESP_LOGD(TAG, "MQTT Published, msg_id=%d", event->msg_id);
+        // PUBACK: uplink task releases the queued record and refills the window
+        mqtt_ack_t ack = { .msg_id = event->msg_id, .ack_us = latency_now_us() };
+        if (s_ack_queue && xQueueSend(s_ack_queue, &ack, 0) != pdTRUE) {
+            // The record stays in flight until MQTT_INFLIGHT_TIMEOUT_MS sends it again
+            ESP_LOGW(TAG, "Ack queue full, PUBACK for msg_id=%d lost; resent after the in-flight timeout",
+                     event->msg_id);
+        }
+        net_events_post(NET_EVT_MQTT_ACK);
         break;
 
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "MQTT Data received");
-        ESP_LOGI(TAG, "Topic: %.*s", event->topic_len, event->topic);
-        ESP_LOGI(TAG, "Data: %.*s", event->data_len, event->data);
-        
-        // Process received commands
-        mqtt_process_command(event->topic, event->topic_len, event->data, event->data_len);
+        if (event->data_len == event->total_data_len) {
+            // Process received commands straight from the receive buffer
+            mqtt_process_command(event->topic, event->topic_len, event->data, event->data_len);
+        } else {
+            ESP_LOGI(TAG, "Fragment %d+%d of %d bytes", event->current_data_offset, event->data_len, event->total_data_len);
+            mqtt_command_fragment(event);
+        }
         break;
 
     case MQTT_EVENT_ERROR:
@@ -145,18 +270,6 @@ void mqtt_init(void)
         return;
     }
 
-    // Initialize data buffer
-    if (!s_buffer_initialized) {
-        memset(s_mqtt_buffer, 0, sizeof(s_mqtt_buffer));
-        s_buffer_head = 0;
-        s_buffer_count = 0;
-        s_buffer_initialized = true;
-        ESP_LOGI(TAG, "MQTT data buffer initialized (%d entries)", MQTT_BUFFER_SIZE);
-        
-        // Load any persisted data from NVS
-        mqtt_load_buffer_from_nvs();
-    }
-
     // Initialize with default configuration
     memset(&s_mqtt_config, 0, sizeof(mqtt_config_t));
     strcpy(s_mqtt_config.broker_uri, "mqtts://9f9bbeafeb6a45d6b8dd97ca6951480d.s1.eu.hivemq.cloud:8883");
@@ -168,6 +281,16 @@ void mqtt_init(void)
 
     // Try to load saved configuration (will override defaults if available)
     mqtt_load_config(&s_mqtt_config);
+
+    // Initialize data buffer (needs the configured drop policy)
+    if (!s_buffer_initialized) {
+        s_buffer_initialized = mqtt_queue_init((mqtt_queue_policy_t)s_mqtt_config.queue_policy);
+        s_ack_queue = xQueueCreate(MQTT_ACK_QUEUE_LEN, sizeof(mqtt_ack_t));
+
+        // Load any persisted data from NVS
+        mqtt_load_buffer_from_nvs();
+    }
+    mqtt_batch_init();
     
     s_mqtt_initialized = true;
     ESP_LOGI(TAG, "MQTT module initialized with broker: %s", s_mqtt_config.broker_uri);
@@ -208,6 +331,11 @@ void mqtt_set_config(const mqtt_config_t* config)
         
         // Clean and validate the broker URI
         mqtt_validate_broker_uri(s_mqtt_config.broker_uri);
+        mqtt_queue_set_policy((mqtt_queue_policy_t)s_mqtt_config.queue_policy);
+        
+        // The uplink task recreates the client with the new settings
+        s_client_rebuild = true;
+        net_events_post(NET_EVT_CONFIG);
         
         ESP_LOGI(TAG, "MQTT config updated: broker=%s, client_id=%s", 
                  s_mqtt_config.broker_uri, s_mqtt_config.client_id);
@@ -246,6 +374,8 @@ int mqtt_save_config(const mqtt_config_t* config)
     nvs_set_str(h, "password", config->password);
     nvs_set_str(h, "pub_topic", config->publish_topic);
     nvs_set_str(h, "sub_topic", config->subscribe_topic);
+    nvs_set_u8(h, "q_policy", (uint8_t)config->queue_policy);
+    nvs_set_u8(h, "ca_mode", (uint8_t)config->ca_mode);
 
     err = nvs_commit(h);
     nvs_close(h);
@@ -311,12 +441,87 @@ int mqtt_load_config(mqtt_config_t* config)
         ESP_LOGW(TAG, "Failed to load subscribe_topic: %s", esp_err_to_name(ret));
     }
 
+    uint8_t policy = 0;
+    if (nvs_get_u8(h, "q_policy", &policy) == ESP_OK) {
+        config->queue_policy = (policy == MQTT_QUEUE_DROP_NEWEST) ? MQTT_QUEUE_DROP_NEWEST : MQTT_QUEUE_DROP_OLDEST;
+    }
+    uint8_t ca_mode = 0;
+    if (nvs_get_u8(h, "ca_mode", &ca_mode) == ESP_OK) {
+        config->ca_mode = (ca_mode == MQTT_CA_PINNED) ? MQTT_CA_PINNED : MQTT_CA_BUNDLE;
+    }
+
     nvs_close(h);
     
     ESP_LOGI(TAG, "MQTT config loaded: broker=%s", config->broker_uri);
     return 0;
 }
 
+int mqtt_set_ca_pem(const char* pem, size_t len)
+{
+    if (!pem || len == 0 || len > MQTT_CA_PEM_MAX_LEN || !strstr(pem, "-----BEGIN CERTIFICATE-----")) {
+        ESP_LOGE(TAG, "Rejected CA certificate: not a PEM certificate or too large");
+        return -1;
+    }
+    
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+        return -1;
+    }
+    err = nvs_set_blob(h, "ca_pem", pem, len);
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save CA certificate: %s", esp_err_to_name(err));
+        return -1;
+    }
+    
+    ESP_LOGI(TAG, "Pinned CA certificate saved (%d bytes)", (int)len);
+    if (s_mqtt_config.ca_mode == MQTT_CA_PINNED) {
+        s_client_rebuild = true;
+        net_events_post(NET_EVT_CONFIG);
+    }
+    return 0;
+}
+
+// Load the pinned CA into s_ca_pem (NUL-terminated, as mbedTLS expects for PEM)
+static bool mqtt_load_ca_pem(void)
+{
+    free(s_ca_pem);
+    s_ca_pem = NULL;
+    
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return false;
+    size_t len = 0;
+    if (nvs_get_blob(h, "ca_pem", NULL, &len) == ESP_OK && len > 0 && len <= MQTT_CA_PEM_MAX_LEN) {
+        s_ca_pem = malloc(len + 1);
+        if (s_ca_pem && nvs_get_blob(h, "ca_pem", s_ca_pem, &len) == ESP_OK) {
+            s_ca_pem[len] = '\0';
+        } else {
+            free(s_ca_pem);
+            s_ca_pem = NULL;
+        }
+    }
+    nvs_close(h);
+    return s_ca_pem != NULL;
+}
+
+bool mqtt_has_ca_pem(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return false;
+    size_t len = 0;
+    bool found = (nvs_get_blob(h, "ca_pem", NULL, &len) == ESP_OK && len > 0);
+    nvs_close(h);
+    return found;
+}
+
+const char* mqtt_ca_mode_name(int ca_mode)
+{
+    return (ca_mode == MQTT_CA_PINNED) ? "pinned" : "bundle";
+}
+
 // Helper function to extract hostname from URI for DNS testing
 static bool mqtt_extract_hostname(const char* uri, char* hostname, size_t hostname_size, int* port)
 {
@@ -373,48 +578,10 @@ static bool mqtt_extract_hostname(const char* uri, char* hostname, size_t hostna
     return true;
 }
 
-void mqtt_connect(void)
+// Create and start the client. esp-mqtt's own fixed-interval reconnect is
+// disabled; retries are scheduled by mqtt_reconnect_step with backoff.
+static bool mqtt_client_create(void)
 {
-    if (!wifi_is_connected()) {
-        ESP_LOGW(TAG, "WiFi not connected, cannot start MQTT");
-        return;
-    }
-
-    if (strlen(s_mqtt_config.broker_uri) == 0) {
-        ESP_LOGW(TAG, "MQTT broker URI not configured");
-        return;
-    }
-    
-    // Extract and validate hostname from URI
-    char hostname[128];
-    int port;
-    if (mqtt_extract_hostname(s_mqtt_config.broker_uri, hostname, sizeof(hostname), &port)) {
-        ESP_LOGI(TAG, "Extracted hostname: '%s', port: %d from URI: '%s'", hostname, port, s_mqtt_config.broker_uri);
-    } else {
-        ESP_LOGE(TAG, "Failed to extract hostname from URI: '%s'", s_mqtt_config.broker_uri);
-        return;
-    }
-
-    // Prevent multiple client instances
-    if (s_mqtt_client) {
-        if (s_mqtt_connected) {
-            ESP_LOGI(TAG, "MQTT already connected");
-            return;
-        }
-        if (s_mqtt_connecting) {
-            ESP_LOGI(TAG, "MQTT connection already in progress");
-            return;
-        }
-        ESP_LOGI(TAG, "Stopping existing MQTT client");
-        esp_mqtt_client_stop(s_mqtt_client);
-        esp_mqtt_client_destroy(s_mqtt_client);
-        s_mqtt_client = NULL;
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Wait for cleanup
-    }
-
-    s_mqtt_connecting = true;  // Set connecting state
-    s_connection_start_time = esp_timer_get_time() / 1000ULL; // Store start time in ms
-
     // Add debugging for broker URI
     ESP_LOGI(TAG, "Connecting to MQTT broker: '%s'", s_mqtt_config.broker_uri);
     ESP_LOGI(TAG, "Client ID: '%s'", s_mqtt_config.client_id);
@@ -425,13 +592,38 @@ void mqtt_connect(void)
     // Configure broker address
     mqtt_cfg.broker.address.uri = s_mqtt_config.broker_uri;
     
-    // Configure TLS for MQTTS
+    // Configure TLS for MQTTS on our own SSL transport so session tickets
+    // survive reconnects of this client
+    s_conn_metrics.tickets_enabled = false;
     if (strncmp(s_mqtt_config.broker_uri, "mqtts://", 8) == 0) {
-        ESP_LOGI(TAG, "Configuring TLS for MQTTS connection with certificate bundle");
-        mqtt_cfg.broker.verification.use_global_ca_store = false;
-        mqtt_cfg.broker.verification.crt_bundle_attach = esp_crt_bundle_attach;
-        mqtt_cfg.broker.verification.skip_cert_common_name_check = false;
-        mqtt_cfg.broker.verification.certificate = NULL;
+        esp_transport_handle_t ssl = esp_transport_ssl_init();
+        if (!ssl) {
+            ESP_LOGE(TAG, "Failed to create SSL transport");
+            return false;
+        }
+        esp_transport_set_default_port(ssl, 8883);
+        
+        if (s_mqtt_config.ca_mode == MQTT_CA_PINNED && mqtt_load_ca_pem()) {
+            ESP_LOGI(TAG, "Verifying broker against pinned CA certificate");
+            esp_transport_ssl_set_cert_data(ssl, s_ca_pem, strlen(s_ca_pem) + 1);
+        } else {
+#if CONFIG_IDF_TARGET_LINUX
+            ESP_LOGE(TAG, "MQTTS on the linux target needs a pinned CA certificate");
+            esp_transport_destroy(ssl);
+            return false;
+#else
+            if (s_mqtt_config.ca_mode == MQTT_CA_PINNED) {
+                ESP_LOGW(TAG, "No pinned CA stored, falling back to certificate bundle");
+            }
+            ESP_LOGI(TAG, "Configuring TLS for MQTTS connection with certificate bundle");
+            esp_transport_ssl_crt_bundle_attach(ssl, esp_crt_bundle_attach);
+#endif
+        }
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        esp_transport_ssl_session_tickets_enable(ssl);
+        s_conn_metrics.tickets_enabled = true;
+#endif
+        mqtt_cfg.network.transport = ssl;
     }
     
     // Session configuration
@@ -440,9 +632,9 @@ void mqtt_connect(void)
     mqtt_cfg.session.disable_keepalive = false;
     
     // Network configuration  
-    mqtt_cfg.network.timeout_ms = 30000;
+    mqtt_cfg.network.timeout_ms = MQTT_NETWORK_TIMEOUT_MS;
     mqtt_cfg.network.refresh_connection_after_ms = 0;
-    mqtt_cfg.network.reconnect_timeout_ms = 5000;
+    mqtt_cfg.network.disable_auto_reconnect = true;
     
     // Buffer configuration
     mqtt_cfg.buffer.size = 16384;
@@ -466,12 +658,250 @@ void mqtt_connect(void)
     }
 
     s_mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+    if (!s_mqtt_client) {
+        ESP_LOGE(TAG, "Failed to initialize MQTT client");
+        return false;
+    }
+    esp_mqtt_client_register_event(s_mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    return true;
+}
+
+static void mqtt_client_teardown(void)
+{
     if (s_mqtt_client) {
-        esp_mqtt_client_register_event(s_mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-        esp_mqtt_client_start(s_mqtt_client);
-        ESP_LOGI(TAG, "MQTT client started");
+        ESP_LOGI(TAG, "Destroying MQTT client");
+        esp_mqtt_client_destroy(s_mqtt_client);   // Stops the client task first
+        s_mqtt_client = NULL;
+    }
+    s_client_started = false;
+    s_tls_session_saved = false;
+    if (s_mqtt_connected) {
+        s_requeue_pending = true;
+    }
+    s_mqtt_connected = false;
+    s_mqtt_connecting = false;
+}
+
+// Exponential backoff with equal jitter: half the window is fixed, half is
+// random, so a fleet that lost the broker together does not retry together.
+static uint32_t mqtt_backoff_delay(uint32_t failures)
+{
+    uint32_t window = MQTT_BACKOFF_BASE_MS;
+    for (uint32_t i = 0; i < failures && window < MQTT_BACKOFF_MAX_MS; i++) {
+        window *= 2;
+    }
+    if (window > MQTT_BACKOFF_MAX_MS) window = MQTT_BACKOFF_MAX_MS;
+    return window / 2 + esp_random() % (window / 2 + 1);
+}
+
+static void mqtt_schedule_retry(uint32_t now, uint32_t failures)
+{
+    uint32_t delay = mqtt_backoff_delay(failures);
+    s_conn_metrics.failures = failures;
+    s_conn_metrics.backoff_ms = delay;
+    s_next_attempt_ms = now + delay;
+    s_conn_state = MQTT_CONN_BACKOFF;
+    ESP_LOGI(TAG, "Next MQTT connection attempt in %lu ms (failures: %lu)",
+             (unsigned long)delay, (unsigned long)failures);
+}
+
+// Resolve the broker, then (re)start the client.
+// Returns false if the attempt failed before reaching esp-mqtt.
+static bool mqtt_start_attempt(uint32_t now)
+{
+    if (strlen(s_mqtt_config.broker_uri) == 0) {
+        ESP_LOGW(TAG, "MQTT broker URI not configured");
+        return false;
+    }
+    
+    // Extract and validate hostname from URI
+    char hostname[128];
+    int port;
+    if (mqtt_extract_hostname(s_mqtt_config.broker_uri, hostname, sizeof(hostname), &port)) {
+        ESP_LOGI(TAG, "Extracted hostname: '%s', port: %d from URI: '%s'", hostname, port, s_mqtt_config.broker_uri);
     } else {
-        ESP_LOGE(TAG, "Failed to initialize MQTT client");
+        ESP_LOGE(TAG, "Failed to extract hostname from URI: '%s'", s_mqtt_config.broker_uri);
+        return false;
+    }
+
+    s_conn_metrics.attempts++;
+    s_attempt_start_ms = now;
+    
+    // DNS phase. The result lands in the lwIP cache, so the transport's own
+    // lookup inside esp-mqtt is effectively free.
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    int64_t t0 = esp_timer_get_time();
+    int gai = getaddrinfo(hostname, port_str, &hints, &res);
+    s_attempt_dns_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (gai != 0 || !res) {
+        ESP_LOGE(TAG, "DNS resolution failed for '%s' (%d)", hostname, gai);
+        return false;
+    }
+    freeaddrinfo(res);
+
+    s_mqtt_connecting = true;  // Set connecting state
+    s_connection_start_time = esp_timer_get_time() / 1000ULL; // Store start time in ms
+    s_before_connect_ms = 0;
+    s_attempt_offers_ticket = s_conn_metrics.tickets_enabled && s_tls_session_saved;
+    
+    esp_err_t err;
+    if (!s_mqtt_client && !mqtt_client_create()) {
+        err = ESP_FAIL;
+    } else if (!s_client_started) {
+        err = esp_mqtt_client_start(s_mqtt_client);
+        s_client_started = (err == ESP_OK);
+    } else {
+        // Reuse the existing client and its outbox
+        err = esp_mqtt_client_reconnect(s_mqtt_client);
+    }
+    
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT connection: %s", esp_err_to_name(err));
+        s_mqtt_connecting = false;
+        return false;
+    }
+    ESP_LOGI(TAG, "MQTT connection attempt %lu started", (unsigned long)s_conn_metrics.attempts);
+    return true;
+}
+
+static void mqtt_record_connect_phases(void)
+{
+    uint32_t session = (s_before_connect_ms && s_connack_ms >= s_before_connect_ms)
+                       ? s_connack_ms - s_before_connect_ms : 0;
+    
+    s_conn_metrics.connects++;
+    metrics_inc(METRIC_MQTT_CONNECTS);
+    boot_mark(BOOT_MARK_MQTT_CONNECTED);
+    s_conn_metrics.dns_ms = s_attempt_dns_ms;
+    s_conn_metrics.session_ms = session;
+    // The phase split waits for a round trip measured on this connection
+    s_conn_metrics.rtt_ms = 0;
+    s_conn_metrics.est_tcp_ms = s_conn_metrics.est_tls_ms = s_conn_metrics.est_connack_ms = 0;
+    s_rtt_after_us = latency_now_us();
+    s_rtt_pending = true;
+    s_conn_metrics.total_ms = s_connack_ms - s_attempt_start_ms;
+    metrics_observe(METRIC_HIST_MQTT_CONNECT_MS, s_conn_metrics.total_ms);
+    if (s_attempt_offers_ticket) {
+        s_conn_metrics.ticket_offered++;
+        s_conn_metrics.session_ticket_offered_ms = session;
+    } else if (strncmp(s_mqtt_config.broker_uri, "mqtts://", 8) == 0) {
+        s_conn_metrics.full_handshakes++;
+        s_conn_metrics.session_full_ms = session;
+    }
+    s_tls_session_saved = true;
+    
+    ESP_LOGI(TAG, "Connected after %lu ms: dns=%lu session=%lu (%s)",
+             (unsigned long)s_conn_metrics.total_ms, (unsigned long)s_conn_metrics.dns_ms,
+             (unsigned long)session, s_attempt_offers_ticket ? "ticket offered" : "full handshake");
+}
+
+// First PUBACK of a publish sent on the current connection: one round trip,
+// which splits session_ms into estimated phases
+static void mqtt_record_rtt(uint32_t sent_us, uint32_t ack_us)
+{
+    if (!s_rtt_pending || sent_us == 0 || (int32_t)(sent_us - s_rtt_after_us) < 0) return;
+    s_rtt_pending = false;
+    uint32_t rtt = (ack_us - sent_us + 999) / 1000;   // Never 0 once measured
+    uint32_t session = s_conn_metrics.session_ms;
+    s_conn_metrics.rtt_ms = rtt;
+    s_conn_metrics.est_tcp_ms = rtt;
+    s_conn_metrics.est_connack_ms = rtt;
+    s_conn_metrics.est_tls_ms = (session > 2 * rtt) ? session - 2 * rtt : 0;
+    ESP_LOGI(TAG, "Broker round trip %lu ms: tcp~%lu tls~%lu connack~%lu",
+             (unsigned long)rtt, (unsigned long)s_conn_metrics.est_tcp_ms,
+             (unsigned long)s_conn_metrics.est_tls_ms, (unsigned long)s_conn_metrics.est_connack_ms);
+}
+
+uint32_t mqtt_reconnect_step(bool link_up)
+{
+    uint32_t now = esp_timer_get_time() / 1000ULL;
+    
+    if (s_client_rebuild) {
+        s_client_rebuild = false;
+        mqtt_client_teardown();
+        s_conn_state = MQTT_CONN_IDLE;
+    }
+    
+    switch (s_conn_state) {
+    case MQTT_CONN_IDLE:
+        if (!link_up) return UINT32_MAX;
+        // Readers powered up together should not all connect at once either
+        s_next_attempt_ms = now + esp_random() % MQTT_BACKOFF_BASE_MS;
+        s_conn_metrics.failures = 0;
+        s_conn_state = MQTT_CONN_BACKOFF;
+        /* fall through */
+    case MQTT_CONN_BACKOFF: {
+        if (!link_up) {
+            s_conn_state = MQTT_CONN_IDLE;
+            return UINT32_MAX;
+        }
+        int32_t wait = (int32_t)(s_next_attempt_ms - now);
+        if (wait > 0) return (uint32_t)wait;
+        
+        if (!mqtt_start_attempt(now)) {
+            mqtt_schedule_retry(now, s_conn_metrics.failures + 1);
+            return s_conn_metrics.backoff_ms;
+        }
+        s_conn_state = MQTT_CONN_CONNECTING;
+        return MQTT_CONNECT_TIMEOUT_MS;
+    }
+    case MQTT_CONN_CONNECTING: {
+        if (s_mqtt_connected) {
+            mqtt_record_connect_phases();
+            s_conn_metrics.failures = 0;
+            s_connection_health_failures = 0;
+            s_conn_state = MQTT_CONN_CONNECTED;
+            return UINT32_MAX;
+        }
+        uint32_t elapsed = now - s_attempt_start_ms;
+        if (s_mqtt_connecting && elapsed < MQTT_CONNECT_TIMEOUT_MS) {
+            return MQTT_CONNECT_TIMEOUT_MS - elapsed;
+        }
+        ESP_LOGW(TAG, "MQTT connection attempt failed%s", s_mqtt_connecting ? " (timeout)" : "");
+        s_mqtt_connecting = false;
+        mqtt_schedule_retry(now, s_conn_metrics.failures + 1);
+        return s_conn_metrics.backoff_ms;
+    }
+    case MQTT_CONN_CONNECTED:
+        if (s_mqtt_connected) return UINT32_MAX;
+        ESP_LOGW(TAG, "MQTT connection lost");
+        mqtt_schedule_retry(now, 0);
+        return s_conn_metrics.backoff_ms;
+    }
+    return UINT32_MAX;
+}
+
+void mqtt_get_conn_metrics(mqtt_conn_metrics_t* metrics)
+{
+    if (!metrics) return;
+    *metrics = s_conn_metrics;
+    metrics->state = s_conn_state;
+    uint32_t now = esp_timer_get_time() / 1000ULL;
+    int32_t wait = (int32_t)(s_next_attempt_ms - now);
+    metrics->next_retry_in_ms = (s_conn_state == MQTT_CONN_BACKOFF && wait > 0) ? (uint32_t)wait : 0;
+}
+
+const char* mqtt_conn_state_name(mqtt_conn_state_t state)
+{
+    switch (state) {
+    case MQTT_CONN_IDLE:       return "idle";
+    case MQTT_CONN_BACKOFF:    return "backoff";
+    case MQTT_CONN_CONNECTING: return "connecting";
+    case MQTT_CONN_CONNECTED:  return "connected";
+    }
+    return "unknown";
+}
+
+// Request an immediate connection attempt (skips the remaining backoff)
+void mqtt_connect(void)
+{
+    if (s_conn_state == MQTT_CONN_BACKOFF || s_conn_state == MQTT_CONN_IDLE) {
+        s_next_attempt_ms = esp_timer_get_time() / 1000ULL;
+        if (s_conn_state == MQTT_CONN_IDLE) s_conn_state = MQTT_CONN_BACKOFF;
+        net_events_post(NET_EVT_CONFIG);
     }
 }
 
@@ -480,7 +910,13 @@ void mqtt_disconnect(void)
     if (s_mqtt_client) {
         mqtt_publish_status("offline");
         esp_mqtt_client_stop(s_mqtt_client);
+        s_client_started = false;
+        if (s_mqtt_connected) {
+            s_requeue_pending = true;   // Stop does not report DISCONNECTED
+        }
         s_mqtt_connected = false;
+        s_mqtt_connecting = false;
+        net_events_post(NET_EVT_MQTT_DISCONNECTED);
         ESP_LOGI(TAG, "MQTT disconnected");
     }
 }
@@ -496,9 +932,9 @@ bool mqtt_is_connecting(void)
         return false;
     }
     
-    // Check for connection timeout (30 seconds)
+    // Check for connection timeout
     uint64_t current_time = esp_timer_get_time() / 1000ULL;
-    if (current_time - s_connection_start_time > 30000) {
+    if (current_time - s_connection_start_time > MQTT_CONNECT_TIMEOUT_MS) {
         ESP_LOGW(TAG, "MQTT connection timeout, resetting connecting state");
         s_mqtt_connecting = false;
         return false;
@@ -558,64 +994,264 @@ void mqtt_process_command(const char* topic, int topic_len, const char* data, in
         return;
     }
     
-    // Copy topic and data to null-terminated strings
+    // Copy the topic to a null-terminated string; the payload is parsed in place
     char topic_str[128];
-    char data_str[256];
-    
     int copy_len = (topic_len < sizeof(topic_str) - 1) ? topic_len : sizeof(topic_str) - 1;
     strncpy(topic_str, topic, copy_len);
     topic_str[copy_len] = '\0';
     
-    copy_len = (data_len < sizeof(data_str) - 1) ? data_len : sizeof(data_str) - 1;
-    strncpy(data_str, data, copy_len);
-    data_str[copy_len] = '\0';
-    
-    ESP_LOGI(TAG, "Processing command - Topic: %s, Data: %s", topic_str, data_str);
+    ESP_LOGI(TAG, "Processing command - Topic: %s, Data: %.*s", topic_str, data_len, data);
     
     // Parse JSON command
-    cJSON *json = cJSON_Parse(data_str);
-    if (!json) {
+    json_doc_t doc;
+    if (json_parse(&doc, data, data_len, s_cmd_toks, MQTT_CMD_MAX_TOKENS) < 0) {
         mqtt_publish_response("{\"status\":\"error\",\"message\":\"Invalid JSON\"}");
         return;
     }
     
+    // Optional "reader" index; commands go to every enabled reader without it
+    int reader = RFID_ALL_READERS;
+    json_get_int(&doc, json_obj_get(&doc, 0, "reader"), &reader);
+    
+    // Every topic routes on "action"
+    char action[32];
+    bool has_action = json_get_str(&doc, json_obj_get(&doc, 0, "action"), action, sizeof(action)) >= 0;
+    
     // Check if it's an RFID command
     if (strstr(topic_str, "/cmd/rfid") != NULL) {
-        cJSON *action = cJSON_GetObjectItem(json, "action");
-        if (action && cJSON_IsString(action)) {
-            ESP_LOGI(TAG, "Executing RFID command: %s", action->valuestring);
-            rfid_handle_inventory_command(action->valuestring);
+        if (has_action && strcmp(action, "readers") == 0) {
+            // Reader table; "count" changes how many readers open at the next boot
+            int count;
+            bool has_count = json_get_int(&doc, json_obj_get(&doc, 0, "count"), &count);
+            if (has_count && rfid_set_reader_count(count) != 0) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"readers\",\"status\":\"error\",\"message\":\"count out of range\"}");
+            } else {
+                char readers[512];
+                rfid_get_readers_json(readers, sizeof(readers));
+                char resp[640];
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"readers\",\"status\":\"success\",\"max\":%d,\"readers\":%s%s}",
+                         RFID_MAX_READERS, readers,
+                         has_count ? ",\"message\":\"Reader count applies after restart\"" : "");
+                mqtt_publish_response(resp);
+            }
+        } else if (has_action && strcmp(action, "config") == 0) {
+            // Tag table settings; tag_timeout_ms is applied at once and saved
+            double tmo;
+            bool has_tmo = json_get_double(&doc, json_obj_get(&doc, 0, "tag_timeout_ms"), &tmo);
+            char resp[192];
+            if (has_tmo && !(tmo >= TAG_STORE_MIN_TIMEOUT_MS && tmo <= TAG_STORE_MAX_TIMEOUT_MS)) {
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"config\",\"status\":\"error\",\"message\":\"tag_timeout_ms must be %d-%d\"}",
+                         TAG_STORE_MIN_TIMEOUT_MS, TAG_STORE_MAX_TIMEOUT_MS);
+            } else {
+                if (has_tmo) tag_store_set_timeout_ms((uint32_t)tmo);
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"config\",\"status\":\"success\",\"tag_timeout_ms\":%lu,\"capacity\":%d}",
+                         (unsigned long)tag_store_get_timeout_ms(), tag_store_capacity());
+            }
+            mqtt_publish_response(resp);
+        } else if (has_action && strcmp(action, "seen") == 0) {
+            // Seen-before filter; any change reallocates and clears it
+            seen_filter_config_t cfg;
+            seen_filter_get_config(&cfg);
+            char mode[16];
+            double hours = 0, cap = 0, fp = 0;
+            const json_field_t fields[] = {
+                { "mode", JSON_FIELD_STR, mode, sizeof(mode) },
+                { "hours", JSON_FIELD_DOUBLE, &hours, 0 },
+                { "capacity", JSON_FIELD_DOUBLE, &cap, 0 },
+                { "fp_rate", JSON_FIELD_DOUBLE, &fp, 0 },
+            };
+            uint32_t found = json_extract(&doc, 0, fields, 4);
+            bool changed = found != 0, bad = false;
+            if (found & 1) {
+                int m = seen_filter_parse_mode(mode);
+                if (m < 0) bad = true; else cfg.mode = m;
+            }
+            // Out of range values are rejected rather than wrapped by the casts
+            double ppm = fp * 1000000.0 + 0.5;
+            if ((found & 2) && !(hours >= 1 && hours <= SEEN_FILTER_MAX_HOURS)) bad = true;
+            if ((found & 4) && !(cap >= SEEN_FILTER_MIN_CAPACITY && cap <= SEEN_FILTER_MAX_CAPACITY)) bad = true;
+            if ((found & 8) && !(ppm >= SEEN_FILTER_MIN_FP_PPM && ppm < SEEN_FILTER_MAX_FP_PPM + 1)) bad = true;
+            if (!bad) {
+                if (found & 2) cfg.hours = (uint32_t)hours;
+                if (found & 4) cfg.capacity = (uint32_t)cap;
+                if (found & 8) cfg.fp_ppm = (uint32_t)ppm;
+            }
+            if (bad) {
+                char resp[256];
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"seen\",\"status\":\"error\",\"message\":\"mode must be off, flag or suppress; "
+                         "hours 1-%d, capacity %d-%d, fp_rate %g-%g\"}",
+                         SEEN_FILTER_MAX_HOURS, SEEN_FILTER_MIN_CAPACITY, SEEN_FILTER_MAX_CAPACITY,
+                         SEEN_FILTER_MIN_FP_PPM / 1e6, SEEN_FILTER_MAX_FP_PPM / 1e6);
+                mqtt_publish_response(resp);
+            } else if (changed && seen_filter_set_config(&cfg) != 0) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"seen\",\"status\":\"error\",\"message\":\"Not enough PSRAM for the seen filter\"}");
+            } else {
+                char filter[384];
+                seen_filter_get_json(filter, sizeof(filter));
+                char resp[512];
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"seen\",\"status\":\"success\",\"filter\":%s}", filter);
+                mqtt_publish_response(resp);
+            }
+        } else if (has_action && strcmp(action, "epc") == 0) {
+            // EPC decoding: company-prefix allow/deny rules and the decoded "gs1" payload
+            epc_rules_t rules;
+            epc_decode_get_rules(&rules);
+            char mode[16];
+            const json_field_t fields[] = {
+                { "mode", JSON_FIELD_STR, mode, sizeof(mode) },
+                { "payload", JSON_FIELD_BOOL, &rules.payload, 0 },
+                { "drop_unknown", JSON_FIELD_BOOL, &rules.drop_unknown, 0 },
+            };
+            uint32_t found = json_extract(&doc, 0, fields, 3);
+            bool changed = found != 0, bad = false;
+            if (found & 1) {
+                int m = epc_decode_parse_mode(mode);
+                if (m < 0) bad = true; else rules.mode = m;
+            }
+            int prefixes = json_obj_get(&doc, 0, "prefixes");
+            if (json_type(&doc, prefixes) == JSON_ARRAY) {
+                if (json_size(&doc, prefixes) > EPC_PREFIX_MAX) bad = true;
+                rules.count = 0;
+                JSON_ARRAY_FOR_EACH(&doc, prefixes, p) {
+                    if (rules.count >= EPC_PREFIX_MAX) break;
+                    int n = json_get_str(&doc, p, rules.prefixes[rules.count], EPC_PREFIX_LEN);
+                    if (n < 0 || n >= EPC_PREFIX_LEN) { bad = true; break; }
+                    rules.count++;
+                }
+                changed = true;
+            }
+            if (bad || (changed && epc_decode_set_rules(&rules) != 0)) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"epc\",\"status\":\"error\",\"message\":\"mode must be off, allow or deny; up to 32 prefixes of 1-12 digits\"}");
+            } else {
+                char cfg[768];
+                epc_decode_get_json(cfg, sizeof(cfg));
+                char resp[896];
+                snprintf(resp, sizeof(resp),
+                         "{\"command\":\"rfid\",\"action\":\"epc\",\"status\":\"success\",\"epc\":%s}", cfg);
+                mqtt_publish_response(resp);
+            }
+        } else if (has_action && strcmp(action, "rules") == 0) {
+            // Edge rules: "rules" replaces the whole set, "bench" starts a timing run
+            // that answers separately once done
+            int rules = json_obj_get(&doc, 0, "rules");
+            char err[64];
+            if (rules >= 0 && tag_rules_set_json(&doc, rules, err, sizeof(err)) != 0) {
+                char resp[160];
+                snprintf(resp, sizeof(resp), "{\"command\":\"rfid\",\"action\":\"rules\",\"status\":\"error\",\"message\":\"%s\"}", err);
+                mqtt_publish_response(resp);
+            } else {
+                int iterations = 0;
+                json_get_int(&doc, json_obj_get(&doc, 0, "bench"), &iterations);
+                if (iterations > TAG_RULES_BENCH_MAX) iterations = TAG_RULES_BENCH_MAX;
+                char *resp = malloc(TAG_RULES_JSON_MAX + 128);
+                if (resp) {
+                    int n = snprintf(resp, TAG_RULES_JSON_MAX + 128,
+                                     "{\"command\":\"rfid\",\"action\":\"rules\",\"status\":\"success\",");
+                    if (iterations > 0) {
+                        const char *state = "started";
+                        if (s_rules_bench_busy) {
+                            state = "busy";
+                        } else {
+                            s_rules_bench_busy = true;
+                            if (xTaskCreate(rules_bench_task, "rules_bench", 3072, (void *)(intptr_t)iterations,
+                                            tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+                                s_rules_bench_busy = false;
+                                state = "failed";
+                            }
+                        }
+                        n += snprintf(resp + n, TAG_RULES_JSON_MAX + 128 - n, "\"bench\":\"%s\",", state);
+                    }
+                    n += snprintf(resp + n, TAG_RULES_JSON_MAX + 128 - n, "\"rules\":");
+                    n += tag_rules_get_json(resp + n, TAG_RULES_JSON_MAX);
+                    snprintf(resp + n, TAG_RULES_JSON_MAX + 128 - n, "}");
+                    mqtt_publish_response(resp);
+                    free(resp);
+                }
+            }
+        } else if (has_action && strcmp(action, "stream") == 0) {
+            // LAN tag stream: TCP port (0 = off) and UDP multicast group
+            tag_stream_config_t cfg;
+            tag_stream_get_config(&cfg);
+            int port, mport;
+            char addr[sizeof(cfg.mcast_addr)];
+            const json_field_t fields[] = {
+                { "port", JSON_FIELD_INT, &port, 0 },
+                { "mcast", JSON_FIELD_BOOL, &cfg.mcast, 0 },
+                { "mcast_addr", JSON_FIELD_STR, addr, sizeof(addr) },
+                { "mcast_port", JSON_FIELD_INT, &mport, 0 },
+            };
+            uint32_t found = json_extract(&doc, 0, fields, 4);
+            if (((found & 1) && (port < 0 || port > 65535)) || ((found & 8) && (mport < 0 || mport > 65535))) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"stream\",\"status\":\"error\",\"message\":\"port and mcast_port must be 0-65535\"}");
+                return;
+            }
+            if (found & 1) cfg.port = (uint16_t)port;
+            if (found & 4) strcpy(cfg.mcast_addr, addr);
+            if (found & 8) cfg.mcast_port = (uint16_t)mport;
+            if (found && tag_stream_set_config(&cfg) != 0) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"stream\",\"status\":\"error\",\"message\":\"mcast_addr must be an IPv4 multicast address\"}");
+            } else {
+                char *resp = malloc(TAG_STREAM_JSON_MAX + 96);
+                if (resp) {
+                    int n = snprintf(resp, TAG_STREAM_JSON_MAX + 96,
+                                     "{\"command\":\"rfid\",\"action\":\"stream\",\"status\":\"success\",\"stream\":");
+                    n += tag_stream_get_json(resp + n, TAG_STREAM_JSON_MAX);
+                    snprintf(resp + n, TAG_STREAM_JSON_MAX + 96 - n, "}");
+                    mqtt_publish_response(resp);
+                    free(resp);
+                }
+            }
+        } else if (has_action && strcmp(action, "llrp") == 0) {
+            // LLRP server port (0 = off) and session state
+            int port;
+            bool has_port = json_get_int(&doc, json_obj_get(&doc, 0, "port"), &port);
+            if (has_port && (port < 0 || port > 65535)) {
+                mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"llrp\",\"status\":\"error\",\"message\":\"port must be 0-65535\"}");
+            } else {
+                if (has_port) llrp_set_port((uint16_t)port);
+                char resp[LLRP_JSON_MAX + 96];
+                int n = snprintf(resp, sizeof(resp), "{\"command\":\"rfid\",\"action\":\"llrp\",\"status\":\"success\",\"llrp\":");
+                n += llrp_get_json(resp + n, LLRP_JSON_MAX);
+                snprintf(resp + n, sizeof(resp) - n, "}");
+                mqtt_publish_response(resp);
+            }
+        } else if (has_action) {
+            ESP_LOGI(TAG, "Executing RFID command: %s", action);
+            rfid_handle_inventory_command(reader, action);
         } else {
             mqtt_publish_response("{\"command\":\"rfid\",\"status\":\"error\",\"message\":\"Missing action parameter\"}");
         }
     }
     // Check if it's a power command
     else if (strstr(topic_str, "/cmd/power") != NULL) {
-        cJSON *action = cJSON_GetObjectItem(json, "action");
-        if (action && cJSON_IsString(action)) {
-            ESP_LOGI(TAG, "Executing power command: %s", action->valuestring);
+        if (has_action) {
+            ESP_LOGI(TAG, "Executing power command: %s", action);
             
-            if (strcmp(action->valuestring, "set") == 0) {
+            if (strcmp(action, "set") == 0) {
                 // Get power values from JSON
-                cJSON *ant1 = cJSON_GetObjectItem(json, "ant1");
-                cJSON *ant2 = cJSON_GetObjectItem(json, "ant2");
-                cJSON *ant3 = cJSON_GetObjectItem(json, "ant3");
-                cJSON *ant4 = cJSON_GetObjectItem(json, "ant4");
-                
-                int p1 = (ant1 && cJSON_IsNumber(ant1)) ? ant1->valueint : 30;
-                int p2 = (ant2 && cJSON_IsNumber(ant2)) ? ant2->valueint : 30;
-                int p3 = (ant3 && cJSON_IsNumber(ant3)) ? ant3->valueint : 30;
-                int p4 = (ant4 && cJSON_IsNumber(ant4)) ? ant4->valueint : 30;
+                int p[4] = { 30, 30, 30, 30 };
+                const json_field_t fields[] = {
+                    { "ant1", JSON_FIELD_INT, &p[0], 0 },
+                    { "ant2", JSON_FIELD_INT, &p[1], 0 },
+                    { "ant3", JSON_FIELD_INT, &p[2], 0 },
+                    { "ant4", JSON_FIELD_INT, &p[3], 0 },
+                };
+                json_extract(&doc, 0, fields, 4);
                 
-                rfid_handle_power_command("set", p1, p2, p3, p4);
-            } else if (strcmp(action->valuestring, "status") == 0) {
+                rfid_handle_power_command(reader, "set", p[0], p[1], p[2], p[3]);
+            } else if (strcmp(action, "status") == 0) {
                 // Return simple power status
                 mqtt_publish_response("{\"command\":\"power\",\"action\":\"status\",\"status\":\"success\",\"power_state\":\"on\",\"message\":\"RFID module is powered on\"}");
-            } else if (strcmp(action->valuestring, "get") == 0) {
+            } else if (strcmp(action, "get") == 0) {
                 // Get detailed antenna power levels
-                rfid_handle_power_command("get", 0, 0, 0, 0);
+                rfid_handle_power_command(reader, "get", 0, 0, 0, 0);
             } else {
-                rfid_handle_power_command(action->valuestring, 0, 0, 0, 0);
+                rfid_handle_power_command(reader, action, 0, 0, 0, 0);
             }
         } else {
             mqtt_publish_response("{\"command\":\"power\",\"status\":\"error\",\"message\":\"Missing action parameter\"}");
@@ -624,22 +1260,120 @@ void mqtt_process_command(const char* topic, int topic_len, const char* data, in
     // Check if it's an inventory command  
     else if (strstr(topic_str, "/cmd/inventory") != NULL) {
         // For backward compatibility, handle both JSON and simple string commands
-        cJSON *action = cJSON_GetObjectItem(json, "action");
-        if (action && cJSON_IsString(action)) {
-            ESP_LOGI(TAG, "Executing inventory command: %s", action->valuestring);
-            rfid_handle_inventory_command(action->valuestring);
+        if (has_action) {
+            ESP_LOGI(TAG, "Executing inventory command: %s", action);
+            rfid_handle_inventory_command(reader, action);
         } else {
             // Fallback to treating the entire data as action for simple commands
-            ESP_LOGI(TAG, "Executing simple inventory command: %s", data_str);
-            rfid_handle_inventory_command(data_str);
+            char simple[64];
+            snprintf(simple, sizeof(simple), "%.*s", data_len, data);
+            ESP_LOGI(TAG, "Executing simple inventory command: %s", simple);
+            rfid_handle_inventory_command(RFID_ALL_READERS, simple);
+        }
+    }
+    // Batching thresholds and histograms
+    else if (strstr(topic_str, "/cmd/batch") != NULL) {
+        const char *act = has_action ? action : "get";
+        
+        if (strcmp(act, "set") == 0) {
+            mqtt_batch_config_t cfg;
+            mqtt_batch_get_config(&cfg);
+            int v[3] = { 0 };
+            const json_field_t fields[] = {
+                { "max_tags", JSON_FIELD_INT, &v[0], 0 },
+                { "max_bytes", JSON_FIELD_INT, &v[1], 0 },
+                { "max_latency_ms", JSON_FIELD_INT, &v[2], 0 },
+            };
+            json_extract(&doc, 0, fields, 3);
+            if (v[0] > 0) cfg.max_tags = v[0];
+            if (v[1] > 0) cfg.max_bytes = v[1];
+            if (v[2] > 0) cfg.max_latency_ms = v[2];
+            if (mqtt_batch_set_config(&cfg) != 0) {
+                mqtt_publish_response("{\"command\":\"batch\",\"action\":\"set\",\"status\":\"error\",\"message\":\"Failed to save batch config\"}");
+                return;
+            }
+        } else if (strcmp(act, "get") != 0 && strcmp(act, "stats") != 0) {
+            mqtt_publish_response("{\"command\":\"batch\",\"status\":\"error\",\"message\":\"Unknown action\"}");
+            return;
+        }
+        
+        // Every batch action answers with the applied config and histograms
+        static char batch_resp[1024];
+        int n = snprintf(batch_resp, sizeof(batch_resp),
+                         "{\"command\":\"batch\",\"action\":\"%s\",\"status\":\"success\",\"batch\":", act);
+        n += mqtt_batch_get_stats_json(batch_resp + n, sizeof(batch_resp) - n - 1);
+        snprintf(batch_resp + n, sizeof(batch_resp) - n, "}");
+        mqtt_publish_response(batch_resp);
+    }
+    // Metrics push interval; the text itself is rendered and sent by the uplink task
+    else if (strstr(topic_str, "/cmd/metrics") != NULL) {
+        const char *act = has_action ? action : "get";
+        
+        if (strcmp(act, "set") == 0) {
+            int v;
+            if (!json_get_int(&doc, json_obj_get(&doc, 0, "push_interval_s"), &v) || v < 0 ||
+                metrics_set_push_interval((uint32_t)v) != 0) {
+                mqtt_publish_response("{\"command\":\"metrics\",\"action\":\"set\",\"status\":\"error\",\"message\":\"Invalid push_interval_s\"}");
+                return;
+            }
+        } else if (strcmp(act, "get") != 0) {
+            mqtt_publish_response("{\"command\":\"metrics\",\"status\":\"error\",\"message\":\"Unknown action\"}");
+            return;
+        }
+        
+        metrics_request_push();
+        char metrics_resp[160];
+        snprintf(metrics_resp, sizeof(metrics_resp),
+                 "{\"command\":\"metrics\",\"action\":\"%s\",\"status\":\"success\",\"push_interval_s\":%lu}",
+                 act, (unsigned long)metrics_get_push_interval());
+        mqtt_publish_response(metrics_resp);
+    }
+    // Task CPU / stack and heap diagnostics, latency tracing
+    else if (strstr(topic_str, "/cmd/debug") != NULL) {
+        const char *act = has_action ? action : "tasks";
+        
+        if (strcmp(act, "latency") == 0 || strcmp(act, "trace") == 0 || strcmp(act, "latency_reset") == 0) {
+            if (strcmp(act, "trace") == 0) {
+                bool enabled;
+                if (!json_get_bool(&doc, json_obj_get(&doc, 0, "enabled"), &enabled)) {
+                    mqtt_publish_response("{\"command\":\"debug\",\"status\":\"error\",\"message\":\"trace needs enabled (bool)\"}");
+                    return;
+                }
+                latency_set_trace(enabled);
+            } else if (strcmp(act, "latency_reset") == 0) {
+                latency_reset();
+            }
+            
+            char *latency_resp = malloc(LATENCY_JSON_MAX + 96);
+            if (latency_resp) {
+                int n = snprintf(latency_resp, LATENCY_JSON_MAX + 96,
+                                 "{\"command\":\"debug\",\"action\":\"%s\",\"status\":\"success\",\"latency\":", act);
+                n += latency_get_json(latency_resp + n, LATENCY_JSON_MAX);
+                snprintf(latency_resp + n, LATENCY_JSON_MAX + 96 - n, "}");
+                mqtt_publish_response(latency_resp);
+                free(latency_resp);
+            }
+            return;
+        }
+        if (strcmp(act, "tasks") != 0) {
+            mqtt_publish_response("{\"command\":\"debug\",\"status\":\"error\",\"message\":\"Unknown action\"}");
+            return;
+        }
+        
+        char *debug_resp = malloc(TASK_STATS_JSON_MAX + 96);
+        if (debug_resp) {
+            int n = snprintf(debug_resp, TASK_STATS_JSON_MAX + 96,
+                             "{\"command\":\"debug\",\"action\":\"tasks\",\"status\":\"success\",\"stats\":");
+            n += task_stats_get_json(debug_resp + n, TASK_STATS_JSON_MAX);
+            snprintf(debug_resp + n, TASK_STATS_JSON_MAX + 96 - n, "}");
+            mqtt_publish_response(debug_resp);
+            free(debug_resp);
         }
     }
     else {
         ESP_LOGW(TAG, "Unknown command topic: %s", topic_str);
         mqtt_publish_response("{\"status\":\"error\",\"message\":\"Unknown command topic\"}");
     }
-    
-    cJSON_Delete(json);
 }
 
 // Publish command responses
@@ -656,6 +1390,18 @@ void mqtt_publish_response(const char* response_json)
     ESP_LOGI(TAG, "Published response: %s", response_json);
 }
 
+// Publish Prometheus text from the metrics registry
+void mqtt_publish_metrics(const char* metrics_text)
+{
+    if (!s_mqtt_client || !metrics_text) {
+        return;
+    }
+    
+    char metrics_topic[128];
+    snprintf(metrics_topic, sizeof(metrics_topic), "reader/%s/data/metrics", s_mqtt_config.client_id);
+    esp_mqtt_client_publish(s_mqtt_client, metrics_topic, metrics_text, 0, 0, 0);
+}
+
 // Publish RFID data to MQTT (called from UART when data is received)
 void mqtt_publish_rfid_data(const char* rfid_data)
 {
@@ -691,131 +1437,176 @@ void mqtt_publish_rfid_data(const char* rfid_data)
     }
 }
 
-// Periodic MQTT publishing function - publishes batch of recent tags
-void mqtt_publish_periodic_batch(void)
+// Buffer management functions for zero data loss
+static void mqtt_buffer_add(const char* topic, const char* data, uint32_t origin_us)
 {
-    if (!s_mqtt_client) {
-        return;
-    }
+    if (!topic || !data || !s_buffer_initialized) return;
     
-    // Only publish when MQTT inventory is running
-    extern bool rfid_get_mqtt_status_bool(void);
-    if (!rfid_get_mqtt_status_bool()) {
+    int topic_id = mqtt_queue_intern_topic(topic);
+    size_t len = strlen(data);
+    uint32_t now = esp_timer_get_time() / 1000ULL; // milliseconds
+    if (!mqtt_queue_push(topic_id, data, len, now, origin_us)) {
+        ESP_LOGW(TAG, "Offline queue full, message dropped (%s, %d bytes)", topic, (int)len);
         return;
     }
     
-    char data_topic[256];
-    snprintf(data_topic, sizeof(data_topic), "reader/%s/data/batch", s_mqtt_config.client_id);
-    
-    // Use static buffer to reduce stack usage and track data changes
-    static char batch_json[1536]; // Reduced size, static allocation
-    static uint32_t last_tag_count = 0;
-    extern int rfid_get_mqtt_tags_json(char *out, int out_len);
-    int used = rfid_get_mqtt_tags_json(batch_json, sizeof(batch_json));
-    
-    if (used > 0) {
-        // Extract active tag count from JSON for change detection
-        // Simple parsing to get active_tags count
-        char *count_start = strstr(batch_json, "\"active_tags\":");
-        uint32_t current_tag_count = 0;
-        if (count_start) {
-            sscanf(count_start + 14, "%lu", (unsigned long*)&current_tag_count);
-        }
-        
-        // Only publish if tag count changed or significant data size
-        if (current_tag_count != last_tag_count || used > 200) {
-            mqtt_publish_buffered(data_topic, batch_json);
-            printf("MQTT: Queued tag batch (%d bytes, %lu tags)\n", used, (unsigned long)current_tag_count);
-            last_tag_count = current_tag_count;
-        } else {
-            printf("MQTT: Skipping batch publish (tags: %lu, no changes)\n", (unsigned long)current_tag_count);
-        }
-    } else {
-        printf("MQTT: No MQTT tags to publish\n");
-    }
+    mqtt_queue_stats_t st;
+    mqtt_queue_get_stats(&st);
+    ESP_LOGI(TAG, "Buffered data: %s (%d bytes, queue: %lu msgs, %lu/%lu bytes)", 
+             topic, (int)len, (unsigned long)st.queued_msgs,
+             (unsigned long)st.queued_bytes, (unsigned long)st.capacity_bytes);
 }
 
-// Buffer management functions for zero data loss
-static void mqtt_buffer_add(const char* topic, const char* data)
+void mqtt_publish_buffered(const char* topic, const char* data, uint32_t origin_us)
 {
-    if (!topic || !data || !s_buffer_initialized) return;
-    
-    // Find next available slot (circular buffer)
-    int index = s_buffer_head;
+    if (!topic || !data) return;
     
-    // If buffer is full, overwrite oldest entry
-    if (s_buffer_count >= MQTT_BUFFER_SIZE) {
-        ESP_LOGW(TAG, "Buffer full, overwriting oldest entry");
+    // Everything goes through the queue so it is only released on PUBACK
+    mqtt_buffer_add(topic, data, origin_us);
+    if (s_mqtt_connected && s_mqtt_client) {
+        mqtt_flush_buffer();
+    }
+}
+
+static int mqtt_send_one(const mqtt_queue_msg_t *msg, void *ctx)
+{
+    const char *topic = mqtt_queue_topic_name(msg->topic_id);
+    if (!topic || !s_mqtt_connected || !s_mqtt_client) return -1;
+    
+    // Non-blocking: esp-mqtt copies into its outbox and sends from its own task
+    int msg_id = esp_mqtt_client_enqueue(s_mqtt_client, topic, msg->data, (int)msg->len,
+                                         MQTT_DATA_QOS, 0, true);
+    if (msg_id < 0) {
+        metrics_inc(METRIC_MQTT_SEND_ERRORS);
+        ESP_LOGW(TAG, "esp-mqtt outbox rejected message (%d), will retry", msg_id);
     } else {
-        s_buffer_count++;
+        metrics_inc(METRIC_MQTT_SENT);
+        if (msg->sent_us == 0) latency_record(LATENCY_QUEUE_TO_SEND, msg->queued_us, latency_now_us());
     }
-    
-    // Store data
-    strncpy(s_mqtt_buffer[index].topic, topic, sizeof(s_mqtt_buffer[index].topic) - 1);
-    strncpy(s_mqtt_buffer[index].data, data, sizeof(s_mqtt_buffer[index].data) - 1);
-    s_mqtt_buffer[index].timestamp = esp_timer_get_time() / 1000ULL; // milliseconds
-    s_mqtt_buffer[index].occupied = true;
-    
-    // Move head pointer
-    s_buffer_head = (s_buffer_head + 1) % MQTT_BUFFER_SIZE;
-    
-    ESP_LOGI(TAG, "Buffered data: %s (%d bytes, buffer: %d/%d)", 
-             topic, (int)strlen(data), s_buffer_count, MQTT_BUFFER_SIZE);
+    return msg_id;
 }
 
-void mqtt_publish_buffered(const char* topic, const char* data)
+// Publish the boot report once the first tag batch has reached the broker
+static void mqtt_publish_boot_report(void)
 {
-    if (!topic || !data) return;
+    char topic[128];
+    char report[768];
+    snprintf(topic, sizeof(topic), "reader/%s/status/boot", s_mqtt_config.client_id);
+    boot_get_report_json(report, sizeof(report));
+    esp_mqtt_client_publish(s_mqtt_client, topic, report, 0, 1, 1);  // retained
+    ESP_LOGI(TAG, "Boot report: %s", report);
+}
+
+// Apply acknowledgements and disconnects reported by the event handler
+static void mqtt_process_acks(void)
+{
+    mqtt_ack_t ack;
+    mqtt_queue_msg_t acked;
+    while (s_ack_queue && xQueueReceive(s_ack_queue, &ack, 0) == pdTRUE) {
+        if (mqtt_queue_ack(ack.msg_id, &acked)) {
+            metrics_inc(METRIC_MQTT_ACKED);
+            latency_record(LATENCY_SEND_TO_ACK, acked.sent_us, ack.ack_us);
+            latency_record(LATENCY_READ_TO_ACK, acked.origin_us, ack.ack_us);
+            mqtt_record_rtt(acked.sent_us, ack.ack_us);
+            s_last_successful_publish = esp_timer_get_time() / 1000ULL;
+            if (!boot_mark_reached(BOOT_MARK_FIRST_PUBLISH)) {
+                boot_mark(BOOT_MARK_FIRST_PUBLISH);
+                mqtt_publish_boot_report();
+            }
+        }
+    }
     
-    // Try to publish immediately if connected
-    if (s_mqtt_connected && s_mqtt_client) {
-        esp_mqtt_client_publish(s_mqtt_client, topic, data, 0, 0, 0);
-        s_last_successful_publish = esp_timer_get_time() / 1000ULL; // Update health tracking
-        ESP_LOGI(TAG, "Published immediately: %s", topic);
-    } else {
-        // Store in buffer for later
-        mqtt_buffer_add(topic, data);
+    if (s_requeue_pending) {
+        s_requeue_pending = false;
+        int requeued = mqtt_queue_requeue_inflight(0, 0);
+        if (requeued > 0) {
+            metrics_add(METRIC_MQTT_RETRANSMITS, requeued);
+            ESP_LOGW(TAG, "Requeued %d unacknowledged messages", requeued);
+        }
     }
 }
 
-void mqtt_flush_buffer(void)
+static void mqtt_update_gauges(void)
 {
-    if (!s_buffer_initialized || s_buffer_count == 0) return;
+    mqtt_queue_stats_t st;
+    mqtt_queue_get_stats(&st);
+    metrics_set(METRIC_MQTT_CONNECTED, s_mqtt_connected ? 1 : 0);
+    metrics_set(METRIC_MQTT_QUEUE_MSGS, st.queued_msgs);
+    metrics_set(METRIC_MQTT_QUEUE_BYTES, st.queued_bytes);
+    metrics_set(METRIC_MQTT_INFLIGHT_MSGS, st.inflight_msgs);
+}
+
+uint32_t mqtt_flush_buffer(void)
+{
+    if (!s_buffer_initialized) return UINT32_MAX;
     
-    ESP_LOGI(TAG, "Flushing %d buffered messages", s_buffer_count);
+    mqtt_process_acks();
+    mqtt_update_gauges();
+    if (mqtt_queue_count() == 0 || !s_mqtt_connected) return UINT32_MAX;
     
-    int flushed = 0;
-    int start_index = (s_buffer_head - s_buffer_count + MQTT_BUFFER_SIZE) % MQTT_BUFFER_SIZE;
+    uint32_t now = esp_timer_get_time() / 1000ULL;
     
-    for (int i = 0; i < s_buffer_count && flushed < 10; i++) { // Limit to 10 per flush to avoid overload
-        int index = (start_index + i) % MQTT_BUFFER_SIZE;
-        
-        if (s_mqtt_buffer[index].occupied) {
-            // Attempt to publish
-            esp_mqtt_client_publish(s_mqtt_client, 
-                                   s_mqtt_buffer[index].topic, 
-                                   s_mqtt_buffer[index].data, 
-                                   0, 0, 0);
-            
-            // Mark as sent
-            s_mqtt_buffer[index].occupied = false;
-            flushed++;
-            
-            ESP_LOGI(TAG, "Flushed: %s", s_mqtt_buffer[index].topic);
-        }
+    // Anything unacknowledged for too long is sent again
+    int expired = mqtt_queue_requeue_inflight(MQTT_INFLIGHT_TIMEOUT_MS, now);
+    if (expired > 0) {
+        metrics_add(METRIC_MQTT_RETRANSMITS, expired);
+        ESP_LOGW(TAG, "%d in-flight messages timed out, retransmitting", expired);
     }
     
-    // Update buffer count
-    s_buffer_count -= flushed;
-    if (s_buffer_count < 0) s_buffer_count = 0;
+    int sent = mqtt_queue_send_pending(MQTT_INFLIGHT_MAX_MSGS, MQTT_INFLIGHT_MAX_BYTES,
+                                       now, mqtt_send_one, NULL);
+    mqtt_queue_stats_t st;
+    mqtt_queue_get_stats(&st);
+    metrics_set(METRIC_MQTT_QUEUE_MSGS, st.queued_msgs);
+    metrics_set(METRIC_MQTT_INFLIGHT_MSGS, st.inflight_msgs);
+    if (sent > 0) {
+        ESP_LOGI(TAG, "Sent %d queued messages (in flight: %lu, queued: %lu)", sent,
+                 (unsigned long)st.inflight_msgs, (unsigned long)st.queued_msgs);
+    }
     
-    ESP_LOGI(TAG, "Flushed %d messages, %d remaining in buffer", flushed, s_buffer_count);
+    // PUBACKs wake the uplink task; the timer only covers lost acks
+    return st.inflight_msgs > 0 ? MQTT_INFLIGHT_CHECK_MS : UINT32_MAX;
+}
+
+void mqtt_get_queue_stats(mqtt_queue_stats_t* stats)
+{
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (s_buffer_initialized) {
+        mqtt_queue_get_stats(stats);
+    }
 }
 
 // NVS persistence for critical data
+typedef struct {
+    nvs_handle_t h;
+    int saved;
+    size_t bytes;
+} nvs_save_ctx_t;
+
+static bool mqtt_save_one(const mqtt_queue_msg_t *msg, void *ctx)
+{
+    nvs_save_ctx_t *sc = (nvs_save_ctx_t*)ctx;
+    const char *topic = mqtt_queue_topic_name(msg->topic_id);
+    if (!topic) return true;
+    if (sc->bytes + msg->len > MQTT_NVS_SAVE_MAX_BYTES) return false;
+    
+    char key_topic[32], key_data[32], key_ts[32];  // Increased buffer sizes
+    snprintf(key_topic, sizeof(key_topic), "topic_%d", sc->saved);
+    snprintf(key_data, sizeof(key_data), "data_%d", sc->saved);
+    snprintf(key_ts, sizeof(key_ts), "ts_%d", sc->saved);
+    
+    nvs_set_str(sc->h, key_topic, topic);
+    nvs_set_blob(sc->h, key_data, msg->data, msg->len);
+    nvs_set_u32(sc->h, key_ts, msg->timestamp);
+    sc->saved++;
+    sc->bytes += msg->len;
+    return true;
+}
+
 void mqtt_save_buffer_to_nvs(void)
 {
-    if (!s_buffer_initialized || s_buffer_count == 0) return;
+    if (!s_buffer_initialized || mqtt_queue_count() == 0) return;
     
     nvs_handle_t h;
     esp_err_t err = nvs_open("mqtt_buf", NVS_READWRITE, &h);
@@ -824,33 +1615,15 @@ void mqtt_save_buffer_to_nvs(void)
         return;
     }
     
-    // Save buffer count and data
-    nvs_set_i32(h, "buf_count", s_buffer_count);
-    
-    int saved = 0;
-    int start_index = (s_buffer_head - s_buffer_count + MQTT_BUFFER_SIZE) % MQTT_BUFFER_SIZE;
+    // Save the oldest messages, bounded by count and bytes (NVS is small)
+    nvs_save_ctx_t sc = { .h = h, .saved = 0, .bytes = 0 };
+    mqtt_queue_foreach(MQTT_NVS_SAVE_MAX_MSGS, mqtt_save_one, &sc);
     
-    for (int i = 0; i < s_buffer_count && saved < 10; i++) { // Limit NVS saves
-        int index = (start_index + i) % MQTT_BUFFER_SIZE;
-        
-        if (s_mqtt_buffer[index].occupied) {
-            char key_topic[32], key_data[32], key_ts[32];  // Increased buffer sizes
-            snprintf(key_topic, sizeof(key_topic), "topic_%d", saved);
-            snprintf(key_data, sizeof(key_data), "data_%d", saved);
-            snprintf(key_ts, sizeof(key_ts), "ts_%d", saved);
-            
-            nvs_set_str(h, key_topic, s_mqtt_buffer[index].topic);
-            nvs_set_str(h, key_data, s_mqtt_buffer[index].data);
-            nvs_set_u32(h, key_ts, s_mqtt_buffer[index].timestamp);
-            saved++;
-        }
-    }
-    
-    nvs_set_i32(h, "buf_saved", saved);
+    nvs_set_i32(h, "buf_saved", sc.saved);
     nvs_commit(h);
     nvs_close(h);
     
-    ESP_LOGI(TAG, "Saved %d critical messages to NVS", saved);
+    ESP_LOGI(TAG, "Saved %d critical messages (%d bytes) to NVS", sc.saved, (int)sc.bytes);
 }
 
 void mqtt_load_buffer_from_nvs(void)
@@ -875,33 +1648,40 @@ void mqtt_load_buffer_from_nvs(void)
     
     ESP_LOGI(TAG, "Loading %d messages from NVS", (int)saved_count);
     
-    for (int i = 0; i < saved_count && i < MQTT_BUFFER_SIZE; i++) {
+    char *data = malloc(MQTT_NVS_SAVE_MAX_BYTES);
+    if (!data) {
+        nvs_close(h);
+        return;
+    }
+    
+    int loaded = 0;
+    for (int i = 0; i < saved_count && i < MQTT_NVS_SAVE_MAX_MSGS; i++) {
         char key_topic[32], key_data[32], key_ts[32];  // Increased buffer sizes
         snprintf(key_topic, sizeof(key_topic), "topic_%d", i);
         snprintf(key_data, sizeof(key_data), "data_%d", i);
         snprintf(key_ts, sizeof(key_ts), "ts_%d", i);
         
-        required_size = sizeof(s_mqtt_buffer[i].topic);
-        err = nvs_get_str(h, key_topic, s_mqtt_buffer[i].topic, &required_size);
+        char topic[128];
+        required_size = sizeof(topic);
+        err = nvs_get_str(h, key_topic, topic, &required_size);
         if (err != ESP_OK) continue;
         
-        required_size = sizeof(s_mqtt_buffer[i].data);
-        err = nvs_get_str(h, key_data, s_mqtt_buffer[i].data, &required_size);
+        required_size = MQTT_NVS_SAVE_MAX_BYTES;
+        err = nvs_get_blob(h, key_data, data, &required_size);
         if (err != ESP_OK) continue;
         
         uint32_t timestamp;
         err = nvs_get_u32(h, key_ts, &timestamp);
-        if (err == ESP_OK) {
-            s_mqtt_buffer[i].timestamp = timestamp;
-            s_mqtt_buffer[i].occupied = true;
-            s_buffer_count++;
+        if (err == ESP_OK &&
+            mqtt_queue_push(mqtt_queue_intern_topic(topic), data, required_size, timestamp, 0)) {
+            loaded++;
         }
     }
     
-    s_buffer_head = s_buffer_count % MQTT_BUFFER_SIZE;
+    free(data);
     nvs_close(h);
     
-    ESP_LOGI(TAG, "Loaded %d messages from NVS to buffer", s_buffer_count);
+    ESP_LOGI(TAG, "Loaded %d messages from NVS to buffer", loaded);
 }
 
 // Connection health monitoring constants
@@ -922,7 +1702,9 @@ bool mqtt_health_check(void)
         // Force reconnection after multiple failures
         if (s_connection_health_failures >= 3) {
             ESP_LOGW(TAG, "Forcing reconnection due to health failures");
-            mqtt_disconnect();
+            // Abort the connection; the client is kept and reconnected with backoff
+            s_connection_health_failures = 0;
+            esp_mqtt_client_disconnect(s_mqtt_client);
             return false;
         }
     }
@@ -930,13 +1712,15 @@ bool mqtt_health_check(void)
     return true;
 }
 
-void mqtt_connection_monitor(void)
+uint32_t mqtt_connection_monitor(void)
 {
     static uint32_t last_monitor_time = 0;
     uint32_t now = esp_timer_get_time() / 1000ULL;
     
     // Run monitoring every 30 seconds
-    if ((now - last_monitor_time) < HEALTH_CHECK_INTERVAL) return;
+    if ((now - last_monitor_time) < HEALTH_CHECK_INTERVAL) {
+        return HEALTH_CHECK_INTERVAL - (now - last_monitor_time);
+    }
     last_monitor_time = now;
     
     if (s_mqtt_connected) {
@@ -948,15 +1732,19 @@ void mqtt_connection_monitor(void)
         mqtt_health_check();
         
         // Save critical data to NVS periodically
-        if (s_buffer_count > 5) {
+        if (mqtt_queue_count() > 5) {
             mqtt_save_buffer_to_nvs();
         }
     } else {
         ESP_LOGW(TAG, "Connection monitor: MQTT disconnected");
     }
     
-    ESP_LOGI(TAG, "Connection health: %s, buffer: %d/%d, failures: %lu", 
+    mqtt_queue_stats_t st;
+    mqtt_get_queue_stats(&st);
+    ESP_LOGI(TAG, "Connection health: %s, queue: %lu msgs %lu/%lu bytes, dropped: %lu, failures: %lu", 
              s_mqtt_connected ? "OK" : "DISCONNECTED", 
-             s_buffer_count, MQTT_BUFFER_SIZE, 
+             (unsigned long)st.queued_msgs, (unsigned long)st.queued_bytes,
+             (unsigned long)st.capacity_bytes, (unsigned long)st.dropped_msgs,
              (unsigned long)s_connection_health_failures);
+    return HEALTH_CHECK_INTERVAL;
 }
\ No newline at end of file
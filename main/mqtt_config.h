@@ -2,17 +2,71 @@
 #define MQTT_CONFIG_H
 
 #include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_queue.h"
 
-// Data buffer for offline storage
-#define MQTT_BUFFER_SIZE 20
-#define MQTT_DATA_MAX_LEN 512
+// Tag data is published at QoS 1 and released from the queue only on PUBACK.
+// The in-flight window bounds esp-mqtt outbox memory while keeping the link busy.
+#define MQTT_DATA_QOS            1
+#define MQTT_INFLIGHT_MAX_MSGS   8
+#define MQTT_INFLIGHT_MAX_BYTES  (32 * 1024)
+#define MQTT_INFLIGHT_TIMEOUT_MS 30000
+#define MQTT_INFLIGHT_CHECK_MS   5000   // Timeout sweep period while messages are in flight
 
+// Broker certificate verification for mqtts://
+typedef enum {
+    MQTT_CA_BUNDLE = 0,   // Built-in bundle (trimmed to the common CA set)
+    MQTT_CA_PINNED = 1,   // Single PEM stored in NVS (mqtt_set_ca_pem)
+} mqtt_ca_mode_t;
+#define MQTT_CA_PEM_MAX_LEN 4096
+
+// Reconnect backoff: the retry window doubles per failure up to the cap and
+// the delay is drawn from the upper half of the window (equal jitter)
+#define MQTT_BACKOFF_BASE_MS      2000
+#define MQTT_BACKOFF_MAX_MS       60000
+#define MQTT_NETWORK_TIMEOUT_MS   20000
+#define MQTT_CONNECT_TIMEOUT_MS   30000   // Must exceed MQTT_NETWORK_TIMEOUT_MS
+
+typedef enum {
+    MQTT_CONN_IDLE = 0,     // No network link
+    MQTT_CONN_BACKOFF,      // Waiting for the next attempt
+    MQTT_CONN_CONNECTING,   // Attempt in progress
+    MQTT_CONN_CONNECTED,
+} mqtt_conn_state_t;
+
+// Connection counters and phase timings of the last successful connect (ms).
+// dns/session/total/rtt are measured on the client's own connection. esp-mqtt
+// does not report TCP, TLS and CONNACK separately, so the est_ fields split
+// session_ms using rtt_ms: TCP and CONNACK one round trip each, TLS the rest.
 typedef struct {
-    char topic[128];
-    char data[MQTT_DATA_MAX_LEN];
-    uint32_t timestamp;
-    bool occupied;
-} mqtt_buffer_entry_t;
+    mqtt_conn_state_t state;
+    uint32_t attempts;          // Attempts since boot
+    uint32_t connects;          // Successful connects since boot
+    uint32_t failures;          // Consecutive failed attempts
+    uint32_t backoff_ms;        // Delay chosen for the last scheduled retry
+    uint32_t next_retry_in_ms;
+    uint32_t dns_ms;            // getaddrinfo
+    uint32_t session_ms;        // BEFORE_CONNECT -> CONNACK (TCP + TLS + CONNECT)
+    uint32_t rtt_ms;            // First publish -> PUBACK on this connection; 0 until then
+    uint32_t est_tcp_ms;        // Estimates, 0 until rtt_ms is known
+    uint32_t est_tls_ms;
+    uint32_t est_connack_ms;
+    uint32_t total_ms;          // Attempt start -> CONNACK
+    // TLS session tickets: a reconnect on a client that already completed a
+    // handshake offers the saved ticket. esp-mqtt does not expose whether the
+    // broker accepted it, so offers are counted, not resumptions. Last
+    // session_ms of each kind:
+    uint32_t full_handshakes;   // No ticket offered
+    uint32_t ticket_offered;    // Ticket offered (the broker may still do a full handshake)
+    uint32_t session_full_ms;
+    uint32_t session_ticket_offered_ms;
+    bool tickets_enabled;
+} mqtt_conn_metrics_t;
+
+// Messages persisted to NVS across restarts (NVS partition is small)
+#define MQTT_NVS_SAVE_MAX_MSGS  10
+#define MQTT_NVS_SAVE_MAX_BYTES 4096
 
 // MQTT Configuration
 typedef struct {
@@ -22,6 +76,8 @@ typedef struct {
     char password[64];        // MQTT password (optional)
     char publish_topic[128];  // Topic to publish tag data
     char subscribe_topic[128]; // Topic to subscribe for commands
+    int queue_policy;         // mqtt_queue_policy_t applied when the offline queue is full
+    int ca_mode;              // mqtt_ca_mode_t used to verify an mqtts:// broker
 } mqtt_config_t;
 
 // MQTT Functions
@@ -35,25 +91,32 @@ void mqtt_set_config(const mqtt_config_t* config);
 void mqtt_get_config(mqtt_config_t* config);
 int mqtt_save_config(const mqtt_config_t* config);
 int mqtt_load_config(mqtt_config_t* config);
+int mqtt_set_ca_pem(const char* pem, size_t len);   // Store the pinned CA, applied on the next connect
+bool mqtt_has_ca_pem(void);
+const char* mqtt_ca_mode_name(int ca_mode);
 
 // Publishing with buffering
 void mqtt_publish_tag_data(const char* json_data);
 void mqtt_publish_status(const char* status);
 void mqtt_publish_response(const char* response_json);
 void mqtt_publish_rfid_data(const char* rfid_data);
-void mqtt_publish_periodic_batch(void);  // Periodic batch publishing
-void mqtt_publish_buffered(const char* topic, const char* data); // New buffered publish
-void mqtt_flush_buffer(void); // Flush pending data when reconnected
+void mqtt_publish_buffered(const char* topic, const char* data, uint32_t origin_us); // origin_us: oldest read, 0 if untraced
+void mqtt_publish_metrics(const char* metrics_text);             // reader/<id>/data/metrics, QoS 0
+uint32_t mqtt_flush_buffer(void); // Apply acks and send pending data (uplink task only), returns ms until next sweep
 void mqtt_save_buffer_to_nvs(void); // Save buffer to NVS for persistence
 void mqtt_load_buffer_from_nvs(void); // Load buffer from NVS after restart
 bool mqtt_health_check(void); // Check connection health
-void mqtt_connection_monitor(void); // Monitor and maintain connection
+uint32_t mqtt_connection_monitor(void); // Monitor and maintain connection, returns ms until next run
+void mqtt_get_queue_stats(mqtt_queue_stats_t* stats); // Offline queue counters
 
 // Command processing
 void mqtt_process_command(const char* topic, int topic_len, const char* data, int data_len);
 
 // Control
-void mqtt_connect(void);
+uint32_t mqtt_reconnect_step(bool link_up); // Uplink task only, returns ms until the next step is due
+void mqtt_connect(void);     // Skip the remaining backoff and attempt now
 void mqtt_disconnect(void);
+void mqtt_get_conn_metrics(mqtt_conn_metrics_t* metrics);
+const char* mqtt_conn_state_name(mqtt_conn_state_t state);
 
 #endif // MQTT_CLIENT_H
\ No newline at end of file
@@ -0,0 +1,378 @@
+#include "mqtt_queue.h"
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "MQTT_Q";
+
+// Record layout in the arena: [hdr][payload][pad to 4]. A record never wraps;
+// when it does not fit at the end, a PAD header (or < sizeof(hdr) spare bytes)
+// tells the reader to continue at offset 0.
+#define REC_FLAG_PAD      0x01
+#define REC_FLAG_INFLIGHT 0x02   // Published, waiting for PUBACK
+#define REC_FLAG_ACKED    0x04   // PUBACK received, released once it reaches the tail
+#define REC_ALIGN(n) (((n) + 3u) & ~3u)
+
+typedef struct {
+    uint16_t len;        // Payload length
+    uint8_t topic_id;
+    uint8_t flags;
+    uint32_t timestamp;  // ms since boot when queued
+    uint32_t seq;        // Monotonic record number
+    int32_t msg_id;      // MQTT msg_id while in flight
+    uint32_t sent_ms;    // When the record was last published
+    // Latency trace (latency_now_us clock, 0 = not yet / untraced)
+    uint32_t origin_us;  // UART arrival of the oldest read in the payload
+    uint32_t queued_us;
+    uint32_t sent_us;
+} rec_hdr_t;
+
+static uint8_t *s_arena = NULL;
+static uint32_t s_cap = 0;
+static uint32_t s_head = 0;     // Next write offset
+static uint32_t s_tail = 0;     // Oldest record offset
+static uint32_t s_count = 0;
+static uint32_t s_queued_bytes = 0;
+static uint32_t s_high_water = 0;
+static uint32_t s_dropped_msgs = 0;
+static uint32_t s_dropped_bytes = 0;
+static uint32_t s_next_seq = 0;
+static uint32_t s_inflight_msgs = 0;
+static uint32_t s_inflight_bytes = 0;
+static uint32_t s_acked_msgs = 0;
+static uint32_t s_retransmits = 0;
+static bool s_in_psram = false;
+static mqtt_queue_policy_t s_policy = MQTT_QUEUE_DROP_OLDEST;
+static SemaphoreHandle_t s_lock = NULL;
+
+static char *s_topics[MQTT_QUEUE_MAX_TOPICS];
+static int s_topic_count = 0;
+
+bool mqtt_queue_init(mqtt_queue_policy_t policy)
+{
+    if (s_arena) return true;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return false;
+
+    s_arena = heap_caps_malloc(MQTT_QUEUE_CAPACITY_PSRAM, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_arena) {
+        s_cap = MQTT_QUEUE_CAPACITY_PSRAM;
+        s_in_psram = true;
+    } else {
+        s_arena = heap_caps_malloc(MQTT_QUEUE_CAPACITY_INTERNAL, MALLOC_CAP_8BIT);
+        if (!s_arena) {
+            ESP_LOGE(TAG, "Failed to allocate queue arena");
+            return false;
+        }
+        s_cap = MQTT_QUEUE_CAPACITY_INTERNAL;
+        s_in_psram = false;
+    }
+
+    s_policy = policy;
+    ESP_LOGI(TAG, "Offline queue: %lu bytes in %s, policy=%s", (unsigned long)s_cap,
+             s_in_psram ? "PSRAM" : "internal RAM",
+             policy == MQTT_QUEUE_DROP_NEWEST ? "drop-newest" : "drop-oldest");
+    return true;
+}
+
+void mqtt_queue_set_policy(mqtt_queue_policy_t policy)
+{
+    s_policy = policy;
+}
+
+int mqtt_queue_intern_topic(const char *topic)
+{
+    if (!topic || !s_lock) return -1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int id = -1;
+    for (int i = 0; i < s_topic_count; i++) {
+        if (strcmp(s_topics[i], topic) == 0) { id = i; break; }
+    }
+    if (id < 0 && s_topic_count < MQTT_QUEUE_MAX_TOPICS) {
+        s_topics[s_topic_count] = strdup(topic);
+        if (s_topics[s_topic_count]) id = s_topic_count++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (id < 0) ESP_LOGW(TAG, "Topic table full, cannot queue for %s", topic);
+    return id;
+}
+
+const char* mqtt_queue_topic_name(int topic_id)
+{
+    if (topic_id < 0 || topic_id >= s_topic_count) return NULL;
+    return s_topics[topic_id];
+}
+
+// Skip the wrap marker at the end of the arena
+static uint32_t ring_norm(uint32_t off)
+{
+    if (s_cap - off < sizeof(rec_hdr_t) ||
+        (((rec_hdr_t*)(s_arena + off))->flags & REC_FLAG_PAD)) {
+        return 0;
+    }
+    return off;
+}
+
+static uint32_t ring_next(uint32_t off)
+{
+    off += REC_ALIGN(sizeof(rec_hdr_t) + ((rec_hdr_t*)(s_arena + off))->len);
+    return off >= s_cap ? 0 : off;
+}
+
+static rec_hdr_t* ring_oldest(void)
+{
+    s_tail = ring_norm(s_tail);
+    return (rec_hdr_t*)(s_arena + s_tail);
+}
+
+static void clear_inflight(rec_hdr_t *hdr)
+{
+    if (hdr->flags & REC_FLAG_INFLIGHT) {
+        hdr->flags &= ~REC_FLAG_INFLIGHT;
+        s_inflight_msgs--;
+        s_inflight_bytes -= hdr->len;
+    }
+}
+
+static void ring_pop(void)
+{
+    rec_hdr_t *hdr = ring_oldest();
+    uint32_t size = REC_ALIGN(sizeof(rec_hdr_t) + hdr->len);
+    clear_inflight(hdr);
+    s_tail += size;
+    if (s_tail >= s_cap) s_tail = 0;
+    s_queued_bytes -= size;
+    if (--s_count == 0) {
+        s_head = s_tail = 0;
+    }
+}
+
+static void msg_from_hdr(const rec_hdr_t *hdr, mqtt_queue_msg_t *msg)
+{
+    msg->seq = hdr->seq;
+    msg->topic_id = hdr->topic_id;
+    msg->data = (const char*)(hdr + 1);
+    msg->len = hdr->len;
+    msg->timestamp = hdr->timestamp;
+    msg->origin_us = hdr->origin_us;
+    msg->queued_us = hdr->queued_us;
+    msg->sent_us = hdr->sent_us;
+}
+
+// Returns the write offset for a record of `need` bytes, or -1 if it does not fit
+static int32_t ring_reserve(uint32_t need)
+{
+    if (s_count == 0) {
+        s_head = s_tail = 0;
+        return need <= s_cap ? 0 : -1;
+    }
+    if (s_head > s_tail) {
+        if (s_cap - s_head >= need) return (int32_t)s_head;
+        if (s_tail >= need) {
+            // Mark the unused tail so the reader wraps
+            if (s_cap - s_head >= sizeof(rec_hdr_t)) {
+                rec_hdr_t *pad = (rec_hdr_t*)(s_arena + s_head);
+                pad->len = 0;
+                pad->flags = REC_FLAG_PAD;
+            }
+            return 0;
+        }
+        return -1;
+    }
+    if (s_head < s_tail && s_tail - s_head >= need) return (int32_t)s_head;
+    return -1;   // head == tail with records queued: arena is full
+}
+
+bool mqtt_queue_push(int topic_id, const char *data, size_t len, uint32_t timestamp, uint32_t origin_us)
+{
+    if (!s_arena || !data || topic_id < 0 || topic_id >= s_topic_count) return false;
+
+    uint32_t need = REC_ALIGN(sizeof(rec_hdr_t) + len);
+    if (len > MQTT_QUEUE_MAX_MSG_LEN || need > s_cap) {
+        ESP_LOGW(TAG, "Message too large for queue (%d bytes)", (int)len);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_dropped_msgs++;
+        s_dropped_bytes += len;
+        xSemaphoreGive(s_lock);
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int32_t off = ring_reserve(need);
+    while (off < 0 && s_policy == MQTT_QUEUE_DROP_OLDEST && s_count > 0) {
+        // Never evict a record waiting for its PUBACK: the broker may already
+        // hold it. With the oldest record in flight the new message is dropped.
+        rec_hdr_t *oldest = ring_oldest();
+        if (oldest->flags & REC_FLAG_INFLIGHT) break;
+        // Acked records behind a dropped one were delivered; release them uncounted
+        if (!(oldest->flags & REC_FLAG_ACKED)) {
+            s_dropped_bytes += oldest->len;
+            s_dropped_msgs++;
+        }
+        ring_pop();
+        off = ring_reserve(need);
+    }
+    if (off < 0) {
+        s_dropped_msgs++;
+        s_dropped_bytes += len;
+        xSemaphoreGive(s_lock);
+        return false;
+    }
+
+    rec_hdr_t *hdr = (rec_hdr_t*)(s_arena + off);
+    hdr->len = (uint16_t)len;
+    hdr->topic_id = (uint8_t)topic_id;
+    hdr->flags = 0;
+    hdr->timestamp = timestamp;
+    hdr->seq = s_next_seq++;
+    hdr->msg_id = -1;
+    hdr->sent_ms = 0;
+    hdr->origin_us = origin_us;
+    hdr->queued_us = (uint32_t)esp_timer_get_time();
+    hdr->sent_us = 0;
+    memcpy(hdr + 1, data, len);
+
+    s_head = (uint32_t)off + need;
+    if (s_head >= s_cap) s_head = 0;
+    s_count++;
+    s_queued_bytes += need;
+    if (s_queued_bytes > s_high_water) s_high_water = s_queued_bytes;
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+int mqtt_queue_foreach(int max_msgs, mqtt_queue_visit_fn fn, void *ctx)
+{
+    if (!s_arena || !fn) return 0;
+
+    int visited = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t off = s_tail;
+    for (uint32_t i = 0; i < s_count && visited < max_msgs; i++) {
+        off = ring_norm(off);
+        mqtt_queue_msg_t msg;
+        msg_from_hdr((rec_hdr_t*)(s_arena + off), &msg);
+        visited++;
+        if (!fn(&msg, ctx)) break;
+        off = ring_next(off);
+    }
+    xSemaphoreGive(s_lock);
+    return visited;
+}
+
+int mqtt_queue_send_pending(uint32_t max_inflight_msgs, uint32_t max_inflight_bytes,
+                            uint32_t now_ms, mqtt_queue_send_fn fn, void *ctx)
+{
+    if (!s_arena || !fn) return 0;
+
+    int sent = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t off = s_tail;
+    for (uint32_t i = 0; i < s_count && s_inflight_msgs < max_inflight_msgs; i++) {
+        off = ring_norm(off);
+        rec_hdr_t *hdr = (rec_hdr_t*)(s_arena + off);
+        if (!(hdr->flags & (REC_FLAG_INFLIGHT | REC_FLAG_ACKED))) {
+            // Always allow one message so an oversized record cannot stall the queue
+            if (s_inflight_msgs > 0 && s_inflight_bytes + hdr->len > max_inflight_bytes) break;
+
+            mqtt_queue_msg_t msg;
+            msg_from_hdr(hdr, &msg);
+            int msg_id = fn(&msg, ctx);
+            if (msg_id < 0) break;
+
+            hdr->flags |= REC_FLAG_INFLIGHT;
+            hdr->msg_id = msg_id;
+            hdr->sent_ms = now_ms;
+            hdr->sent_us = (uint32_t)esp_timer_get_time() | 1;   // Never 0, which means "not sent"
+            s_inflight_msgs++;
+            s_inflight_bytes += hdr->len;
+            sent++;
+        }
+        off = ring_next(off);
+    }
+    xSemaphoreGive(s_lock);
+    return sent;
+}
+
+bool mqtt_queue_ack(int msg_id, mqtt_queue_msg_t *acked)
+{
+    if (!s_arena) return false;
+
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t off = s_tail;
+    for (uint32_t i = 0; i < s_count; i++) {
+        off = ring_norm(off);
+        rec_hdr_t *hdr = (rec_hdr_t*)(s_arena + off);
+        if ((hdr->flags & REC_FLAG_INFLIGHT) && hdr->msg_id == msg_id) {
+            if (acked) {
+                msg_from_hdr(hdr, acked);
+                acked->data = NULL;   // Released below
+            }
+            clear_inflight(hdr);
+            hdr->flags |= REC_FLAG_ACKED;
+            s_acked_msgs++;
+            found = true;
+            break;
+        }
+        off = ring_next(off);
+    }
+    // Release acknowledged records in order; out-of-order acks wait here
+    while (s_count > 0 && (ring_oldest()->flags & REC_FLAG_ACKED)) {
+        ring_pop();
+    }
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+int mqtt_queue_requeue_inflight(uint32_t timeout_ms, uint32_t now_ms)
+{
+    if (!s_arena) return 0;
+
+    int requeued = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t off = s_tail;
+    for (uint32_t i = 0; i < s_count && s_inflight_msgs > 0; i++) {
+        off = ring_norm(off);
+        rec_hdr_t *hdr = (rec_hdr_t*)(s_arena + off);
+        if ((hdr->flags & REC_FLAG_INFLIGHT) &&
+            (timeout_ms == 0 || now_ms - hdr->sent_ms >= timeout_ms)) {
+            clear_inflight(hdr);
+            hdr->msg_id = -1;
+            requeued++;
+        }
+        off = ring_next(off);
+    }
+    s_retransmits += requeued;
+    xSemaphoreGive(s_lock);
+    return requeued;
+}
+
+void mqtt_queue_get_stats(mqtt_queue_stats_t *stats)
+{
+    if (!stats) return;
+    stats->capacity_bytes = s_cap;
+    stats->queued_bytes = s_queued_bytes;
+    stats->queued_msgs = s_count;
+    stats->high_water_bytes = s_high_water;
+    stats->dropped_msgs = s_dropped_msgs;
+    stats->dropped_bytes = s_dropped_bytes;
+    stats->inflight_msgs = s_inflight_msgs;
+    stats->inflight_bytes = s_inflight_bytes;
+    stats->acked_msgs = s_acked_msgs;
+    stats->retransmits = s_retransmits;
+    stats->in_psram = s_in_psram;
+    stats->policy = s_policy;
+}
+
+uint32_t mqtt_queue_count(void)
+{
+    return s_count;
+}
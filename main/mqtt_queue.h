@@ -0,0 +1,80 @@
+/* mqtt_queue.h - variable-length offline queue for MQTT messages
+ *
+ * Records stay in the arena until the broker acknowledges them: sending marks
+ * a record in-flight with its msg_id, MQTT_EVENT_PUBLISHED acks it, and acked
+ * records are released from the oldest end. */
+#ifndef MQTT_QUEUE_H
+#define MQTT_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Arena size: large when PSRAM is present, smaller fallback in internal RAM
+#define MQTT_QUEUE_CAPACITY_PSRAM    (256 * 1024)
+#define MQTT_QUEUE_CAPACITY_INTERNAL (24 * 1024)
+#define MQTT_QUEUE_MAX_TOPICS        16
+#define MQTT_QUEUE_MAX_MSG_LEN       0xFFFF
+
+typedef enum {
+    MQTT_QUEUE_DROP_OLDEST = 0,   // Evict the oldest messages to make room (never one in flight)
+    MQTT_QUEUE_DROP_NEWEST = 1,   // Reject the incoming message when full
+} mqtt_queue_policy_t;
+
+typedef struct {
+    uint32_t capacity_bytes;   // Arena size
+    uint32_t queued_bytes;     // Bytes held by live records (headers included)
+    uint32_t queued_msgs;      // Live records
+    uint32_t high_water_bytes; // Peak queued_bytes since boot
+    uint32_t dropped_msgs;     // Messages lost to the capacity limit
+    uint32_t dropped_bytes;    // Payload bytes lost to the capacity limit
+    uint32_t inflight_msgs;    // Sent, waiting for PUBACK
+    uint32_t inflight_bytes;
+    uint32_t acked_msgs;       // Released after PUBACK since boot
+    uint32_t retransmits;      // In-flight records returned to pending
+    bool in_psram;
+    mqtt_queue_policy_t policy;
+} mqtt_queue_stats_t;
+
+// A queued message as seen by the drain callback. data is NOT NUL-terminated
+// and is only valid for the duration of the callback.
+typedef struct {
+    uint32_t seq;
+    uint8_t topic_id;
+    const char *data;
+    size_t len;
+    uint32_t timestamp;
+    uint32_t origin_us;   // Latency trace: oldest read in the payload (0 = untraced)
+    uint32_t queued_us;   // When pushed
+    uint32_t sent_us;     // Last handed to esp-mqtt (0 = never sent)
+} mqtt_queue_msg_t;
+
+// Return true to continue, false to stop.
+typedef bool (*mqtt_queue_visit_fn)(const mqtt_queue_msg_t *msg, void *ctx);
+// Publish one message; return its msg_id (>= 0) or < 0 to stop sending.
+typedef int (*mqtt_queue_send_fn)(const mqtt_queue_msg_t *msg, void *ctx);
+
+bool mqtt_queue_init(mqtt_queue_policy_t policy);
+void mqtt_queue_set_policy(mqtt_queue_policy_t policy);
+
+// Topics are stored once and referenced by a small ID from every record
+int mqtt_queue_intern_topic(const char *topic);      // -1 if the table is full
+const char* mqtt_queue_topic_name(int topic_id);
+
+bool mqtt_queue_push(int topic_id, const char *data, size_t len, uint32_t timestamp, uint32_t origin_us);
+int mqtt_queue_foreach(int max_msgs, mqtt_queue_visit_fn fn, void *ctx);  // Visits oldest first, no state change
+
+// Send pending records oldest first while the in-flight window has room.
+// Returns the number of records handed to fn.
+int mqtt_queue_send_pending(uint32_t max_inflight_msgs, uint32_t max_inflight_bytes,
+                            uint32_t now_ms, mqtt_queue_send_fn fn, void *ctx);
+// false if no in-flight record carries msg_id. acked (optional) receives the
+// record's header fields; its data pointer is NULL as the record may be released.
+bool mqtt_queue_ack(int msg_id, mqtt_queue_msg_t *acked);
+// Return in-flight records to pending so they are sent again. With
+// timeout_ms == 0 every in-flight record is returned (e.g. after a disconnect).
+int mqtt_queue_requeue_inflight(uint32_t timeout_ms, uint32_t now_ms);
+void mqtt_queue_get_stats(mqtt_queue_stats_t *stats);
+uint32_t mqtt_queue_count(void);
+
+#endif // MQTT_QUEUE_H
@@ -0,0 +1,40 @@
+#include "net_events.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "NET_EVT";
+
+static EventGroupHandle_t s_net_event_group = NULL;
+
+void net_events_init(void)
+{
+    if (s_net_event_group) return;
+    s_net_event_group = xEventGroupCreate();
+    if (!s_net_event_group) {
+        ESP_LOGE(TAG, "Failed to create network event group");
+    }
+}
+
+void net_events_post(EventBits_t bits)
+{
+    if (s_net_event_group) {
+        xEventGroupSetBits(s_net_event_group, bits);
+    }
+}
+
+EventBits_t net_events_wait(uint32_t timeout_ms)
+{
+    TickType_t ticks;
+    if (timeout_ms == NET_EVENTS_WAIT_FOREVER) {
+        ticks = portMAX_DELAY;
+    } else {
+        ticks = pdMS_TO_TICKS(timeout_ms);
+        if (ticks == 0 && timeout_ms > 0) ticks = 1;
+    }
+
+    if (!s_net_event_group) {
+        vTaskDelay(ticks ? ticks : 1);
+        return 0;
+    }
+    return xEventGroupWaitBits(s_net_event_group, NET_EVT_ALL, pdTRUE, pdFALSE, ticks) & NET_EVT_ALL;
+}
@@ -0,0 +1,31 @@
+/* net_events.h - event group that drives the MQTT uplink task
+ *
+ * Producers (Ethernet/WiFi, MQTT client, batching) post bits; mqtt_task sleeps on
+ * the group until one is set or its next deadline expires. */
+#ifndef NET_EVENTS_H
+#define NET_EVENTS_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#define NET_EVT_LINK_UP           BIT0  // Ethernet or WiFi has an IP address
+#define NET_EVT_LINK_DOWN         BIT1  // Ethernet or WiFi link lost
+#define NET_EVT_MQTT_CONNECTED    BIT2
+#define NET_EVT_MQTT_DISCONNECTED BIT3
+#define NET_EVT_MQTT_ACK          BIT4  // PUBACK waiting in the ack queue
+#define NET_EVT_BATCH_READY       BIT5  // A batch size threshold was reached
+#define NET_EVT_CONFIG            BIT6  // Uplink configuration changed
+#define NET_EVT_ALL               (NET_EVT_LINK_UP | NET_EVT_LINK_DOWN | NET_EVT_MQTT_CONNECTED | \
+                                   NET_EVT_MQTT_DISCONNECTED | NET_EVT_MQTT_ACK | NET_EVT_BATCH_READY | \
+                                   NET_EVT_CONFIG)
+
+#define NET_EVENTS_WAIT_FOREVER   UINT32_MAX
+
+void net_events_init(void);
+void net_events_post(EventBits_t bits);
+// Block until any event is posted or timeout_ms passes. Returns (and clears)
+// the posted bits; 0 means the timeout expired.
+EventBits_t net_events_wait(uint32_t timeout_ms);
+
+#endif // NET_EVENTS_H
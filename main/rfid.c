@@ -8,95 +8,155 @@
 #include "esp_timer.h"
 #include "uart.h"
 #include "mqtt_config.h"
-
-#define READER_TXD  17
-#define READER_RXD  18
+#include "tag_store.h"
+#include "epc_decode.h"
+#include "tag_rules.h"
+#include "epcdb.h"
+#include "tag_stream.h"
+#include "llrp.h"
+#include "boot.h"
+#include "metrics.h"
+#include "latency.h"
+#include "nvs.h"
 
 static const char *TAG = "RFID";
-static volatile int s_running = 0;         // Global running state (for hardware)
-static volatile int s_local_running = 0;   // Local/web server running state
-static volatile int s_mqtt_running = 0;    // MQTT running state
-static volatile int s_mqtt_mode = 0;       // Track if inventory was started via MQTT
-static char s_last_command[128] = "No command sent yet";  // Reduced from 256
-
-// Store actual power values received from reader
-static int s_power_values[4] = {30, 30, 30, 30}; // Default values
-static volatile int s_power_request_pending = 0;
+#define RFID_NVS_NAMESPACE "rfid"
 
-// Tag cleanup configuration
-#define TAG_TIMEOUT_MS (30000)  // 30 seconds timeout for inactive tags
-#define MAX_TAGS 32
+// Reader slots: UART port and pins. Slot 0 is the original single-reader wiring.
+typedef struct {
+    int uart_port;
+    int txd;
+    int rxd;
+} rfid_reader_hw_t;
+
+static const rfid_reader_hw_t s_reader_hw[RFID_MAX_READERS] = {
+    { 1, 17, 18 },   // UART1
+    { 2, 15, 16 },   // UART2
+};
+
+// A request whose reply must be consumed by its parser rather than the tag decoder
+#define RFID_CMD_TIMEOUT_MS 1000
+typedef struct {
+    uint8_t category;
+    uint8_t mid;
+    volatile uint32_t sent_ms;   // 0 = nothing outstanding
+} rfid_pending_cmd_t;
 
-// Tag storage
 typedef struct {
-    char epc[64];  // Reduced from 128 to 64
-    int rssi;
-    int ant;
-    uint64_t last_ms;
-    uint32_t count;  // How many times this specific tag has been detected
-    int collected_by; // 0=local, 1=mqtt - tracks which mode collected this tag
-} tag_item_t;
-
-static tag_item_t s_tags[MAX_TAGS];
-static uint32_t s_total_tag_count = 0;  // Total detections across all tags
-
-// Clean up old tags periodically
-static void cleanup_old_tags(void) {
-    uint64_t now = esp_timer_get_time() / 1000ULL;
-    int cleaned = 0;
-    
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] != '\0' && (now - s_tags[i].last_ms) > TAG_TIMEOUT_MS) {
-            s_tags[i].epc[0] = '\0'; // Mark as empty
-            cleaned++;
-        }
+    int id;
+    const rfid_reader_hw_t *hw;
+    bool open;                       // UART driver installed
+    volatile bool present;           // At least one frame received
+    volatile int running;            // Hardware inventory state
+    volatile int local_running;      // Local/web server running state
+    volatile int mqtt_running;       // MQTT running state
+    char last_command[128];
+    int power_values[4];             // Actual power values received from reader
+    rfid_pending_cmd_t pending;
+    // Decoder state (touched only by this reader's UART task)
+    int startup_packets;
+    int process_count;
+    int skip_count;
+    int log_count;
+} rfid_reader_t;
+
+static rfid_reader_t s_readers[RFID_MAX_READERS];
+static int s_reader_count = 1;
+
+static uint16_t crc16_xmodem(const uint8_t *data, size_t len) {
+    uint16_t crc = 0x0000;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; ++b)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
     }
-    
-    if (cleaned > 0) {
-        ESP_LOGI(TAG, "Cleaned up %d old tags", cleaned);
+    return crc;
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000ULL);
+}
+
+// Count complete NRN frames in a UART read by message ID and check their CRC.
+// Frame: 5A | PCW (4) | LEN (2) | DATA | CRC16-XMODEM over PCW..DATA
+static void count_frames(const uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    while (pos + 9 <= len && buf[pos] == 0x5A) {
+        size_t frame_len = 9 + ((buf[pos + 5] << 8) | buf[pos + 6]);
+        if (pos + frame_len > len) break;   // Split across reads
+
+        const uint8_t *f = buf + pos;
+        uint16_t crc = (uint16_t)((f[frame_len - 2] << 8) | f[frame_len - 1]);
+        if (crc16_xmodem(f + 1, frame_len - 3) == crc) {
+            metrics_count_frame(f[3]);
+        } else {
+            metrics_inc(METRIC_RFID_CRC_ERRORS);
+        }
+        pos += frame_len;
     }
 }
 
-static int find_tag_index(const char* epc) {
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] != '\0' && strcmp(s_tags[i].epc, epc) == 0) return i;
+bool rfid_reader_valid(int reader)
+{
+    return reader >= 0 && reader < s_reader_count && s_readers[reader].open;
+}
+
+int rfid_reader_count(void)
+{
+    return s_reader_count;
+}
+
+// Resolve a command target to a range of readers; false if it names no enabled reader
+static bool reader_range(int reader, int *first, int *last)
+{
+    if (reader == RFID_ALL_READERS) {
+        *first = 0;
+        *last = s_reader_count - 1;
+        return s_reader_count > 0;
     }
-    return -1;
+    if (!rfid_reader_valid(reader)) return false;
+    *first = *last = reader;
+    return true;
 }
 
-static int alloc_tag_index(const char* epc) {
-    // First try to find an empty slot
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] == '\0') { 
-            strncpy(s_tags[i].epc, epc, sizeof(s_tags[i].epc)-1);
-            s_tags[i].count = 0;  // Initialize count for new tag
-            s_tags[i].collected_by = 0;  // Initialize collection mode
-            return i; 
-        }
+static void set_last_command(rfid_reader_t *r, const char* cmd_description)
+{
+    strncpy(r->last_command, cmd_description, sizeof(r->last_command) - 1);
+    r->last_command[sizeof(r->last_command) - 1] = '\0';
+}
+
+int rfid_format_frame(const uint8_t *data, size_t len, char *out, size_t out_len)
+{
+    if (!out || out_len < 5) return 0;
+    strcpy(out, "TX: ");
+    size_t offset = 4; // Start after "TX: "
+    for (size_t i = 0; i < len && offset + 4 < out_len; i++) {
+        snprintf(out + offset, out_len - offset, "%02X ", data[i]);
+        offset += 3; // Each byte takes 3 characters ("XX ")
     }
-    
-    // If no empty slots, clean up old tags and try again
-    cleanup_old_tags();
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] == '\0') { 
-            strncpy(s_tags[i].epc, epc, sizeof(s_tags[i].epc)-1);
-            s_tags[i].count = 0;  // Initialize count for new tag
-            s_tags[i].collected_by = 0;  // Initialize collection mode
-            return i; 
-        }
+    if (offset > 4) out[--offset] = '\0';   // Remove trailing space
+    return (int)offset;
+}
+
+// Send a frame to one reader and keep it as that reader's last command
+static void reader_send(rfid_reader_t *r, const uint8_t *data, size_t len)
+{
+    if (!r->open) {
+        ESP_LOGE(TAG, "Reader %d not initialized, cannot send data", r->id);
+        return;
     }
-    
-    // Still no space, overwrite oldest
-    int oldest = 0; 
-    uint64_t tmin = s_tags[0].last_ms;
-    for (int i = 1; i < MAX_TAGS; ++i) {
-        if (s_tags[i].last_ms < tmin) { 
-            tmin = s_tags[i].last_ms; 
-            oldest = i; 
-        }
+
+    // Capture command for status display
+    char cmd_str[sizeof(r->last_command)];
+    rfid_format_frame(data, len, cmd_str, sizeof(cmd_str));
+    set_last_command(r, cmd_str);
+
+    int bytes_written = uart_send_bytes(r->hw->uart_port, (const char*)data, len);
+    if (bytes_written >= 0) {
+        ESP_LOGI(TAG, "Reader %d sent %d bytes: %s", r->id, bytes_written, cmd_str);
     }
-    strncpy(s_tags[oldest].epc, epc, sizeof(s_tags[oldest].epc)-1);
-    return oldest;
 }
 
 // helper: convert byte to hex chars
@@ -105,7 +165,7 @@ static inline void byte_to_hex(uint8_t b, char *out) { const char *h = "01234567
 static inline int ok_rssi(int v) { int a = v<0 ? -v : v; return (a>=20 && a<=100); }
 
 // Parser: look for pattern E2 80 and preceding length byte, similar heuristic from Arduino code
-static int extract_one_tag(const uint8_t* buf, size_t len, size_t startPos, size_t *nextPos, char *epc_out, size_t epc_out_len, int *rssi_out, int *ant_out) {
+static int extract_one_tag(const uint8_t* buf, size_t len, size_t startPos, size_t *nextPos, const uint8_t **epc_out, size_t *epc_len_out, int *rssi_out, int *ant_out) {
     for (size_t i = startPos; i + 4 < len; ++i) {
         if (buf[i] == 0xE2 && buf[i+1] == 0x80) {
             if (i == 0) continue;
@@ -114,12 +174,8 @@ static int extract_one_tag(const uint8_t* buf, size_t len, size_t startPos, size
             if (i + L > len) break;
 
             // epc is L bytes starting at i
-            size_t written = 0;
-            for (size_t k = 0; k < L && written + 2 < epc_out_len; ++k) {
-                char h[2]; byte_to_hex(buf[i+k], h);
-                epc_out[written++] = h[0]; epc_out[written++] = h[1];
-            }
-            epc_out[written] = '\0';
+            *epc_out = &buf[i];
+            *epc_len_out = L;
 
             // RSSI heuristics
             int r0 = 0, r1 = 0;
@@ -140,8 +196,46 @@ static int extract_one_tag(const uint8_t* buf, size_t len, size_t startPos, size
     return 0;
 }
 
+// Hand one decoded read to the shared tag store, unless the edge rules, the
+// asset table or the company-prefix rules drop it first
+static void reader_tag_read(rfid_reader_t *r, const uint8_t *epc_bytes, size_t epc_len, int rssi, int ant, uint32_t rx_us, const char *fmt)
+{
+    if (epc_len == 0) return;
+    if (!tag_rules_accept(r->id, ant, rssi, epc_bytes, epc_len)) {
+        metrics_inc(METRIC_RFID_RULE_DROPS);
+        return;
+    }
+    if (!epcdb_accept(epc_bytes, epc_len)) {
+        metrics_inc(METRIC_RFID_EPCDB_SUPPRESSED);
+        return;
+    }
+    if (!epc_decode_accept(epc_bytes, epc_len)) {
+        metrics_inc(METRIC_RFID_EPC_REJECTED);
+        return;
+    }
+
+    char epc[65];
+    size_t n = epc_len < 32 ? epc_len : 32;
+    for (size_t k = 0; k < n; ++k) byte_to_hex(epc_bytes[k], &epc[2 * k]);
+    epc[2 * n] = '\0';
+
+    // The store decides whether the read is reportable yet (min_reads, seen
+    // filter suppress mode); the LAN stream and LLRP only carry reportable reads
+    uint32_t parse_us = latency_now_us();   // Decoded; the store stage starts here
+    if (tag_store_touch(epc, r->id, ant, rssi, rx_us, parse_us)) {
+        tag_stream_read(r->id, ant, rssi, epc_bytes, epc_len, rx_us);
+        llrp_read(r->id, ant, rssi, epc_bytes, epc_len, rx_us);
+    }
+
+    // Periodic logging to show activity without flooding the console
+    if (++r->log_count % 100 == 0) {
+        printf("R%d TAG epc=%s rssi=%d ant=%d total=%lu (%s)\n",
+               r->id, epc, rssi, ant, (unsigned long)tag_store_total(r->mqtt_running ? TAG_CONSUMER_MQTT : TAG_CONSUMER_WEB), fmt);
+    }
+}
+
 // Parse power response from reader
-static void parse_power_response(const uint8_t *buf, size_t len) {
+static void parse_power_response(rfid_reader_t *r, const uint8_t *buf, size_t len) {
     // Expected response format: 5A 00 01 02 02 00 08 01 PWR1 02 PWR2 03 PWR3 04 PWR4 CRC CRC
     // Length should be 17 bytes for power response
     if (len >= 17 && buf[0] == 0x5A && buf[1] == 0x00 && buf[2] == 0x01 && buf[3] == 0x02 && buf[4] == 0x02) {
@@ -150,81 +244,75 @@ static void parse_power_response(const uint8_t *buf, size_t len) {
             // Parse antenna power values
             // Format: ID PWR ID PWR ID PWR ID PWR
             // buf[7]=0x01, buf[8]=power1, buf[9]=0x02, buf[10]=power2, etc.
-            
-            if (buf[7] == 0x01) s_power_values[0] = buf[8];   // Antenna 1 power
-            if (buf[9] == 0x02) s_power_values[1] = buf[10];  // Antenna 2 power  
-            if (buf[11] == 0x03) s_power_values[2] = buf[12]; // Antenna 3 power
-            if (buf[13] == 0x04) s_power_values[3] = buf[14]; // Antenna 4 power
-            
-            s_power_request_pending = 0;
+
+            if (buf[7] == 0x01) r->power_values[0] = buf[8];   // Antenna 1 power
+            if (buf[9] == 0x02) r->power_values[1] = buf[10];  // Antenna 2 power
+            if (buf[11] == 0x03) r->power_values[2] = buf[12]; // Antenna 3 power
+            if (buf[13] == 0x04) r->power_values[3] = buf[14]; // Antenna 4 power
+
+            r->pending.sent_ms = 0;
         }
     }
 }
 
+// Route a reply to the outstanding request. Returns true while the bytes
+// belong to the request (they are not decoded as tags).
+static bool correlate_reply(rfid_reader_t *r, const uint8_t *buf, size_t len)
+{
+    uint32_t sent = r->pending.sent_ms;
+    if (sent == 0) return false;
+    if (now_ms() - sent > RFID_CMD_TIMEOUT_MS) {
+        ESP_LOGW(TAG, "Reader %d: no reply to %02X/%02X within %d ms", r->id,
+                 r->pending.category, r->pending.mid, RFID_CMD_TIMEOUT_MS);
+        r->pending.sent_ms = 0;
+        return false;
+    }
+    if (r->pending.category == 0x02 && r->pending.mid == 0x02) {
+        parse_power_response(r, buf, len);
+    }
+    return true;
+}
+
 // Parse tag/EPC response from reader (handles multiple tag response formats)
-static bool parse_tag_response(const uint8_t *buf, size_t len) {
+static bool parse_tag_response(rfid_reader_t *r, const uint8_t *buf, size_t len, uint32_t rx_us) {
     // Check for valid frame header: 5A 00 01
     if (len < 9 || buf[0] != 0x5A || buf[1] != 0x00 || buf[2] != 0x01) {
         return false;
     }
-    
+
     uint8_t mid = buf[3]; // Message ID
-    
+
     // Handle different tag response formats
     if (mid == 0x12) {
         // Real-time tag data format (from log): 5A 00 01 12 00 00 LEN [TAG_DATA] CRC CRC
         // Example: 5A 00 01 12 00 00 18 00 0C E2 80 69 15 60 00 02 16 65 10 B3 31 30 00 01 01 FE 08 00 0D F7 32 49 7B
-        
+
         if (len >= 15) { // Minimum for meaningful tag data
             uint16_t data_len = (buf[5] << 8) | buf[6]; // Length field
-            
+
             if (len >= 7 + data_len + 2 && data_len >= 8) { // header + data + CRC, minimum tag data
                 // Look for EPC pattern (E2 80 prefix is common for EPC tags)
                 const uint8_t *data = &buf[7];
-                
+
                 // Find EPC data - typically starts at offset 2-3 in tag data
                 for (int epc_start = 2; epc_start <= 4 && epc_start < data_len - 6; epc_start++) {
                     if (data[epc_start] == 0xE2 && data[epc_start + 1] == 0x80) {
                         // Found potential EPC start, determine length
                         int epc_len = 12; // Common EPC-96 length in bytes
                         if (epc_start + epc_len <= data_len) {
-                            
-                            char epc[128] = "";
-                            for (int i = 0; i < epc_len; i++) {
-                                char hex_byte[3];
-                                snprintf(hex_byte, sizeof(hex_byte), "%02X", data[epc_start + i]);
-                                strcat(epc, hex_byte);
-                            }
-                            
+
                             // Extract RSSI and antenna from tag data (rough approximation)
                             int rssi = -48; // Default from observed data
                             int ant = 1;    // Default antenna
-                            
+
                             // Try to extract antenna and RSSI from the tag data
                             if (data_len > epc_start + epc_len + 2) {
                                 ant = data[epc_start + epc_len + 1]; // Antenna number usually follows EPC
                                 if (ant < 1 || ant > 4) ant = 1;   // Validate antenna
                             }
-                            
-                            // Find or allocate tag slot
-                            int idx = find_tag_index(epc);
-                            if (idx < 0) idx = alloc_tag_index(epc);
-                            
-                            if (idx >= 0) {
-                                s_tags[idx].rssi = rssi;
-                                s_tags[idx].ant = ant;
-                                s_tags[idx].last_ms = esp_timer_get_time() / 1000ULL;
-                                s_tags[idx].count++;        // Increment individual tag count
-                                s_total_tag_count++;        // Increment total count
-                                
-                                // Enable fast logging every 50 tags instead of being silent
-                                static int tag_log_count = 0;
-                                if (++tag_log_count % 50 == 0) {
-                                    printf("TAG[%d] epc=%s rssi=%d ant=%d count=%lu total=%lu (MID 0x12)\n", 
-                                           idx, epc, rssi, ant, (unsigned long)s_tags[idx].count, (unsigned long)s_total_tag_count);
-                                }
-                                return true;
-                            }
+
+                            reader_tag_read(r, &data[epc_start], epc_len, rssi, ant, rx_us, "MID 0x12");
+                            return true;
                         }
                     }
                 }
@@ -233,129 +321,94 @@ static bool parse_tag_response(const uint8_t *buf, size_t len) {
     } else if (mid == 0x10) {
         // Legacy tag response format: 5A 00 01 10 00 00 LEN [EPC_DATA] CRC CRC
         uint16_t data_len = (buf[5] << 8) | buf[6]; // bytes 5-6 contain length
-        
+
         if (len >= 7 + data_len + 2) { // header + data + CRC
-            // Extract EPC data
-            char epc[128] = "";
-            for (int i = 0; i < data_len && i < 32; i++) { // Limit EPC to reasonable size
-                char hex_byte[3];
-                snprintf(hex_byte, sizeof(hex_byte), "%02X", buf[7 + i]);
-                strcat(epc, hex_byte);
-            }
-            
+            // EPC data (reader_tag_read keeps at most 32 bytes)
             // For now, assume antenna 1 and RSSI -50 (since not in this response format)
-            int rssi = -50;
-            int ant = 1;
-            
-            // Find or allocate tag slot
-            int idx = find_tag_index(epc);
-            if (idx < 0) idx = alloc_tag_index(epc);
-            
-            if (idx >= 0) {
-                s_tags[idx].rssi = rssi;
-                s_tags[idx].ant = ant;
-                s_tags[idx].last_ms = esp_timer_get_time() / 1000ULL;
-                
-                // Silent operation to prevent watchdog timeout
-                // ESP_LOGI(TAG, "TAG[%d] epc=%s (legacy, count=%d)", idx, epc, legacy_log_count);
-                return true;
-            }
+            reader_tag_read(r, &buf[7], data_len, -50, 1, rx_us, "legacy");
+            return true;
         }
     }
-    
+
     return false;
 }
 
 // Function to reset startup delay for immediate tag processing
-void rfid_reset_startup_delay(void) 
+void rfid_reset_startup_delay(void)
 {
     // This function allows bypassing startup delay when inventory is manually started
     // The static variable will be reset to force immediate processing
 }
 
-void rfid_process_bytes(const uint8_t *buf, size_t len)
+// UART RX callback: bytes received from one reader
+static void rfid_process_bytes(void *ctx, const uint8_t *buf, size_t len, uint32_t rx_us)
 {
-    if (!buf || len == 0) return;
-    
-    // CRITICAL: Check for power response FIRST, before any filtering
-    // Power responses must be processed immediately regardless of system state
-    if (s_power_request_pending) {
-        parse_power_response(buf, len);
+    rfid_reader_t *r = (rfid_reader_t *)ctx;
+    if (!r || !buf || len == 0) return;
+    if (buf[0] == 0x5A) {
+        if (!r->present) {
+            r->present = true;
+            ESP_LOGI(TAG, "Reader %d answered on UART%d", r->id, r->hw->uart_port);
+        }
+        boot_mark(BOOT_MARK_READER_READY);
+        count_frames(buf, len);
+    }
+
+    // CRITICAL: Check for a pending reply (power query) FIRST, before any filtering
+    // Replies must be processed immediately regardless of system state
+    if (correlate_reply(r, buf, len)) {
         return; // Don't process as tag data
     }
-    
+
     // During system startup, minimize processing to prevent watchdog timeout
-    static int startup_packets = 0;
-    startup_packets++;
-    
+    r->startup_packets++;
+
     // Skip heavy processing only during boot, but NOT when inventory is manually started
-    if (startup_packets < 200 && !s_running) {  // Only skip if inventory is not running
-        if (startup_packets % 50 == 0) {  // Yield less frequently
+    if (r->startup_packets < 200 && !r->running) {  // Only skip if inventory is not running
+        metrics_inc(METRIC_RFID_PACKETS_SKIPPED);
+        if (r->startup_packets % 50 == 0) {  // Yield less frequently
             vTaskDelay(pdMS_TO_TICKS(1));
         }
         return;
     }
-    
+
     // Yield occasionally to prevent watchdog timeout during high-speed processing
-    static int process_count = 0;
-    if (++process_count % 100 == 0) {  // Reduced frequency from 50 to 100
+    if (++r->process_count % 100 == 0) {  // Reduced frequency from 50 to 100
         vTaskDelay(pdMS_TO_TICKS(1));
     }
-    
+
     // IMPORTANT: Check if inventory is running FIRST before any tag processing
-    if (!s_running) {
+    if (!r->running) {
+        metrics_inc(METRIC_RFID_PACKETS_SKIPPED);
         // Don't log every skipped packet to reduce console load
-        static int skip_count = 0;
-        if (++skip_count % 1000 == 0) {
-            printf("Inventory not running, skipped %d packets\n", skip_count);
+        if (++r->skip_count % 1000 == 0) {
+            printf("Reader %d: inventory not running, skipped %d packets\n", r->id, r->skip_count);
         }
         return;
     }
-    
+
     // Try to parse as tag response (support both MID 0x10 and 0x12)
     if (buf[3] == 0x10 || buf[3] == 0x12) {
-        if (parse_tag_response(buf, len)) {
+        if (parse_tag_response(r, buf, len, rx_us)) {
             return; // Successfully parsed as tag response
         }
     }
-    
+
     // Continue with normal tag processing
     size_t pos = 0;
     int tags_found = 0;
     const int MAX_TAGS_PER_BATCH = 20; // Increased from 10 to 20 for faster processing
-    
+
     while (pos + 6 <= len && tags_found < MAX_TAGS_PER_BATCH) {
-        char epc[128]; 
-        int rssi = 0, ant = 0; 
+        const uint8_t *epc = NULL;
+        size_t epc_len = 0;
+        int rssi = 0, ant = 0;
         size_t next = pos + 1;
-        
-        if (extract_one_tag(buf, len, pos, &next, epc, sizeof(epc), &rssi, &ant)) {
-            if (epc[0] != '\0') {
-                int idx = find_tag_index(epc);
-                if (idx < 0) idx = alloc_tag_index(epc);
-                
-                s_tags[idx].rssi = rssi;
-                s_tags[idx].ant = ant;
-                s_tags[idx].last_ms = esp_timer_get_time() / 1000ULL;
-                s_tags[idx].count++;        // Increment individual tag count
-                s_total_tag_count++;        // Increment total count
-                
-                // Mark which mode collected this tag
-                if (s_mqtt_running) {
-                    s_tags[idx].collected_by = 1; // MQTT mode
-                } else if (s_local_running) {
-                    s_tags[idx].collected_by = 0; // Local mode
-                }
-                
-                // Note: MQTT publishing is now handled by periodic batch task
-                // Individual tag detections are no longer published immediately
-                
-                // Enable periodic logging to show activity (reduced frequency)
-                static int fallback_log_count = 0;
-                if (++fallback_log_count % 100 == 0) {
-                    printf("TAG[%d] epc=%s rssi=%d ant=%d count=%lu total=%lu (fallback)\n", 
-                           idx, epc, rssi, ant, (unsigned long)s_tags[idx].count, (unsigned long)s_total_tag_count);
-                }
+
+        if (extract_one_tag(buf, len, pos, &next, &epc, &epc_len, &rssi, &ant)) {
+            if (epc_len > 0) {
+                // Note: MQTT publishing is handled by the batching stage (mqtt_batch.c)
+                reader_tag_read(r, epc, epc_len, rssi, ant, rx_us, "fallback");
                 tags_found++;
             }
             pos = next;
@@ -365,224 +418,220 @@ void rfid_process_bytes(const uint8_t *buf, size_t len)
     }
 }
 
-int rfid_get_tags_json(char *out, int out_len)
-{
-    if (!out || out_len <= 10) return 0;
-    
-    int used = 0;
-    int count = 0;
-    
-    // Start with object containing count, total, and tags array
-    used += snprintf(out + used, out_len - used, "{\"active_tags\":");
-    
-    // Count active tags first (only local tags for web server)
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] != '\0' && s_tags[i].collected_by == 0) count++;
-    }
-    
-    // Add active count and total count to JSON
-    used += snprintf(out + used, out_len - used, "%d,\"total_detections\":%lu,\"tags\":[", count, (unsigned long)s_total_tag_count);
-    
-    int first = 1;
-    int tags_output = 0;
-    
-    for (int i = 0; i < MAX_TAGS && used < out_len - 100; ++i) {
-        if (s_tags[i].epc[0] == '\0') continue;
-        if (s_tags[i].collected_by != 0) continue; // Skip MQTT tags, only show local tags
-        
-        if (!first) {
-            used += snprintf(out + used, out_len - used, ",");
-        }
-        first = 0;
-        
-        uint64_t ts = s_tags[i].last_ms;
-        used += snprintf(out + used, out_len - used, 
-            "{\"epc\":\"%s\",\"rssi\":%d,\"ant\":%d,\"ts\":%llu,\"count\":%lu}",
-            s_tags[i].epc, s_tags[i].rssi, s_tags[i].ant, 
-            (unsigned long long)ts, (unsigned long)s_tags[i].count);
-        
-        tags_output++;
-        if (tags_output >= 50) break; // Limit output size
-    }
-    
-    used += snprintf(out + used, out_len - used, "]}");
-    return used;
+int rfid_get_tags_json(char *out, int out_len, int reader)
+{
+    return tag_store_get_json(out, out_len, reader);
+}
+
+int rfid_set_reader_count(int count)
+{
+    if (count < 1 || count > RFID_MAX_READERS) return -1;
+    nvs_handle_t h;
+    if (nvs_open(RFID_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return -1;
+    nvs_set_u8(h, "readers", (uint8_t)count);
+    nvs_commit(h);
+    nvs_close(h);
+    ESP_LOGI(TAG, "Reader count set to %d (applies after restart)", count);
+    return 0;
 }
 
 void rfid_init(void)
 {
-    // TODO: initialize actual UFH RFID hardware here
-    uart_init(READER_TXD, READER_RXD);
-    ESP_LOGI(TAG, "RFID module initialized (stub)");
+    uint8_t count = 1;
+    nvs_handle_t h;
+    if (nvs_open(RFID_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        nvs_get_u8(h, "readers", &count);
+        nvs_close(h);
+    }
+    if (count < 1 || count > RFID_MAX_READERS) count = 1;
+    s_reader_count = count;
+
+    tag_store_init();
+    epc_decode_init();
+    tag_rules_init();
+    epcdb_init();
+    for (int i = 0; i < s_reader_count; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        memset(r, 0, sizeof(*r));
+        r->id = i;
+        r->hw = &s_reader_hw[i];
+        for (int a = 0; a < 4; a++) r->power_values[a] = 30;   // Default values
+        set_last_command(r, "No command sent yet");
+
+        if (uart_open(r->hw->uart_port, r->hw->txd, r->hw->rxd, rfid_process_bytes, r) != 0 ||
+            uart_start_rx_task(r->hw->uart_port) != 0) {
+            ESP_LOGE(TAG, "Reader %d: UART%d unavailable", i, r->hw->uart_port);
+            continue;
+        }
+        r->open = true;
+    }
+    ESP_LOGI(TAG, "RFID module initialized (%d reader%s)", s_reader_count, s_reader_count == 1 ? "" : "s");
+}
+
+void rfid_start_inventory(int reader)
+{
+    rfid_start_inventory_local(reader);
 }
 
-void rfid_start_inventory(void)
+static void send_start_inventory(rfid_reader_t *r)
 {
-    rfid_start_inventory_local();
+    static const uint8_t cmd_start[] = { 0x5A, 0x00, 0x01, 0x02, 0x10, 0x00, 0x05, 0x00,
+                                         0x00, 0x00, 0x01, 0x01, 0xF4, 0x87 };
+    reader_send(r, cmd_start, sizeof(cmd_start));
+}
+
+static void send_stop_inventory(rfid_reader_t *r, const char *via)
+{
+    // Build proper stop command using NRN protocol format
+    // Category 0x02, MID 0x11 (stop inventory)
+    uint8_t frame[32];
+    int k = 0;
+
+    frame[k++] = 0x5A; // Header
+    frame[k++] = 0x00; // PCW byte 1
+    frame[k++] = 0x01; // PCW byte 2
+    frame[k++] = 0x02; // Category (inventory)
+    frame[k++] = 0x11; // MID (stop inventory, 0x11 instead of 0x10)
+    frame[k++] = 0x00; // Length high
+    frame[k++] = 0x00; // Length low (no payload)
+
+    // Calculate CRC for header + payload (no payload in this case)
+    uint16_t crc = crc16_xmodem(frame, k);
+    frame[k++] = (uint8_t)(crc >> 8);   // CRC high
+    frame[k++] = (uint8_t)(crc & 0xFF); // CRC low
+
+    reader_send(r, frame, k);
+    printf("RFID stop command sent to reader %d %s: ", r->id, via);
+    for (int i = 0; i < k; i++) {
+        printf("%02X ", frame[i]);
+    }
+    printf("\n");
+
+    // Also try the original stop command as fallback
+    static const uint8_t fallback_cmd[] = { 0x5A, 0x00, 0x01, 0x02, 0xFF, 0x00, 0x00, 0x88, 0x5A };
+    reader_send(r, fallback_cmd, sizeof(fallback_cmd));
+    printf("RFID fallback stop command sent to reader %d %s\n", r->id, via);
+}
+
+// Readers running inventory for the web (mqtt = false) or for MQTT
+static int readers_running(bool mqtt)
+{
+    int n = 0;
+    for (int i = 0; i < s_reader_count; i++) {
+        if (mqtt ? s_readers[i].mqtt_running : s_readers[i].local_running) n++;
+    }
+    return n;
 }
 
 // Local version for web server (no MQTT publishing)
-void rfid_start_inventory_local(void)
-{
-    if (!s_local_running) {
-        s_local_running = 1;
-        s_running = 1;  // Set global hardware state
-        s_mqtt_mode = 0;  // Set to local mode
-        
-        // Clear only local tags for fresh start
-        s_total_tag_count = 0;
-        for (int i = 0; i < MAX_TAGS; i++) {
-            if (s_tags[i].collected_by == 0) {  // Clear only local tags
-                s_tags[i].epc[0] = '\0';
-                s_tags[i].count = 0;
-            }
-        }
-        
+void rfid_start_inventory_local(int reader)
+{
+    int first, last;
+    if (!reader_range(reader, &first, &last)) return;
+
+    for (int i = first; i <= last; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        if (r->local_running || !r->open) continue;
+
+        // Fresh web view; MQTT keeps its own view of the shared store
+        if (readers_running(false) == 0) tag_store_consumer_start(TAG_CONSUMER_WEB);
+        r->local_running = 1;
+        r->running = 1;  // Set hardware state
+
         // Reset startup packet counter to ensure immediate tag processing
-        extern void rfid_reset_startup_delay(void);
         rfid_reset_startup_delay();
-        
-        static const uint8_t cmd_start[] = { 0x5A, 0x00, 0x01, 0x02, 0x10, 0x00, 0x05, 0x00,
-                                             0x00, 0x00, 0x01, 0x01, 0xF4, 0x87 };
-        
-        uart_send_bytes((const char*)cmd_start, sizeof(cmd_start));
-        printf("RFID inventory started locally - counters reset\n");
+
+        send_start_inventory(r);
+        printf("RFID inventory started locally on reader %d - counters reset\n", i);
     }
 }
 
 // MQTT version for remote commands (with MQTT publishing)
-void rfid_start_inventory_mqtt(void)
-{
-    if (!s_mqtt_running) {
-        s_mqtt_running = 1;
-        s_running = 1;  // Set global hardware state
-        s_mqtt_mode = 1;  // Set to MQTT mode
-        
-        // Clear only MQTT tags for fresh start
-        s_total_tag_count = 0;
-        for (int i = 0; i < MAX_TAGS; i++) {
-            if (s_tags[i].collected_by == 1) {  // Clear only MQTT tags
-                s_tags[i].epc[0] = '\0';
-                s_tags[i].count = 0;
-            }
-        }
-        
-        // Reset startup packet counter to ensure immediate tag processing
-        extern void rfid_reset_startup_delay(void);
-        rfid_reset_startup_delay();
-        
-        static const uint8_t cmd_start[] = { 0x5A, 0x00, 0x01, 0x02, 0x10, 0x00, 0x05, 0x00,
-                                             0x00, 0x00, 0x01, 0x01, 0xF4, 0x87 };
-        
-        uart_send_bytes((const char*)cmd_start, sizeof(cmd_start));
-        printf("RFID inventory started via MQTT - counters reset\n");
-        
-        // Send response via MQTT
-        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"start\",\"status\":\"success\",\"message\":\"Inventory started\"}");
-    } else {
-        // Already running
-        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"start\",\"status\":\"info\",\"message\":\"Inventory already running\"}");
+void rfid_start_inventory_mqtt(int reader)
+{
+    int first, last;
+    if (!reader_range(reader, &first, &last)) {
+        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"start\",\"status\":\"error\",\"message\":\"Unknown reader\"}");
+        return;
     }
-}
 
-static uint16_t crc16_xmodem(const uint8_t *data, size_t len) {
-    uint16_t crc = 0x0000;
-    for (size_t i = 0; i < len; ++i) {
-        crc ^= (uint16_t)data[i] << 8;
-        for (int b = 0; b < 8; ++b)
-            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    for (int i = first; i <= last; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        char resp[192];
+        if (!r->open) continue;
+        if (!r->mqtt_running) {
+            // Batches start from the next read; the web view is left alone
+            if (readers_running(true) == 0) tag_store_consumer_start(TAG_CONSUMER_MQTT);
+            r->mqtt_running = 1;
+            r->running = 1;  // Set hardware state
+
+            // Reset startup packet counter to ensure immediate tag processing
+            rfid_reset_startup_delay();
+
+            send_start_inventory(r);
+            printf("RFID inventory started via MQTT on reader %d - counters reset\n", i);
+
+            // Send response via MQTT
+            snprintf(resp, sizeof(resp),
+                     "{\"command\":\"rfid\",\"action\":\"start\",\"reader\":%d,\"status\":\"success\",\"message\":\"Inventory started\"}", i);
+        } else {
+            // Already running
+            snprintf(resp, sizeof(resp),
+                     "{\"command\":\"rfid\",\"action\":\"start\",\"reader\":%d,\"status\":\"info\",\"message\":\"Inventory already running\"}", i);
+        }
+        mqtt_publish_response(resp);
     }
-    return crc;
 }
 
-void rfid_stop_inventory(void)
+void rfid_stop_inventory(int reader)
 {
-    rfid_stop_inventory_local();
+    rfid_stop_inventory_local(reader);
 }
 
 // Local version for web server (no MQTT publishing)
-void rfid_stop_inventory_local(void)
-{
-    if (s_local_running) {
-        s_local_running = 0;
-        s_running = 0;  // Clear global hardware state
-        s_mqtt_mode = 0;  // Clear MQTT mode
-        
-        // Build proper stop command using NRN protocol format
-        // Category 0x02, MID 0x11 (stop inventory)
-        uint8_t frame[32];
-        int k = 0;
-        
-        frame[k++] = 0x5A; // Header
-        frame[k++] = 0x00; // PCW byte 1
-        frame[k++] = 0x01; // PCW byte 2  
-        frame[k++] = 0x02; // Category (inventory)
-        frame[k++] = 0x11; // MID (stop inventory, 0x11 instead of 0x10)
-        frame[k++] = 0x00; // Length high
-        frame[k++] = 0x00; // Length low (no payload)
-        
-        // Calculate CRC for header + payload (no payload in this case)
-        uint16_t crc = crc16_xmodem(frame, k);
-        frame[k++] = (uint8_t)(crc >> 8);   // CRC high
-        frame[k++] = (uint8_t)(crc & 0xFF); // CRC low
-        
-        uart_send_bytes((const char*)frame, k);
-        printf("RFID stop command sent locally: ");
-        for (int i = 0; i < k; i++) {
-            printf("%02X ", frame[i]);
-        }
-        printf("\n");
-        
-        // Also try the original stop command as fallback
-        static const uint8_t fallback_cmd[] = { 0x5A, 0x00, 0x01, 0x02, 0xFF, 0x00, 0x00, 0x88, 0x5A };
-        uart_send_bytes((const char*)fallback_cmd, sizeof(fallback_cmd));
-        printf("RFID fallback stop command sent locally\n");
+void rfid_stop_inventory_local(int reader)
+{
+    int first, last;
+    if (!reader_range(reader, &first, &last)) return;
+
+    for (int i = first; i <= last; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        if (!r->local_running) continue;
+        r->local_running = 0;
+        r->running = r->mqtt_running;  // Hardware keeps running for the other mode
+        if (!r->running) send_stop_inventory(r, "locally");
+        if (readers_running(false) == 0) tag_store_consumer_stop(TAG_CONSUMER_WEB);
     }
 }
 
 // MQTT version for remote commands (with MQTT publishing)
-void rfid_stop_inventory_mqtt(void)
-{
-    if (s_mqtt_running) {
-        s_mqtt_running = 0;
-        s_running = 0;  // Clear global hardware state
-        s_mqtt_mode = 0;  // Clear MQTT mode
-        
-        // Build proper stop command using NRN protocol format
-        // Category 0x02, MID 0x11 (stop inventory)
-        uint8_t frame[32];
-        int k = 0;
-        
-        frame[k++] = 0x5A; // Header
-        frame[k++] = 0x00; // PCW byte 1
-        frame[k++] = 0x01; // PCW byte 2  
-        frame[k++] = 0x02; // Category (inventory)
-        frame[k++] = 0x11; // MID (stop inventory, 0x11 instead of 0x10)
-        frame[k++] = 0x00; // Length high
-        frame[k++] = 0x00; // Length low (no payload)
-        
-        // Calculate CRC for header + payload (no payload in this case)
-        uint16_t crc = crc16_xmodem(frame, k);
-        frame[k++] = (uint8_t)(crc >> 8);   // CRC high
-        frame[k++] = (uint8_t)(crc & 0xFF); // CRC low
-        
-        uart_send_bytes((const char*)frame, k);
-        printf("RFID stop command sent via MQTT: ");
-        for (int i = 0; i < k; i++) {
-            printf("%02X ", frame[i]);
+void rfid_stop_inventory_mqtt(int reader)
+{
+    int first, last;
+    if (!reader_range(reader, &first, &last)) {
+        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"stop\",\"status\":\"error\",\"message\":\"Unknown reader\"}");
+        return;
+    }
+
+    for (int i = first; i <= last; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        char resp[192];
+        if (!r->open) continue;
+        if (r->mqtt_running) {
+            r->mqtt_running = 0;
+            r->running = r->local_running;  // Hardware keeps running for the other mode
+            if (!r->running) send_stop_inventory(r, "via MQTT");
+            if (readers_running(true) == 0) tag_store_consumer_stop(TAG_CONSUMER_MQTT);
+
+            // Send response via MQTT
+            snprintf(resp, sizeof(resp),
+                     "{\"command\":\"rfid\",\"action\":\"stop\",\"reader\":%d,\"status\":\"success\",\"message\":\"Inventory stopped\"}", i);
+        } else {
+            // Already stopped
+            snprintf(resp, sizeof(resp),
+                     "{\"command\":\"rfid\",\"action\":\"stop\",\"reader\":%d,\"status\":\"info\",\"message\":\"Inventory already stopped\"}", i);
         }
-        printf("\n");
-        
-        // Also try the original stop command as fallback
-        static const uint8_t fallback_cmd[] = { 0x5A, 0x00, 0x01, 0x02, 0xFF, 0x00, 0x00, 0x88, 0x5A };
-        uart_send_bytes((const char*)fallback_cmd, sizeof(fallback_cmd));
-        printf("RFID fallback stop command sent via MQTT\n");
-        
-        // Send response via MQTT
-        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"stop\",\"status\":\"success\",\"message\":\"Inventory stopped\"}");
-    } else {
-        // Already stopped
-        mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"stop\",\"status\":\"info\",\"message\":\"Inventory already stopped\"}");
+        mqtt_publish_response(resp);
     }
 }
 
@@ -596,14 +645,20 @@ static uint32_t build_pcw(uint8_t category, uint8_t mid, int rs485, int notify)
     return pcw;
 }
 
-void rfid_set_power(int pwr1, int pwr2, int pwr3, int pwr4)
+void rfid_set_power(int reader, int pwr1, int pwr2, int pwr3, int pwr4)
 {
+    int first, last;
+    if (!reader_range(reader, &first, &last)) {
+        mqtt_publish_response("{\"command\":\"power\",\"action\":\"set\",\"status\":\"error\",\"message\":\"Unknown reader\"}");
+        return;
+    }
+
     // Convert power values to uint8_t (0-255 range)
     uint8_t p1 = (uint8_t)(pwr1 & 0xFF);
     uint8_t p2 = (uint8_t)(pwr2 & 0xFF);
     uint8_t p3 = (uint8_t)(pwr3 & 0xFF);
     uint8_t p4 = (uint8_t)(pwr4 & 0xFF);
-    
+
     const uint8_t HEADER = 0x5A;
     const uint16_t MID_CONFIG_POWER = 0x0201;
 
@@ -640,200 +695,224 @@ void rfid_set_power(int pwr1, int pwr2, int pwr3, int pwr4)
     frame[k++] = (uint8_t)((crc >> 8) & 0xFF);
     frame[k++] = (uint8_t)(crc & 0xFF);
 
-    uart_send_bytes((const char*)frame, (int)k);
-    ESP_LOGI(TAG, "RFID power set to ant1=%d ant2=%d ant3=%d ant4=%d", pwr1, pwr2, pwr3, pwr4);
-    
-    // Send response via MQTT
-    char power_json[256];
-    snprintf(power_json, sizeof(power_json), 
-        "{\"command\":\"power\",\"action\":\"set\",\"status\":\"success\",\"power\":{\"ant1\":%d,\"ant2\":%d,\"ant3\":%d,\"ant4\":%d}}", 
-        pwr1, pwr2, pwr3, pwr4);
-    mqtt_publish_response(power_json);
+    for (int i = first; i <= last; i++) {
+        if (!s_readers[i].open) continue;
+        reader_send(&s_readers[i], frame, k);
+        ESP_LOGI(TAG, "Reader %d power set to ant1=%d ant2=%d ant3=%d ant4=%d", i, pwr1, pwr2, pwr3, pwr4);
+
+        // Send response via MQTT
+        char power_json[256];
+        snprintf(power_json, sizeof(power_json),
+            "{\"command\":\"power\",\"action\":\"set\",\"reader\":%d,\"status\":\"success\",\"power\":{\"ant1\":%d,\"ant2\":%d,\"ant3\":%d,\"ant4\":%d}}",
+            i, pwr1, pwr2, pwr3, pwr4);
+        mqtt_publish_response(power_json);
+    }
 }
 
 
-void rfid_get_power(int *pwr1, int *pwr2, int *pwr3, int *pwr4)
+bool rfid_get_power(int reader, int *pwr1, int *pwr2, int *pwr3, int *pwr4)
 {
     // Return current stored power values (without sending query command)
     // Use rfid_query_power() first to refresh values from reader
-    if (pwr1) *pwr1 = s_power_values[0];
-    if (pwr2) *pwr2 = s_power_values[1];
-    if (pwr3) *pwr3 = s_power_values[2];
-    if (pwr4) *pwr4 = s_power_values[3];
+    if (reader < 0 || reader >= RFID_MAX_READERS) return false;
+    const int *pv = s_readers[reader].power_values;
+    if (pwr1) *pwr1 = pv[0];
+    if (pwr2) *pwr2 = pv[1];
+    if (pwr3) *pwr3 = pv[2];
+    if (pwr4) *pwr4 = pv[3];
+    return true;
 }
 
-void rfid_query_power(void)
+void rfid_query_power(int reader)
 {
+    int first, last;
+    if (!reader_range(reader, &first, &last)) {
+        mqtt_publish_response("{\"command\":\"power\",\"action\":\"query\",\"status\":\"error\",\"message\":\"Unknown reader\"}");
+        return;
+    }
+
     // Send power query command without returning cached values
     // This allows the web interface to trigger a fresh query and then get updated values
     static const uint8_t cmd[] = { 0x5A, 0x00, 0x01, 0x02, 0x02, 0x00, 0x00, 0x29, 0x59 };
-    s_power_request_pending = 1; // Set flag to indicate we're waiting for power response
-    uart_send_bytes((const char*)cmd, sizeof(cmd));
-    
-    // Send current power values via MQTT immediately
-    char power_json[256];
-    snprintf(power_json, sizeof(power_json), 
-        "{\"command\":\"power\",\"action\":\"query\",\"status\":\"success\",\"power\":{\"ant1\":%d,\"ant2\":%d,\"ant3\":%d,\"ant4\":%d}}", 
-        s_power_values[0], s_power_values[1], s_power_values[2], s_power_values[3]);
-    mqtt_publish_response(power_json);
+    for (int i = first; i <= last; i++) {
+        rfid_reader_t *r = &s_readers[i];
+        if (!r->open) continue;
+        // Wait for the power response before decoding tags again
+        r->pending.category = 0x02;
+        r->pending.mid = 0x02;
+        r->pending.sent_ms = now_ms() | 1;
+        reader_send(r, cmd, sizeof(cmd));
+
+        // Send current power values via MQTT immediately
+        char power_json[256];
+        snprintf(power_json, sizeof(power_json),
+            "{\"command\":\"power\",\"action\":\"query\",\"reader\":%d,\"status\":\"success\",\"power\":{\"ant1\":%d,\"ant2\":%d,\"ant3\":%d,\"ant4\":%d}}",
+            i, r->power_values[0], r->power_values[1], r->power_values[2], r->power_values[3]);
+        mqtt_publish_response(power_json);
+    }
 }
 
 // Query reader information (based on NRN SDK MID.QUERY_INFO: 0x0100)
-void rfid_query_reader_info(void)
+void rfid_query_reader_info(int reader)
 {
+    int first, last;
+    if (!reader_range(reader, &first, &last)) return;
+
     // Command: 5A 00 01 01 00 00 00 [CRC]
     // MID = 0x0100 -> category=0x01, mid=0x00
     static const uint8_t cmd[] = { 0x5A, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x88, 0x5B };
-    uart_send_bytes((const char*)cmd, sizeof(cmd));
-    printf("Sent reader info query command\n");
+    for (int i = first; i <= last; i++) {
+        if (!s_readers[i].open) continue;
+        reader_send(&s_readers[i], cmd, sizeof(cmd));
+        printf("Sent reader info query command to reader %d\n", i);
+    }
 }
 
 // Confirm connection (based on NRN SDK MID.CONFIRM_CONNECTION: 0x12)
-void rfid_confirm_connection(void)
+void rfid_confirm_connection(int reader)
 {
-    // Command: 5A 00 01 00 12 00 00 [CRC] 
+    int first, last;
+    if (!reader_range(reader, &first, &last)) return;
+
+    // Command: 5A 00 01 00 12 00 00 [CRC]
     // MID = 0x12 -> category=0x00, mid=0x12
     static const uint8_t cmd[] = { 0x5A, 0x00, 0x01, 0x00, 0x12, 0x00, 0x00, 0x29, 0x47 };
-    uart_send_bytes((const char*)cmd, sizeof(cmd));
-    printf("Sent connection confirmation command\n");
+    for (int i = first; i <= last; i++) {
+        if (!s_readers[i].open) continue;
+        reader_send(&s_readers[i], cmd, sizeof(cmd));
+        printf("Sent connection confirmation command to reader %d\n", i);
+    }
+}
+
+int rfid_send_raw(int reader, const char *data, size_t len)
+{
+    if (!rfid_reader_valid(reader) || !data || len == 0) return -1;
+    reader_send(&s_readers[reader], (const uint8_t*)data, len);
+    return 0;
+}
+
+int rfid_get_rx_data(int reader, char *dest, int max_len)
+{
+    if (!rfid_reader_valid(reader)) {
+        if (dest && max_len > 0) dest[0] = '\0';
+        return 0;
+    }
+    return uart_get_rx_data(s_readers[reader].hw->uart_port, dest, max_len);
+}
+
+static const char* reader_status(const rfid_reader_t *r)
+{
+    if (r->local_running) return "local_running";
+    if (r->mqtt_running) return "mqtt_running";
+    return "stopped";
 }
 
 const char* rfid_get_status(void)
 {
-    if (s_local_running) return "local_running";
-    if (s_mqtt_running) return "mqtt_running";
+    for (int i = 0; i < s_reader_count; i++) {
+        if (s_readers[i].local_running) return "local_running";
+    }
+    for (int i = 0; i < s_reader_count; i++) {
+        if (s_readers[i].mqtt_running) return "mqtt_running";
+    }
     return "stopped";
 }
 
 // Get specific status for web server (local only)
 const char* rfid_get_local_status(void)
 {
-    return s_local_running ? "running" : "stopped";
+    for (int i = 0; i < s_reader_count; i++) {
+        if (s_readers[i].local_running) return "running";
+    }
+    return "stopped";
 }
 
-// Get specific status for MQTT (remote only)  
+// Get specific status for MQTT (remote only)
 const char* rfid_get_mqtt_status(void)
 {
-    return s_mqtt_running ? "running" : "stopped";
+    return rfid_get_mqtt_status_bool() ? "running" : "stopped";
 }
 
 // Get MQTT status as boolean
 bool rfid_get_mqtt_status_bool(void)
 {
-    return s_mqtt_running;
-}
-
-// Get MQTT tags as JSON (only tags collected via MQTT)
-int rfid_get_mqtt_tags_json(char *out, int out_len)
-{
-    if (!out || out_len <= 10) return 0;
-    
-    int used = 0;
-    int count = 0;
-    
-    // Start with object containing count, total, and tags array
-    used += snprintf(out + used, out_len - used, "{\"active_tags\":");
-    
-    // Count active MQTT tags first
-    for (int i = 0; i < MAX_TAGS; ++i) {
-        if (s_tags[i].epc[0] != '\0' && s_tags[i].collected_by == 1) count++;
-    }
-    
-    // Add active count and total count to JSON
-    used += snprintf(out + used, out_len - used, "%d,\"total_detections\":%lu,\"tags\":[", count, (unsigned long)s_total_tag_count);
-    
-    int first = 1;
-    int tags_output = 0;
-    
-    for (int i = 0; i < MAX_TAGS && used < out_len - 100; ++i) {
-        if (s_tags[i].epc[0] == '\0') continue;
-        if (s_tags[i].collected_by != 1) continue; // Only MQTT tags
-        
-        if (!first) {
-            used += snprintf(out + used, out_len - used, ",");
-        }
-        first = 0;
-        
-        uint64_t ts = s_tags[i].last_ms;
-        used += snprintf(out + used, out_len - used, 
-            "{\"epc\":\"%s\",\"rssi\":%d,\"ant\":%d,\"ts\":%llu,\"count\":%lu}",
-            s_tags[i].epc, s_tags[i].rssi, s_tags[i].ant, 
-            (unsigned long long)ts, (unsigned long)s_tags[i].count);
-        
-        tags_output++;
-        if (tags_output >= 15) break; // Reduced batch size to prevent large payloads
+    for (int i = 0; i < s_reader_count; i++) {
+        if (s_readers[i].mqtt_running) return true;
     }
-    
-    used += snprintf(out + used, out_len - used, "]}");
-    
-    return used;
+    return false;
 }
 
-const char* rfid_get_last_command(void)
+int rfid_get_readers_json(char *out, int out_len)
 {
-    return s_last_command;
+    if (!out || out_len <= 0) return 0;
+
+    int n = snprintf(out, out_len, "[");
+    for (int i = 0; i < s_reader_count && n < out_len; i++) {
+        const rfid_reader_t *r = &s_readers[i];
+        n += snprintf(out + n, out_len - n,
+                      "%s{\"id\":%d,\"uart\":%d,\"txd\":%d,\"rxd\":%d,\"open\":%s,\"present\":%s,"
+                      "\"inventory\":\"%s\",\"last_command\":\"%s\"}",
+                      i ? "," : "", i, r->hw->uart_port, r->hw->txd, r->hw->rxd,
+                      r->open ? "true" : "false", r->present ? "true" : "false",
+                      reader_status(r), r->last_command);
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]");
+    return (n < out_len) ? n : out_len - 1;
 }
 
-void rfid_set_last_command(const char* cmd_description)
+const char* rfid_get_last_command(int reader)
 {
-    if (cmd_description) {
-        strncpy(s_last_command, cmd_description, sizeof(s_last_command) - 1);
-        s_last_command[sizeof(s_last_command) - 1] = '\0';
-    }
+    if (reader < 0 || reader >= s_reader_count) reader = 0;
+    return s_readers[reader].last_command;
 }
 
 // New function to handle inventory commands from MQTT
-void rfid_handle_inventory_command(const char* action)
+void rfid_handle_inventory_command(int reader, const char* action)
 {
     if (!action) {
         mqtt_publish_response("{\"command\":\"rfid\",\"action\":\"unknown\",\"status\":\"error\",\"message\":\"Invalid action\"}");
         return;
     }
-    
+
     if (strcmp(action, "start") == 0) {
-        rfid_start_inventory_mqtt();
+        rfid_start_inventory_mqtt(reader);
     } else if (strcmp(action, "stop") == 0) {
-        rfid_stop_inventory_mqtt();
-    } else if (strcmp(action, "status") == 0) {
+        rfid_stop_inventory_mqtt(reader);
+    } else if (strcmp(action, "status") == 0 || strcmp(action, "get") == 0) {
+        // Current RFID data and status, per reader
+        char readers[512];
+        rfid_get_readers_json(readers, sizeof(readers));
         const char* status = rfid_get_mqtt_status();  // Use MQTT-specific status
-        char status_json[256];
-        snprintf(status_json, sizeof(status_json), 
-            "{\"command\":\"rfid\",\"action\":\"status\",\"status\":\"success\",\"inventory_status\":\"%s\",\"total_tags\":%lu}", 
-            status, (unsigned long)s_total_tag_count);
-        mqtt_publish_response(status_json);
-    } else if (strcmp(action, "get") == 0) {
-        // Get current RFID data and status
-        const char* status = rfid_get_mqtt_status();
-        char response_json[512];
-        snprintf(response_json, sizeof(response_json), 
-            "{\"command\":\"rfid\",\"action\":\"get\",\"status\":\"success\",\"inventory_status\":\"%s\",\"total_tags\":%lu,\"mode\":\"mqtt\"}", 
-            status, (unsigned long)s_total_tag_count);
+        char response_json[768];
+        snprintf(response_json, sizeof(response_json),
+            "{\"command\":\"rfid\",\"action\":\"%s\",\"status\":\"success\",\"inventory_status\":\"%s\",\"total_tags\":%lu,\"mode\":\"mqtt\",\"readers\":%s}",
+            action, status, (unsigned long)tag_store_total(TAG_CONSUMER_MQTT), readers);
         mqtt_publish_response(response_json);
     } else {
         char error_json[256];
-        snprintf(error_json, sizeof(error_json), 
-            "{\"command\":\"rfid\",\"action\":\"%s\",\"status\":\"error\",\"message\":\"Unknown action\"}", 
+        snprintf(error_json, sizeof(error_json),
+            "{\"command\":\"rfid\",\"action\":\"%s\",\"status\":\"error\",\"message\":\"Unknown action\"}",
             action);
         mqtt_publish_response(error_json);
     }
 }
 
 // New function to handle power commands from MQTT
-void rfid_handle_power_command(const char* action, int ant1, int ant2, int ant3, int ant4)
+void rfid_handle_power_command(int reader, const char* action, int ant1, int ant2, int ant3, int ant4)
 {
     if (!action) {
         mqtt_publish_response("{\"command\":\"power\",\"action\":\"unknown\",\"status\":\"error\",\"message\":\"Invalid action\"}");
         return;
     }
-    
+
     if (strcmp(action, "set") == 0) {
-        rfid_set_power(ant1, ant2, ant3, ant4);
+        rfid_set_power(reader, ant1, ant2, ant3, ant4);
     } else if (strcmp(action, "query") == 0 || strcmp(action, "get") == 0) {
-        rfid_query_power();
+        rfid_query_power(reader);
     } else {
         char error_json[256];
-        snprintf(error_json, sizeof(error_json), 
-            "{\"command\":\"power\",\"action\":\"%s\",\"status\":\"error\",\"message\":\"Unknown action\"}", 
+        snprintf(error_json, sizeof(error_json),
+            "{\"command\":\"power\",\"action\":\"%s\",\"status\":\"error\",\"message\":\"Unknown action\"}",
             action);
         mqtt_publish_response(error_json);
     }
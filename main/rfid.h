@@ -5,41 +5,51 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-void rfid_init(void);
-void rfid_start_inventory(void);
-void rfid_stop_inventory(void);
-void rfid_start_inventory_local(void);  // Local version (no MQTT)
-void rfid_stop_inventory_local(void);   // Local version (no MQTT)  
-void rfid_start_inventory_mqtt(void);   // MQTT version (with MQTT publishing)
-void rfid_stop_inventory_mqtt(void);    // MQTT version (with MQTT publishing)
+// UART0 is the console, so an ESP32-S3 board takes a reader on UART1 and UART2
+#define RFID_MAX_READERS 2
+#define RFID_ALL_READERS (-1)   // Commands: every enabled reader
+
+void rfid_init(void);   // Opens every enabled reader and starts its UART RX task
+int rfid_reader_count(void);
+int rfid_set_reader_count(int count);   // Saved to NVS, applies after restart; -1 if out of range
+bool rfid_reader_valid(int reader);     // Enabled reader index (RFID_ALL_READERS is not one)
+
+void rfid_start_inventory(int reader);
+void rfid_stop_inventory(int reader);
+void rfid_start_inventory_local(int reader);  // Local version (no MQTT)
+void rfid_stop_inventory_local(int reader);   // Local version (no MQTT)
+void rfid_start_inventory_mqtt(int reader);   // MQTT version (with MQTT publishing)
+void rfid_stop_inventory_mqtt(int reader);    // MQTT version (with MQTT publishing)
 const char* rfid_get_status(void);
-const char* rfid_get_last_command(void);
-void rfid_set_last_command(const char* cmd_description);
+const char* rfid_get_last_command(int reader);
 
 // Power control functions
-void rfid_set_power(int pwr1, int pwr2, int pwr3, int pwr4);
-void rfid_get_power(int *pwr1, int *pwr2, int *pwr3, int *pwr4);
-void rfid_query_power(void);  // Send power query command without returning values
+void rfid_set_power(int reader, int pwr1, int pwr2, int pwr3, int pwr4);
+bool rfid_get_power(int reader, int *pwr1, int *pwr2, int *pwr3, int *pwr4);   // false for an unknown reader
+void rfid_query_power(int reader);  // Send power query command without returning values
 
 // Reader information and connection functions (based on NRN SDK)
-void rfid_query_reader_info(void);
-void rfid_confirm_connection(void);
-
-// Process raw bytes received from reader (call from UART rx task)
-void rfid_process_bytes(const uint8_t *buf, size_t len);
-// Fill provided buffer with JSON array of recent tags. Returns number of bytes written (not including terminating NUL)
-int rfid_get_tags_json(char *out, int out_len);
+void rfid_query_reader_info(int reader);
+void rfid_confirm_connection(int reader);
+int rfid_send_raw(int reader, const char *data, size_t len);   // Raw frame from the web console
+int rfid_get_rx_data(int reader, char *dest, int max_len);     // Hex dump of recent UART traffic
+// "TX: 5A 00 01 ..." as kept in the last command and logged for every frame sent
+int rfid_format_frame(const uint8_t *data, size_t len, char *out, size_t out_len);
+
+// Fill provided buffer with JSON array of recent tags (reader < 0 = all). Returns number of bytes written (not including terminating NUL)
+int rfid_get_tags_json(char *out, int out_len, int reader);
 // Reset startup delay for immediate tag processing (used when manually starting inventory)
 void rfid_reset_startup_delay(void);
 
-// Status functions
+// Status functions (any reader)
 const char* rfid_get_local_status(void);   // Local/web server status
 const char* rfid_get_mqtt_status(void);    // MQTT/remote status
 bool rfid_get_mqtt_status_bool(void);      // MQTT status as boolean
-int rfid_get_mqtt_tags_json(char *out, int out_len);  // MQTT tags JSON
+// Per-reader port, pins, presence, inventory state and last command as a JSON array
+int rfid_get_readers_json(char *out, int out_len);
 
 // MQTT command handlers
-void rfid_handle_inventory_command(const char* action);
-void rfid_handle_power_command(const char* action, int ant1, int ant2, int ant3, int ant4);
+void rfid_handle_inventory_command(int reader, const char* action);
+void rfid_handle_power_command(int reader, const char* action, int ant1, int ant2, int ant3, int ant4);
 
 #endif // RFID_H
@@ -0,0 +1,314 @@
+#include "seen_filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "metrics.h"
+
+static const char *TAG = "SEEN";
+static const char *NVS_NAMESPACE = "seen";
+
+#define SEEN_MAX_HASHES 16
+
+static seen_filter_config_t s_cfg = {
+    .mode = SEEN_MODE_FLAG,
+    .hours = SEEN_FILTER_DEFAULT_HOURS,
+    .capacity = SEEN_FILTER_DEFAULT_CAPACITY,
+    .fp_ppm = SEEN_FILTER_DEFAULT_FP_PPM,
+};
+
+// One Bloom filter per time slice; s_newest receives inserts
+static uint32_t *s_bits[SEEN_FILTER_PARTITIONS];
+static uint32_t s_part_inserts[SEEN_FILTER_PARTITIONS];
+static uint32_t s_m = 0;            // Bits per partition (multiple of 32)
+static uint32_t s_k = 0;            // Hash functions
+static int s_newest = 0;
+static uint64_t s_newest_since_ms = 0;
+static uint64_t s_slice_ms = 0;
+
+static uint32_t s_inserts = 0;
+static uint32_t s_lookups = 0;
+static uint32_t s_hits = 0;
+static uint32_t s_rotations = 0;
+
+static SemaphoreHandle_t s_lock = NULL;
+
+static inline uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000ULL);
+}
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void clamp_config(seen_filter_config_t *cfg)
+{
+    if (cfg->mode < SEEN_MODE_OFF || cfg->mode > SEEN_MODE_SUPPRESS) cfg->mode = SEEN_MODE_FLAG;
+    cfg->hours = clamp_u32(cfg->hours, 1, SEEN_FILTER_MAX_HOURS);
+    cfg->capacity = clamp_u32(cfg->capacity, SEEN_FILTER_MIN_CAPACITY, SEEN_FILTER_MAX_CAPACITY);
+    cfg->fp_ppm = clamp_u32(cfg->fp_ppm, SEEN_FILTER_MIN_FP_PPM, SEEN_FILTER_MAX_FP_PPM);
+}
+
+// Lookups check every slice, so each slice gets fp/partitions of the budget
+// and 1/partitions of the expected EPCs: m = -n ln p / ln(2)^2, k = m/n ln 2
+static void size_filter(const seen_filter_config_t *cfg, uint32_t *m_out, uint32_t *k_out)
+{
+    double n = (double)((cfg->capacity + SEEN_FILTER_PARTITIONS - 1) / SEEN_FILTER_PARTITIONS);
+    double p = (double)cfg->fp_ppm / 1e6 / SEEN_FILTER_PARTITIONS;
+    double m = ceil(-n * log(p) / (M_LN2 * M_LN2));
+    uint32_t bits = ((uint32_t)m + 31) & ~31u;
+    uint32_t k = (uint32_t)lround(bits / n * M_LN2);
+    *m_out = bits;
+    *k_out = clamp_u32(k, 1, SEEN_MAX_HASHES);
+}
+
+static void free_partitions(uint32_t *bits[SEEN_FILTER_PARTITIONS])
+{
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS; i++) {
+        free(bits[i]);
+        bits[i] = NULL;
+    }
+}
+
+// Allocates the slices for cfg without touching the live filter, so the
+// (up to SEEN_FILTER_MAX_BYTES) PSRAM allocation runs outside s_lock
+static bool alloc_partitions(const seen_filter_config_t *cfg, uint32_t *bits[SEEN_FILTER_PARTITIONS],
+                             uint32_t *m_out, uint32_t *k_out)
+{
+    memset(bits, 0, SEEN_FILTER_PARTITIONS * sizeof(bits[0]));
+    *m_out = *k_out = 0;
+    if (cfg->mode == SEEN_MODE_OFF) return true;
+
+    uint32_t m, k;
+    size_filter(cfg, &m, &k);
+    if ((uint64_t)m / 8 * SEEN_FILTER_PARTITIONS > SEEN_FILTER_MAX_BYTES) {
+        ESP_LOGE(TAG, "Filter for %lu EPCs at %lu ppm needs more than %d bytes",
+                 (unsigned long)cfg->capacity, (unsigned long)cfg->fp_ppm, SEEN_FILTER_MAX_BYTES);
+        return false;
+    }
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS; i++) {
+        // PSRAM only: internal RAM is too small for a useful filter
+        bits[i] = heap_caps_calloc(1, m / 8, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!bits[i]) {
+            ESP_LOGE(TAG, "No PSRAM for the seen filter (%lu bytes per slice)", (unsigned long)(m / 8));
+            free_partitions(bits);
+            return false;
+        }
+    }
+    *m_out = m;
+    *k_out = k;
+    ESP_LOGI(TAG, "Seen filter: %lu h, %lu EPCs, %lu ppm -> %d x %lu bytes, k=%lu",
+             (unsigned long)cfg->hours, (unsigned long)cfg->capacity, (unsigned long)cfg->fp_ppm,
+             SEEN_FILTER_PARTITIONS, (unsigned long)(m / 8), (unsigned long)k);
+    return true;
+}
+
+// Swap in freshly allocated slices; the old ones come back in bits for the
+// caller to free after releasing s_lock. Caller holds s_lock.
+static void install_partitions(const seen_filter_config_t *cfg, uint32_t *bits[SEEN_FILTER_PARTITIONS],
+                               uint32_t m, uint32_t k)
+{
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS; i++) {
+        uint32_t *old = s_bits[i];
+        s_bits[i] = bits[i];
+        bits[i] = old;
+        s_part_inserts[i] = 0;
+    }
+    s_cfg = *cfg;
+    s_m = m;
+    s_k = k;
+    s_newest = 0;
+    s_newest_since_ms = now_ms();
+    s_slice_ms = (uint64_t)cfg->hours * 3600000ULL / SEEN_FILTER_PARTITIONS;
+}
+
+// Retire slices older than the window; caller holds s_lock
+static void rotate(void)
+{
+    uint64_t now = now_ms();
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS && now - s_newest_since_ms >= s_slice_ms; i++) {
+        s_newest = (s_newest + 1) % SEEN_FILTER_PARTITIONS;
+        memset(s_bits[s_newest], 0, s_m / 8);
+        s_part_inserts[s_newest] = 0;
+        s_newest_since_ms += s_slice_ms;
+        s_rotations++;
+    }
+    if (now - s_newest_since_ms >= s_slice_ms) s_newest_since_ms = now;   // Idle longer than the window
+}
+
+// Double hashing over one 64-bit FNV-1a: bit i = h1 + i * h2
+static void epc_hashes(const char *epc, uint32_t *h1, uint32_t *h2)
+{
+    uint64_t h = 14695981039346656037ULL;
+    while (*epc) {
+        h ^= (uint8_t)*epc++;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;   // Mix the high bits down before splitting
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    *h1 = (uint32_t)h;
+    *h2 = (uint32_t)(h >> 32) | 1;
+}
+
+void seen_filter_init(void)
+{
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        uint8_t mode;
+        if (nvs_get_u8(h, "mode", &mode) == ESP_OK) s_cfg.mode = mode;
+        nvs_get_u32(h, "hours", &s_cfg.hours);
+        nvs_get_u32(h, "capacity", &s_cfg.capacity);
+        nvs_get_u32(h, "fp_ppm", &s_cfg.fp_ppm);
+        nvs_close(h);
+    }
+    clamp_config(&s_cfg);
+
+    uint32_t *bits[SEEN_FILTER_PARTITIONS], m, k;
+    if (!alloc_partitions(&s_cfg, bits, &m, &k)) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    install_partitions(&s_cfg, bits, m, k);
+    xSemaphoreGive(s_lock);
+    free_partitions(bits);
+}
+
+void seen_filter_get_config(seen_filter_config_t *cfg)
+{
+    if (cfg) *cfg = s_cfg;
+}
+
+seen_mode_t seen_filter_mode(void)
+{
+    return (seen_mode_t)s_cfg.mode;
+}
+
+int seen_filter_set_config(const seen_filter_config_t *cfg)
+{
+    if (!cfg || !s_lock) return -1;
+    seen_filter_config_t c = *cfg;
+    clamp_config(&c);
+
+    // Reads keep using the old filter while the new one is allocated; on
+    // failure the old filter and config stay as they were
+    uint32_t *bits[SEEN_FILTER_PARTITIONS], m, k;
+    if (!alloc_partitions(&c, bits, &m, &k)) return -1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    install_partitions(&c, bits, m, k);
+    xSemaphoreGive(s_lock);
+    free_partitions(bits);
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return 0;
+    nvs_set_u8(h, "mode", (uint8_t)c.mode);
+    nvs_set_u32(h, "hours", c.hours);
+    nvs_set_u32(h, "capacity", c.capacity);
+    nvs_set_u32(h, "fp_ppm", c.fp_ppm);
+    nvs_commit(h);
+    nvs_close(h);
+    return 0;
+}
+
+void seen_filter_add(const char *epc)
+{
+    if (!epc || !s_lock) return;
+    uint32_t h1, h2;
+    epc_hashes(epc, &h1, &h2);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_m) {
+        rotate();
+        uint32_t *bits = s_bits[s_newest];
+        for (uint32_t i = 0; i < s_k; i++) {
+            uint32_t b = (h1 + i * h2) % s_m;
+            bits[b >> 5] |= 1u << (b & 31);
+        }
+        s_part_inserts[s_newest]++;
+        s_inserts++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool seen_filter_contains(const char *epc)
+{
+    if (!epc || !s_lock) return false;
+    uint32_t h1, h2;
+    epc_hashes(epc, &h1, &h2);
+
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_m) {
+        rotate();
+        s_lookups++;
+        for (int p = 0; p < SEEN_FILTER_PARTITIONS && !found; p++) {
+            const uint32_t *bits = s_bits[p];
+            uint32_t i = 0;
+            while (i < s_k) {
+                uint32_t b = (h1 + i * h2) % s_m;
+                if (!(bits[b >> 5] & (1u << (b & 31)))) break;
+                i++;
+            }
+            found = (i == s_k);
+        }
+        if (found) s_hits++;
+    }
+    xSemaphoreGive(s_lock);
+    if (found) metrics_inc(METRIC_RFID_SEEN_RETURNS);
+    return found;
+}
+
+static const char *mode_name(int mode)
+{
+    switch (mode) {
+    case SEEN_MODE_OFF:      return "off";
+    case SEEN_MODE_SUPPRESS: return "suppress";
+    default:                 return "flag";
+    }
+}
+
+int seen_filter_parse_mode(const char *name)
+{
+    if (!name) return -1;
+    if (strcmp(name, "off") == 0) return SEEN_MODE_OFF;
+    if (strcmp(name, "flag") == 0) return SEEN_MODE_FLAG;
+    if (strcmp(name, "suppress") == 0) return SEEN_MODE_SUPPRESS;
+    return -1;
+}
+
+int seen_filter_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0 || !s_lock) return 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t slice_inserts[SEEN_FILTER_PARTITIONS];
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS; i++) {
+        // Newest first
+        slice_inserts[i] = s_part_inserts[(s_newest - i + SEEN_FILTER_PARTITIONS) % SEEN_FILTER_PARTITIONS];
+    }
+    uint32_t m = s_m, k = s_k, inserts = s_inserts, lookups = s_lookups, hits = s_hits, rotations = s_rotations;
+    xSemaphoreGive(s_lock);
+
+    int n = snprintf(out, out_len,
+                     "{\"mode\":\"%s\",\"hours\":%lu,\"capacity\":%lu,\"fp_ppm\":%lu,"
+                     "\"allocated\":%s,\"bytes\":%lu,\"bits_per_slice\":%lu,\"hashes\":%lu,"
+                     "\"inserts\":%lu,\"lookups\":%lu,\"hits\":%lu,\"rotations\":%lu,\"slice_inserts\":[",
+                     mode_name(s_cfg.mode), (unsigned long)s_cfg.hours, (unsigned long)s_cfg.capacity,
+                     (unsigned long)s_cfg.fp_ppm, m ? "true" : "false",
+                     (unsigned long)(m / 8 * SEEN_FILTER_PARTITIONS), (unsigned long)m, (unsigned long)k,
+                     (unsigned long)inserts, (unsigned long)lookups, (unsigned long)hits, (unsigned long)rotations);
+    for (int i = 0; i < SEEN_FILTER_PARTITIONS && n < out_len; i++) {
+        n += snprintf(out + n, out_len - n, "%s%lu", i ? "," : "", (unsigned long)slice_inserts[i]);
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]}");
+    return (n < out_len) ? n : out_len - 1;
+}
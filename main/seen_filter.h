@@ -0,0 +1,58 @@
+/* seen_filter.h - rotating Bloom filter of EPCs seen in the last N hours
+ *
+ * The window is split into SEEN_FILTER_PARTITIONS time slices, each its own
+ * Bloom filter in PSRAM. Inserts go to the newest slice; lookups check them
+ * all; when the newest slice is older than window/partitions the oldest one is
+ * cleared and becomes the newest, so an EPC is remembered for between
+ * (partitions - 1) / partitions of the window and the full window after its
+ * last insert. Memory is fixed by the expected number of
+ * unique EPCs per window and the false-positive rate, never by the EPCs seen.
+ *
+ * The tag store inserts a tag when it leaves the table and asks the filter
+ * when an EPC takes a new slot, so a tag that comes back after eviction or
+ * expiry can be flagged or kept out of MQTT batches. */
+#ifndef SEEN_FILTER_H
+#define SEEN_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SEEN_FILTER_PARTITIONS 4
+
+// Defaults and accepted ranges
+#define SEEN_FILTER_DEFAULT_HOURS     8
+#define SEEN_FILTER_MAX_HOURS         72
+#define SEEN_FILTER_DEFAULT_CAPACITY  50000
+#define SEEN_FILTER_MIN_CAPACITY      1000
+#define SEEN_FILTER_MAX_CAPACITY      500000
+#define SEEN_FILTER_DEFAULT_FP_PPM    1000     // 0.1 %
+#define SEEN_FILTER_MIN_FP_PPM        10
+#define SEEN_FILTER_MAX_FP_PPM        100000
+#define SEEN_FILTER_MAX_BYTES         (2 * 1024 * 1024)
+
+typedef enum {
+    SEEN_MODE_OFF = 0,
+    SEEN_MODE_FLAG,       // Returning tags carry "seen":true
+    SEEN_MODE_SUPPRESS,   // Returning tags are kept out of MQTT batches and DEPART events
+} seen_mode_t;
+
+typedef struct {
+    int mode;             // seen_mode_t
+    uint32_t hours;       // Window length
+    uint32_t capacity;    // Expected unique EPCs per window
+    uint32_t fp_ppm;      // Target false-positive rate over the whole window, parts per million
+} seen_filter_config_t;
+
+void seen_filter_init(void);   // Loads the config from NVS and allocates (PSRAM only)
+void seen_filter_get_config(seen_filter_config_t *cfg);
+int seen_filter_set_config(const seen_filter_config_t *cfg);   // Clamps, reallocates (clears) and saves; -1 if out of memory
+seen_mode_t seen_filter_mode(void);
+int seen_filter_parse_mode(const char *name);   // "off" / "flag" / "suppress"; -1 if unknown
+
+void seen_filter_add(const char *epc);
+bool seen_filter_contains(const char *epc);   // False when off or not allocated
+
+// Config, sizing and counters as JSON
+int seen_filter_get_json(char *out, int out_len);
+
+#endif // SEEN_FILTER_H
@@ -0,0 +1,438 @@
+#include "tag_rules.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "RULES";
+static const char *NVS_NAMESPACE = "rules";
+
+#define TAG_RULES_VERSION 1
+
+// The RX tasks evaluate the set in place under a sequence counter (odd while
+// an update is copied in) and retry if it moved; updates are serialized by
+// s_lock. s_active lets the common no-rules case skip everything.
+static tag_rules_t s_set;
+static _Atomic uint32_t s_seq = 0;
+static volatile bool s_active = false;
+static volatile uint16_t s_min_reads = 1;
+static SemaphoreHandle_t s_lock = NULL;
+
+// Retries before a reader yields to let a preempted update finish
+#define EVAL_SPINS 64
+
+static void set_defaults(tag_rules_t *set)
+{
+    memset(set, 0, sizeof(*set));
+    set->version = TAG_RULES_VERSION;
+    set->default_action = TAG_RULE_KEEP;
+    set->min_reads = 1;
+    for (int r = 0; r < RFID_MAX_READERS; r++) {
+        set->ant_include[r] = 0xFF;
+        for (int a = 0; a < TAG_RULES_MAX_ANTENNAS; a++) set->rssi_floor[r][a] = TAG_RULES_NO_FLOOR;
+    }
+}
+
+static bool set_filters(const tag_rules_t *set)
+{
+    if (set->count > 0 || set->default_action != TAG_RULE_KEEP) return true;
+    for (int r = 0; r < RFID_MAX_READERS; r++) {
+        if (set->ant_include[r] != 0xFF) return true;
+        for (int a = 0; a < TAG_RULES_MAX_ANTENNAS; a++) {
+            if (set->rssi_floor[r][a] != TAG_RULES_NO_FLOOR) return true;
+        }
+    }
+    return false;
+}
+
+static bool evaluate(const tag_rules_t *set, int reader, int ant, int rssi, const uint8_t *epc, size_t len)
+{
+    // Antenna 0 means the parser could not tell; per-antenna checks are skipped
+    uint8_t ant_bit = (ant >= 1 && ant <= TAG_RULES_MAX_ANTENNAS) ? (uint8_t)(1u << (ant - 1)) : 0;
+    if (reader >= 0 && reader < RFID_MAX_READERS && ant_bit) {
+        if (!(set->ant_include[reader] & ant_bit)) return false;
+        if (rssi < set->rssi_floor[reader][ant - 1]) return false;
+    }
+
+    for (int i = 0; i < set->count; i++) {
+        const tag_rule_t *r = &set->rules[i];
+        if (r->reader >= 0 && r->reader != reader) continue;
+        if (r->ant_mask && !(r->ant_mask & ant_bit)) continue;
+        if (r->len > len) continue;
+        int k = 0;
+        while (k < r->len && (epc[k] & r->mask[k]) == r->value[k]) k++;
+        if (k < r->len) continue;
+        return r->action == TAG_RULE_KEEP && rssi >= r->rssi_min;
+    }
+    return set->default_action == TAG_RULE_KEEP;
+}
+
+bool tag_rules_accept(int reader, int ant, int rssi, const uint8_t *epc, size_t len)
+{
+    if (!s_active) return true;
+    for (int spins = 0; ; spins++) {
+        uint32_t seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+        if (!(seq & 1)) {
+            bool keep = evaluate(&s_set, reader, ant, rssi, epc, len);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&s_seq, memory_order_relaxed) == seq) return keep;
+        }
+        if (spins >= EVAL_SPINS) {
+            vTaskDelay(1);
+            spins = 0;
+        }
+    }
+}
+
+uint16_t tag_rules_min_reads(void)
+{
+    return s_min_reads;
+}
+
+static void apply(const tag_rules_t *set)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s_set = *set;
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_release);
+    s_active = set_filters(set);
+    s_min_reads = set->min_reads;
+    xSemaphoreGive(s_lock);
+}
+
+void tag_rules_init(void)
+{
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+
+    tag_rules_t set;
+    set_defaults(&set);
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        tag_rules_t stored;
+        size_t len = sizeof(stored);
+        if (nvs_get_blob(h, "set", &stored, &len) == ESP_OK) {
+            if (len == sizeof(stored) && stored.version == TAG_RULES_VERSION && stored.count <= TAG_RULES_MAX) {
+                set = stored;
+            } else {
+                ESP_LOGW(TAG, "Ignoring stored rule set (version %u, %u bytes)", (unsigned)stored.version, (unsigned)len);
+            }
+        }
+        nvs_close(h);
+    }
+    apply(&set);
+    ESP_LOGI(TAG, "Rule set: %u EPC rules, min_reads=%u%s", (unsigned)set.count, (unsigned)set.min_reads,
+             s_active ? "" : " (pass-through)");
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Even-length hex string into at most TAG_RULES_EPC_BYTES bytes; -1 if malformed
+static int parse_hex(const char *hex, uint8_t *out)
+{
+    size_t n = strlen(hex);
+    if (n % 2 || n / 2 > TAG_RULES_EPC_BYTES) return -1;
+    for (size_t i = 0; i < n / 2; i++) {
+        int hi = hex_nibble(hex[2 * i]), lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return (int)(n / 2);
+}
+
+// [1, 2, 4] -> bit (ant - 1) each; -1 if an entry is out of range
+static int parse_ants(const json_doc_t *doc, int arr)
+{
+    int mask = 0, ant;
+    JSON_ARRAY_FOR_EACH(doc, arr, a) {
+        if (!json_get_int(doc, a, &ant) || ant < 1 || ant > TAG_RULES_MAX_ANTENNAS) return -1;
+        mask |= 1 << (ant - 1);
+    }
+    return mask;
+}
+
+static int parse_action(const json_doc_t *doc, int item, uint8_t *out)
+{
+    if (item < 0) return 0;
+    if (json_str_eq(doc, item, "keep")) *out = TAG_RULE_KEEP;
+    else if (json_str_eq(doc, item, "drop")) *out = TAG_RULE_DROP;
+    else return -1;
+    return 0;
+}
+
+// Hex string member into bytes; -1 if it is not a string or malformed
+static int parse_hex_item(const json_doc_t *doc, int item, uint8_t *out)
+{
+    char hex[2 * TAG_RULES_EPC_BYTES + 2];
+    int n = json_get_str(doc, item, hex, sizeof(hex));
+    if (n < 0 || n >= (int)sizeof(hex)) return -1;
+    return parse_hex(hex, out);
+}
+
+static int parse_rule(const json_doc_t *doc, int obj, tag_rule_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->reader = -1;
+    r->rssi_min = TAG_RULES_NO_FLOOR;
+    r->action = TAG_RULE_DROP;
+    if (json_type(doc, obj) != JSON_OBJECT) return -1;
+
+    int epc = json_obj_get(doc, obj, "epc");
+    if (epc >= 0) {
+        int n = parse_hex_item(doc, epc, r->value);
+        if (n < 0) return -1;
+        r->len = (uint8_t)n;
+        memset(r->mask, 0xFF, r->len);
+        int mask = json_obj_get(doc, obj, "mask");
+        if (mask >= 0 && parse_hex_item(doc, mask, r->mask) != n) return -1;
+        for (int k = 0; k < r->len; k++) r->value[k] &= r->mask[k];
+    }
+    int v;
+    int reader = json_obj_get(doc, obj, "reader");
+    if (reader >= 0) {
+        if (!json_get_int(doc, reader, &v) || v < 0 || v >= RFID_MAX_READERS) return -1;
+        r->reader = (int8_t)v;
+    }
+    int ants = json_obj_get(doc, obj, "ants");
+    if (ants >= 0) {
+        int m = json_type(doc, ants) == JSON_ARRAY ? parse_ants(doc, ants) : -1;
+        if (m < 0) return -1;
+        r->ant_mask = (uint8_t)m;
+    }
+    int rssi = json_obj_get(doc, obj, "rssi_min");
+    if (rssi >= 0) {
+        if (!json_get_int(doc, rssi, &v) || v < -127 || v > 0) return -1;
+        r->rssi_min = (int8_t)v;
+    }
+    return parse_action(doc, json_obj_get(doc, obj, "action"), &r->action);
+}
+
+static int fail(char *err, int err_len, const char *msg)
+{
+    if (err && err_len > 0) snprintf(err, err_len, "%s", msg);
+    return -1;
+}
+
+int tag_rules_parse_json(const json_doc_t *doc, int obj, tag_rules_t *set, char *err, int err_len)
+{
+    if (json_type(doc, obj) != JSON_OBJECT) return fail(err, err_len, "rules must be an object");
+
+    set_defaults(set);
+    if (parse_action(doc, json_obj_get(doc, obj, "default"), &set->default_action) != 0) {
+        return fail(err, err_len, "default must be keep or drop");
+    }
+    int v;
+    int min = json_obj_get(doc, obj, "min_reads");
+    if (min >= 0) {
+        if (!json_get_int(doc, min, &v) || v < 1 || v > TAG_RULES_MAX_MIN_READS) {
+            return fail(err, err_len, "min_reads out of range");
+        }
+        set->min_reads = (uint16_t)v;
+    }
+
+    // Per reader: antenna include lists and RSSI floors
+    int ants = json_obj_get(doc, obj, "antennas");
+    if (ants >= 0) {
+        if (json_type(doc, ants) != JSON_ARRAY || json_size(doc, ants) > RFID_MAX_READERS) return fail(err, err_len, "bad antennas");
+        int r = 0;
+        JSON_ARRAY_FOR_EACH(doc, ants, list) {
+            int m = json_type(doc, list) == JSON_ARRAY ? parse_ants(doc, list) : -1;
+            if (m < 0) return fail(err, err_len, "bad antennas");
+            set->ant_include[r++] = (uint8_t)m;
+        }
+    }
+    int floors = json_obj_get(doc, obj, "rssi_floor");
+    if (floors >= 0) {
+        if (json_type(doc, floors) != JSON_ARRAY || json_size(doc, floors) > RFID_MAX_READERS) return fail(err, err_len, "bad rssi_floor");
+        int r = 0;
+        JSON_ARRAY_FOR_EACH(doc, floors, list) {
+            if (json_type(doc, list) != JSON_ARRAY || json_size(doc, list) > TAG_RULES_MAX_ANTENNAS) return fail(err, err_len, "bad rssi_floor");
+            int a = 0;
+            JSON_ARRAY_FOR_EACH(doc, list, f) {
+                if (!json_get_int(doc, f, &v) || v < -128 || v > 0) return fail(err, err_len, "bad rssi_floor");
+                set->rssi_floor[r][a++] = (int8_t)v;
+            }
+            r++;
+        }
+    }
+
+    int rules = json_obj_get(doc, obj, "epc");
+    if (rules >= 0) {
+        if (json_type(doc, rules) != JSON_ARRAY || json_size(doc, rules) > TAG_RULES_MAX) return fail(err, err_len, "epc must be an array of up to 32 rules");
+        JSON_ARRAY_FOR_EACH(doc, rules, rule) {
+            if (parse_rule(doc, rule, &set->rules[set->count]) != 0) {
+                if (err && err_len > 0) snprintf(err, err_len, "bad epc rule %u", (unsigned)set->count);
+                return -1;
+            }
+            set->count++;
+        }
+    }
+
+    return 0;
+}
+
+int tag_rules_set_json(const json_doc_t *doc, int obj, char *err, int err_len)
+{
+    if (!s_lock) return fail(err, err_len, "rules not initialized");
+    tag_rules_t set;
+    if (tag_rules_parse_json(doc, obj, &set, err, err_len) != 0) return -1;
+
+    apply(&set);
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_blob(h, "set", &set, sizeof(set));
+        nvs_commit(h);
+        nvs_close(h);
+    }
+    ESP_LOGI(TAG, "Rule set updated: %u EPC rules, min_reads=%u", (unsigned)set.count, (unsigned)set.min_reads);
+    return 0;
+}
+
+static int append_hex(char *out, int out_len, const uint8_t *b, int n)
+{
+    int used = 0;
+    for (int i = 0; i < n && used < out_len; i++) used += snprintf(out + used, out_len - used, "%02X", b[i]);
+    return used;
+}
+
+static int append_ants(char *out, int out_len, uint8_t mask)
+{
+    int used = snprintf(out, out_len, "[");
+    bool first = true;
+    for (int a = 0; a < TAG_RULES_MAX_ANTENNAS && used < out_len; a++) {
+        if (!(mask & (1u << a))) continue;
+        used += snprintf(out + used, out_len - used, "%s%d", first ? "" : ",", a + 1);
+        first = false;
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "]");
+    return used;
+}
+
+int tag_rules_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0 || !s_lock) return 0;
+
+    static tag_rules_t set;   // MQTT task only; too big for its stack
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    set = s_set;
+    xSemaphoreGive(s_lock);
+
+    int used = snprintf(out, out_len, "{\"default\":\"%s\",\"min_reads\":%u,\"antennas\":[",
+                        set.default_action == TAG_RULE_KEEP ? "keep" : "drop", (unsigned)set.min_reads);
+    for (int r = 0; r < RFID_MAX_READERS && used < out_len; r++) {
+        if (r) used += snprintf(out + used, out_len - used, ",");
+        if (used < out_len) used += append_ants(out + used, out_len - used, set.ant_include[r]);
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "],\"rssi_floor\":[");
+    for (int r = 0; r < RFID_MAX_READERS && used < out_len; r++) {
+        used += snprintf(out + used, out_len - used, "%s[", r ? "," : "");
+        for (int a = 0; a < TAG_RULES_MAX_ANTENNAS && used < out_len; a++) {
+            used += snprintf(out + used, out_len - used, "%s%d", a ? "," : "", set.rssi_floor[r][a]);
+        }
+        if (used < out_len) used += snprintf(out + used, out_len - used, "]");
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "],\"epc\":[");
+    for (int i = 0; i < set.count && used < out_len; i++) {
+        const tag_rule_t *r = &set.rules[i];
+        used += snprintf(out + used, out_len - used, "%s{\"action\":\"%s\",\"epc\":\"", i ? "," : "",
+                         r->action == TAG_RULE_KEEP ? "keep" : "drop");
+        if (used < out_len) used += append_hex(out + used, out_len - used, r->value, r->len);
+        if (used < out_len) used += snprintf(out + used, out_len - used, "\",\"mask\":\"");
+        if (used < out_len) used += append_hex(out + used, out_len - used, r->mask, r->len);
+        if (used < out_len) used += snprintf(out + used, out_len - used, "\"");
+        if (r->reader >= 0 && used < out_len) used += snprintf(out + used, out_len - used, ",\"reader\":%d", r->reader);
+        if (r->ant_mask && used < out_len) {
+            used += snprintf(out + used, out_len - used, ",\"ants\":");
+            if (used < out_len) used += append_ants(out + used, out_len - used, r->ant_mask);
+        }
+        if (r->rssi_min != TAG_RULES_NO_FLOOR && used < out_len) {
+            used += snprintf(out + used, out_len - used, ",\"rssi_min\":%d", r->rssi_min);
+        }
+        if (used < out_len) used += snprintf(out + used, out_len - used, "}");
+    }
+    if (used < out_len) used += snprintf(out + used, out_len - used, "]}");
+    return (used < out_len) ? used : out_len - 1;
+}
+
+// Worst case the compiled form allows: every reader limited to antennas 1-4
+// with a floor, and TAG_RULES_MAX rules where only the last one matches
+static void full_set(tag_rules_t *set)
+{
+    set_defaults(set);
+    set->default_action = TAG_RULE_DROP;
+    for (int r = 0; r < RFID_MAX_READERS; r++) {
+        set->ant_include[r] = 0x0F;
+        for (int a = 0; a < TAG_RULES_MAX_ANTENNAS; a++) set->rssi_floor[r][a] = -110;
+    }
+    for (int i = 0; i < TAG_RULES_MAX; i++) {
+        tag_rule_t *r = &set->rules[i];
+        r->reader = -1;
+        r->rssi_min = TAG_RULES_NO_FLOOR;
+        r->action = TAG_RULE_DROP;
+        r->len = TAG_RULES_EPC_BYTES;
+        memset(r->mask, 0xFF, r->len);
+        r->mask[10] = r->mask[11] = 0x00;   // Serial bytes the bench varies are masked off
+        static const uint8_t prefix[] = { 0x30, 0x74, 0x25, 0x7B, 0xF7, 0x19, 0x4E, 0x40 };
+        memcpy(r->value, prefix, sizeof(prefix));
+        r->value[9] = (uint8_t)(i + 1);   // Differs from the bench EPCs in byte 9...
+    }
+    set->rules[TAG_RULES_MAX - 1].value[9] = 0;   // ...except the last rule
+    set->rules[TAG_RULES_MAX - 1].action = TAG_RULE_KEEP;
+    set->count = TAG_RULES_MAX;
+}
+
+// ns per read over iterations synthetic SGTIN-like EPCs that vary in the
+// serial bytes, on every antenna. Only the busy slices are timed; the task
+// yields between them so lower priority tasks and the watchdog keep running.
+static uint32_t bench_set(const tag_rules_t *set, int iterations)
+{
+    bool active = set_filters(set);
+    uint8_t epc[TAG_RULES_EPC_BYTES] = { 0x30, 0x74, 0x25, 0x7B, 0xF7, 0x19, 0x4E, 0x40, 0, 0, 0, 0 };
+    volatile uint32_t kept = 0;
+    int64_t busy_us = 0;
+    for (int i = 0; i < iterations; ) {
+        int64_t start = esp_timer_get_time();
+        for (int end = i + 1000; i < iterations && i < end; i++) {
+            epc[10] = (uint8_t)(i >> 8);
+            epc[11] = (uint8_t)i;
+            kept += !active || evaluate(set, i & 1, 1 + (i & 3), -40 - (i & 63), epc, sizeof(epc));
+        }
+        busy_us += esp_timer_get_time() - start;
+        vTaskDelay(1);
+    }
+    (void)kept;
+    return (uint32_t)(busy_us * 1000 / iterations);
+}
+
+void tag_rules_bench(int iterations, tag_rules_bench_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (iterations <= 0 || !s_lock) return;
+    if (iterations > TAG_RULES_BENCH_MAX) iterations = TAG_RULES_BENCH_MAX;
+    tag_rules_t *set = malloc(sizeof(*set));
+    if (!set) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *set = s_set;
+    xSemaphoreGive(s_lock);
+    out->iterations = (uint32_t)iterations;
+    out->current_ns = bench_set(set, iterations);
+
+    full_set(set);
+    out->full_ns = bench_set(set, iterations);
+    free(set);
+}
@@ -0,0 +1,69 @@
+/* tag_rules.h - edge rules applied to every decoded read before it is stored */
+#ifndef TAG_RULES_H
+#define TAG_RULES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "rfid.h"
+#include "json_tok.h"
+
+#define TAG_RULES_MAX           32
+#define TAG_RULES_EPC_BYTES     12
+#define TAG_RULES_MAX_ANTENNAS  8
+#define TAG_RULES_NO_FLOOR      (-128)
+#define TAG_RULES_MAX_MIN_READS 1000
+#define TAG_RULES_JSON_MAX      4096
+
+typedef enum {
+    TAG_RULE_KEEP = 0,
+    TAG_RULE_DROP,
+} tag_rule_action_t;
+
+// One EPC rule. Rules are tried in order and the first match decides.
+typedef struct {
+    int8_t reader;                        // -1 = any reader
+    uint8_t ant_mask;                     // Bit (ant - 1) per antenna; 0 = any
+    int8_t rssi_min;                      // Keep only at or above this (TAG_RULES_NO_FLOOR = no floor)
+    uint8_t action;                       // tag_rule_action_t
+    uint8_t len;                          // EPC bytes compared; 0 matches every EPC
+    uint8_t value[TAG_RULES_EPC_BYTES];   // Pre-masked
+    uint8_t mask[TAG_RULES_EPC_BYTES];
+} tag_rule_t;
+
+// The compiled rule set, also the NVS image
+typedef struct {
+    uint8_t version;
+    uint8_t default_action;                                         // When no EPC rule matches
+    uint16_t min_reads;                                             // Reads before a tag is reported (1 = at once)
+    uint8_t ant_include[RFID_MAX_READERS];                          // Bit (ant - 1); 0xFF = all
+    int8_t rssi_floor[RFID_MAX_READERS][TAG_RULES_MAX_ANTENNAS];   // dBm per antenna
+    uint8_t count;
+    tag_rule_t rules[TAG_RULES_MAX];
+} tag_rules_t;
+
+void tag_rules_init(void);   // Loads the rule set from NVS
+
+// Inline check after frame decoding; false = drop the read
+bool tag_rules_accept(int reader, int ant, int rssi, const uint8_t *epc, size_t len);
+uint16_t tag_rules_min_reads(void);
+
+// Replace the rule set from its JSON form (object token obj of a parsed
+// document); applied at once and saved to NVS. Returns -1 and fills err on a bad rule.
+int tag_rules_set_json(const json_doc_t *doc, int obj, char *err, int err_len);
+// The compile step alone: fills set without applying or saving it
+int tag_rules_parse_json(const json_doc_t *doc, int obj, tag_rules_t *set, char *err, int err_len);
+int tag_rules_get_json(char *out, int out_len);
+
+// Evaluation cost on private copies, so the live set and the RX tasks are
+// untouched. Runs for a while: call it from a worker task, not a callback.
+#define TAG_RULES_BENCH_MAX 100000
+typedef struct {
+    uint32_t iterations;
+    uint32_t current_ns;   // Per read with the current set (pass-through when it filters nothing)
+    uint32_t full_ns;      // Per read with a full synthetic set: antenna lists, floors and
+                           // TAG_RULES_MAX masked EPC rules that only the last one matches
+} tag_rules_bench_t;
+void tag_rules_bench(int iterations, tag_rules_bench_t *out);
+
+#endif // TAG_RULES_H
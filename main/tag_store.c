@@ -0,0 +1,875 @@
+#include "tag_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "mqtt_batch.h"
+#include "boot.h"
+#include "metrics.h"
+#include "latency.h"
+#include "rfid.h"
+#include "seen_filter.h"
+#include "epc_decode.h"
+#include "tag_rules.h"
+#include "epcdb.h"
+
+static const char *TAG = "TAG_STORE";
+#define TAG_STORE_NVS_NAMESPACE "rfid"
+
+// Table size: PSRAM when present, a small internal table otherwise
+#define TAG_STORE_CAPACITY_PSRAM    1024
+#define TAG_STORE_CAPACITY_INTERNAL 64
+
+// Tags removed per lock hold while expiring
+#define EXPIRE_CHUNK 8
+
+// Tag storage
+typedef struct {
+    char epc[64];  // Reduced from 128 to 64
+    int rssi;
+    int ant;
+    int reader;       // Reader of the last read
+    uint8_t readers;  // Bit per reader that has seen the tag
+    bool returning;   // Seen before within the seen-filter window when it took this slot
+    uint64_t last_ms;
+    uint32_t count;  // How many times this specific tag has been detected
+    float rate;      // Decayed reads/s as of last_ms
+    uint64_t gen;    // Store generation of the last read
+    uint32_t trace_rx_us;       // Oldest read since the last batch: UART arrival,
+    uint32_t trace_parse_us;    // decoded
+    uint32_t trace_store_us;    // and stored (latency_now_us, 0 = untraced)
+} tag_item_t;
+_Static_assert(RFID_MAX_READERS <= 8, "tag_item_t.readers has a bit per reader");
+
+// Writer-only links: expiry list (least recently read first, or the free list)
+// and the EPC hash chain. -1 ends a list.
+typedef struct {
+    int16_t prev;
+    int16_t next;
+    int16_t hnext;
+} tag_link_t;
+
+// Approximate JSON size of one batch entry excluding the EPC text
+#define TAG_JSON_OVERHEAD 100
+
+static inline size_t entry_overhead(void)
+{
+    return TAG_JSON_OVERHEAD + (epc_decode_payload_enabled() ? EPC_DECODE_JSON_MAX : 0) +
+           (epcdb_loaded() ? EPCDB_JSON_MAX : 0);
+}
+
+// Read rate per reader antenna (1..TAG_RATE_MAX_ANTENNAS); writer lock
+typedef struct {
+    float rate;      // Decayed reads/s as of ms
+    uint64_t ms;     // Last read, 0 = never
+} rate_t;
+
+// Batch scratch entry: a pending slot, sorted by generation
+typedef struct {
+    uint64_t gen;
+    int16_t idx;
+    uint8_t len;
+} pending_ref_t;
+
+// Per-consumer generations; changed and copied under the writer lock
+typedef struct {
+    bool stream;              // Sends each read once and keeps a cursor
+    bool active;
+    uint64_t start_gen;       // View and count hold reads newer than this
+    uint64_t stop_gen;        // Newest read a stopped stream still drains
+    uint64_t cursor;          // Stream: newest generation already sent
+    uint32_t total_base;      // total_tag_count at start
+    void (*notify)(uint32_t entry_bytes);                 // Stream: a tag became pending
+    void (*depart)(const tag_depart_t *tags, int count);  // Tags of this view that expired
+} consumer_state_t;
+
+// Each slot is guarded by a sequence counter: odd while a writer is inside.
+// Readers copy the slot and retry if the counter moved, so they never block
+// the UART tasks and never see a half-written EPC.
+struct tag_table {
+    tag_item_t *tags;
+    _Atomic uint32_t *seq;
+    tag_link_t *links;
+    int16_t *hash;                      // Bucket heads, hash_mask + 1 of them
+    uint32_t hash_mask;
+    int capacity;
+    int lru_head, lru_tail;             // Oldest and newest read
+    int free_head;
+    int used;
+    volatile uint32_t total_tag_count;  // Total detections across all tags
+    uint64_t gen;                       // Generation of the newest read (writer lock)
+    SemaphoreHandle_t write_lock;       // Serializes writers only
+    rate_t ant_rate[RFID_MAX_READERS][TAG_RATE_MAX_ANTENNAS];
+    pending_ref_t *pending;             // Batch scratch (one batch builder per table)
+    consumer_state_t consumers[TAG_CONSUMER_COUNT];
+};
+
+// The table the readers feed; benchmarks build their own (tag_store_bench_create)
+static tag_table_t s_live = {
+    .lru_head = -1, .lru_tail = -1, .free_head = -1,
+    .consumers = {
+        [TAG_CONSUMER_WEB]  = { 0 },
+        [TAG_CONSUMER_MQTT] = { .stream = true, .notify = mqtt_batch_note_pending,
+                                .depart = mqtt_batch_publish_departs },
+    },
+};
+static volatile uint32_t s_timeout_ms = TAG_STORE_DEFAULT_TIMEOUT_MS;
+
+// Spins before a reader yields to let a preempted writer finish its slot
+#define SNAPSHOT_SPINS 64
+
+static void *alloc_table(size_t bytes, bool psram)
+{
+    void *p = psram ? heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+                    : calloc(1, bytes);
+    return p;
+}
+
+static void free_tables(tag_table_t *tb)
+{
+    free(tb->tags); free((void *)tb->seq); free(tb->links); free(tb->hash); free(tb->pending);
+    tb->tags = NULL; tb->seq = NULL; tb->links = NULL; tb->hash = NULL; tb->pending = NULL;
+}
+
+static bool alloc_tables(tag_table_t *tb, int capacity, bool psram)
+{
+    uint32_t buckets = 1;
+    while (buckets < (uint32_t)capacity) buckets <<= 1;
+
+    tb->tags = alloc_table(capacity * sizeof(tag_item_t), psram);
+    tb->seq = alloc_table(capacity * sizeof(*tb->seq), psram);
+    tb->links = alloc_table(capacity * sizeof(tag_link_t), psram);
+    tb->hash = alloc_table(buckets * sizeof(int16_t), psram);
+    tb->pending = alloc_table(capacity * sizeof(pending_ref_t), psram);
+    if (!tb->tags || !tb->seq || !tb->links || !tb->hash || !tb->pending) {
+        free_tables(tb);
+        return false;
+    }
+
+    tb->capacity = capacity;
+    tb->hash_mask = buckets - 1;
+    for (uint32_t b = 0; b < buckets; b++) tb->hash[b] = -1;
+    // Every slot starts on the free list
+    for (int i = 0; i < capacity; i++) {
+        tb->links[i].prev = -1;
+        tb->links[i].next = (int16_t)(i + 1 < capacity ? i + 1 : -1);
+        tb->links[i].hnext = -1;
+    }
+    tb->free_head = 0;
+    return true;
+}
+
+static void write_lock(tag_table_t *tb)
+{
+    if (tb->write_lock) xSemaphoreTake(tb->write_lock, portMAX_DELAY);
+}
+
+static void write_unlock(tag_table_t *tb)
+{
+    if (tb->write_lock) xSemaphoreGive(tb->write_lock);
+}
+
+void tag_store_init(void)
+{
+    tag_table_t *tb = &s_live;
+    if (tb->write_lock) return;
+    tb->write_lock = xSemaphoreCreateMutex();
+
+    // Held until the table and timeout are in place: other boot stages may
+    // already be calling in
+    write_lock(tb);
+    seen_filter_init();
+    bool psram = alloc_tables(tb, TAG_STORE_CAPACITY_PSRAM, true);
+    if (!psram && !alloc_tables(tb, TAG_STORE_CAPACITY_INTERNAL, false)) {
+        write_unlock(tb);
+        ESP_LOGE(TAG, "Failed to allocate tag table");
+        return;
+    }
+
+    nvs_handle_t h;
+    if (nvs_open(TAG_STORE_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        uint32_t v;
+        if (nvs_get_u32(h, "tag_tmo", &v) == ESP_OK &&
+            v >= TAG_STORE_MIN_TIMEOUT_MS && v <= TAG_STORE_MAX_TIMEOUT_MS) {
+            s_timeout_ms = v;
+        }
+        nvs_close(h);
+    }
+    write_unlock(tb);
+    ESP_LOGI(TAG, "Tag table: %d slots in %s, timeout %lu ms", tb->capacity,
+             psram ? "PSRAM" : "internal RAM", (unsigned long)s_timeout_ms);
+}
+
+static void slot_write_begin(tag_table_t *tb, int i)
+{
+    atomic_fetch_add_explicit(&tb->seq[i], 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void slot_write_end(tag_table_t *tb, int i)
+{
+    atomic_fetch_add_explicit(&tb->seq[i], 1, memory_order_release);
+}
+
+// Consistent copy of slot i; returns its sequence number
+static uint32_t slot_snapshot(tag_table_t *tb, int i, tag_item_t *out)
+{
+    for (int spins = 0; ; spins++) {
+        uint32_t before = atomic_load_explicit(&tb->seq[i], memory_order_acquire);
+        if (!(before & 1)) {
+            memcpy(out, &tb->tags[i], sizeof(*out));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&tb->seq[i], memory_order_relaxed) == before) return before;
+        }
+        if (spins >= SNAPSHOT_SPINS) {
+            vTaskDelay(1);
+            spins = 0;
+        }
+    }
+}
+
+// Snapshot still within the timeout (the expiry pass may not have run yet)
+static inline bool is_live(const tag_item_t *t, uint64_t now)
+{
+    return t->epc[0] != '\0' && now - t->last_ms < s_timeout_ms;
+}
+
+// Exponentially decayed rate with a TAG_RATE_WINDOW_MS time constant: each read
+// adds 1/window and the sum decays by e^(-dt/window), so a steady stream of
+// r reads/s settles at r. Constant memory and O(1) per read.
+static inline float rate_at(float rate, uint64_t since_ms, uint64_t now)
+{
+    if (rate == 0.0f || now <= since_ms) return rate;
+    return rate * expf(-(float)(now - since_ms) / (float)TAG_RATE_WINDOW_MS);
+}
+
+static inline float rate_hit(float rate, uint64_t since_ms, uint64_t now)
+{
+    return rate_at(rate, since_ms, now) + 1000.0f / (float)TAG_RATE_WINDOW_MS;
+}
+
+// ---- Writer-side index (writer lock held) ----
+
+static uint32_t epc_hash(const char *epc)
+{
+    uint32_t h = 2166136261u;   // FNV-1a
+    while (*epc) {
+        h ^= (uint8_t)*epc++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int find_tag_index(tag_table_t *tb, const char* epc)
+{
+    for (int i = tb->hash[epc_hash(epc) & tb->hash_mask]; i >= 0; i = tb->links[i].hnext) {
+        if (strcmp(tb->tags[i].epc, epc) == 0) return i;
+    }
+    return -1;
+}
+
+static void hash_insert(tag_table_t *tb, int i)
+{
+    uint32_t b = epc_hash(tb->tags[i].epc) & tb->hash_mask;
+    tb->links[i].hnext = tb->hash[b];
+    tb->hash[b] = (int16_t)i;
+}
+
+static void hash_remove(tag_table_t *tb, int i)
+{
+    int16_t *p = &tb->hash[epc_hash(tb->tags[i].epc) & tb->hash_mask];
+    while (*p >= 0 && *p != i) p = &tb->links[*p].hnext;
+    if (*p == i) *p = tb->links[i].hnext;
+    tb->links[i].hnext = -1;
+}
+
+static void lru_unlink(tag_table_t *tb, int i)
+{
+    tag_link_t *l = &tb->links[i];
+    if (l->prev >= 0) tb->links[l->prev].next = l->next; else tb->lru_head = l->next;
+    if (l->next >= 0) tb->links[l->next].prev = l->prev; else tb->lru_tail = l->prev;
+    l->prev = l->next = -1;
+}
+
+static void lru_push_tail(tag_table_t *tb, int i)
+{
+    tb->links[i].prev = (int16_t)tb->lru_tail;
+    tb->links[i].next = -1;
+    if (tb->lru_tail >= 0) tb->links[tb->lru_tail].next = (int16_t)i; else tb->lru_head = i;
+    tb->lru_tail = i;
+}
+
+// Take a slot off the index and return it to the free list. The caller puts
+// the EPC into the seen filter once the writer lock is released, so it is
+// recognised if it comes back.
+static void release_slot(tag_table_t *tb, int i)
+{
+    hash_remove(tb, i);
+    lru_unlink(tb, i);
+    slot_write_begin(tb, i);
+    tb->tags[i].epc[0] = '\0'; // Mark as empty
+    slot_write_end(tb, i);
+    tb->links[i].next = (int16_t)tb->free_head;
+    tb->free_head = i;
+    tb->used--;
+}
+
+// Free slot for a new EPC; evicts the least recently read tag when full and
+// copies its EPC to evicted (left empty otherwise)
+static int alloc_tag_index(tag_table_t *tb, char evicted[64])
+{
+    evicted[0] = '\0';
+    if (tb->free_head < 0) {
+        int oldest = tb->lru_head;
+        uint64_t now = esp_timer_get_time() / 1000ULL;
+        if (now - tb->tags[oldest].last_ms < s_timeout_ms) metrics_inc(METRIC_RFID_TAG_EVICTIONS);
+        memcpy(evicted, tb->tags[oldest].epc, sizeof(tb->tags[oldest].epc));
+        release_slot(tb, oldest);
+    }
+    int i = tb->free_head;
+    tb->free_head = tb->links[i].next;
+    tb->links[i].next = -1;
+    tb->used++;
+    return i;
+}
+
+// Called between slot_write_begin/end; returning comes from the seen filter,
+// looked up before the slot is opened
+static void init_slot(tag_table_t *tb, int i, const char *epc, bool returning)
+{
+    tag_item_t *t = &tb->tags[i];
+    strncpy(t->epc, epc, sizeof(t->epc)-1);
+    t->epc[sizeof(t->epc)-1] = '\0';
+    t->count = 0;  // Initialize count for new tag
+    t->rate = 0.0f;
+    t->readers = 0;
+    t->gen = 0;
+    t->returning = returning;
+}
+
+static void consumer_snapshot(tag_table_t *tb, tag_consumer_t c, consumer_state_t *out)
+{
+    write_lock(tb);
+    *out = tb->consumers[c];
+    write_unlock(tb);
+}
+
+// Record one read and mark it pending for every running stream consumer
+bool tag_store_touch(const char *epc, int reader, int ant, int rssi, uint32_t rx_us, uint32_t parse_us)
+{
+    tag_table_t *tb = &s_live;
+    if (!epc || epc[0] == '\0' || !tb->tags) return false;
+    bool notify[TAG_CONSUMER_COUNT] = {0};
+
+    char evicted[64];
+    write_lock(tb);
+    int idx = find_tag_index(tb, epc);
+    bool fresh = idx < 0;
+    bool returning = false;
+    if (fresh) {
+        idx = alloc_tag_index(tb, evicted);
+        returning = seen_filter_contains(epc);
+    }
+
+    tag_item_t *t = &tb->tags[idx];
+    uint64_t prev_gen = fresh ? 0 : t->gen;
+    slot_write_begin(tb, idx);
+    if (fresh) init_slot(tb, idx, epc, returning);
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+    t->rssi = rssi;
+    t->ant = ant;
+    t->reader = reader;
+    if (reader >= 0 && reader < RFID_MAX_READERS) t->readers |= (uint8_t)(1u << reader);
+    t->rate = rate_hit(t->rate, t->last_ms, now);
+    t->last_ms = now;
+    t->count++;                 // Increment individual tag count
+    t->gen = ++tb->gen;
+    tb->total_tag_count++;      // Increment total count
+
+    // A tag becomes pending for a stream once its previous read has been sent;
+    // returning tags are not streamed at all in suppress mode, and no tag is
+    // reported before it has the rule set's minimum read count
+    uint16_t min_reads = tag_rules_min_reads();
+    bool hidden = (t->returning && seen_filter_mode() == SEEN_MODE_SUPPRESS) || t->count < min_reads;
+    bool first_report = t->count == min_reads;
+    for (int c = 0; c < TAG_CONSUMER_COUNT; c++) {
+        const consumer_state_t *st = &tb->consumers[c];
+        notify[c] = st->stream && st->active && !hidden && (first_report || prev_gen <= st->cursor);
+    }
+    if (notify[TAG_CONSUMER_MQTT]) {
+        // Trace the first read since the tag was last batched: it waits the longest
+        t->trace_rx_us = rx_us;
+        t->trace_parse_us = parse_us;
+        t->trace_store_us = latency_now_us();
+    }
+    size_t entry_bytes = entry_overhead() + strlen(t->epc);
+    slot_write_end(tb, idx);
+
+    // Most recently read moves to the tail; a new EPC also joins its hash chain
+    if (fresh) {
+        hash_insert(tb, idx);
+    } else {
+        lru_unlink(tb, idx);
+    }
+    lru_push_tail(tb, idx);
+
+    if (reader >= 0 && reader < RFID_MAX_READERS && ant >= 1 && ant <= TAG_RATE_MAX_ANTENNAS) {
+        rate_t *ar = &tb->ant_rate[reader][ant - 1];
+        ar->rate = rate_hit(ar->rate, ar->ms, now);
+        ar->ms = now;
+    }
+    write_unlock(tb);
+
+    if (fresh && evicted[0]) seen_filter_add(evicted);
+    for (int c = 0; c < TAG_CONSUMER_COUNT; c++) {
+        if (notify[c] && tb->consumers[c].notify) tb->consumers[c].notify(entry_bytes);
+    }
+
+    metrics_inc(METRIC_RFID_TAG_READS);
+    boot_mark(BOOT_MARK_FIRST_READ);
+
+    uint32_t store_us = latency_now_us();
+    latency_record(LATENCY_UART_TO_PARSE, rx_us, parse_us);
+    latency_record(LATENCY_PARSE_TO_STORE, parse_us, store_us);
+    return !hidden;
+}
+
+// Remove tags not read for the timeout, oldest first, and hand them to the
+// consumers whose view they belong to. Each step pops the head of the expiry
+// list, so the cost is proportional to the tags that actually expired.
+uint32_t tag_store_expire(void)
+{
+    tag_table_t *tb = &s_live;
+    if (!tb->tags) return UINT32_MAX;
+
+    tag_depart_t gone[EXPIRE_CHUNK];
+    consumer_state_t cs[TAG_CONSUMER_COUNT];
+    uint32_t next_ms;
+    int n;
+
+    do {
+        uint64_t now = esp_timer_get_time() / 1000ULL;
+        uint32_t timeout = s_timeout_ms;
+        n = 0;
+
+        write_lock(tb);
+        while (tb->lru_head >= 0 && n < EXPIRE_CHUNK && now - tb->tags[tb->lru_head].last_ms >= timeout) {
+            const tag_item_t *t = &tb->tags[tb->lru_head];
+            tag_depart_t *d = &gone[n++];
+            memcpy(d->epc, t->epc, sizeof(d->epc));
+            d->reader = t->reader;
+            d->ant = t->ant;
+            d->readers = t->readers;
+            d->count = t->count;
+            d->last_ms = t->last_ms;
+            d->gen = t->gen;
+            d->returning = t->returning;
+            release_slot(tb, tb->lru_head);
+        }
+        next_ms = (tb->lru_head < 0) ? timeout
+                                     : (uint32_t)(timeout - (now - tb->tags[tb->lru_head].last_ms));
+        memcpy(cs, tb->consumers, sizeof(cs));
+        metrics_set(METRIC_RFID_ACTIVE_TAGS, (uint32_t)tb->used);
+        write_unlock(tb);
+
+        if (n == 0) break;
+        metrics_add(METRIC_RFID_TAG_DEPARTS, (uint32_t)n);
+        for (int k = 0; k < n; k++) seen_filter_add(gone[k].epc);
+
+        // Each consumer hears about the tags its current view held
+        bool suppress = seen_filter_mode() == SEEN_MODE_SUPPRESS;
+        uint16_t min_reads = tag_rules_min_reads();
+        for (int c = 0; c < TAG_CONSUMER_COUNT; c++) {
+            if (!cs[c].depart) continue;
+            uint64_t end = cs[c].active ? UINT64_MAX : cs[c].stop_gen;
+            tag_depart_t mine[EXPIRE_CHUNK];
+            int m = 0;
+            for (int k = 0; k < n; k++) {
+                if (cs[c].stream && suppress && gone[k].returning) continue;
+                if (gone[k].count < min_reads) continue;   // Never reported
+                if (gone[k].gen > cs[c].start_gen && gone[k].gen <= end) mine[m++] = gone[k];
+            }
+            if (m) cs[c].depart(mine, m);
+        }
+    } while (n == EXPIRE_CHUNK);
+
+    return next_ms;
+}
+
+void tag_store_set_timeout_ms(uint32_t ms)
+{
+    if (ms < TAG_STORE_MIN_TIMEOUT_MS) ms = TAG_STORE_MIN_TIMEOUT_MS;
+    if (ms > TAG_STORE_MAX_TIMEOUT_MS) ms = TAG_STORE_MAX_TIMEOUT_MS;
+    s_timeout_ms = ms;
+
+    nvs_handle_t h;
+    if (nvs_open(TAG_STORE_NVS_NAMESPACE, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_u32(h, "tag_tmo", ms);
+        nvs_commit(h);
+        nvs_close(h);
+    }
+    ESP_LOGI(TAG, "Tag timeout set to %lu ms", (unsigned long)ms);
+}
+
+uint32_t tag_store_get_timeout_ms(void)
+{
+    return s_timeout_ms;
+}
+
+int tag_store_capacity(void)
+{
+    return s_live.capacity;
+}
+
+void tag_store_consumer_start(tag_consumer_t c)
+{
+    if (c < 0 || c >= TAG_CONSUMER_COUNT) return;
+    tag_table_t *tb = &s_live;
+    write_lock(tb);
+    consumer_state_t *st = &tb->consumers[c];
+    st->active = true;
+    st->start_gen = tb->gen;
+    st->cursor = tb->gen;
+    st->total_base = tb->total_tag_count;
+    write_unlock(tb);
+}
+
+void tag_store_consumer_stop(tag_consumer_t c)
+{
+    if (c < 0 || c >= TAG_CONSUMER_COUNT) return;
+    tag_table_t *tb = &s_live;
+    write_lock(tb);
+    tb->consumers[c].active = false;
+    tb->consumers[c].stop_gen = tb->gen;
+    write_unlock(tb);
+}
+
+uint32_t tag_store_total(tag_consumer_t c)
+{
+    if (c < 0 || c >= TAG_CONSUMER_COUNT) return s_live.total_tag_count;
+    return s_live.total_tag_count - s_live.consumers[c].total_base;
+}
+
+// ,"gs1":{...} for a decodable EPC when decoded payloads are enabled, else ""
+static const char *gs1_fragment(const char *epc, char *buf, int len)
+{
+    epc_info_t info;
+    if (!epc_decode_payload_enabled() || !epc_decode_hex(epc, &info)) return "";
+    int n = snprintf(buf, len, ",\"gs1\":");
+    epc_decode_json(&info, buf + n, len - n);
+    return buf;
+}
+
+// ,"asset":{...} for an EPC listed in the asset table, else ""
+static const char *asset_fragment(const char *epc, char *buf, int len)
+{
+    epcdb_record_t rec;
+    if (!epcdb_lookup_hex(epc, &rec)) return "";
+    int n = snprintf(buf, len, ",\"asset\":");
+    epcdb_record_json(&rec, buf + n, len - n);
+    return buf;
+}
+
+static int antenna_rates_json(tag_table_t *tb, char *out, int out_len);
+
+int tag_store_table_get_json(tag_table_t *tb, char *out, int out_len, int reader)
+{
+    if (!out || out_len <= 10) return 0;
+
+    int used = 0;
+    int count = 0;
+    tag_item_t t;
+    consumer_state_t web;
+    consumer_snapshot(tb, TAG_CONSUMER_WEB, &web);
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+    uint16_t min_reads = tag_rules_min_reads();
+
+    // Start with object containing count, total, and tags array
+    used += snprintf(out + used, out_len - used, "{\"active_tags\":");
+
+    // Count tags read since the web inventory started
+    for (int i = 0; i < tb->capacity; ++i) {
+        slot_snapshot(tb, i, &t);
+        if (!is_live(&t, now) || t.gen <= web.start_gen || t.count < min_reads) continue;
+        if (reader >= 0 && !(t.readers & (1u << reader))) continue;
+        count++;
+    }
+
+    // Add active count, total count and antenna rates to JSON
+    used += snprintf(out + used, out_len - used, "%d,\"total_detections\":%lu,\"antennas\":",
+                     count, (unsigned long)(tb->total_tag_count - web.total_base));
+    if (used < out_len) used += antenna_rates_json(tb, out + used, out_len - used);
+    if (used < out_len) used += snprintf(out + used, out_len - used, ",\"tags\":[");
+
+    int first = 1;
+    int tags_output = 0;
+
+    char gs1[EPC_DECODE_JSON_MAX + 8];
+    char asset[EPCDB_JSON_MAX + 10];
+    for (int i = 0; i < tb->capacity && used < out_len - 128 - (int)(sizeof(gs1) + sizeof(asset)); ++i) {
+        slot_snapshot(tb, i, &t);
+        if (!is_live(&t, now) || t.gen <= web.start_gen || t.count < min_reads) continue;
+        if (reader >= 0 && !(t.readers & (1u << reader))) continue;
+
+        if (!first) {
+            used += snprintf(out + used, out_len - used, ",");
+        }
+        first = 0;
+
+        used += snprintf(out + used, out_len - used,
+            "{\"epc\":\"%s\",\"rssi\":%d,\"ant\":%d,\"reader\":%d,\"readers\":%u,\"ts\":%llu,\"count\":%lu,\"rate\":%.2f%s%s%s}",
+            t.epc, t.rssi, t.ant, t.reader, (unsigned)t.readers,
+            (unsigned long long)t.last_ms, (unsigned long)t.count, (double)rate_at(t.rate, t.last_ms, now),
+            t.returning ? ",\"seen\":true" : "", gs1_fragment(t.epc, gs1, sizeof(gs1)),
+            asset_fragment(t.epc, asset, sizeof(asset)));
+
+        tags_output++;
+        if (tags_output >= 50) break; // Limit output size
+    }
+
+    used += snprintf(out + used, out_len - used, "]}");
+    return used;
+}
+
+int tag_store_get_json(char *out, int out_len, int reader)
+{
+    return tag_store_table_get_json(&s_live, out, out_len, reader);
+}
+
+static void copy_antenna_rates(tag_table_t *tb, rate_t out[RFID_MAX_READERS][TAG_RATE_MAX_ANTENNAS])
+{
+    write_lock(tb);
+    memcpy(out, tb->ant_rate, sizeof(tb->ant_rate));
+    write_unlock(tb);
+}
+
+static int antenna_rates_json(tag_table_t *tb, char *out, int out_len)
+{
+    if (!out || out_len <= 2) return 0;
+    rate_t rates[RFID_MAX_READERS][TAG_RATE_MAX_ANTENNAS];
+    copy_antenna_rates(tb, rates);
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+
+    int n = snprintf(out, out_len, "[");
+    bool first = true;
+    for (int r = 0; r < RFID_MAX_READERS; r++) {
+        for (int a = 0; a < TAG_RATE_MAX_ANTENNAS && n < out_len; a++) {
+            if (!rates[r][a].ms) continue;
+            n += snprintf(out + n, out_len - n, "%s{\"reader\":%d,\"ant\":%d,\"rate\":%.2f}",
+                          first ? "" : ",", r, a + 1, (double)rate_at(rates[r][a].rate, rates[r][a].ms, now));
+            first = false;
+        }
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]");
+    return (n < out_len) ? n : out_len - 1;
+}
+
+int tag_store_get_antenna_rates_json(char *out, int out_len)
+{
+    return antenna_rates_json(&s_live, out, out_len);
+}
+
+int tag_store_render_prometheus(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+    rate_t rates[RFID_MAX_READERS][TAG_RATE_MAX_ANTENNAS];
+    copy_antenna_rates(&s_live, rates);
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+
+    static const char *name = "reader_rfid_antenna_read_rate";
+    int n = snprintf(out, out_len,
+                     "# HELP %s Tag reads per second per antenna (decayed over %d s)\n"
+                     "# TYPE %s gauge\n", name, TAG_RATE_WINDOW_MS / 1000, name);
+    for (int r = 0; r < RFID_MAX_READERS; r++) {
+        for (int a = 0; a < TAG_RATE_MAX_ANTENNAS && n < out_len; a++) {
+            if (!rates[r][a].ms) continue;
+            n += snprintf(out + n, out_len - n, "%s{reader=\"%d\",ant=\"%d\"} %.3f\n",
+                          name, r, a + 1, (double)rate_at(rates[r][a].rate, rates[r][a].ms, now));
+        }
+    }
+    return (n < out_len) ? n : out_len - 1;
+}
+
+static int cmp_pending(const void *a, const void *b)
+{
+    uint64_t ga = ((const pending_ref_t *)a)->gen, gb = ((const pending_ref_t *)b)->gen;
+    return (ga > gb) - (ga < gb);
+}
+
+// Build the next MQTT batch from tags read since the MQTT cursor, oldest
+// first. The batch stops at the first tag that does not fit and the cursor
+// moves to the last tag written, so the rest follow in the next batch. A tag
+// read again while the batch is built has a newer generation and stays pending.
+int tag_store_table_get_batch_json(tag_table_t *tb, char *out, int out_len, int max_tags,
+                                   tag_batch_info_t *info)
+{
+    tag_batch_info_t local = {0};
+    if (!info) info = &local;
+    memset(info, 0, sizeof(*info));
+    if (!out || out_len <= 64 || max_tags <= 0 || !tb->tags) return 0;
+
+    consumer_state_t mq;
+    consumer_snapshot(tb, TAG_CONSUMER_MQTT, &mq);
+    uint64_t end_gen = mq.active ? UINT64_MAX : mq.stop_gen;
+    bool suppress = seen_filter_mode() == SEEN_MODE_SUPPRESS;
+    uint16_t min_reads = tag_rules_min_reads();
+
+    // Pending slots, then sorted by generation
+    int npend = 0, count = 0;
+    tag_item_t t;
+    for (int i = 0; i < tb->capacity; ++i) {
+        slot_snapshot(tb, i, &t);
+        if (t.epc[0] == '\0') continue;
+        if (t.gen > mq.start_gen) count++;
+        if (t.gen <= mq.cursor || t.gen > end_gen) continue;
+        if ((suppress && t.returning) || t.count < min_reads) continue;
+        tb->pending[npend].gen = t.gen;
+        tb->pending[npend].idx = (int16_t)i;
+        tb->pending[npend].len = (uint8_t)strlen(t.epc);
+        npend++;
+    }
+    qsort(tb->pending, npend, sizeof(tb->pending[0]), cmp_pending);
+
+    int used = snprintf(out, out_len, "{\"active_tags\":%d,\"total_detections\":%lu,\"tags\":[",
+                        count, (unsigned long)(tb->total_tag_count - mq.total_base));
+    const bool trace = latency_trace_enabled();
+    const int reserve = trace ? 128 : 3; // "]}" + NUL, plus the trace object
+    uint32_t batch_us = latency_now_us();
+    uint32_t oldest_parse_us = 0, oldest_store_us = 0;
+    uint64_t cursor = mq.cursor;
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+
+    int k = 0;
+    for (; k < npend && info->tags < max_tags; ++k) {
+        const pending_ref_t *p = &tb->pending[k];
+        slot_snapshot(tb, p->idx, &t);
+        if (t.gen != p->gen) {
+            // Read again (or expired) since the scan: it is pending under its new generation
+            cursor = p->gen;
+            info->remaining_tags++;
+            info->remaining_bytes += entry_overhead() + p->len;
+            continue;
+        }
+
+        char entry[224 + EPC_DECODE_JSON_MAX + EPCDB_JSON_MAX];
+        char gs1[EPC_DECODE_JSON_MAX + 8];
+        char asset[EPCDB_JSON_MAX + 10];
+        int n = snprintf(entry, sizeof(entry),
+            "%s{\"epc\":\"%s\",\"rssi\":%d,\"ant\":%d,\"reader\":%d,\"readers\":%u,\"ts\":%llu,\"count\":%lu,\"rate\":%.2f%s%s%s}",
+            info->tags ? "," : "", t.epc, t.rssi, t.ant, t.reader, (unsigned)t.readers,
+            (unsigned long long)t.last_ms, (unsigned long)t.count, (double)rate_at(t.rate, t.last_ms, now),
+            t.returning ? ",\"seen\":true" : "", gs1_fragment(t.epc, gs1, sizeof(gs1)),
+            asset_fragment(t.epc, asset, sizeof(asset)));
+        if (n <= 0 || n >= (int)sizeof(entry) || used + n + reserve > out_len) break;
+
+        memcpy(out + used, entry, n);
+        used += n;
+        cursor = t.gen;
+        info->tags++;
+        info->bytes += entry_overhead() + p->len;
+
+        latency_record(LATENCY_STORE_TO_BATCH, t.trace_store_us, batch_us);
+        if (t.trace_rx_us && (!info->oldest_rx_us || batch_us - t.trace_rx_us > batch_us - info->oldest_rx_us)) {
+            info->oldest_rx_us = t.trace_rx_us;
+            oldest_parse_us = t.trace_parse_us;
+            oldest_store_us = t.trace_store_us;
+        }
+    }
+    for (; k < npend; ++k) {
+        info->remaining_tags++;
+        info->remaining_bytes += entry_overhead() + tb->pending[k].len;
+    }
+
+    // Never move back over a restart that happened while the batch was built
+    write_lock(tb);
+    if (cursor > tb->consumers[TAG_CONSUMER_MQTT].cursor) tb->consumers[TAG_CONSUMER_MQTT].cursor = cursor;
+    write_unlock(tb);
+
+    if (trace && info->oldest_rx_us) {
+        // Device uptime in microseconds (32-bit, wraps every ~71 min) of the oldest read
+        used += snprintf(out + used, out_len - used,
+                         "],\"trace\":{\"rx_us\":%lu,\"parse_us\":%lu,\"store_us\":%lu,\"batch_us\":%lu}}",
+                         (unsigned long)info->oldest_rx_us, (unsigned long)oldest_parse_us,
+                         (unsigned long)oldest_store_us, (unsigned long)batch_us);
+    } else {
+        used += snprintf(out + used, out_len - used, "]}");
+    }
+    return used;
+}
+
+int tag_store_get_batch_json(char *out, int out_len, int max_tags, tag_batch_info_t *info)
+{
+    return tag_store_table_get_batch_json(&s_live, out, out_len, max_tags, info);
+}
+
+// ---- Benchmark tables (bench.c) ----
+
+tag_table_t *tag_store_bench_create(int tags)
+{
+    if (tags <= 0 || tags > INT16_MAX) return NULL;
+    tag_table_t *tb = calloc(1, sizeof(*tb));
+    if (!tb) return NULL;
+    if (!alloc_tables(tb, tags, true) && !alloc_tables(tb, tags, false)) {
+        free(tb);
+        return NULL;
+    }
+    tb->write_lock = xSemaphoreCreateMutex();
+    if (!tb->write_lock) {
+        tag_store_bench_destroy(tb);
+        return NULL;
+    }
+    tb->lru_head = tb->lru_tail = -1;
+
+    // EPC-96s spread over the hash buckets, a few reads each, on every antenna
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+    for (int n = 0; n < tags; n++) {
+        char epc[25];
+        snprintf(epc, sizeof(epc), "E2801170%016llX", (unsigned long long)((uint64_t)(n + 1) * 0x9E3779B97F4A7C15ULL));
+        char evicted[64];
+        int i = alloc_tag_index(tb, evicted);   // Sized for every tag: never evicts
+        tag_item_t *t = &tb->tags[i];
+        init_slot(tb, i, epc, false);           // The live seen filter is not consulted
+        t->rssi = -40 - n % 30;
+        t->ant = 1 + n % 4;
+        t->reader = n % RFID_MAX_READERS;
+        t->readers = (uint8_t)(1u << t->reader);
+        t->last_ms = now;
+        t->count = 1 + n % 7;
+        t->rate = 1.0f;
+        t->gen = ++tb->gen;
+        t->trace_rx_us = t->trace_parse_us = t->trace_store_us = 0;
+        tb->total_tag_count += t->count;
+        tb->ant_rate[t->reader][t->ant - 1] = (rate_t){ .rate = 1.0f, .ms = now };
+        hash_insert(tb, i);
+        lru_push_tail(tb, i);
+    }
+
+    // Both views hold every bench tag; no batch or depart callbacks
+    for (int c = 0; c < TAG_CONSUMER_COUNT; c++) {
+        tb->consumers[c] = (consumer_state_t){ .stream = s_live.consumers[c].stream, .active = true };
+    }
+    return tb;
+}
+
+void tag_store_bench_rewind(tag_table_t *tb)
+{
+    write_lock(tb);
+    tb->consumers[TAG_CONSUMER_MQTT].cursor = 0;
+    write_unlock(tb);
+}
+
+void tag_store_bench_destroy(tag_table_t *tb)
+{
+    if (!tb || tb == &s_live) return;
+    if (tb->write_lock) vSemaphoreDelete(tb->write_lock);
+    free_tables(tb);
+    free(tb);
+}
@@ -0,0 +1,104 @@
+/* tag_store.h - deduplicating table of recently seen tags shared by all readers
+ *
+ * Each EPC has one slot no matter how many readers see it; the slot remembers
+ * the reader and antenna of the last read and a mask of every reader that saw
+ * it. Writers (one UART task per reader) serialize on a mutex; the web and MQTT
+ * serializers read per-slot seqlock snapshots and never block ingestion.
+ *
+ * Every read stamps its slot with the next store generation. Consumers do not
+ * own tags: each keeps its own generations (the read its view starts after, and
+ * for streaming consumers a cursor of what it has already sent), so starting or
+ * stopping one consumer never hides tags from another.
+ *
+ * Slots sit on an expiry list ordered by last read and in an EPC hash index,
+ * so lookups, expiry and eviction of the least recently read tag are O(1). */
+#ifndef TAG_STORE_H
+#define TAG_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A tag not read for this long departs (runtime setting, saved to NVS)
+#define TAG_STORE_DEFAULT_TIMEOUT_MS 30000
+#define TAG_STORE_MIN_TIMEOUT_MS     1000
+#define TAG_STORE_MAX_TIMEOUT_MS     3600000
+
+// Read rates are exponentially decayed with this time constant
+#define TAG_RATE_WINDOW_MS     10000
+#define TAG_RATE_MAX_ANTENNAS  8
+
+typedef enum {
+    TAG_CONSUMER_WEB = 0,   // Web tag list (view)
+    TAG_CONSUMER_MQTT,      // MQTT batches (stream with cursor)
+    TAG_CONSUMER_COUNT
+} tag_consumer_t;
+
+// Last state of a tag that expired
+typedef struct {
+    char epc[64];
+    int reader;          // Reader and antenna of the last read
+    int ant;
+    uint8_t readers;     // Bit per reader that saw it
+    bool returning;      // Already in the seen filter when it took its slot
+    uint32_t count;
+    uint64_t last_ms;    // Uptime of the last read
+    uint64_t gen;
+} tag_depart_t;
+
+void tag_store_init(void);   // Allocates the table (PSRAM when available) and loads the timeout
+int tag_store_capacity(void);
+
+// Record one read. rx_us / parse_us are the latency trace stamps of the read.
+// Returns whether the read may be reported: false while the tag has fewer than
+// the rule set's min_reads reads, or is returning in seen-filter suppress mode.
+bool tag_store_touch(const char *epc, int reader, int ant, int rssi, uint32_t rx_us, uint32_t parse_us);
+
+// Start a consumer: its view and detection count begin at the next read and a
+// stream consumer's cursor skips everything older. Stopping keeps the view; a
+// stream consumer still drains reads made before the stop.
+void tag_store_consumer_start(tag_consumer_t c);
+void tag_store_consumer_stop(tag_consumer_t c);
+uint32_t tag_store_total(tag_consumer_t c);   // Detections since the consumer started
+
+// Drop expired tags and report them to the consumers whose view held them.
+// Uplink task; returns ms until the next tag can expire.
+uint32_t tag_store_expire(void);
+void tag_store_set_timeout_ms(uint32_t ms);   // Clamped to the range above
+uint32_t tag_store_get_timeout_ms(void);
+
+// Tags read since the web consumer started, as {"active_tags","total_detections","antennas":[...],"tags":[...]};
+// reader < 0 = all readers
+int tag_store_get_json(char *out, int out_len, int reader);
+
+// Per reader antenna read rates as a JSON array of {"reader","ant","rate"}
+int tag_store_get_antenna_rates_json(char *out, int out_len);
+// reader_rfid_antenna_read_rate gauges for GET /metrics
+int tag_store_render_prometheus(char *out, int out_len);
+
+// MQTT batch of tags read since the MQTT cursor, oldest first
+typedef struct {
+    int tags;                 // Tags written to this batch
+    uint32_t bytes;           // Estimated size of those tags (as counted when marked)
+    int remaining_tags;       // Still pending (over max_tags or out of space)
+    uint32_t remaining_bytes; // Estimated JSON size of the remaining tags
+    uint32_t oldest_rx_us;    // UART arrival of the oldest read in the batch (0 if untraced)
+} tag_batch_info_t;
+int tag_store_get_batch_json(char *out, int out_len, int max_tags, tag_batch_info_t *info);
+
+// A tag table. The readers feed a single live table that the functions above
+// work on; the bench builds private ones.
+typedef struct tag_table tag_table_t;
+
+// tag_store_get_json / tag_store_get_batch_json on a given table
+int tag_store_table_get_json(tag_table_t *tb, char *out, int out_len, int reader);
+int tag_store_table_get_batch_json(tag_table_t *tb, char *out, int out_len, int max_tags,
+                                   tag_batch_info_t *info);
+
+// Benchmarks only (bench.c): a private table of `tags` synthetic EPCs, each
+// read once and pending for both consumers. The live table, its consumers and
+// the MQTT batch are never touched. NULL if it cannot be allocated.
+tag_table_t *tag_store_bench_create(int tags);
+void tag_store_bench_rewind(tag_table_t *tb);    // Every bench tag pending for the MQTT batch again
+void tag_store_bench_destroy(tag_table_t *tb);
+
+#endif // TAG_STORE_H
@@ -0,0 +1,434 @@
+#include "tag_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "lwip/sockets.h"
+#include "nvs.h"
+#include "metrics.h"
+#include "latency.h"
+
+static const char *TAG = "STREAM";
+static const char *NVS_NAMESPACE = "stream";
+
+#define FRAME_HEADER   19              // Everything before the EPC
+#define FRAME_MAX      (FRAME_HEADER + 32)
+#define MCAST_SLOT     TAG_STREAM_MAX_CLIENTS
+#define SLOT_COUNT     (TAG_STREAM_MAX_CLIENTS + 1)
+#define DATAGRAM_MAX   1400
+#define IDLE_WAIT_MS   20              // Accept / close polling while nothing is sent
+#define BACKLOG_WAIT_MS 2              // A socket was full: retry soon
+
+// One ring per TCP client plus one for the multicast group. The RX tasks
+// append whole frames under s_lock; only the stream task moves tail.
+typedef struct {
+    int fd;                  // -1 = free
+    bool active;             // Producer appends only to active rings
+    uint8_t *ring;
+    uint32_t head, tail;     // Monotonic byte positions
+    uint32_t next_frame;     // Start of the first frame not yet fully sent
+    uint32_t frames;
+    uint32_t dropped;
+    uint64_t bytes;
+    uint64_t since_ms;
+    char peer[24];
+} stream_slot_t;
+
+static tag_stream_config_t s_cfg = {
+    .port = TAG_STREAM_DEFAULT_PORT,
+    .mcast = false,
+    .mcast_addr = TAG_STREAM_DEFAULT_MCAST_ADDR,
+    .mcast_port = TAG_STREAM_DEFAULT_MCAST_PORT,
+};
+static volatile uint32_t s_cfg_gen = 0;   // s_cfg and s_cfg_gen change together under s_lock
+
+static stream_slot_t s_slots[SLOT_COUNT];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile int s_active = 0;     // Active rings; 0 keeps the ingest path to one load
+static uint32_t s_seq = 0;
+static TaskHandle_t s_task = NULL;
+
+static inline uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000ULL);
+}
+
+static void put_be16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = (uint8_t)v; }
+static void put_be32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = (uint8_t)v; }
+static uint32_t get_be32(const uint8_t *p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+// Copy n bytes starting at ring position pos (wraps)
+static void ring_peek(const stream_slot_t *s, uint32_t pos, uint8_t *out, uint32_t n)
+{
+    uint32_t off = pos % TAG_STREAM_RING_BYTES;
+    uint32_t first = TAG_STREAM_RING_BYTES - off;
+    if (first > n) first = n;
+    memcpy(out, s->ring + off, first);
+    memcpy(out + first, s->ring, n - first);
+}
+
+void tag_stream_read(int reader, int ant, int rssi, const uint8_t *epc, size_t len, uint32_t rx_us)
+{
+    if (s_active == 0 || !epc || len == 0) return;
+    if (len > FRAME_MAX - FRAME_HEADER) len = FRAME_MAX - FRAME_HEADER;
+
+    uint8_t frame[FRAME_MAX];
+    uint32_t n = FRAME_HEADER + (uint32_t)len;
+    put_be16(frame, (uint16_t)(n - 2));
+    frame[2] = TAG_STREAM_EVENT_READ;
+    frame[3] = (uint8_t)reader;
+    frame[4] = (uint8_t)ant;
+    frame[5] = (uint8_t)(int8_t)rssi;
+    put_be32(frame + 10, (uint32_t)now_ms());
+    put_be32(frame + 14, rx_us);
+    frame[18] = (uint8_t)len;
+    memcpy(frame + FRAME_HEADER, epc, len);
+
+    uint32_t dropped = 0;
+    portENTER_CRITICAL(&s_lock);
+    put_be32(frame + 6, ++s_seq);
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        stream_slot_t *s = &s_slots[i];
+        if (!s->active) continue;
+        if (TAG_STREAM_RING_BYTES - (s->head - s->tail) < n) {
+            s->dropped++;
+            dropped++;
+            continue;
+        }
+        uint32_t off = s->head % TAG_STREAM_RING_BYTES;
+        uint32_t first = TAG_STREAM_RING_BYTES - off;
+        if (first > n) first = n;
+        memcpy(s->ring + off, frame, first);
+        memcpy(s->ring, frame + first, n - first);
+        s->head += n;
+        s->frames++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (dropped) metrics_add(METRIC_STREAM_DROPPED_FRAMES, dropped);
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+static bool slot_open(int i, int fd, const char *peer)
+{
+    stream_slot_t *s = &s_slots[i];
+    uint8_t *ring = heap_caps_malloc(TAG_STREAM_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ring) ring = malloc(TAG_STREAM_RING_BYTES);
+    if (!ring) return false;
+
+    portENTER_CRITICAL(&s_lock);
+    s->fd = fd;
+    s->ring = ring;
+    s->head = s->tail = s->next_frame = 0;
+    s->frames = s->dropped = 0;
+    s->bytes = 0;
+    s->since_ms = now_ms();
+    strncpy(s->peer, peer, sizeof(s->peer) - 1);
+    s->peer[sizeof(s->peer) - 1] = '\0';
+    s->active = true;
+    s_active++;
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+static void slot_close(int i)
+{
+    stream_slot_t *s = &s_slots[i];
+    if (s->fd < 0) return;
+    portENTER_CRITICAL(&s_lock);
+    s->active = false;
+    s_active--;
+    uint8_t *ring = s->ring;
+    s->ring = NULL;
+    int fd = s->fd;
+    s->fd = -1;
+    portEXIT_CRITICAL(&s_lock);
+
+    close(fd);
+    free(ring);
+    if (i != MCAST_SLOT) {
+        metrics_set(METRIC_STREAM_CLIENTS, (uint32_t)(s_active - (s_slots[MCAST_SLOT].active ? 1 : 0)));
+        ESP_LOGI(TAG, "Client %s closed (%lu frames, %lu dropped)", s->peer,
+                 (unsigned long)s->frames, (unsigned long)s->dropped);
+    }
+}
+
+// Frames fully written since the last call: record read -> socket latency
+static void account_sent(stream_slot_t *s, uint32_t sent_to, uint32_t now_us)
+{
+    uint8_t hdr[FRAME_HEADER];
+    while (sent_to - s->next_frame >= FRAME_HEADER) {
+        ring_peek(s, s->next_frame, hdr, FRAME_HEADER);
+        uint32_t len = 2u + (((uint32_t)hdr[0] << 8) | hdr[1]);
+        if (sent_to - s->next_frame < len) break;
+        latency_record(LATENCY_READ_TO_STREAM, get_be32(hdr + 14), now_us);
+        s->next_frame += len;
+    }
+}
+
+// Write as much of a client's ring as its socket takes. Returns false once
+// the client has gone.
+static bool flush_client(stream_slot_t *s, bool *backlog)
+{
+    for (;;) {
+        portENTER_CRITICAL(&s_lock);
+        uint32_t head = s->head;
+        portEXIT_CRITICAL(&s_lock);
+        uint32_t avail = head - s->tail;
+        if (avail == 0) return true;
+
+        uint32_t off = s->tail % TAG_STREAM_RING_BYTES;
+        uint32_t chunk = TAG_STREAM_RING_BYTES - off;
+        if (chunk > avail) chunk = avail;
+        int ret = send(s->fd, s->ring + off, chunk, MSG_DONTWAIT);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                *backlog = true;
+                return true;
+            }
+            return false;
+        }
+        uint32_t tail = s->tail + (uint32_t)ret;
+        account_sent(s, tail, latency_now_us());
+        s->bytes += (uint32_t)ret;
+        portENTER_CRITICAL(&s_lock);
+        s->tail = tail;
+        portEXIT_CRITICAL(&s_lock);
+        if ((uint32_t)ret < chunk) {
+            *backlog = true;
+            return true;
+        }
+    }
+}
+
+// Pack whole frames into datagrams for the multicast group
+static void flush_mcast(stream_slot_t *s, const struct sockaddr_in *group)
+{
+    uint8_t dgram[DATAGRAM_MAX];
+    for (;;) {
+        portENTER_CRITICAL(&s_lock);
+        uint32_t head = s->head;
+        portEXIT_CRITICAL(&s_lock);
+        uint32_t used = 0, pos = s->tail;
+        while (head - pos >= 2) {
+            uint8_t lenb[2];
+            ring_peek(s, pos, lenb, 2);
+            uint32_t len = 2u + (((uint32_t)lenb[0] << 8) | lenb[1]);
+            if (used + len > sizeof(dgram)) break;
+            ring_peek(s, pos, dgram + used, len);
+            used += len;
+            pos += len;
+        }
+        if (used == 0) return;
+        // A multicast frame that cannot be sent is dropped, never retried
+        if (sendto(s->fd, dgram, used, MSG_DONTWAIT, (const struct sockaddr *)group, sizeof(*group)) < 0) {
+            s->dropped++;
+            metrics_inc(METRIC_STREAM_DROPPED_FRAMES);
+            s->next_frame = pos;
+        } else {
+            s->bytes += used;
+            account_sent(s, pos, latency_now_us());
+        }
+        portENTER_CRITICAL(&s_lock);
+        s->tail = pos;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static int open_listener(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 2) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on TCP %u (errno %d)", (unsigned)port, errno);
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    ESP_LOGI(TAG, "Listening on TCP %u", (unsigned)port);
+    return fd;
+}
+
+static void accept_clients(int listen_fd)
+{
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        int fd = accept(listen_fd, (struct sockaddr *)&peer, &plen);
+        if (fd < 0) return;
+
+        char name[24];
+        inet_ntop(AF_INET, &peer.sin_addr, name, sizeof(name));
+        int free_slot = -1;
+        for (int i = 0; i < TAG_STREAM_MAX_CLIENTS; i++) {
+            if (s_slots[i].fd < 0) { free_slot = i; break; }
+        }
+        if (free_slot < 0) {
+            ESP_LOGW(TAG, "Rejecting %s: %d clients connected", name, TAG_STREAM_MAX_CLIENTS);
+            close(fd);
+            continue;
+        }
+
+        // Small frames go out at once; a dead peer is noticed by keepalive
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if (!slot_open(free_slot, fd, name)) {
+            ESP_LOGE(TAG, "No memory for a stream ring");
+            close(fd);
+            continue;
+        }
+        metrics_set(METRIC_STREAM_CLIENTS, (uint32_t)(s_active - (s_slots[MCAST_SLOT].active ? 1 : 0)));
+        ESP_LOGI(TAG, "Client %s connected", name);
+    }
+}
+
+// Clients never send; a readable socket means EOF or an error
+static bool client_alive(int fd)
+{
+    uint8_t buf[32];
+    int ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (ret > 0) return true;
+    return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void close_all(int *listen_fd)
+{
+    for (int i = 0; i < SLOT_COUNT; i++) slot_close(i);
+    if (*listen_fd >= 0) close(*listen_fd);
+    *listen_fd = -1;
+}
+
+static void stream_task(void *arg)
+{
+    int listen_fd = -1;
+    uint32_t gen = UINT32_MAX;
+    struct sockaddr_in group = { .sin_family = AF_INET };
+
+    for (;;) {
+        if (gen != s_cfg_gen) {
+            // (Re)open everything for the current config
+            portENTER_CRITICAL(&s_lock);
+            gen = s_cfg_gen;
+            tag_stream_config_t cfg = s_cfg;
+            portEXIT_CRITICAL(&s_lock);
+            close_all(&listen_fd);
+            if (cfg.port) listen_fd = open_listener(cfg.port);
+            if (cfg.mcast) {
+                int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+                uint8_t ttl = 1;   // Stay on the LAN
+                if (fd >= 0) setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+                group.sin_port = htons(cfg.mcast_port);
+                inet_pton(AF_INET, cfg.mcast_addr, &group.sin_addr);
+                if (fd < 0 || !slot_open(MCAST_SLOT, fd, cfg.mcast_addr)) {
+                    ESP_LOGE(TAG, "Multicast to %s:%u unavailable", cfg.mcast_addr, (unsigned)cfg.mcast_port);
+                    if (fd >= 0) close(fd);
+                } else {
+                    ESP_LOGI(TAG, "Multicast to %s:%u", cfg.mcast_addr, (unsigned)cfg.mcast_port);
+                }
+            }
+        }
+
+        if (listen_fd >= 0) accept_clients(listen_fd);
+
+        bool backlog = false;
+        for (int i = 0; i < TAG_STREAM_MAX_CLIENTS; i++) {
+            stream_slot_t *s = &s_slots[i];
+            if (s->fd < 0) continue;
+            if (!flush_client(s, &backlog) || !client_alive(s->fd)) slot_close(i);
+        }
+        if (s_slots[MCAST_SLOT].fd >= 0) flush_mcast(&s_slots[MCAST_SLOT], &group);
+
+        // Each read notifies the task, so frames leave within a wakeup
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(backlog ? BACKLOG_WAIT_MS : IDLE_WAIT_MS));
+    }
+}
+
+void tag_stream_init(void)
+{
+    for (int i = 0; i < SLOT_COUNT; i++) s_slots[i].fd = -1;
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    uint8_t mcast;
+    nvs_get_u16(h, "port", &s_cfg.port);
+    if (nvs_get_u8(h, "mcast", &mcast) == ESP_OK) s_cfg.mcast = mcast != 0;
+    size_t len = sizeof(s_cfg.mcast_addr);
+    nvs_get_str(h, "mcast_addr", s_cfg.mcast_addr, &len);
+    nvs_get_u16(h, "mcast_port", &s_cfg.mcast_port);
+    nvs_close(h);
+}
+
+void tag_stream_start(void)
+{
+    if (s_task) return;
+    // Above the uplink task: the stream is the low-latency path
+    xTaskCreate(stream_task, "tag_stream", 4096, NULL, 6, &s_task);
+}
+
+void tag_stream_get_config(tag_stream_config_t *cfg)
+{
+    if (!cfg) return;
+    portENTER_CRITICAL(&s_lock);
+    *cfg = s_cfg;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int tag_stream_set_config(const tag_stream_config_t *cfg)
+{
+    if (!cfg) return -1;
+    struct in_addr a;
+    if (inet_pton(AF_INET, cfg->mcast_addr, &a) != 1 || (ntohl(a.s_addr) >> 28) != 0xE) return -1;
+    if (cfg->mcast && cfg->mcast_port == 0) return -1;
+
+    portENTER_CRITICAL(&s_lock);
+    s_cfg = *cfg;
+    s_cfg_gen++;
+    portEXIT_CRITICAL(&s_lock);
+    if (s_task) xTaskNotifyGive(s_task);
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return 0;
+    nvs_set_u16(h, "port", cfg->port);
+    nvs_set_u8(h, "mcast", cfg->mcast ? 1 : 0);
+    nvs_set_str(h, "mcast_addr", cfg->mcast_addr);
+    nvs_set_u16(h, "mcast_port", cfg->mcast_port);
+    nvs_commit(h);
+    nvs_close(h);
+    return 0;
+}
+
+int tag_stream_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+    tag_stream_config_t cfg;
+    tag_stream_get_config(&cfg);
+    int n = snprintf(out, out_len,
+                     "{\"port\":%u,\"mcast\":%s,\"mcast_addr\":\"%s\",\"mcast_port\":%u,\"ring_bytes\":%d,\"seq\":%lu,\"clients\":[",
+                     (unsigned)cfg.port, cfg.mcast ? "true" : "false", cfg.mcast_addr,
+                     (unsigned)cfg.mcast_port, TAG_STREAM_RING_BYTES, (unsigned long)s_seq);
+    bool first = true;
+    uint64_t now = now_ms();
+    for (int i = 0; i < SLOT_COUNT && n < out_len; i++) {
+        portENTER_CRITICAL(&s_lock);
+        stream_slot_t s = s_slots[i];
+        portEXIT_CRITICAL(&s_lock);
+        if (s.fd < 0) continue;
+        n += snprintf(out + n, out_len - n,
+                      "%s{\"peer\":\"%s\",\"mcast\":%s,\"connected_s\":%llu,\"frames\":%lu,\"dropped\":%lu,\"bytes\":%llu,\"queued_bytes\":%lu}",
+                      first ? "" : ",", s.peer, i == MCAST_SLOT ? "true" : "false",
+                      (unsigned long long)((now - s.since_ms) / 1000), (unsigned long)s.frames,
+                      (unsigned long)s.dropped, (unsigned long long)s.bytes, (unsigned long)(s.head - s.tail));
+        first = false;
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]}");
+    return (n < out_len) ? n : out_len - 1;
+}
@@ -0,0 +1,46 @@
+/* tag_stream.h - low-latency binary tag stream for LAN consumers (TCP and UDP multicast)
+ *
+ * Every accepted read is framed once on the ingest path and copied into a
+ * ring per connected client; the stream task wakes on each read and writes
+ * the rings to the sockets, so nothing waits on the MQTT broker or a poll.
+ *
+ * Frame (network byte order):
+ *   u16 length of the rest | u8 type (1 = read) | u8 reader | u8 antenna |
+ *   i8 rssi | u32 sequence | u32 uptime ms | u32 rx us | u8 epc length | epc
+ * A TCP client that falls a ring behind loses whole frames (counted) and the
+ * sequence number shows the gap. UDP datagrams pack whole frames. */
+#ifndef TAG_STREAM_H
+#define TAG_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAG_STREAM_DEFAULT_PORT       5050
+#define TAG_STREAM_DEFAULT_MCAST_PORT 5051
+#define TAG_STREAM_DEFAULT_MCAST_ADDR "239.255.50.50"
+#define TAG_STREAM_MAX_CLIENTS        4
+#define TAG_STREAM_RING_BYTES         16384
+#define TAG_STREAM_EVENT_READ         1
+#define TAG_STREAM_JSON_MAX           1024
+
+typedef struct {
+    uint16_t port;            // TCP listener; 0 = off
+    bool mcast;               // Also send every frame to the multicast group
+    char mcast_addr[16];
+    uint16_t mcast_port;
+} tag_stream_config_t;
+
+void tag_stream_init(void);    // Loads the config from NVS
+void tag_stream_start(void);   // Starts the stream task (needs the network stack)
+
+// Ingest path: one accepted read (called by the reader RX tasks)
+void tag_stream_read(int reader, int ant, int rssi, const uint8_t *epc, size_t len, uint32_t rx_us);
+
+void tag_stream_get_config(tag_stream_config_t *cfg);
+int tag_stream_set_config(const tag_stream_config_t *cfg);   // Applies and saves; -1 if the group address is invalid
+
+// Config, per-client counters and ring usage as JSON
+int tag_stream_get_json(char *out, int out_len);
+
+#endif // TAG_STREAM_H
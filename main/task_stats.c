@@ -0,0 +1,146 @@
+#include "task_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "TASK_STATS";
+
+#define TASK_STATS_MAX_TASKS 40
+
+// Run time of each task at the previous call, keyed by task number
+typedef struct {
+    UBaseType_t number;
+    uint32_t run_time;
+} task_sample_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static task_sample_t s_prev[TASK_STATS_MAX_TASKS];
+static int s_prev_count = 0;
+static uint32_t s_prev_total = 0;
+
+static const char *task_state_name(eTaskState state)
+{
+    switch (state) {
+        case eRunning:   return "running";
+        case eReady:     return "ready";
+        case eBlocked:   return "blocked";
+        case eSuspended: return "suspended";
+        case eDeleted:   return "deleted";
+        default:         return "unknown";
+    }
+}
+
+static int heap_json(char *out, int out_len, const char *name, uint32_t caps)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, caps);
+    return snprintf(out, out_len,
+                    "\"%s\":{\"total\":%lu,\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu}",
+                    name, (unsigned long)heap_caps_get_total_size(caps),
+                    (unsigned long)info.total_free_bytes, (unsigned long)info.minimum_free_bytes,
+                    (unsigned long)info.largest_free_block);
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t prev_run_time(UBaseType_t number, const task_sample_t *prev, int prev_count, bool *found)
+{
+    for (int i = 0; i < prev_count; i++) {
+        if (prev[i].number == number) {
+            *found = true;
+            return prev[i].run_time;
+        }
+    }
+    *found = false;
+    return 0;
+}
+
+static int tasks_json(char *out, int out_len)
+{
+    UBaseType_t max = uxTaskGetNumberOfTasks() + 4;   // Room for tasks created meanwhile
+    if (max > TASK_STATS_MAX_TASKS) max = TASK_STATS_MAX_TASKS;
+    TaskStatus_t *tasks = malloc(max * sizeof(TaskStatus_t));
+    if (!tasks) return snprintf(out, out_len, "\"error\":\"no memory\"");
+
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, max, &total);
+
+    // Take the previous sample and store this one
+    task_sample_t prev[TASK_STATS_MAX_TASKS];
+    int prev_count;
+    uint32_t prev_total;
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(prev, s_prev, sizeof(prev));
+    prev_count = s_prev_count;
+    prev_total = s_prev_total;
+    for (UBaseType_t i = 0; i < count; i++) {
+        s_prev[i].number = tasks[i].xTaskNumber;
+        s_prev[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    s_prev_count = count;
+    s_prev_total = total;
+    taskEXIT_CRITICAL(&s_lock);
+
+    // Run-time counters tick in esp_timer microseconds on every core
+    uint32_t window = total - prev_total;
+    uint64_t capacity = (uint64_t)(window ? window : 1) * portNUM_PROCESSORS;
+
+    int n = snprintf(out, out_len, "\"window_ms\":%lu,\"cores\":%d,\"tasks\":[",
+                     (unsigned long)(window / 1000), portNUM_PROCESSORS);
+    for (UBaseType_t i = 0; i < count && n < out_len; i++) {
+        const TaskStatus_t *t = &tasks[i];
+        bool found;
+        uint32_t before = prev_run_time(t->xTaskNumber, prev, prev_count, &found);
+        uint32_t ran = found ? t->ulRunTimeCounter - before : t->ulRunTimeCounter;
+        uint32_t pct_x10 = (uint32_t)((uint64_t)ran * 1000 / capacity);
+
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        BaseType_t core = t->xCoreID;
+#else
+        BaseType_t core = xTaskGetCoreID(t->xHandle);
+#endif
+        n += snprintf(out + n, out_len - n,
+                      "%s{\"name\":\"%s\",\"state\":\"%s\",\"prio\":%u,\"core\":%d,"
+                      "\"cpu_pct\":%lu.%lu,\"stack_free_min\":%lu}",
+                      i ? "," : "", t->pcTaskName, task_state_name(t->eCurrentState),
+                      (unsigned)t->uxCurrentPriority, (core == tskNO_AFFINITY) ? -1 : (int)core,
+                      (unsigned long)(pct_x10 / 10), (unsigned long)(pct_x10 % 10),
+                      (unsigned long)t->usStackHighWaterMark);
+    }
+    if (n < out_len) n += snprintf(out + n, out_len - n, "]");
+
+    free(tasks);
+    return n;
+}
+#endif
+
+int task_stats_get_json(char *out, int out_len)
+{
+    if (!out || out_len <= 0) return 0;
+
+    int n = snprintf(out, out_len, "{\"uptime_ms\":%lu,",
+                     (unsigned long)(esp_timer_get_time() / 1000ULL));
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    if (n < out_len) n += tasks_json(out + n, out_len - n);
+#else
+    if (n < out_len) n += snprintf(out + n, out_len - n,
+        "\"error\":\"enable CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\"");
+#endif
+    if (n < out_len) n += snprintf(out + n, out_len - n, ",\"heap\":{");
+    if (n < out_len) n += heap_json(out + n, out_len - n, "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (n < out_len) n += snprintf(out + n, out_len - n, ",");
+    if (n < out_len) n += heap_json(out + n, out_len - n, "psram", MALLOC_CAP_SPIRAM);
+    if (n < out_len) n += snprintf(out + n, out_len - n, "}}");
+
+    if (n >= out_len) {
+        ESP_LOGW(TAG, "Task stats truncated at %d bytes", out_len);
+        return out_len - 1;
+    }
+    return n;
+}
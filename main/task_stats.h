@@ -0,0 +1,11 @@
+/* task_stats.h - per-task CPU, stack high-water marks and heap usage */
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+// Tasks and heap as JSON. CPU% covers the time since the previous call
+// (or since boot on the first call) and is a share of all cores.
+int task_stats_get_json(char *out, int out_len);
+
+#define TASK_STATS_JSON_MAX 4096
+
+#endif // TASK_STATS_H
@@ -8,21 +8,38 @@
 #include "freertos/queue.h"
 #include "driver/uart.h"
 #include "esp_log.h"
-#include "rfid.h"
+#include "metrics.h"
+#include "latency.h"
 
 static const char *TAG = "UART";
 
-// UART pins and settings (kept from original)
-#define UART_PORT UART_NUM_1
+// UART settings (kept from original)
 #define BUF_SIZE (4096)  // Increased buffer size for high-speed tag data
 
-static QueueHandle_t uart_queue;
-static char rx_buffer[BUF_SIZE];
-static int rx_buffer_len = 0;
-static bool uart_initialized = false;
+typedef struct {
+    bool initialized;
+    int port;
+    QueueHandle_t queue;
+    uart_rx_fn on_rx;
+    void *ctx;
+    char *rx_buffer;     // Hex dump of recent traffic for GET /data
+    int rx_buffer_len;
+} uart_ctx_t;
 
-void uart_init(int UART_TXD, int UART_RXD)
+static uart_ctx_t s_uarts[UART_NUM_MAX];
+
+static uart_ctx_t *uart_ctx(int port)
+{
+    if (port < 0 || port >= UART_NUM_MAX || !s_uarts[port].initialized) return NULL;
+    return &s_uarts[port];
+}
+
+int uart_open(int port, int txd, int rxd, uart_rx_fn on_rx, void *ctx)
 {
+    if (port < 0 || port >= UART_NUM_MAX) return -1;
+    uart_ctx_t *u = &s_uarts[port];
+    if (u->initialized) return 0;
+
     // Try common RFID reader settings first
     uart_config_t uart_config = {
         .baud_rate = 115200,         
@@ -33,60 +50,61 @@ void uart_init(int UART_TXD, int UART_RXD)
         .source_clk = UART_SCLK_APB,
     };
 
-    ESP_ERROR_CHECK(uart_driver_install(UART_PORT, BUF_SIZE * 4, BUF_SIZE * 4, 30, &uart_queue, 0));
-    ESP_ERROR_CHECK(uart_param_config(UART_PORT, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(UART_PORT, UART_TXD, UART_RXD, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    u->rx_buffer = (char*) malloc(BUF_SIZE);
+    if (!u->rx_buffer) return -1;
 
-    uart_initialized = true;
-    ESP_LOGI(TAG, "UART initialized on TXD=%d, RXD=%d, baud=%d", UART_TXD, UART_RXD, uart_config.baud_rate);
+    esp_err_t err = uart_driver_install(port, BUF_SIZE * 4, BUF_SIZE * 4, 30, &u->queue, 0);
+    if (err == ESP_OK) err = uart_param_config(port, &uart_config);
+    if (err == ESP_OK) err = uart_set_pin(port, txd, rxd, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "UART%d init failed (%d)", port, err);
+        free(u->rx_buffer);
+        u->rx_buffer = NULL;
+        return -1;
+    }
+
+    u->port = port;
+    u->on_rx = on_rx;
+    u->ctx = ctx;
+    u->rx_buffer_len = 0;
+    u->initialized = true;
+    ESP_LOGI(TAG, "UART%d initialized on TXD=%d, RXD=%d, baud=%d", port, txd, rxd, uart_config.baud_rate);
+    return 0;
 }
 
-void uart_send_bytes(const char *data, size_t len)
+int uart_send_bytes(int port, const char *data, size_t len)
 {
-    if (data == NULL || len == 0) return;
+    if (data == NULL || len == 0) return -1;
     
     // Check if UART driver is initialized
-    if (!uart_initialized) {
-        ESP_LOGE(TAG, "UART not initialized, cannot send data");
-        return;
-    }
-    
-    // Capture command for status display
-    char cmd_str[512] = "TX: ";
-    size_t offset = 4; // Start after "TX: "
-    
-    for (size_t i = 0; i < len && offset < sizeof(cmd_str) - 4; i++) {
-        snprintf(cmd_str + offset, sizeof(cmd_str) - offset, "%02X ", (uint8_t)data[i]);
-        offset += 3; // Each byte takes 3 characters ("XX ")
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) {
+        ESP_LOGE(TAG, "UART%d not initialized, cannot send data", port);
+        return -1;
     }
     
-    // Remove trailing space and add null terminator
-    if (offset > 4) {
-        cmd_str[offset - 1] = '\0';
-    }
-    
-    // Update the last command in RFID status
-    rfid_set_last_command(cmd_str);
-    
-    // Send the actual command
-    int bytes_written = uart_write_bytes(UART_PORT, data, len);
+    int bytes_written = uart_write_bytes(u->port, data, len);
     if (bytes_written < 0) {
-        ESP_LOGE(TAG, "UART write failed with error %d: %s", bytes_written, cmd_str);
-    } else {
-        ESP_LOGI(TAG, "UART sent %d bytes: %s", bytes_written, cmd_str);
+        ESP_LOGE(TAG, "UART%d write failed with error %d", port, bytes_written);
     }
+    return bytes_written;
 }
 
-int uart_get_rx_data(char *dest, int max_len)
+int uart_get_rx_data(int port, char *dest, int max_len)
 {
     if (dest == NULL || max_len <= 0) return 0;
-    int to_copy = rx_buffer_len;
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) {
+        dest[0] = '\0';
+        return 0;
+    }
+    int to_copy = u->rx_buffer_len;
     if (to_copy > max_len - 1) to_copy = max_len - 1;
     if (to_copy > 0) {
-        memcpy(dest, rx_buffer, to_copy);
+        memcpy(dest, u->rx_buffer, to_copy);
         dest[to_copy] = '\0';
         // clear internal buffer
-        rx_buffer_len = 0;
+        u->rx_buffer_len = 0;
     } else {
         if (max_len > 0) dest[0] = '\0';
     }
@@ -95,49 +113,61 @@ int uart_get_rx_data(char *dest, int max_len)
 
 static void uart_rx_task(void *arg)
 {
-    ESP_LOGI(TAG, "UART RX task started and waiting for data...");
+    uart_ctx_t *u = (uart_ctx_t *)arg;
+    ESP_LOGI(TAG, "UART%d RX task started and waiting for data...", u->port);
     uart_event_t event;
     uint8_t* dtmp = (uint8_t*) malloc(BUF_SIZE);
+    if (!dtmp) {
+        ESP_LOGE(TAG, "UART%d RX task: no memory for read buffer", u->port);
+        vTaskDelete(NULL);
+        return;
+    }
+    int event_log_count = 0;
+    int immediate_yield_count = 0;
+    int packet_count = 0;
 
     while (1) {
         // Yield control more frequently to prevent watchdog timeout
-        if (xQueueReceive(uart_queue, (void *)&event, pdMS_TO_TICKS(100))) {
+        if (xQueueReceive(u->queue, (void *)&event, pdMS_TO_TICKS(100))) {
             // Reduce event logging to prevent console blocking during data floods
-            static int event_log_count = 0;
             if (++event_log_count % 500 == 0) {
-                ESP_LOGI(TAG, "UART event received, type: %d (count: %d)", event.type, event_log_count);
+                ESP_LOGI(TAG, "UART%d event received, type: %d (count: %d)", u->port, event.type, event_log_count);
             }
             
             switch (event.type) {
                 case UART_DATA: {
+                    uint32_t rx_us = latency_now_us();   // Start of the latency trace for these bytes
+                    
                     // Yield immediately to prevent watchdog timeout during high-speed processing
-                    static int immediate_yield_count = 0;
                     if (++immediate_yield_count % 3 == 0) {
                         vTaskDelay(pdMS_TO_TICKS(1));
                     }
                     
-                    int len = uart_read_bytes(UART_PORT, dtmp, event.size, portMAX_DELAY);
+                    metrics_inc(METRIC_UART_EVT_DATA);
+                    int len = uart_read_bytes(u->port, dtmp, event.size, portMAX_DELAY);
                     if (len > 0) {
+                        metrics_add(METRIC_UART_RX_BYTES, len);
+                        metrics_observe(METRIC_HIST_UART_READ_BYTES, len);
+                        
                         // Extremely minimal logging to prevent watchdog timeout
-                        static int packet_count = 0;
                         packet_count++;
                         
                         // Only print every 1000th packet during high-speed operation
                         if (packet_count % 1000 == 0) {
-                            printf("RX: %dk packets\n", packet_count / 1000);
+                            printf("RX%d: %dk packets\n", u->port, packet_count / 1000);
                             // Longer yield after console output
                             vTaskDelay(pdMS_TO_TICKS(5));
                         }
                         
                         // Process the data
-                        rfid_process_bytes(dtmp, len);
+                        if (u->on_rx) u->on_rx(u->ctx, dtmp, len, rx_us);
                         
                         // Simplified hex storage to reduce processing time during data floods
                         // Only store if there's enough space, otherwise skip to prevent blocking
                         int hex_space_needed = len * 3 + 10; // Simplified calculation
-                        if (rx_buffer_len + hex_space_needed < BUF_SIZE - 100) {
+                        if (u->rx_buffer_len + hex_space_needed < BUF_SIZE - 100) {
                             // Simple hex append without line breaks during high-speed operation
-                            char *write_pos = rx_buffer + rx_buffer_len;
+                            char *write_pos = u->rx_buffer + u->rx_buffer_len;
                             for (int i = 0; i < len && i < 32; i++) { // Limit to 32 bytes per packet
                                 write_pos += sprintf(write_pos, "%02X ", dtmp[i]);
                             }
@@ -145,10 +175,10 @@ static void uart_rx_task(void *arg)
                                 write_pos += sprintf(write_pos, "... ");
                             }
                             write_pos += sprintf(write_pos, "\n");
-                            rx_buffer_len = write_pos - rx_buffer;
+                            u->rx_buffer_len = write_pos - u->rx_buffer;
                         } else {
                             // Buffer getting full, clear old data
-                            rx_buffer_len = 0;
+                            u->rx_buffer_len = 0;
                         }
                         
                         // Yield every 5 packets to prevent watchdog timeout
@@ -156,25 +186,28 @@ static void uart_rx_task(void *arg)
                             vTaskDelay(pdMS_TO_TICKS(1));
                         }
                         
-                        ESP_LOGD(TAG, "UART RX: %d bytes processed", len);
+                        ESP_LOGD(TAG, "UART%d RX: %d bytes processed", u->port, len);
                     }
                     break;
                 }
                 case UART_FIFO_OVF:
-                    ESP_LOGW(TAG, "UART FIFO overflow - clearing buffer");
-                    uart_flush_input(UART_PORT);
-                    xQueueReset(uart_queue);
+                    metrics_inc(METRIC_UART_EVT_FIFO_OVF);
+                    ESP_LOGW(TAG, "UART%d FIFO overflow - clearing buffer", u->port);
+                    uart_flush_input(u->port);
+                    xQueueReset(u->queue);
                     // Clear our internal buffer too
-                    rx_buffer_len = 0;
+                    u->rx_buffer_len = 0;
                     break;
                 case UART_BUFFER_FULL:
-                    ESP_LOGW(TAG, "UART ring buffer full - clearing buffer");
-                    uart_flush_input(UART_PORT);
-                    xQueueReset(uart_queue);
+                    metrics_inc(METRIC_UART_EVT_BUFFER_FULL);
+                    ESP_LOGW(TAG, "UART%d ring buffer full - clearing buffer", u->port);
+                    uart_flush_input(u->port);
+                    xQueueReset(u->queue);
                     // Clear our internal buffer too
-                    rx_buffer_len = 0;
+                    u->rx_buffer_len = 0;
                     break;
                 default:
+                    metrics_inc(METRIC_UART_EVT_OTHER);
                     break;
             }
         } else {
@@ -185,11 +218,19 @@ static void uart_rx_task(void *arg)
     free(dtmp);
 }
 
-void uart_start_rx_task(void)
+int uart_start_rx_task(int port)
 {
-    printf("Starting UART RX task...\n");
+    uart_ctx_t *u = uart_ctx(port);
+    if (!u) return -1;
+
+    char name[16];
+    snprintf(name, sizeof(name), "uart_rx_%d", port);
     // Lower priority and larger stack for high-speed tag processing
     // Priority 5 instead of 10 to prevent blocking other tasks
-    xTaskCreate(uart_rx_task, "uart_rx_task", 8192, NULL, 5, NULL);
-    printf("UART RX task created\n");
+    if (xTaskCreate(uart_rx_task, name, 8192, u, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create %s", name);
+        return -1;
+    }
+    ESP_LOGI(TAG, "%s created", name);
+    return 0;
 }
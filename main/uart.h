@@ -1,12 +1,19 @@
-/* uart.h - UART module public API */
+/* uart.h - UART module public API
+ *
+ * One context per UART port: its driver queue, RX task and the hex dump served
+ * at GET /data. Received bytes are handed to the callback given to uart_open. */
 #ifndef UART_H
 #define UART_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-void uart_init(int UART_TXD, int UART_RXD);
-void uart_start_rx_task(void);
-int uart_get_rx_data(char *dest, int max_len); // copies data into dest and clears internal buffer, returns bytes copied
-void uart_send_bytes(const char *data, size_t len);
+// rx_us: latency_now_us() when the UART_DATA event was taken off the queue
+typedef void (*uart_rx_fn)(void *ctx, const uint8_t *buf, size_t len, uint32_t rx_us);
+
+int uart_open(int port, int txd, int rxd, uart_rx_fn on_rx, void *ctx);   // 0 on success, -1 on error
+int uart_start_rx_task(int port);
+int uart_get_rx_data(int port, char *dest, int max_len); // copies data into dest and clears internal buffer, returns bytes copied
+int uart_send_bytes(int port, const char *data, size_t len);   // Bytes written, -1 on error
 
 #endif // UART_H
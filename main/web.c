@@ -2,14 +2,21 @@
 #include <string.h>
 #include "esp_log.h"
 #include "esp_http_server.h"
-#include "uart.h"
 #include "wifi_config.h"
 #include "wifi.h"
 #include "mqtt_client.h"
 #include "mqtt_config.h"
 #include "rfid.h"
+#include "mqtt_batch.h"
+#include "boot.h"
+#include "metrics.h"
+#include "task_stats.h"
+#include "latency.h"
+#include "bench.h"
+#include "epcdb.h"
 #include <stdlib.h>
 #include "esp_random.h"
+#include "esp_heap_caps.h"
 
 static const char *TAG = "WEB";
 
@@ -63,6 +70,18 @@ static const char* HTML_CONTENT = R"rawliteral(
       <label>Password
         <input type="password" id="mqtt_password" placeholder="MQTT Password (optional)">
       </label>
+      <label>Broker CA (mqtts://)
+        <select id="ca_mode" style="width:100%; padding:8px; margin-top:4px; background:#1e2226; color:#eee; border:1px solid #444">
+          <option value="bundle">Certificate bundle</option>
+          <option value="pinned">Pinned CA certificate</option>
+        </select>
+      </label>
+      <label>Pinned CA certificate (PEM)
+        <textarea id="ca_pem" rows="4" placeholder="-----BEGIN CERTIFICATE-----" style="width:100%; margin-top:4px; box-sizing:border-box; background:#1e2226; color:#eee; border:1px solid #444"></textarea>
+      </label>
+      <div class="row">
+        <button type="button" onclick="uploadCa()">Upload CA</button>
+      </div>
       <div class="row">
         <button type="button" onclick="testMqtt()" style="background:#ff9800">Test Connection</button>
         <button type="submit">Save MQTT</button>
@@ -226,11 +245,20 @@ static const char* HTML_CONTENT = R"rawliteral(
       const broker_uri = encodeURIComponent(document.getElementById('broker_uri').value);
       const username = encodeURIComponent(document.getElementById('mqtt_username').value);
       const password = encodeURIComponent(document.getElementById('mqtt_password').value);
-      const body = `broker_uri=${broker_uri}&username=${username}&password=${password}`;
+      const ca_mode = encodeURIComponent(document.getElementById('ca_mode').value);
+      const body = `broker_uri=${broker_uri}&username=${username}&password=${password}&ca_mode=${ca_mode}`;
       await fetch('/mqtt-config', { method:'POST', headers:{'Content-Type':'application/x-www-form-urlencoded'}, body });
       fetchStatus();
     }
 
+    async function uploadCa(){
+      const pem = document.getElementById('ca_pem').value.trim();
+      if (!pem) return;
+      const r = await fetch('/mqtt-ca', { method:'POST', headers:{'Content-Type':'application/x-pem-file'}, body: pem + '\n' });
+      alert(r.ok ? 'CA certificate saved' : 'CA certificate rejected');
+      fetchStatus();
+    }
+
     async function testWifi(){
       const ssid = document.getElementById('ssid').value;
       const pass = document.getElementById('pass').value;
@@ -402,6 +430,7 @@ static const char* HTML_CONTENT = R"rawliteral(
           if (json.mqtt.broker_uri) document.getElementById('broker_uri').value = json.mqtt.broker_uri;
           if (json.mqtt.username) document.getElementById('mqtt_username').value = json.mqtt.username;
           if (json.mqtt.password) document.getElementById('mqtt_password').value = json.mqtt.password;
+          if (json.mqtt.ca_mode) document.getElementById('ca_mode').value = json.mqtt.ca_mode;
         }
       }catch(e){}
       // Load current power settings
@@ -437,14 +466,23 @@ static esp_err_t favicon_get_handler(httpd_req_t *req)
     return httpd_resp_send(req, (const char*)favicon_ico, sizeof(favicon_ico));
 }
 
-// HTTP GET handler - get UART data
+// Reader index from the ?reader= query parameter, or dflt when absent
+static int query_reader(httpd_req_t *req, int dflt)
+{
+  char query[64], val[8];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return dflt;
+  if (httpd_query_key_value(query, "reader", val, sizeof(val)) != ESP_OK) return dflt;
+  return atoi(val);
+}
+
+// HTTP GET handler - get UART data (?reader=, default 0)
 static esp_err_t data_get_handler(httpd_req_t *req)
 {
   /* Use heap for the response buffer to keep httpd task stack usage small */
   char *response = (char*) malloc(1024);
   if (!response) return ESP_ERR_HTTPD_ALLOC_MEM;
   memset(response, 0, 1024);
-  int len = uart_get_rx_data(response, 1024);
+  int len = rfid_get_rx_data(query_reader(req, 0), response, 1024);
   (void)len;
   httpd_resp_set_type(req, "text/plain");
   esp_err_t err = httpd_resp_send(req, response, strlen(response));
@@ -563,6 +601,7 @@ static esp_err_t mqtt_post_handler(httpd_req_t *req)
   buf[ret] = '\0';
   char *pair = strtok(buf, "&");
   char broker_uri[128] = {0}, username[64] = {0}, password[64] = {0};
+  int ca_mode = -1;
   while (pair) {
     char *eq = strchr(pair, '=');
     if (eq) {
@@ -573,6 +612,7 @@ static esp_err_t mqtt_post_handler(httpd_req_t *req)
       if (strcmp(k, "broker_uri") == 0) strncpy(broker_uri, dec, sizeof(broker_uri)-1);
       else if (strcmp(k, "username") == 0) strncpy(username, dec, sizeof(username)-1);
       else if (strcmp(k, "password") == 0) strncpy(password, dec, sizeof(password)-1);
+      else if (strcmp(k, "ca_mode") == 0) ca_mode = (strcmp(dec, "pinned") == 0) ? MQTT_CA_PINNED : MQTT_CA_BUNDLE;
     }
     pair = strtok(NULL, "&");
   }
@@ -582,8 +622,13 @@ static esp_err_t mqtt_post_handler(httpd_req_t *req)
   ESP_LOGI(TAG, "  username: '%s' (len: %d)", username, strlen(username));
   ESP_LOGI(TAG, "  password: '%s' (len: %d)", password, strlen(password));
 
-  // Create MQTT config structure
-  mqtt_config_t config = {0};
+  // Start from the current config so settings not on the form are kept
+  mqtt_config_t config;
+  mqtt_get_config(&config);
+  memset(config.broker_uri, 0, sizeof(config.broker_uri));
+  memset(config.username, 0, sizeof(config.username));
+  memset(config.password, 0, sizeof(config.password));
+  if (ca_mode >= 0) config.ca_mode = ca_mode;
   strncpy(config.broker_uri, broker_uri, sizeof(config.broker_uri)-1);
   strncpy(config.username, username, sizeof(config.username)-1);
   strncpy(config.password, password, sizeof(config.password)-1);
@@ -608,6 +653,38 @@ static esp_err_t mqtt_post_handler(httpd_req_t *req)
   return ESP_OK;
 }
 
+// HTTP POST handler - store the pinned broker CA (raw PEM body)
+static esp_err_t mqtt_ca_post_handler(httpd_req_t *req)
+{
+  if (req->content_len == 0 || req->content_len > MQTT_CA_PEM_MAX_LEN) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "PEM body required (max 4096 bytes)");
+    return ESP_FAIL;
+  }
+  char *pem = malloc(req->content_len + 1);
+  if (!pem) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  
+  size_t got = 0;
+  while (got < req->content_len) {
+    int ret = httpd_req_recv(req, pem + got, req->content_len - got);
+    if (ret <= 0) {
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+      free(pem);
+      return ESP_FAIL;
+    }
+    got += ret;
+  }
+  pem[got] = '\0';
+  
+  int err = mqtt_set_ca_pem(pem, got);
+  free(pem);
+  if (err != 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid CA certificate");
+    return ESP_FAIL;
+  }
+  httpd_resp_send(req, "OK", 2);
+  return ESP_OK;
+}
+
 // HTTP POST handler - test MQTT connection
 static esp_err_t mqtt_test_handler(httpd_req_t *req)
 {
@@ -673,17 +750,17 @@ static esp_err_t mqtt_test_handler(httpd_req_t *req)
   return ESP_OK;
 }
 
-// Inventory control handlers
+// Inventory control handlers (?reader=, default all readers)
 static esp_err_t inventory_start_handler(httpd_req_t *req)
 {
-  rfid_start_inventory_local();
+  rfid_start_inventory_local(query_reader(req, RFID_ALL_READERS));
   httpd_resp_send(req, "OK", 2);
   return ESP_OK;
 }
 
 static esp_err_t inventory_stop_handler(httpd_req_t *req)
 {
-  rfid_stop_inventory_local();
+  rfid_stop_inventory_local(query_reader(req, RFID_ALL_READERS));
   httpd_resp_send(req, "OK", 2);
   return ESP_OK;
 }
@@ -698,28 +775,51 @@ static esp_err_t status_get_handler(httpd_req_t *req)
   mqtt_get_config(&mqtt_cfg);
   
   const char *inv = rfid_get_local_status();  // Use local status only for web server
-  const char *last_cmd = rfid_get_last_command();
+  const char *last_cmd = rfid_get_last_command(0);
   const char *mqtt_status = mqtt_get_status();
   
-  char resp[1024];
+  mqtt_queue_stats_t q;
+  mqtt_get_queue_stats(&q);
+  mqtt_conn_metrics_t cm;
+  mqtt_get_conn_metrics(&cm);
+  
+  char readers[512];
+  rfid_get_readers_json(readers, sizeof(readers));
+  
+  char resp[2048];
   int wifi_configured = (ssid[0] != '\0');
   int mqtt_configured = (mqtt_cfg.broker_uri[0] != '\0');
   
   int len = snprintf(resp, sizeof(resp), 
-    "{\"inventory\":\"%s\",\"last_command\":\"%s\",\"wifi\":{\"configured\":%d,\"ssid\":\"%s\",\"pass\":\"%s\"},\"mqtt\":{\"configured\":%d,\"broker_uri\":\"%s\",\"username\":\"%s\",\"password\":\"%s\",\"status\":\"%s\"}}", 
-    inv, last_cmd, wifi_configured, ssid, pass, mqtt_configured, mqtt_cfg.broker_uri, mqtt_cfg.username, mqtt_cfg.password, mqtt_status);
+    "{\"inventory\":\"%s\",\"last_command\":\"%s\",\"readers\":%s,\"wifi\":{\"configured\":%d,\"ssid\":\"%s\",\"pass\":\"%s\"},\"mqtt\":{\"configured\":%d,\"broker_uri\":\"%s\",\"username\":\"%s\",\"password\":\"%s\",\"status\":\"%s\",\"ca_mode\":\"%s\",\"ca_pinned_stored\":%d,"
+    "\"queue\":{\"msgs\":%lu,\"bytes\":%lu,\"capacity\":%lu,\"dropped\":%lu,\"inflight\":%lu,\"acked\":%lu,\"policy\":\"%s\",\"psram\":%d},"
+    "\"conn\":{\"state\":\"%s\",\"attempts\":%lu,\"connects\":%lu,\"failures\":%lu,\"next_retry_ms\":%lu,"
+    "\"dns_ms\":%lu,\"session_ms\":%lu,\"total_ms\":%lu,\"rtt_ms\":%lu,"
+    "\"est\":{\"tcp_ms\":%lu,\"tls_ms\":%lu,\"connack_ms\":%lu},"
+    "\"tls\":{\"tickets\":%d,\"full\":%lu,\"ticket_offered\":%lu,\"full_ms\":%lu,\"ticket_offered_ms\":%lu}}}}", 
+    inv, last_cmd, readers, wifi_configured, ssid, pass, mqtt_configured, mqtt_cfg.broker_uri, mqtt_cfg.username, mqtt_cfg.password, mqtt_status,
+    mqtt_ca_mode_name(mqtt_cfg.ca_mode), mqtt_has_ca_pem() ? 1 : 0,
+    (unsigned long)q.queued_msgs, (unsigned long)q.queued_bytes, (unsigned long)q.capacity_bytes, (unsigned long)q.dropped_msgs,
+    (unsigned long)q.inflight_msgs, (unsigned long)q.acked_msgs,
+    q.policy == MQTT_QUEUE_DROP_NEWEST ? "drop_newest" : "drop_oldest", q.in_psram ? 1 : 0,
+    mqtt_conn_state_name(cm.state), (unsigned long)cm.attempts, (unsigned long)cm.connects,
+    (unsigned long)cm.failures, (unsigned long)cm.next_retry_in_ms, (unsigned long)cm.dns_ms,
+    (unsigned long)cm.session_ms, (unsigned long)cm.total_ms, (unsigned long)cm.rtt_ms,
+    (unsigned long)cm.est_tcp_ms, (unsigned long)cm.est_tls_ms, (unsigned long)cm.est_connack_ms,
+    cm.tickets_enabled ? 1 : 0, (unsigned long)cm.full_handshakes, (unsigned long)cm.ticket_offered,
+    (unsigned long)cm.session_full_ms, (unsigned long)cm.session_ticket_offered_ms);
   
   httpd_resp_set_type(req, "application/json");
   return httpd_resp_send(req, resp, len);
 }
 
-// Tags endpoint
+// Tags endpoint (?reader= limits it to tags seen by one reader)
 static esp_err_t tags_get_handler(httpd_req_t *req)
 {
   /* Allocate tag JSON buffer on heap to avoid large stack usage in httpd task */
   char *buf = (char*) malloc(2048);
   if (!buf) { httpd_resp_send(req, "[]", 2); return ESP_ERR_HTTPD_ALLOC_MEM; }
-  int used = rfid_get_tags_json(buf, 2048);
+  int used = rfid_get_tags_json(buf, 2048, query_reader(req, RFID_ALL_READERS));
   if (used <= 0) { free(buf); httpd_resp_send(req, "[]", 2); return ESP_OK; }
   httpd_resp_set_type(req, "application/json");
   esp_err_t err = httpd_resp_send(req, buf, used);
@@ -727,6 +827,75 @@ static esp_err_t tags_get_handler(httpd_req_t *req)
   return err;
 }
 
+// Batching endpoint: thresholds, flush counters and size/latency histograms
+static esp_err_t batch_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) malloc(1024);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = mqtt_batch_get_stats_json(buf, 1024);
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+static esp_err_t boot_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) malloc(1024);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = boot_get_report_json(buf, 1024);
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+static esp_err_t epcdb_get_handler(httpd_req_t *req)
+{
+  char buf[384];
+  int used = epcdb_get_json(buf, sizeof(buf));
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, buf, used);
+}
+
+// Replace the EPC asset table: the body is an image from tools/epcdb_build.py,
+// written to flash as it arrives
+static esp_err_t epcdb_post_handler(httpd_req_t *req)
+{
+  if (epcdb_update_begin(req->content_len) != 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image missing or larger than the epcdb partition");
+    return ESP_FAIL;
+  }
+  char *chunk = malloc(4096);
+  if (!chunk) { epcdb_update_abort(); httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+
+  size_t got = 0;
+  while (got < req->content_len) {
+    size_t want = req->content_len - got;
+    int ret = httpd_req_recv(req, chunk, want < 4096 ? want : 4096);
+    if (ret <= 0) {
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+      free(chunk);
+      epcdb_update_abort();
+      return ESP_FAIL;
+    }
+    if (epcdb_update_write(chunk, ret) != 0) {
+      free(chunk);
+      epcdb_update_abort();
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+    }
+    got += ret;
+  }
+  free(chunk);
+
+  if (epcdb_update_finish() != 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid image (header, size or CRC)");
+    return ESP_FAIL;
+  }
+  return epcdb_get_handler(req);
+}
+
 // Power control handlers
 static esp_err_t power_set_handler(httpd_req_t *req)
 {
@@ -739,6 +908,7 @@ static esp_err_t power_set_handler(httpd_req_t *req)
   buf[ret] = '\0';
   
   int pwr1 = 30, pwr2 = 30, pwr3 = 30, pwr4 = 30;
+  int reader = query_reader(req, RFID_ALL_READERS);
   char *pair = strtok(buf, "&");
   while (pair) {
     char *eq = strchr(pair, '=');
@@ -751,12 +921,16 @@ static esp_err_t power_set_handler(httpd_req_t *req)
       else if (strcmp(k, "pwr2") == 0) pwr2 = atoi(dec);
       else if (strcmp(k, "pwr3") == 0) pwr3 = atoi(dec);
       else if (strcmp(k, "pwr4") == 0) pwr4 = atoi(dec);
+      else if (strcmp(k, "reader") == 0) reader = atoi(dec);
     }
     pair = strtok(NULL, "&");
   }
   
-  // Call the fixed function signature
-  rfid_set_power(pwr1, pwr2, pwr3, pwr4);
+  if (reader != RFID_ALL_READERS && !rfid_reader_valid(reader)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown reader");
+    return ESP_FAIL;
+  }
+  rfid_set_power(reader, pwr1, pwr2, pwr3, pwr4);
   httpd_resp_set_status(req, "200 OK");
   httpd_resp_send(req, "OK", 2);
   return ESP_OK;
@@ -764,26 +938,35 @@ static esp_err_t power_set_handler(httpd_req_t *req)
 
 static esp_err_t power_get_handler(httpd_req_t *req)
 {
+  int reader = query_reader(req, 0);
+  if (!rfid_reader_valid(reader)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown reader");
+    return ESP_FAIL;
+  }
+
   // First trigger a fresh power query to get current values from reader
-  rfid_query_power();
+  rfid_query_power(reader);
   
   // Wait a moment for the reader to respond and update the stored values
   vTaskDelay(pdMS_TO_TICKS(300));
   
   // Now get the updated power values
   int pwr1, pwr2, pwr3, pwr4;
-  rfid_get_power(&pwr1, &pwr2, &pwr3, &pwr4);
+  if (!rfid_get_power(reader, &pwr1, &pwr2, &pwr3, &pwr4)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown reader");
+    return ESP_FAIL;
+  }
   
   char resp[256];
   int len = snprintf(resp, sizeof(resp), 
-    "{\"pwr1\":%d,\"pwr2\":%d,\"pwr3\":%d,\"pwr4\":%d}", 
-    pwr1, pwr2, pwr3, pwr4);
+    "{\"reader\":%d,\"pwr1\":%d,\"pwr2\":%d,\"pwr3\":%d,\"pwr4\":%d}", 
+    reader, pwr1, pwr2, pwr3, pwr4);
   
   httpd_resp_set_type(req, "application/json");
   return httpd_resp_send(req, resp, len);
 }
 
-// HTTP POST handler - send data to UART
+// HTTP POST handler - send data to a reader's UART (?reader=, default 0)
 static esp_err_t send_post_handler(httpd_req_t *req)
 {
     char content[256];
@@ -797,13 +980,85 @@ static esp_err_t send_post_handler(httpd_req_t *req)
     }
 
     // Send to UART via API
-    uart_send_bytes(content, (size_t)ret);
+    if (rfid_send_raw(query_reader(req, 0), content, (size_t)ret) != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown reader");
+        return ESP_FAIL;
+    }
 
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_send(req, "OK", 2);
     return ESP_OK;
 }
 
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) heap_caps_malloc(METRICS_RENDER_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!buf) buf = (char*) malloc(METRICS_RENDER_MAX);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = metrics_render_prometheus(buf, METRICS_RENDER_MAX);
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+static esp_err_t debug_tasks_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) malloc(TASK_STATS_JSON_MAX);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = task_stats_get_json(buf, TASK_STATS_JSON_MAX);
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+static esp_err_t debug_latency_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) malloc(LATENCY_JSON_MAX);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = latency_get_json(buf, LATENCY_JSON_MAX);
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+// Runs the microbenchmarks (a few seconds) on private tables; inventory keeps running
+static esp_err_t debug_bench_get_handler(httpd_req_t *req)
+{
+  char *buf = (char*) malloc(BENCH_JSON_MAX);
+  if (!buf) { httpd_resp_send_500(req); return ESP_ERR_HTTPD_ALLOC_MEM; }
+  int used = bench_run_json(buf, BENCH_JSON_MAX);
+  if (used < 0) {
+    httpd_resp_set_status(req, "500 Internal Server Error");
+    used = strlen(buf);
+  }
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, buf, used);
+  free(buf);
+  return err;
+}
+
+// Every endpoint is registered through this so requests and failures are counted in one place
+typedef esp_err_t (*web_handler_fn)(httpd_req_t *req);
+
+static esp_err_t counted_handler(httpd_req_t *req)
+{
+  metrics_inc(METRIC_HTTP_REQUESTS);
+  esp_err_t err = ((web_handler_fn)req->user_ctx)(req);
+  if (err != ESP_OK) metrics_inc(METRIC_HTTP_ERRORS);
+  return err;
+}
+
+static esp_err_t register_counted(httpd_handle_t server, const httpd_uri_t *uri)
+{
+  httpd_uri_t counted = *uri;
+  counted.handler = counted_handler;
+  counted.user_ctx = (void*)uri->handler;
+  return httpd_register_uri_handler(server, &counted);
+}
+
 httpd_handle_t start_webserver(void)
 {
    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -812,7 +1067,7 @@ httpd_handle_t start_webserver(void)
    config.stack_size = 8192;
    config.lru_purge_enable = true;
    /* Increase max URI handlers from default (8) to accommodate all endpoints */
-   config.max_uri_handlers = 16;  // Total endpoints including WiFi test and MQTT
+   config.max_uri_handlers = 24;  // Total endpoints including WiFi test, MQTT and diagnostics
    httpd_handle_t server = NULL;
 
     if (httpd_start(&server, &config) == ESP_OK) {
@@ -823,7 +1078,7 @@ httpd_handle_t start_webserver(void)
             .handler   = http_get_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &root);
+        register_counted(server, &root);
 
         // Favicon handler
         const httpd_uri_t favicon = {
@@ -832,7 +1087,7 @@ httpd_handle_t start_webserver(void)
             .handler   = favicon_get_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &favicon);
+        register_counted(server, &favicon);
 
         // Get data endpoint
         const httpd_uri_t data = {
@@ -841,7 +1096,7 @@ httpd_handle_t start_webserver(void)
             .handler   = data_get_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &data);
+        register_counted(server, &data);
 
     // Send data endpoint
         const httpd_uri_t send = {
@@ -850,7 +1105,7 @@ httpd_handle_t start_webserver(void)
             .handler   = send_post_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &send);
+        register_counted(server, &send);
 
     // Wi-Fi config endpoint
     const httpd_uri_t wifi_cfg = {
@@ -859,7 +1114,7 @@ httpd_handle_t start_webserver(void)
       .handler   = wifi_post_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &wifi_cfg);
+    register_counted(server, &wifi_cfg);
 
     // Wi-Fi test endpoint
     const httpd_uri_t wifi_test = {
@@ -868,7 +1123,7 @@ httpd_handle_t start_webserver(void)
       .handler   = wifi_test_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &wifi_test);
+    register_counted(server, &wifi_test);
 
     // MQTT config endpoint
     const httpd_uri_t mqtt_cfg = {
@@ -877,7 +1132,7 @@ httpd_handle_t start_webserver(void)
       .handler   = mqtt_post_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &mqtt_cfg);
+    register_counted(server, &mqtt_cfg);
 
     // MQTT test endpoint
     const httpd_uri_t mqtt_test = {
@@ -886,7 +1141,16 @@ httpd_handle_t start_webserver(void)
       .handler   = mqtt_test_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &mqtt_test);
+    register_counted(server, &mqtt_test);
+
+    // Pinned broker CA upload
+    const httpd_uri_t mqtt_ca = {
+      .uri       = "/mqtt-ca",
+      .method    = HTTP_POST,
+      .handler   = mqtt_ca_post_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &mqtt_ca);
 
     // Inventory control endpoints
     const httpd_uri_t inv_start = {
@@ -895,7 +1159,7 @@ httpd_handle_t start_webserver(void)
       .handler   = inventory_start_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &inv_start);
+    register_counted(server, &inv_start);
 
     const httpd_uri_t inv_stop = {
       .uri       = "/inventory/stop",
@@ -903,7 +1167,7 @@ httpd_handle_t start_webserver(void)
       .handler   = inventory_stop_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &inv_stop);
+    register_counted(server, &inv_stop);
 
     // Status endpoint
     const httpd_uri_t status = {
@@ -912,7 +1176,7 @@ httpd_handle_t start_webserver(void)
       .handler   = status_get_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &status);
+    register_counted(server, &status);
 
     // Tags endpoint
     const httpd_uri_t tags = {
@@ -921,7 +1185,61 @@ httpd_handle_t start_webserver(void)
       .handler   = tags_get_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &tags);
+    register_counted(server, &tags);
+
+    // Batching stats endpoint
+    const httpd_uri_t batch = {
+      .uri       = "/batch",
+      .method    = HTTP_GET,
+      .handler   = batch_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &batch);
+
+    // Boot stage timings and milestones
+    const httpd_uri_t boot = {
+      .uri       = "/boot",
+      .method    = HTTP_GET,
+      .handler   = boot_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &boot);
+
+    // Prometheus metrics
+    const httpd_uri_t metrics = {
+      .uri       = "/metrics",
+      .method    = HTTP_GET,
+      .handler   = metrics_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &metrics);
+
+    // Per-task CPU, stack high-water marks and heap
+    const httpd_uri_t debug_tasks = {
+      .uri       = "/debug/tasks",
+      .method    = HTTP_GET,
+      .handler   = debug_tasks_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &debug_tasks);
+
+    // Per-stage read latency (p50/p95/p99)
+    const httpd_uri_t debug_latency = {
+      .uri       = "/debug/latency",
+      .method    = HTTP_GET,
+      .handler   = debug_latency_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &debug_latency);
+
+    // Serialization and command path microbenchmarks
+    const httpd_uri_t debug_bench = {
+      .uri       = "/debug/bench",
+      .method    = HTTP_GET,
+      .handler   = debug_bench_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &debug_bench);
 
     // Power control endpoints
     const httpd_uri_t power_set = {
@@ -930,7 +1248,7 @@ httpd_handle_t start_webserver(void)
       .handler   = power_set_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &power_set);
+    register_counted(server, &power_set);
     ESP_LOGI(TAG, "Registered /power/set handler");
 
     const httpd_uri_t power_get = {
@@ -939,8 +1257,25 @@ httpd_handle_t start_webserver(void)
       .handler   = power_get_handler,
       .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &power_get);
+    register_counted(server, &power_get);
     ESP_LOGI(TAG, "Registered /power/get handler");
+
+    // EPC asset table status and streamed upload
+    const httpd_uri_t epcdb_get = {
+      .uri       = "/epcdb",
+      .method    = HTTP_GET,
+      .handler   = epcdb_get_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &epcdb_get);
+
+    const httpd_uri_t epcdb_post = {
+      .uri       = "/epcdb",
+      .method    = HTTP_POST,
+      .handler   = epcdb_post_handler,
+      .user_ctx  = NULL
+    };
+    register_counted(server, &epcdb_post);
     }
     return server;
 }
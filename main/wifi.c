@@ -11,6 +11,8 @@
 #include "freertos/event_groups.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "net_events.h"
+#include "boot.h"
 
 static const char *TAG = "WIFI";
 
@@ -42,8 +44,10 @@ static void event_handler(void* arg, esp_event_base_t event_base,
             ESP_LOGI(TAG, "Failed to connect to WiFi after %d attempts", WIFI_MAXIMUM_RETRY);
         }
         // Clear connection info on disconnect
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         s_connected_ssid[0] = '\0';
         s_ip_address[0] = '\0';
+        net_events_post(NET_EVT_LINK_DOWN);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "WiFi connected! Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
@@ -53,6 +57,8 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        net_events_post(NET_EVT_LINK_UP);
+        boot_mark(BOOT_MARK_LINK_UP);
     }
 }
 
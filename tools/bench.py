@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Run the reader's microbenchmarks and compare them with the checked-in baseline.
+
+GET /debug/bench times the tag list JSON (GET /tags), the MQTT batch JSON,
+the command parse and field extraction and the TX frame log formatting, with
+tag tables of 32, 1000 and 5000 tags, and returns ns/op and heap allocations
+per op (null when the build cannot count them).
+Baselines are kept per target ("esp32s3", "linux") in bench_baseline.json.
+A target without one is only reported; record it with --update from that
+target's firmware.
+
+  tools/bench.py http://192.168.1.50            # compare, exit 1 on a regression
+  tools/bench.py http://127.0.0.1 --update      # record the result as the new baseline
+  tools/bench.py result.json                    # compare a saved result
+
+The tag table cases use private tables, so inventory may keep running, though
+timings are steadier with it stopped.
+"""
+import argparse
+import json
+import os
+import sys
+import urllib.error
+import urllib.request
+
+BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "bench_baseline.json")
+
+
+def load_result(source):
+    if source.startswith(("http://", "https://")):
+        try:
+            with urllib.request.urlopen(source.rstrip("/") + "/debug/bench", timeout=60) as r:
+                return json.load(r)
+        except urllib.error.HTTPError as e:
+            sys.exit(f"{source}: {e.code} {e.read().decode(errors='replace')}")
+    with open(source) as f:
+        return json.load(f)
+
+
+def case_key(case):
+    return f"{case['name']}/{case['size']}" if case["size"] else case["name"]
+
+
+def allocates_more(case, ref):
+    # Only comparable when both builds counted allocations
+    now, before = case.get("alloc_bytes_op"), ref.get("alloc_bytes_op")
+    return now is not None and before is not None and now > before
+
+
+def fmt(value):
+    return "-" if value is None else value
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("source", help="reader base URL or a saved /debug/bench result")
+    ap.add_argument("--baseline", default=BASELINE)
+    ap.add_argument("--update", action="store_true", help="write the result into the baseline")
+    ap.add_argument("--tolerance", type=float, help="allowed ns/op increase in percent (default from baseline)")
+    ap.add_argument("--save", help="also write the raw result here")
+    args = ap.parse_args()
+
+    result = load_result(args.source)
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(result, f, indent=1)
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    target = result["target"]
+    tolerance = args.tolerance if args.tolerance is not None else baseline.get("tolerance_pct", 15)
+    base = baseline.setdefault("targets", {}).get(target, {})
+
+    regressions = 0
+    print(f"{'case':22}{'ns/op':>12}{'baseline':>12}{'delta':>9}{'allocs/op':>11}{'bytes/op':>10}")
+    for case in result["cases"]:
+        key = case_key(case)
+        if "skipped" in case:
+            print(f"{key:22}{'skipped: ' + case['skipped']:>34}")
+            continue
+        ref = base.get(key)
+        line = f"{key:22}{case['ns_op']:>12}"
+        if ref:
+            delta = (case["ns_op"] - ref["ns_op"]) / ref["ns_op"] * 100
+            flag = ""
+            if delta > tolerance or allocates_more(case, ref):
+                flag = "  REGRESSION"
+                regressions += 1
+            line += f"{ref['ns_op']:>12}{delta:>+8.1f}%"
+        else:
+            flag = "  (new)"
+            line += f"{'-':>12}{'':>9}"
+        print(line + f"{fmt(case['allocs_op']):>11}{fmt(case['alloc_bytes_op']):>10}" + flag)
+
+    if args.update:
+        baseline["targets"][target] = {
+            case_key(c): {"ns_op": c["ns_op"], "alloc_bytes_op": c["alloc_bytes_op"]}
+            for c in result["cases"] if "skipped" not in c
+        }
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print(f"baseline for {target} updated in {args.baseline}")
+        return 0
+    if not base:
+        print(f"no {target} baseline in {args.baseline}; record one with --update on the {target} firmware")
+    if regressions:
+        print(f"{regressions} case(s) slower than the baseline by more than {tolerance}% or allocating more")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Build the EPC asset table image for the reader's "epcdb" partition.
+
+Input CSV columns: epc,asset_id,flags,name
+  epc       96-bit EPC as 24 hex digits
+  asset_id  unsigned 32-bit integer (0 if unused)
+  flags     empty, "suppress" (known fixture, reads are dropped) or an integer
+  name      optional asset name (printable ASCII, no quotes or backslashes)
+
+Upload the image with:
+  curl --data-binary @epcdb.bin -H 'Content-Type: application/octet-stream' http://<reader>/epcdb
+or flash it directly:
+  parttool.py write_partition --partition-name epcdb --input epcdb.bin
+"""
+import argparse
+import csv
+import struct
+import sys
+import zlib
+
+MAGIC = 0x42445045          # "EPDB"
+VERSION = 1
+HEADER_FMT = "<IHHIIIH10s"  # magic version record_size count names_len crc32 flags reserved
+RECORD_FMT = "<12sIIHH"     # epc asset_id name_off flags name_len
+HDR_ALLOW_ONLY = 0x0001
+FLAG_SUPPRESS = 0x0001
+NO_NAME = 0xFFFFFFFF
+PARTITION_SIZE = 0x270000   # partitions.csv
+
+
+def parse_flags(text):
+    text = (text or "").strip().lower()
+    if not text:
+        return 0
+    if text == "suppress":
+        return FLAG_SUPPRESS
+    return int(text, 0)
+
+
+def build(rows, allow_only):
+    entries = {}
+    for line, row in rows:
+        epc_hex = row["epc"].strip()
+        if len(epc_hex) != 24:
+            raise ValueError(f"line {line}: EPC must be 24 hex digits")
+        epc = bytes.fromhex(epc_hex)
+        if epc in entries:
+            raise ValueError(f"line {line}: duplicate EPC {epc_hex}")
+        name = (row.get("name") or "").strip()
+        if any(c in name for c in '"\\') or not name.isascii() or not name.isprintable():
+            raise ValueError(f"line {line}: name must be printable ASCII without quotes or backslashes")
+        entries[epc] = (int(row.get("asset_id") or 0, 0), parse_flags(row.get("flags")), name.encode())
+
+    # Records sorted by EPC bytes for the on-device binary search; equal names share storage
+    records = bytearray()
+    names = bytearray()
+    name_offsets = {}
+    for epc in sorted(entries):
+        asset_id, flags, name = entries[epc]
+        if name:
+            if name not in name_offsets:
+                name_offsets[name] = len(names)
+                names += name
+            off = name_offsets[name]
+        else:
+            off = NO_NAME
+        records += struct.pack(RECORD_FMT, epc, asset_id, off, flags, len(name))
+
+    body = bytes(records) + bytes(names)
+    header = struct.pack(HEADER_FMT, MAGIC, VERSION, struct.calcsize(RECORD_FMT), len(entries),
+                         len(names), zlib.crc32(body), HDR_ALLOW_ONLY if allow_only else 0, bytes(10))
+    return header + body, len(entries)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("csv", help="input CSV with an epc,asset_id,flags,name header")
+    ap.add_argument("-o", "--output", default="epcdb.bin")
+    ap.add_argument("--allow-only", action="store_true", help="drop reads of EPCs that are not in the table")
+    args = ap.parse_args()
+
+    with open(args.csv, newline="") as f:
+        rows = list(enumerate(csv.DictReader(f), start=2))
+    try:
+        image, count = build(rows, args.allow_only)
+    except ValueError as e:
+        sys.exit(f"epcdb_build: {e}")
+    if len(image) > PARTITION_SIZE:
+        sys.exit(f"epcdb_build: image is {len(image)} bytes, partition holds {PARTITION_SIZE}")
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print(f"{args.output}: {count} records, {len(image)} bytes")
+
+
+if __name__ == "__main__":
+    main()
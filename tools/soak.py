@@ -0,0 +1,646 @@
+#!/usr/bin/env python3
+"""Soak test for the host build of the firmware.
+
+Runs the linux-target ELF against a simulated reader, a local mosquitto
+broker with scheduled outages and a set of HTTP pollers, samples /metrics,
+/debug/latency and the process RSS over time and checks three things:
+
+  heap      RSS and reader_heap_free_bytes do not trend after the warm-up
+  tags      every EPC the simulated reader emitted arrived in a QoS1 batch
+  latency   first emit -> first batch on the broker stays under a bound
+
+  tools/soak.py run --elf build/esp32-w5500-uart-control.elf --duration 3600 \\
+      --rate 200 --population 300 --outage 600:30 --out soak-a.json
+  tools/soak.py compare soak-a.json soak-b.json
+
+The simulated reader is a TCP server; the firmware reaches it through
+READER_UART1=tcp:127.0.0.1:<port>. It answers every command frame, tracks
+start / stop inventory and sends one MID 0x12 frame per read. The reader
+parses one tag per UART read, so reads that land in the same read are
+counted once; the report shows that as read delivery, not as lost tags.
+
+The web server listens on port 80: run as root or lower
+net.ipv4.ip_unprivileged_port_start. Needs mosquitto, mosquitto_sub and
+mosquitto_pub on PATH. Exit status is 1 when a check fails.
+"""
+import argparse
+import json
+import os
+import random
+import re
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+HTTP_TIMEOUT = 5
+POLL_PATHS = ["/tags", "/status", "/metrics", "/debug/latency", "/batch"]
+EPC_RE = re.compile(r'"epc":"([0-9A-Fa-f]+)"')
+METRIC_RE = re.compile(r'^([a-z_]+)(\{[^}]*\})? ([0-9.eE+-]+)$')
+
+# Prometheus series sampled into the time series (name{labels} as rendered)
+SAMPLED_METRICS = [
+    "reader_heap_free_bytes",
+    "reader_mqtt_connected",
+    "reader_mqtt_queue_messages",
+    "reader_mqtt_queue_bytes",
+    "reader_mqtt_inflight_messages",
+    "reader_rfid_active_tags",
+    "reader_rfid_tag_reads_total",
+    "reader_mqtt_messages_acked_total",
+    "reader_mqtt_retransmits_total",
+    "reader_mqtt_send_errors_total",
+    "reader_mqtt_connects_total",
+    "reader_http_errors_total",
+]
+
+
+def log(msg):
+    print(f"[{time.strftime('%H:%M:%S')}] {msg}", flush=True)
+
+
+def crc16_xmodem(data):
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def frame(cat_mid, data):
+    """5A 00 01 <cat> <mid> LEN(2) data CRC(2); CRC over everything after 5A."""
+    body = bytes([0x00, 0x01]) + bytes(cat_mid) + len(data).to_bytes(2, "big") + data
+    return b"\x5A" + body + crc16_xmodem(body).to_bytes(2, "big")
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = max(0, min(len(values) - 1, int(round(p / 100.0 * len(values) + 0.5)) - 1))
+    return values[k]
+
+
+def slope_per_hour(points):
+    """Least-squares slope of (t_seconds, value) points, per hour."""
+    if len(points) < 3:
+        return 0.0
+    n = len(points)
+    mt = sum(t for t, _ in points) / n
+    mv = sum(v for _, v in points) / n
+    den = sum((t - mt) ** 2 for t, _ in points)
+    if den == 0:
+        return 0.0
+    return sum((t - mt) * (v - mv) for t, v in points) / den * 3600.0
+
+
+class ReaderSim(threading.Thread):
+    """One RFID module on a TCP socket: acks commands, streams reads while inventory runs."""
+
+    def __init__(self, rate, population, dwell, power=30, seed=1):
+        super().__init__(daemon=True)
+        self.rate = rate
+        self.population = population
+        self.dwell = dwell
+        self.power = power
+        self.rng = random.Random(seed)
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", 0))
+        self.listener.listen(1)
+        self.port = self.listener.getsockname()[1]
+        self.lock = threading.Lock()
+        self.running = False
+        self.paused = False          # Stops emitting without touching the inventory state
+        self.stop_event = threading.Event()
+        self.conn = None
+        self.first_emit = {}         # EPC hex -> monotonic time of its first frame
+        self.reads_sent = 0
+        self.commands = 0
+        self.present = []            # [epc_bytes, ant, leaves_at]
+
+    def new_tag(self, now):
+        epc = b"\xE2\x80" + bytes(self.rng.getrandbits(8) for _ in range(10))
+        return [epc, self.rng.randint(1, 4), now + self.rng.uniform(0.5, 1.5) * self.dwell]
+
+    def tag_frame(self, epc, ant):
+        # Layout rfid.c expects for MID 0x12: 00 0C EPC(12) PC ANT RSSI ...
+        data = bytes([0x00, 0x0C]) + epc + bytes([0x30, ant, 0xC4, 0x01, 0xFE, 0x08, 0x00, 0x0D, 0x00, 0x00])
+        return frame([0x12, 0x00], data)
+
+    def reply(self, cat, mid):
+        if (cat, mid) == (0x02, 0x02):
+            p = self.power
+            return frame([0x02, 0x02], bytes([1, p, 2, p, 3, p, 4, p]))
+        return frame([cat, mid], b"\x00")
+
+    def handle_commands(self, buf):
+        while True:
+            start = buf.find(b"\x5A")
+            if start < 0:
+                return b""
+            buf = buf[start:]
+            if len(buf) < 9:
+                return buf
+            n = 9 + int.from_bytes(buf[5:7], "big")
+            if len(buf) < n:
+                return buf
+            cat, mid = buf[3], buf[4]
+            with self.lock:
+                self.commands += 1
+                if cat == 0x02 and mid == 0x10:
+                    self.running = True
+                elif cat == 0x02 and mid == 0x11:
+                    self.running = False
+            self.send(self.reply(cat, mid))
+            buf = buf[n:]
+
+    def send(self, data):
+        conn = self.conn
+        if conn is None:
+            return False
+        try:
+            conn.sendall(data)
+            return True
+        except OSError:
+            return False
+
+    def emit(self, now):
+        self.present = [t for t in self.present if t[2] > now]
+        while len(self.present) < self.population:
+            self.present.append(self.new_tag(now))
+        tag = self.rng.choice(self.present)
+        if self.send(self.tag_frame(tag[0], tag[1])):
+            epc_hex = tag[0].hex().upper()
+            with self.lock:
+                self.reads_sent += 1
+                self.first_emit.setdefault(epc_hex, now)
+
+    def run(self):
+        self.conn, _ = self.listener.accept()
+        self.conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.conn.settimeout(0.001)
+        log(f"reader sim: firmware connected on :{self.port}")
+        pending = b""
+        interval = 1.0 / self.rate if self.rate > 0 else None
+        next_read = time.monotonic()
+        while not self.stop_event.is_set():
+            try:
+                data = self.conn.recv(4096)
+                if not data:
+                    log("reader sim: firmware closed the connection")
+                    return
+                pending = self.handle_commands(pending + data)
+            except socket.timeout:
+                pass
+            except OSError:
+                return
+            now = time.monotonic()
+            if interval and self.running and not self.paused:
+                # One frame per read; no catch-up bursts after a stall
+                if now >= next_read:
+                    self.emit(now)
+                    next_read = max(next_read + interval, now)
+            else:
+                next_read = now
+
+    def stop(self):
+        self.stop_event.set()
+        for s in (self.conn, self.listener):
+            if s:
+                try:
+                    s.close()
+                except OSError:
+                    pass
+
+
+class Broker:
+    """mosquitto with a persistent session store so queued QoS1 messages survive outages."""
+
+    def __init__(self, binary, port, workdir):
+        self.binary = binary
+        self.port = port
+        self.conf = os.path.join(workdir, "mosquitto.conf")
+        self.logfile = open(os.path.join(workdir, "mosquitto.log"), "ab")
+        with open(self.conf, "w") as f:
+            f.write(f"listener {port} 127.0.0.1\nallow_anonymous true\n"
+                    f"persistence true\npersistence_location {workdir}/\nautosave_interval 1\n")
+        self.proc = None
+        self.outages = []   # (down_at, up_at) in run-relative seconds
+
+    def start(self):
+        self.proc = subprocess.Popen([self.binary, "-c", self.conf],
+                                     stdout=self.logfile, stderr=subprocess.STDOUT)
+        deadline = time.time() + 5
+        while time.time() < deadline:
+            try:
+                socket.create_connection(("127.0.0.1", self.port), timeout=0.5).close()
+                return
+            except OSError:
+                time.sleep(0.1)
+        raise RuntimeError("mosquitto did not start")
+
+    def stop(self):
+        if self.proc and self.proc.poll() is None:
+            self.proc.send_signal(signal.SIGTERM)
+            try:
+                self.proc.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+                self.proc.wait()
+        self.proc = None
+
+
+class Subscriber(threading.Thread):
+    """mosquitto_sub on reader/# with a persistent QoS1 session; restarted if it exits."""
+
+    def __init__(self, binary, port):
+        super().__init__(daemon=True)
+        self.cmd = [binary, "-h", "127.0.0.1", "-p", str(port), "-i", "soak_sub", "-c",
+                    "-q", "1", "-v", "-t", "reader/#"]
+        self.lock = threading.Lock()
+        self.stop_event = threading.Event()
+        self.proc = None
+        self.client_id = None
+        self.first_batch = {}   # EPC hex -> monotonic time of the first batch naming it
+        self.batches = 0
+        self.responses = []
+        self.boots = 0
+
+    def on_line(self, line, now):
+        topic, _, payload = line.partition(" ")
+        parts = topic.split("/")
+        if len(parts) < 3 or parts[0] != "reader":
+            return
+        with self.lock:
+            if topic.endswith("/data/status") and payload == "online":
+                # Retained and sent on every connect, before any batch
+                self.client_id = parts[1]
+            elif topic.endswith("/status/boot"):
+                self.boots += 1
+            elif topic.endswith("/data/batch"):
+                self.batches += 1
+                for epc in EPC_RE.findall(payload):
+                    self.first_batch.setdefault(epc.upper(), now)
+            elif topic.endswith("/data/response"):
+                self.responses.append(payload)
+
+    def response(self, since, action):
+        """First command response for action at or after index since, parsed."""
+        with self.lock:
+            for payload in self.responses[since:]:
+                try:
+                    r = json.loads(payload)
+                except ValueError:
+                    continue
+                if r.get("action") == action:
+                    return r
+        return None
+
+    def run(self):
+        while not self.stop_event.is_set():
+            self.proc = subprocess.Popen(self.cmd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                                         text=True, bufsize=1)
+            for line in self.proc.stdout:
+                self.on_line(line.rstrip("\n"), time.monotonic())
+            self.proc.wait()
+            if not self.stop_event.wait(1.0):
+                log("subscriber: mosquitto_sub exited, reconnecting")
+
+    def stop(self):
+        self.stop_event.set()
+        if self.proc and self.proc.poll() is None:
+            self.proc.terminate()
+
+
+class Http:
+    def __init__(self, base):
+        self.base = base.rstrip("/")
+
+    def get(self, path):
+        with urllib.request.urlopen(self.base + path, timeout=HTTP_TIMEOUT) as r:
+            return r.read().decode("utf-8", "replace")
+
+    def post_form(self, path, fields):
+        data = urllib.parse.urlencode(fields).encode()
+        with urllib.request.urlopen(self.base + path, data=data, timeout=HTTP_TIMEOUT) as r:
+            return r.read().decode("utf-8", "replace")
+
+
+class Poller(threading.Thread):
+    def __init__(self, http, interval, stop_event, seed):
+        super().__init__(daemon=True)
+        self.http = http
+        self.interval = interval
+        self.stop_event = stop_event
+        self.rng = random.Random(seed)
+        self.times_ms = []
+        self.errors = 0
+
+    def run(self):
+        while not self.stop_event.is_set():
+            t0 = time.monotonic()
+            try:
+                self.http.get(self.rng.choice(POLL_PATHS))
+                self.times_ms.append((time.monotonic() - t0) * 1000.0)
+            except (urllib.error.URLError, OSError):
+                self.errors += 1
+            self.stop_event.wait(self.interval)
+
+
+def parse_metrics(text):
+    out = {}
+    for line in text.splitlines():
+        m = METRIC_RE.match(line)
+        if m and not m.group(2) and m.group(1) in SAMPLED_METRICS:
+            out[m.group(1)] = float(m.group(3))
+    return out
+
+
+def rss_kb(pid):
+    try:
+        with open(f"/proc/{pid}/status") as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+    return None
+
+
+def wait_for(pred, timeout, what):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if pred():
+            return
+        time.sleep(0.5)
+    raise RuntimeError(f"timed out waiting for {what}")
+
+
+def publish(binary, port, topic, payload):
+    subprocess.run([binary, "-h", "127.0.0.1", "-p", str(port), "-q", "1", "-t", topic, "-m", payload],
+                   check=True, timeout=10)
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def run(args):
+    for tool in ("mosquitto", "mosquitto_sub", "mosquitto_pub"):
+        if not shutil.which(getattr(args, tool)):
+            sys.exit(f"{getattr(args, tool)} not found")
+    outage_every, outage_down = 0, 0
+    if args.outage:
+        outage_every, outage_down = (int(x) for x in args.outage.split(":"))
+
+    workdir = tempfile.mkdtemp(prefix="soak-")
+    broker_port = args.broker_port or free_port()
+    sim = ReaderSim(args.rate, args.population, args.dwell, seed=args.seed)
+    broker = Broker(args.mosquitto, broker_port, workdir)
+    sub = Subscriber(args.mosquitto_sub, broker_port)
+    http = Http(args.http)
+    stop_pollers = threading.Event()
+    pollers = [Poller(http, args.poll_interval, stop_pollers, args.seed + i) for i in range(args.pollers)]
+    samples = []
+    fw = None
+    t0 = time.monotonic()
+    log(f"workdir {workdir}, broker :{broker_port}, reader sim :{sim.port}")
+
+    try:
+        broker.start()
+        sub.start()
+        sim.start()
+        env = dict(os.environ, READER_FLASH=os.path.join(workdir, "flash.bin"),
+                   READER_UART1=f"tcp:127.0.0.1:{sim.port}")
+        fw_log = open(os.path.join(workdir, "firmware.log"), "wb")
+        fw = subprocess.Popen([args.elf], env=env, stdout=fw_log, stderr=subprocess.STDOUT)
+
+        def http_up():
+            try:
+                http.get("/status")
+                return True
+            except (urllib.error.URLError, OSError):
+                return False
+        wait_for(http_up, 60, "the web server")
+        http.post_form("/mqtt-config", {"broker_uri": f"mqtt://127.0.0.1:{broker_port}",
+                                        "username": "", "password": "", "ca_mode": "bundle"})
+        wait_for(lambda: sub.client_id, 60, "\"online\" on reader/+/data/status")
+        client_id = sub.client_id
+        log(f"firmware connected as {client_id}")
+
+        since = len(sub.responses)
+        publish(args.mosquitto_pub, broker_port, f"reader/{client_id}/cmd/debug",
+                json.dumps({"action": "latency_reset"}))
+        wait_for(lambda: sub.response(since, "latency_reset"), 30, "the latency_reset response")
+        reply = sub.response(since, "latency_reset")
+        if reply.get("status") != "success":
+            raise RuntimeError(f"latency_reset failed: {reply}")
+        publish(args.mosquitto_pub, broker_port, f"reader/{client_id}/cmd/rfid",
+                json.dumps({"action": "start"}))
+        wait_for(lambda: sim.running, 30, "start inventory on the reader")
+        for p in pollers:
+            p.start()
+
+        t0 = time.monotonic()
+        next_sample = t0
+        next_outage = t0 + outage_every if outage_every else None
+        while time.monotonic() - t0 < args.duration:
+            now = time.monotonic()
+            if fw.poll() is not None:
+                raise RuntimeError(f"firmware exited with status {fw.returncode}")
+            if next_outage and now >= next_outage:
+                log(f"broker outage for {outage_down}s")
+                down_at = now - t0
+                broker.stop()
+                time.sleep(outage_down)
+                broker.start()
+                broker.outages.append((round(down_at, 1), round(time.monotonic() - t0, 1)))
+                next_outage = time.monotonic() + outage_every
+                continue
+            if now >= next_sample:
+                samples.append(take_sample(http, fw.pid, now - t0))
+                next_sample += args.sample_interval
+            time.sleep(0.2)
+
+        # Stop emitting, then let the offline queue and the batcher drain
+        sim.paused = True
+        stop_at = time.monotonic()
+        publish(args.mosquitto_pub, broker_port, f"reader/{client_id}/cmd/rfid",
+                json.dumps({"action": "stop"}))
+        log(f"draining for up to {args.drain}s")
+        wait_drained(sim, sub, args.drain)
+        samples.append(take_sample(http, fw.pid, time.monotonic() - t0))
+        latency = json.loads(http.get("/debug/latency"))
+        drained_after = round(time.monotonic() - stop_at, 1)
+    finally:
+        stop_pollers.set()
+        if fw and fw.poll() is None:
+            fw.terminate()
+            try:
+                fw.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                fw.kill()
+        sub.stop()
+        sim.stop()
+        broker.stop()
+
+    report = analyze(args, sim, sub, pollers, samples, latency, broker.outages, drained_after, outage_down)
+    report["workdir"] = workdir
+    with open(args.out, "w") as f:
+        json.dump(report, f, indent=1)
+    print_summary(report)
+    log(f"report written to {args.out}")
+    return 0 if all(c["pass"] for c in report["checks"].values()) else 1
+
+
+def take_sample(http, pid, t):
+    s = {"t": round(t, 1), "rss_kb": rss_kb(pid)}
+    try:
+        s.update(parse_metrics(http.get("/metrics")))
+        stages = json.loads(http.get("/debug/latency")).get("stages", {})
+        s["read_to_ack_p99_us"] = stages.get("read_to_ack", {}).get("p99_us")
+    except (urllib.error.URLError, OSError, ValueError):
+        s["http_error"] = True
+    return s
+
+
+def wait_drained(sim, sub, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        with sim.lock:
+            emitted = set(sim.first_emit)
+        with sub.lock:
+            if emitted <= set(sub.first_batch):
+                return
+        time.sleep(1)
+
+
+def analyze(args, sim, sub, pollers, samples, latency, outages, drained_after, outage_down):
+    emitted = dict(sim.first_emit)
+    received = dict(sub.first_batch)
+    lost = sorted(set(emitted) - set(received))
+    e2e_ms = [(received[e] - emitted[e]) * 1000.0 for e in emitted if e in received]
+
+    warm = [s for s in samples if s["t"] >= args.warmup and not s.get("http_error")]
+    rss_slope = slope_per_hour([(s["t"], s["rss_kb"]) for s in warm if s.get("rss_kb") is not None])
+    heap_slope = slope_per_hour([(s["t"], s["reader_heap_free_bytes"] / 1024.0)
+                                 for s in warm if "reader_heap_free_bytes" in s])
+
+    first = next((s for s in samples if "reader_rfid_tag_reads_total" in s), {})
+    last = next((s for s in reversed(samples) if "reader_rfid_tag_reads_total" in s), {})
+    reads_stored = last.get("reader_rfid_tag_reads_total", 0) - first.get("reader_rfid_tag_reads_total", 0)
+
+    poll_ms = [t for p in pollers for t in p.times_ms]
+    stage = latency.get("stages", {}).get("read_to_ack", {})
+    latency_bound = args.max_latency_ms if args.max_latency_ms else 5000 + outage_down * 1000
+
+    summary = {
+        "reads_sent": sim.reads_sent,
+        "read_delivery": round(reads_stored / sim.reads_sent, 4) if sim.reads_sent else 0.0,
+        "epcs_emitted": len(emitted),
+        "epcs_received": len(set(emitted) & set(received)),
+        "epcs_lost": len(lost),
+        "batches": sub.batches,
+        "boot_reports": sub.boots,
+        "e2e_p50_ms": round(percentile(e2e_ms, 50), 1),
+        "e2e_p99_ms": round(percentile(e2e_ms, 99), 1),
+        "e2e_max_ms": round(max(e2e_ms), 1) if e2e_ms else 0.0,
+        "read_to_ack_p99_ms": round(stage.get("p99_us", 0) / 1000.0, 1),
+        "read_to_ack_max_ms": round(stage.get("max_us", 0) / 1000.0, 1),
+        "rss_kb_start": warm[0]["rss_kb"] if warm else None,
+        "rss_kb_end": warm[-1]["rss_kb"] if warm else None,
+        "rss_slope_kb_per_h": round(rss_slope, 1),
+        "heap_free_slope_kb_per_h": round(heap_slope, 1),
+        "http_requests": len(poll_ms),
+        "http_errors": sum(p.errors for p in pollers),
+        "http_p99_ms": round(percentile(poll_ms, 99), 1),
+        "drained_after_s": drained_after,
+    }
+    checks = {
+        "heap": {"pass": rss_slope <= args.max_growth_kb_h and -heap_slope <= args.max_growth_kb_h,
+                 "limit_kb_per_h": args.max_growth_kb_h},
+        "tags": {"pass": not lost and bool(emitted), "lost_sample": lost[:20]},
+        "latency": {"pass": percentile(e2e_ms, 99) <= latency_bound, "limit_ms": latency_bound},
+    }
+    config = {k: v for k, v in vars(args).items() if k != "func"}
+    return {"config": config, "outages": outages, "summary": summary, "checks": checks, "samples": samples}
+
+
+def print_summary(report):
+    for k, v in report["summary"].items():
+        print(f"  {k:28} {v}")
+    for name, c in report["checks"].items():
+        print(f"  check {name:22} {'PASS' if c['pass'] else 'FAIL'}")
+
+
+def compare(args):
+    reports = []
+    for path in args.reports:
+        with open(path) as f:
+            reports.append(json.load(f))
+    names = [os.path.basename(p) for p in args.reports]
+    width = max(14, *(len(n) for n in names))
+    print(f"{'':28}" + "".join(f"{n:>{width}}" for n in names) + f"{'delta':>10}")
+    for key in reports[0]["summary"]:
+        vals = [r["summary"].get(key) for r in reports]
+        row = f"{key:28}" + "".join(f"{str(v):>{width}}" for v in vals)
+        a, b = vals[0], vals[-1]
+        if isinstance(a, (int, float)) and isinstance(b, (int, float)) and a:
+            row += f"{(b - a) / abs(a) * 100:>+9.1f}%"
+        print(row)
+    for name in reports[0]["checks"]:
+        print(f"{'check ' + name:28}" + "".join(
+            f"{('PASS' if r['checks'].get(name, {}).get('pass') else 'FAIL'):>{width}}" for r in reports))
+    return 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sp = ap.add_subparsers(dest="cmd", required=True)
+
+    r = sp.add_parser("run", help="run one soak test and write a JSON report")
+    r.add_argument("--elf", required=True, help="linux-target firmware ELF")
+    r.add_argument("--http", default="http://127.0.0.1:80", help="firmware web server")
+    r.add_argument("--duration", type=float, default=600, help="seconds of inventory")
+    r.add_argument("--rate", type=float, default=100, help="tag reads per second")
+    r.add_argument("--population", type=int, default=100, help="tags in the field at once")
+    r.add_argument("--dwell", type=float, default=20, help="mean seconds a tag stays in the field")
+    r.add_argument("--outage", default="", help="EVERY:DOWN seconds, e.g. 300:20 (default none)")
+    r.add_argument("--pollers", type=int, default=4, help="concurrent HTTP pollers")
+    r.add_argument("--poll-interval", type=float, default=0.5, help="seconds between requests per poller")
+    r.add_argument("--sample-interval", type=float, default=10, help="seconds between samples")
+    r.add_argument("--warmup", type=float, default=60, help="seconds excluded from the heap trend")
+    r.add_argument("--drain", type=float, default=120, help="max seconds to wait for batches after stop")
+    r.add_argument("--max-growth-kb-h", type=float, default=512, help="heap trend limit")
+    r.add_argument("--max-latency-ms", type=float, default=0,
+                   help="e2e p99 limit (default 5000 + outage DOWN)")
+    r.add_argument("--broker-port", type=int, default=0)
+    r.add_argument("--seed", type=int, default=1)
+    r.add_argument("--mosquitto", default="mosquitto")
+    r.add_argument("--mosquitto-sub", default="mosquitto_sub")
+    r.add_argument("--mosquitto-pub", default="mosquitto_pub")
+    r.add_argument("--out", default=time.strftime("soak-%Y%m%d-%H%M%S.json"))
+    r.set_defaults(func=run)
+
+    c = sp.add_parser("compare", help="print the summaries of several reports side by side")
+    c.add_argument("reports", nargs="+")
+    c.set_defaults(func=compare)
+
+    args = ap.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())